@@ -0,0 +1,540 @@
+/*******************************************************************************
+ *
+ *                              Delta Chat Core
+ *                      Copyright (C) 2017 Björn Petersen
+ *                   Contact: r10s@b44t.com, http://b44t.com
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see http://www.gnu.org/licenses/ .
+ *
+ ******************************************************************************/
+
+
+/* End-to-end benchmark of a mailbox against mockimap_t and mocksmtp_t.
+
+Usage:  benche2e [<msg-cnt> [<latency-ms>]]
+
+A mrmailbox_t is created in a temporary directory and driven through the
+following phases; the IMAP- and SMTP-threads run as in a real client:
+
+- configure:  mrmailbox_configure() incl. the generation of the keypair
+- sync:       download and store <msg-cnt> messages from the INBOX
+- idle:       push single messages to the client waiting in IDLE
+- send:       a burst of <msg-cnt>/2 text messages sent to the chats
+- markseen:   mark all received messages as seen at once
+
+The messages are generated by mockcorpus_t from a fixed seed, so the runs are
+comparable.  For each phase, a line of JSON is printed with the number of
+messages, the time taken, the IMAP and SMTP round-trips per message and the median and 99th
+percentile of the latencies; a latency is the time from adding/sending/marking
+a message until the client or the server has processed it.  If a phase does not
+complete, the program exits with 1. */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/time.h>
+#include "../src/mrmailbox_internal.h"
+#include "../src/mrloginparam.h"
+#include "mockimap.h"
+#include "mocksmtp.h"
+#include "mockcorpus.h"
+
+
+#define BENCH_ADDR           "me@mock.example"
+#define BENCH_IDLE_CNT       20
+#define BENCH_IDLE_SETTLE_MS 10
+#define BENCH_TIMEOUT_MS     (120*1000)
+
+
+static double now_ms(void)
+{
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec*1000.0 + tv.tv_usec/1000.0;
+}
+
+
+/*******************************************************************************
+ * Events and threads
+ ******************************************************************************/
+
+
+static pthread_mutex_t s_critical = PTHREAD_MUTEX_INITIALIZER;
+static int             s_configured = 0;         /* 1=success, -1=failure */
+static int             s_incoming_cnt = 0;
+static double*         s_incoming_ms = NULL;     /* time of each MR_EVENT_INCOMING_MSG */
+static int             s_incoming_alloc = 0;
+static uint32_t*       s_delivered_ids = NULL;   /* message IDs and times of MR_EVENT_MSG_DELIVERED */
+static double*         s_delivered_ms = NULL;
+static int             s_delivered_cnt = 0;
+static int             s_delivered_alloc = 0;
+
+
+static uintptr_t receive_event(mrmailbox_t* mailbox, int event, uintptr_t data1, uintptr_t data2)
+{
+	switch( event )
+	{
+		case MR_EVENT_ERROR:
+			fprintf(stderr, "ERROR: %s\n", (char*)data2);
+			break;
+
+		case MR_EVENT_CONFIGURE_PROGRESS:
+			if( data1 == 1000 || data1 == 0 ) {
+				s_configured = data1? 1 : -1;
+			}
+			break;
+
+		case MR_EVENT_INCOMING_MSG:
+			pthread_mutex_lock(&s_critical);
+				if( s_incoming_cnt >= s_incoming_alloc ) {
+					s_incoming_alloc = s_incoming_alloc*2 + 256;
+					if( (s_incoming_ms=realloc(s_incoming_ms, s_incoming_alloc*sizeof(double)))==NULL ) {
+						exit(1);
+					}
+				}
+				s_incoming_ms[s_incoming_cnt++] = now_ms();
+			pthread_mutex_unlock(&s_critical);
+			break;
+
+		case MR_EVENT_MSG_DELIVERED:
+			pthread_mutex_lock(&s_critical);
+				if( s_delivered_cnt < s_delivered_alloc ) {
+					s_delivered_ids[s_delivered_cnt] = (uint32_t)data2;
+					s_delivered_ms[s_delivered_cnt++] = now_ms();
+				}
+			pthread_mutex_unlock(&s_critical);
+			break;
+	}
+
+	return 0; /* also for MR_EVENT_IS_OFFLINE and for strings, the defaults are used then */
+}
+
+
+static int       s_running = 1;
+static pthread_t s_imap_thread, s_smtp_thread;
+static int       s_imap_thread_running, s_smtp_thread_running;
+
+
+static void* imap_thread_entry_point(void* entry_arg)
+{
+	mrmailbox_t* mailbox = (mrmailbox_t*)entry_arg;
+	while( s_running ) {
+		mrmailbox_perform_jobs(mailbox);
+		mrmailbox_fetch(mailbox);
+		if( s_running ) {
+			mrmailbox_idle(mailbox);
+		}
+	}
+	s_imap_thread_running = 0;
+	return NULL;
+}
+
+
+static void* smtp_thread_entry_point(void* entry_arg)
+{
+	mrmailbox_t* mailbox = (mrmailbox_t*)entry_arg;
+	while( s_running ) {
+		mrmailbox_perform_smtp_jobs(mailbox);
+		if( s_running ) {
+			mrmailbox_perform_smtp_idle(mailbox);
+		}
+	}
+	s_smtp_thread_running = 0;
+	return NULL;
+}
+
+
+static void stop_threads(mrmailbox_t* mailbox)
+{
+	s_running = 0;
+	while( s_imap_thread_running || s_smtp_thread_running ) {
+		mrmailbox_interrupt_idle(mailbox); /* repeated as the threads may not yet idle */
+		mrmailbox_interrupt_smtp_idle(mailbox);
+		usleep(10*1000);
+	}
+	pthread_join(s_imap_thread, NULL);
+	pthread_join(s_smtp_thread, NULL);
+}
+
+
+/*******************************************************************************
+ * Phases
+ ******************************************************************************/
+
+
+typedef struct phase_t
+{
+	const char* m_name;
+	double      m_start_ms;
+	int         m_imap_cmd_cnt;
+	int         m_smtp_cmd_cnt;
+	double*     m_latencies;
+	int         m_cnt;
+} phase_t;
+
+
+static mockimap_t*  s_imap_server;
+static mocksmtp_t*  s_smtp_server;
+
+
+static void phase_start(phase_t* phase, const char* name, int cnt)
+{
+	memset(phase, 0, sizeof(phase_t));
+	phase->m_name         = name;
+	phase->m_cnt          = cnt;
+	phase->m_imap_cmd_cnt = mockimap_get_cmd_cnt(s_imap_server);
+	phase->m_smtp_cmd_cnt = mocksmtp_get_cmd_cnt(s_smtp_server);
+	if( (phase->m_latencies=calloc(cnt>0? cnt : 1, sizeof(double)))==NULL ) {
+		exit(1);
+	}
+	phase->m_start_ms = now_ms();
+}
+
+
+static int cmp_double(const void* p1, const void* p2)
+{
+	double d1 = *(const double*)p1, d2 = *(const double*)p2;
+	return d1<d2? -1 : (d1>d2? 1 : 0);
+}
+
+
+static double percentile(const double* sorted, int cnt, int p)
+{
+	/* nearest-rank method */
+	int i = (cnt*p + 99) / 100 - 1;
+	return cnt>0? sorted[i<0? 0 : i] : 0;
+}
+
+
+static void phase_end(phase_t* phase, double end_ms, int latency_ms)
+{
+	double ms = end_ms - phase->m_start_ms;
+	int    cnt = phase->m_cnt>0? phase->m_cnt : 1;
+
+	qsort(phase->m_latencies, phase->m_cnt, sizeof(double), cmp_double);
+
+	printf("{\"bench\":\"e2e\",\"phase\":\"%s\",\"server_latency_ms\":%i,\"msgs\":%i,\"ms\":%.1f,\"msgs_per_s\":%.1f,"
+		"\"imap_roundtrips_per_msg\":%.2f,\"smtp_roundtrips_per_msg\":%.2f,\"p50_ms\":%.1f,\"p99_ms\":%.1f}\n",
+		phase->m_name, latency_ms, phase->m_cnt, ms, phase->m_cnt*1000.0/(ms>0? ms : 1),
+		(mockimap_get_cmd_cnt(s_imap_server)-phase->m_imap_cmd_cnt)/(double)cnt,
+		(mocksmtp_get_cmd_cnt(s_smtp_server)-phase->m_smtp_cmd_cnt)/(double)cnt,
+		percentile(phase->m_latencies, phase->m_cnt, 50), percentile(phase->m_latencies, phase->m_cnt, 99));
+	fflush(stdout);
+
+	free(phase->m_latencies);
+	phase->m_latencies = NULL;
+}
+
+
+static int get_incoming_cnt(double* ret_last_ms)
+{
+	int cnt;
+	pthread_mutex_lock(&s_critical);
+		cnt = s_incoming_cnt;
+		if( ret_last_ms && cnt > 0 ) {
+			*ret_last_ms = s_incoming_ms[cnt-1];
+		}
+	pthread_mutex_unlock(&s_critical);
+	return cnt;
+}
+
+
+static int get_delivered_cnt(void)
+{
+	int cnt;
+	pthread_mutex_lock(&s_critical);
+		cnt = s_delivered_cnt;
+	pthread_mutex_unlock(&s_critical);
+	return cnt;
+}
+
+
+static int wait_for_idle(void)
+{
+	/* wait until the client waits in IDLE, so that the first fetch is done and a push is needed for new messages */
+	double start = now_ms();
+	while( mockimap_get_idle_cnt(s_imap_server) == 0 ) {
+		if( now_ms()-start > BENCH_TIMEOUT_MS ) {
+			fprintf(stderr, "ERROR: Timeout waiting for IDLE.\n");
+			return 0;
+		}
+		usleep(100);
+	}
+
+	/* libetpan waits for the socket in IDLE and does not look at its read buffer; if the push arrives
+	together with the continuation of IDLE, it is noticed only at the next timeout.  So give the
+	client some time to read the continuation. */
+	usleep(BENCH_IDLE_SETTLE_MS*1000);
+	return 1;
+}
+
+
+static int get_job_cnt(mrmailbox_t* mailbox)
+{
+	sqlite3_stmt* stmt;
+	int           cnt = 0;
+	mrsqlite3_lock(mailbox->m_sql);
+		stmt = mrsqlite3_prepare_v2_(mailbox->m_sql, "SELECT COUNT(*) FROM jobs;");
+		if( stmt && sqlite3_step(stmt)==SQLITE_ROW ) {
+			cnt = sqlite3_column_int(stmt, 0);
+		}
+		sqlite3_finalize(stmt);
+	mrsqlite3_unlock(mailbox->m_sql);
+	return cnt;
+}
+
+
+static int wait_for_jobs(mrmailbox_t* mailbox)
+{
+	/* wait until all jobs are done, so that the round-trips of the jobs following a phase are not counted for the next phase */
+	double start = now_ms();
+	while( get_job_cnt(mailbox) > 0 ) {
+		if( now_ms()-start > BENCH_TIMEOUT_MS ) {
+			fprintf(stderr, "ERROR: Timeout waiting for %i jobs.\n", get_job_cnt(mailbox));
+			return 0;
+		}
+		usleep(1000);
+	}
+	return 1;
+}
+
+
+int main(int argc, char* argv[])
+{
+	int          msg_cnt = argc>1? atoi(argv[1]) : 200, latency_ms = argc>2? atoi(argv[2]) : 0;
+	int          idle_cnt = BENCH_IDLE_CNT, send_cnt = msg_cnt/2, sender_cnt = msg_cnt/20+2, group_cnt = msg_cnt/100+1;
+	int          i, j, seen_start, seen_cnt, cur, success = 0;
+	char         dir[] = "/tmp/benche2e-XXXXXX", *dbfile = NULL, *blobdir = NULL, **msgs = NULL, *str;
+	mockcorpus_t* corpus = NULL;
+	uint32_t*    chat_ids = NULL, *sent_ids = NULL, *fresh_ids = NULL;
+	mrmailbox_t* mailbox = NULL;
+	mrarray_t*   fresh = NULL;
+	phase_t      phase;
+	double       start, end;
+	time_t       timestamp = time(NULL) - (msg_cnt+idle_cnt)*60;
+
+	memset(&phase, 0, sizeof(phase_t));
+
+	if( msg_cnt < 1 ) {
+		fprintf(stderr, "Usage: %s [<msg-cnt> [<latency-ms>]]\n", argv[0]);
+		return 1;
+	}
+
+	/* generate the messages and start the servers */
+	s_delivered_alloc = send_cnt;
+	if( (msgs=calloc(msg_cnt+idle_cnt, sizeof(char*)))==NULL || (chat_ids=calloc(sender_cnt, sizeof(uint32_t)))==NULL
+	 || (sent_ids=calloc(send_cnt+1, sizeof(uint32_t)))==NULL
+	 || (s_delivered_ids=calloc(send_cnt+1, sizeof(uint32_t)))==NULL || (s_delivered_ms=calloc(send_cnt+1, sizeof(double)))==NULL ) {
+		exit(1);
+	}
+	/* 1:1 and group messages from known contacts, see below */
+	str = mr_mprintf("plain=3,group=1,senders=%i,groups=%i", sender_cnt, group_cnt);
+		corpus = mockcorpus_new(NULL, BENCH_ADDR, 0, str);
+	free(str);
+	for( i = 0; corpus && i < msg_cnt+idle_cnt; i++ ) {
+		msgs[i] = mockcorpus_render(corpus, i, timestamp+i*60, NULL);
+	}
+	mockcorpus_unref(corpus);
+
+	/* the INBOX contains an old message; messages on the server before the first fetch are not downloaded, however, the first fetch of an empty folder does not remember that */
+	s_imap_server = mockimap_new(1, 0, latency_ms);
+	s_smtp_server = mocksmtp_new(NULL, latency_ms);
+	if( s_imap_server == NULL || s_smtp_server == NULL || mkdtemp(dir) == NULL ) {
+		fprintf(stderr, "ERROR: Cannot start servers.\n");
+		goto cleanup;
+	}
+
+	dbfile = mr_mprintf("%s/db.sqlite", dir);
+	blobdir = mr_mprintf("%s/blobs", dir);
+	mr_create_folder(blobdir, NULL);
+	mailbox = mrmailbox_new(receive_event, NULL, "benche2e");
+	if( !mrmailbox_open(mailbox, dbfile, blobdir) ) {
+		fprintf(stderr, "ERROR: Cannot open %s.\n", dbfile);
+		goto cleanup;
+	}
+
+	mrmailbox_set_config    (mailbox, "addr",         BENCH_ADDR);
+	mrmailbox_set_config    (mailbox, "mail_pw",      "bench");
+	mrmailbox_set_config    (mailbox, "mail_server",  "127.0.0.1");
+	mrmailbox_set_config_int(mailbox, "mail_port",    mockimap_get_port(s_imap_server));
+	mrmailbox_set_config    (mailbox, "send_server",  "127.0.0.1");
+	mrmailbox_set_config_int(mailbox, "send_port",    mocksmtp_get_port(s_smtp_server));
+	mrmailbox_set_config_int(mailbox, "server_flags", MR_AUTH_NORMAL|MR_IMAP_SOCKET_PLAIN|MR_SMTP_SOCKET_PLAIN);
+
+	/* configure, this includes the generation of the keypair */
+	phase_start(&phase, "configure", 0);
+		mrmailbox_configure(mailbox);
+		s_imap_thread_running = s_smtp_thread_running = 1;
+		pthread_create(&s_imap_thread, NULL, imap_thread_entry_point, mailbox);
+		pthread_create(&s_smtp_thread, NULL, smtp_thread_entry_point, mailbox);
+		while( s_configured == 0 ) {
+			usleep(1000);
+		}
+		if( s_configured < 0 ) {
+			fprintf(stderr, "ERROR: Configure failed.\n");
+			goto cleanup;
+		}
+	phase_end(&phase, now_ms(), latency_ms);
+
+	/* the senders are known contacts with chats, so that the messages are not put to the deaddrop */
+	for( i = 0; i < sender_cnt; i++ ) {
+		char* name = mr_mprintf("Sender %i", i), *addr = mockcorpus_get_sender_addr(NULL, i);
+			chat_ids[i] = mrmailbox_create_chat_by_contact_id(mailbox, mrmailbox_create_contact(mailbox, name, addr));
+		free(addr);
+		free(name);
+	}
+
+	/* initial sync: all messages are added at once, the latency of a message is the time until it is stored */
+	if( !wait_for_idle() ) {
+		goto cleanup;
+	}
+	phase_start(&phase, "sync", msg_cnt);
+		for( i = 0; i < msg_cnt; i++ ) {
+			mockimap_add_msg(s_imap_server, "INBOX", msgs[i], strlen(msgs[i]));
+		}
+		while( get_incoming_cnt(NULL) < msg_cnt ) {
+			if( now_ms()-phase.m_start_ms > BENCH_TIMEOUT_MS ) {
+				fprintf(stderr, "ERROR: Sync timeout, %i of %i messages received.\n", get_incoming_cnt(NULL), msg_cnt);
+				goto cleanup;
+			}
+			usleep(1000);
+		}
+		pthread_mutex_lock(&s_critical);
+			for( i = 0; i < msg_cnt; i++ ) {
+				phase.m_latencies[i] = s_incoming_ms[i] - phase.m_start_ms;
+			}
+			end = s_incoming_ms[msg_cnt-1];
+		pthread_mutex_unlock(&s_critical);
+		if( !wait_for_jobs(mailbox) ) {
+			goto cleanup;
+		}
+	phase_end(&phase, end, latency_ms);
+
+	/* single messages pushed to the client in IDLE */
+	phase_start(&phase, "idle", idle_cnt);
+		for( i = 0; i < idle_cnt; i++ ) {
+			if( !wait_for_idle() ) {
+				goto cleanup;
+			}
+			start = now_ms();
+			mockimap_add_msg(s_imap_server, "INBOX", msgs[msg_cnt+i], strlen(msgs[msg_cnt+i]));
+			while( get_incoming_cnt(&end) < msg_cnt+i+1 ) {
+				if( now_ms()-start > BENCH_TIMEOUT_MS ) {
+					fprintf(stderr, "ERROR: IDLE timeout.\n");
+					goto cleanup;
+				}
+				usleep(100);
+			}
+			phase.m_latencies[i] = end - start;
+		}
+	phase_end(&phase, end, latency_ms);
+
+	/* a burst of messages sent to the chats, the latency is the time until the message is delivered by SMTP */
+	phase_start(&phase, "send", send_cnt);
+		for( i = 0; i < send_cnt; i++ ) {
+			str = mr_mprintf("Reply %i", i);
+				phase.m_latencies[i] = now_ms();
+				sent_ids[i] = mrmailbox_send_text_msg(mailbox, chat_ids[i%sender_cnt], str);
+			free(str);
+		}
+		while( get_delivered_cnt() < send_cnt ) {
+			if( now_ms()-phase.m_start_ms > BENCH_TIMEOUT_MS ) {
+				fprintf(stderr, "ERROR: Send timeout, %i of %i messages delivered.\n", get_delivered_cnt(), send_cnt);
+				goto cleanup;
+			}
+			usleep(1000);
+		}
+		end = 0;
+		pthread_mutex_lock(&s_critical);
+			for( i = 0; i < send_cnt; i++ ) {
+				for( j = 0; j < s_delivered_cnt; j++ ) {
+					if( s_delivered_ids[j] == sent_ids[i] ) {
+						phase.m_latencies[i] = s_delivered_ms[j] - phase.m_latencies[i];
+						end = MR_MAX(end, s_delivered_ms[j]);
+						break;
+					}
+				}
+			}
+		pthread_mutex_unlock(&s_critical);
+		if( !wait_for_jobs(mailbox) ) {
+			goto cleanup;
+		}
+	phase_end(&phase, end, latency_ms);
+
+	/* mark all received messages as seen at once, the latency is the time until the message is marked on the server */
+	fresh = mrmailbox_get_fresh_msgs(mailbox);
+	if( (fresh_ids=calloc(mrarray_get_cnt(fresh)+1, sizeof(uint32_t)))==NULL ) {
+		exit(1);
+	}
+	for( i = 0; i < (int)mrarray_get_cnt(fresh); i++ ) {
+		fresh_ids[i] = mrarray_get_id(fresh, i); /* the array holds uintptr_t, markseen takes uint32_t */
+	}
+	phase_start(&phase, "markseen", (int)mrarray_get_cnt(fresh));
+		seen_start = mockimap_get_seen_cnt(s_imap_server);
+		seen_cnt = 0;
+		end = phase.m_start_ms;
+		mrmailbox_markseen_msgs(mailbox, fresh_ids, phase.m_cnt);
+		while( seen_cnt < phase.m_cnt ) {
+			if( (cur=mockimap_get_seen_cnt(s_imap_server)-seen_start) > seen_cnt ) {
+				end = now_ms();
+				while( seen_cnt < cur && seen_cnt < phase.m_cnt ) {
+					phase.m_latencies[seen_cnt++] = end - phase.m_start_ms;
+				}
+			}
+			else if( now_ms()-phase.m_start_ms > BENCH_TIMEOUT_MS ) {
+				fprintf(stderr, "ERROR: Markseen timeout, %i of %i messages marked as seen.\n", seen_cnt, phase.m_cnt);
+				goto cleanup;
+			}
+			else {
+				usleep(100);
+			}
+		}
+		if( !wait_for_jobs(mailbox) ) {
+			goto cleanup;
+		}
+	phase_end(&phase, end, latency_ms);
+
+	success = 1;
+
+cleanup:
+	if( s_imap_thread_running || s_smtp_thread_running ) {
+		stop_threads(mailbox);
+	}
+	free(phase.m_latencies);
+	mrarray_unref(fresh);
+	if( mailbox ) {
+		mrmailbox_close(mailbox);
+		mrmailbox_unref(mailbox);
+	}
+	mockimap_unref(s_imap_server);
+	mocksmtp_unref(s_smtp_server);
+	if( dbfile ) {
+		mr_delete_file(dbfile, NULL);
+		rmdir(blobdir);
+		rmdir(dir);
+	}
+	for( i = 0; msgs && i < msg_cnt+idle_cnt; i++ ) {
+		free(msgs[i]);
+	}
+	free(msgs);
+	free(chat_ids);
+	free(sent_ids);
+	free(fresh_ids);
+	free(dbfile);
+	free(blobdir);
+	return success? 0 : 1;
+}
@@ -0,0 +1,142 @@
+/*******************************************************************************
+ *
+ *                              Delta Chat Core
+ *                      Copyright (C) 2017 Björn Petersen
+ *                   Contact: r10s@b44t.com, http://b44t.com
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see http://www.gnu.org/licenses/ .
+ *
+ ******************************************************************************/
+
+
+#ifndef __CHAINEDHASH_H__
+#define __CHAINEDHASH_H__
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+
+/* The chained hash table as used by mrhash_t before it was replaced by an
+ * open-addressing table, kept unchanged except for the names as a reference
+ * for the command "benchhash".
+ */
+
+
+/* Forward declarations of structures.
+ */
+typedef struct chainedhashelem_t   chainedhashelem_t;
+
+
+/* A complete hash table is an instance of the following structure.
+ * The internals of this structure are intended to be opaque -- client
+ * code should not attempt to access or modify the fields of this structure
+ * directly.  Change this structure only by using the routines below.
+ * However, many of the "procedures" and "functions" for modifying and
+ * accessing this structure are really macros, so we can't really make
+ * this structure opaque.
+ */
+typedef struct chainedhash_t
+{
+	char              keyClass;       /* SJHASH_INT, _POINTER, _STRING, _BINARY */
+	char              copyKey;        /* True if copy of key made on insert */
+	int               count;          /* Number of entries in this table */
+	chainedhashelem_t*     first;          /* The first element of the array */
+	int               htsize;         /* Number of buckets in the hash table */
+	struct _ht
+	{	/* the hash table */
+		int           count;          /* Number of entries with this hash */
+		chainedhashelem_t* chain;          /* Pointer to first entry with this hash */
+	} *ht;
+} chainedhash_t;
+
+
+/* Each element in the hash table is an instance of the following
+ * structure.  All elements are stored on a single doubly-linked list.
+ *
+ * Again, this structure is intended to be opaque, but it can't really
+ * be opaque because it is used by macros.
+ */
+typedef struct chainedhashelem_t
+{
+	chainedhashelem_t      *next, *prev;   /* Next and previous elements in the table */
+	void*             data;           /* Data associated with this element */
+	void*             pKey;           /* Key associated with this element */
+	int               nKey;           /* Key associated with this element */
+} chainedhashelem_t;
+
+
+/*
+ * There are 4 different modes of operation for a hash table:
+ *
+ *   CHAINEDHASH_INT         nKey is used as the key and pKey is ignored.
+ *
+ *   CHAINEDHASH_POINTER     pKey is used as the key and nKey is ignored.
+ *
+ *   CHAINEDHASH_STRING      pKey points to a string that is nKey bytes long
+ *                      (including the null-terminator, if any).  Case
+ *                      is ignored in comparisons.
+ *
+ *   CHAINEDHASH_BINARY      pKey points to binary data nKey bytes long.
+ *                      memcmp() is used to compare keys.
+ *
+ * A copy of the key is made for CHAINEDHASH_STRING and CHAINEDHASH_BINARY
+ * if the copyKey parameter to chainedhash_init() is 1.
+ */
+#define CHAINEDHASH_INT       1
+#define CHAINEDHASH_POINTER   2
+#define CHAINEDHASH_STRING    3
+#define CHAINEDHASH_BINARY    4
+
+
+/*
+ * Access routines.  To delete an element, insert a NULL pointer.
+ */
+void    chainedhash_init     (chainedhash_t*, int keytype, int copyKey);
+void*   chainedhash_insert   (chainedhash_t*, const void *pKey, int nKey, void *pData);
+void*   chainedhash_find     (const chainedhash_t*, const void *pKey, int nKey);
+void    chainedhash_clear    (chainedhash_t*);
+
+#define chainedhash_find_str(H, s) chainedhash_find((H), (s), strlen((s)))
+
+
+/*
+ * Macros for looping over all elements of a hash table.  The idiom is
+ * like this:
+ *
+ *   SjHash h;
+ *   SjHashElem *p;
+ *   ...
+ *   for(p=chainedhash_first(&h); p; p=chainedhash_next(p)){
+ *     SomeStructure *pData = chainedhash_data(p);
+ *     // do something with pData
+ *   }
+ */
+#define chainedhash_first(H)      ((H)->first)
+#define chainedhash_next(E)       ((E)->next)
+#define chainedhash_data(E)       ((E)->data)
+#define chainedhash_key(E)        ((E)->pKey)
+#define chainedhash_keysize(E)    ((E)->nKey)
+
+
+/*
+ * Number of entries in a hash table
+ */
+#define chainedhash_count(H)      ((H)->count)
+
+
+#ifdef __cplusplus
+};  /* /extern "C" */
+#endif
+#endif /* __CHAINEDHASH_H__ */
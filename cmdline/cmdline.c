@@ -25,14 +25,992 @@ your library */
 
 
 #include <dirent.h>
+#include <unistd.h>
+#include <sys/time.h>
 #include "../src/mrmailbox_internal.h"
 #include "../src/mraheader.h"
+#include "../src/mrjob.h"
 #include "../src/mrapeerstate.h"
 #include "../src/mrkey.h"
+#include "../src/mrkeyring.h"
 #include "../src/mrpgp.h"
+#include "../src/mrimap.h"
+#include "../src/mrloginparam.h"
+#include "../src/mrhash.h"
+#include "../src/mrmimeparser.h"
+#include "../src/mrcodec.h"
+#include "mockimap.h"
+#include "mockcorpus.h"
+#include "chainedhash.h"
+#include "mallocstat.h"
 
 
 
+/*
+ * Download messages from a mockimap_t server, used by the command "benchimap".
+ * The messages are counted but not added to the database; lastseenuid is stored in memory
+ * so that the real configuration is not affected.
+ */
+static char*  s_bench_lastseenuid = NULL;
+static char*  s_bench_batch_cnt = NULL;
+static int    s_bench_received_cnt = 0;
+static size_t s_bench_received_bytes = 0;
+
+
+static char* bench_get_config(mrimap_t* imap, const char* key, const char* def)
+{
+	if( strncmp(key, "imap.mailbox.", 13)==0 ) {
+		return safe_strdup(s_bench_lastseenuid? s_bench_lastseenuid : def);
+	}
+	else if( strcmp(key, "imap_fetch_batch_cnt")==0 ) {
+		return safe_strdup(s_bench_batch_cnt? s_bench_batch_cnt : def);
+	}
+	return def? safe_strdup(def) : NULL;
+}
+
+
+static void bench_set_config(mrimap_t* imap, const char* key, const char* value)
+{
+	if( strncmp(key, "imap.mailbox.", 13)==0 ) {
+		free(s_bench_lastseenuid);
+		s_bench_lastseenuid = safe_strdup(value);
+	}
+}
+
+
+static void bench_receive_imf(mrimap_t* imap, const mrimapfetched_t* msgs, int msgs_cnt, const char* server_folder)
+{
+	int i;
+	for( i = 0; i < msgs_cnt; i++ ) {
+		s_bench_received_cnt++;
+		s_bench_received_bytes += msgs[i].m_imf_raw_bytes;
+	}
+}
+
+
+static char* bench_imap(mrmailbox_t* mailbox, int msg_cnt, int latency_ms, const char* batch_cnt)
+{
+	char*           ret = NULL;
+	mockimap_t*     server = mockimap_new(msg_cnt, 2000, latency_ms);
+	mrimap_t*       imap = mrimap_new(bench_get_config, bench_set_config, bench_receive_imf, NULL, NULL, mailbox);
+	mrloginparam_t* param = mrloginparam_new();
+	struct timeval  start, end;
+	int             fetch_cmd_cnt;
+
+	if( server == NULL ) {
+		ret = safe_strdup("ERROR: Cannot start IMAP server.");
+		goto cleanup;
+	}
+
+	free(s_bench_lastseenuid);
+	s_bench_lastseenuid = safe_strdup("1:0"); /* UIDVALIDITY of the mock server, download all messages */
+	s_bench_batch_cnt = (char*)batch_cnt;
+	s_bench_received_cnt = 0;
+	s_bench_received_bytes = 0;
+
+	param->m_mail_server  = safe_strdup("127.0.0.1");
+	param->m_mail_port    = mockimap_get_port(server);
+	param->m_mail_user    = safe_strdup("bench");
+	param->m_mail_pw      = safe_strdup("bench");
+	param->m_server_flags = MR_IMAP_SOCKET_PLAIN;
+
+	gettimeofday(&start, NULL);
+		if( !mrimap_connect(imap, param) ) {
+			ret = safe_strdup("ERROR: Cannot connect to IMAP server.");
+			goto cleanup;
+		}
+		mrimap_fetch(imap);
+	gettimeofday(&end, NULL);
+	fetch_cmd_cnt = mockimap_get_cmd_cnt(server);
+
+	/* a second full resync of the unchanged server, with CONDSTORE this is a single STATUS command per folder */
+	imap->m_last_fullread_time = 0;
+	mrimap_fetch(imap);
+	mrimap_disconnect(imap);
+
+	double ms = (end.tv_sec-start.tv_sec)*1000.0 + (end.tv_usec-start.tv_usec)/1000.0;
+	ret = mr_mprintf("batch size %s: %i messages (%i KB) in %.0f ms, %.0f messages/s, %i IMAP commands, %i commands for resync.",
+		batch_cnt? batch_cnt : "default", s_bench_received_cnt, (int)(s_bench_received_bytes/1024), ms,
+		s_bench_received_cnt*1000.0/(ms>0? ms : 1), fetch_cmd_cnt, mockimap_get_cmd_cnt(server)-fetch_cmd_cnt);
+
+cleanup:
+	mrloginparam_unref(param);
+	mrimap_unref(imap);
+	mockimap_unref(server);
+	s_bench_batch_cnt = NULL;
+	return ret;
+}
+
+
+/*
+ * Mark messages on a mockimap_t server as seen and move them to the chats folder,
+ * used by the command "benchmarkseen".  This is done message by message as
+ * the former MRJ_MARKSEEN_MSG_ON_IMAP jobs did and by a single mrimap_markseen_msgs() call.
+ */
+static char* bench_markseen(mrmailbox_t* mailbox, int msg_cnt, int latency_ms, int batched)
+{
+	char*             ret = NULL;
+	mockimap_t*       server = mockimap_new(msg_cnt, 100, latency_ms);
+	mrimap_t*         imap = mrimap_new(bench_get_config, bench_set_config, bench_receive_imf, NULL, NULL, mailbox);
+	mrloginparam_t*   param = mrloginparam_new();
+	mrimapmarkseen_t* msgs = calloc(msg_cnt>0? msg_cnt : 1, sizeof(mrimapmarkseen_t));
+	char*             new_server_folder = NULL;
+	struct timeval    start, end;
+	int               i, connect_cmd_cnt, moved_cnt = 0;
+
+	if( server == NULL ) {
+		ret = safe_strdup("ERROR: Cannot start IMAP server.");
+		goto cleanup;
+	}
+
+	param->m_mail_server  = safe_strdup("127.0.0.1");
+	param->m_mail_port    = mockimap_get_port(server);
+	param->m_mail_user    = safe_strdup("bench");
+	param->m_mail_pw      = safe_strdup("bench");
+	param->m_server_flags = MR_IMAP_SOCKET_PLAIN;
+
+	if( !mrimap_connect(imap, param) ) {
+		ret = safe_strdup("ERROR: Cannot connect to IMAP server.");
+		goto cleanup;
+	}
+	connect_cmd_cnt = mockimap_get_cmd_cnt(server);
+
+	for( i = 0; i < msg_cnt; i++ ) {
+		msgs[i].m_server_uid = i+1;
+		msgs[i].m_ms_flags = MR_MS_ALSO_MOVE;
+	}
+
+	gettimeofday(&start, NULL);
+		if( batched ) {
+			mrimap_markseen_msgs(imap, "INBOX", msgs, msg_cnt, &new_server_folder);
+		}
+		else {
+			for( i = 0; i < msg_cnt; i++ ) {
+				free(new_server_folder);
+				new_server_folder = NULL;
+				int dummy_flags = 0;
+				mrimap_markseen_msg(imap, "INBOX", msgs[i].m_server_uid, msgs[i].m_ms_flags, &new_server_folder, &msgs[i].m_new_server_uid, &dummy_flags);
+			}
+		}
+	gettimeofday(&end, NULL);
+
+	for( i = 0; i < msg_cnt; i++ ) {
+		if( msgs[i].m_new_server_uid ) {
+			moved_cnt++;
+		}
+	}
+
+	double ms = (end.tv_sec-start.tv_sec)*1000.0 + (end.tv_usec-start.tv_usec)/1000.0;
+	ret = mr_mprintf("%s: %i messages marked as seen in %.0f ms, %i IMAP commands, %i new UIDs assigned.",
+		batched? "batched" : "message by message", msg_cnt, ms, mockimap_get_cmd_cnt(server)-connect_cmd_cnt, moved_cnt);
+
+	mrimap_disconnect(imap);
+
+cleanup:
+	free(new_server_folder);
+	free(msgs);
+	mrloginparam_unref(param);
+	mrimap_unref(imap);
+	mockimap_unref(server);
+	return ret;
+}
+
+
+/*
+ * Access parameters as done when loading and sending messages and when
+ * performing jobs, used by the command "benchparam".
+ */
+static char* bench_param(int loop_cnt)
+{
+	mrparam_t*     param = mrparam_new();
+	struct timeval start, end;
+	int            i, sum = 0;
+	double         ms[3];
+
+	/* read-mostly, eg. mrmsg_get_*(), mrmimefactory_load_msg() */
+	gettimeofday(&start, NULL);
+		for( i = 0; i < loop_cnt; i++ ) {
+			mrparam_set_packed(param, "f=/storage/emulated/0/delta-blobs/image-1234.jpg\nm=image/jpeg\nw=1024\nh=768\nc=1\nr=1\nN=Author");
+			char* file = mrparam_get(param, MRP_FILE, NULL);
+			char* mime = mrparam_get(param, MRP_MIMETYPE, NULL);
+			sum += mrparam_get_int(param, MRP_WIDTH, 0) + mrparam_get_int(param, MRP_HEIGHT, 0) + mrparam_get_int(param, MRP_DURATION, 0)
+			     + mrparam_get_int(param, MRP_GUARANTEE_E2EE, 0) + mrparam_get_int(param, MRP_ERRONEOUS_E2EE, 0) + mrparam_get_int(param, MRP_FORCE_PLAINTEXT, 0)
+			     + mrparam_get_int(param, MRP_CMD, 0) + mrparam_exists(param, MRP_FORWARDED);
+			free(file);
+			free(mime);
+		}
+	gettimeofday(&end, NULL);
+	ms[0] = (end.tv_sec-start.tv_sec)*1000.0 + (end.tv_usec-start.tv_usec)/1000.0;
+
+	/* read-modify-write, eg. the job parameters when a job is retried */
+	gettimeofday(&start, NULL);
+		for( i = 0; i < loop_cnt; i++ ) {
+			mrparam_set_packed(param, "Z=INBOX\nz=4711\nt=2");
+			mrparam_set_int(param, MRP_TIMES, mrparam_get_int(param, MRP_TIMES, 0)+1);
+			mrparam_set_int(param, MRP_SERVER_UID, mrparam_get_int(param, MRP_SERVER_UID, 0)+1);
+			sum += strlen(mrparam_get_packed(param));
+		}
+	gettimeofday(&end, NULL);
+	ms[1] = (end.tv_sec-start.tv_sec)*1000.0 + (end.tv_usec-start.tv_usec)/1000.0;
+
+	/* build from scratch, eg. the parameters of a received message part */
+	gettimeofday(&start, NULL);
+		for( i = 0; i < loop_cnt; i++ ) {
+			mrparam_empty(param);
+			mrparam_set    (param, MRP_FILE, "/storage/emulated/0/delta-blobs/image-1234.jpg");
+			mrparam_set    (param, MRP_MIMETYPE, "image/jpeg");
+			mrparam_set_int(param, MRP_WIDTH, 1024);
+			mrparam_set_int(param, MRP_HEIGHT, 768);
+			mrparam_set_int(param, MRP_GUARANTEE_E2EE, 1);
+			mrparam_set_int(param, MRP_WANTS_MDN, 1);
+			sum += strlen(mrparam_get_packed(param));
+		}
+	gettimeofday(&end, NULL);
+	ms[2] = (end.tv_sec-start.tv_sec)*1000.0 + (end.tv_usec-start.tv_usec)/1000.0;
+
+	mrparam_unref(param);
+
+	return mr_mprintf("%i loops: read-mostly %.0f ms, read-modify-write %.0f ms, build %.0f ms (checksum %i).",
+		loop_cnt, ms[0], ms[1], ms[2], sum);
+}
+
+/*
+ * Hash header fields and recipients as done for each parsed message,
+ * used by the command "benchhash".  The same is done with the former chained
+ * implementation, see chainedhash.c, so both results come from the same run.
+ */
+static const char* s_bench_hash_fields[] = { "Return-Path", "Delivered-To", "Received", "Received", "Received", "Received",
+	"DKIM-Signature", "X-Google-DKIM-Signature", "X-Gm-Message-State", "X-Received", "ARC-Seal",
+	"ARC-Message-Signature", "ARC-Authentication-Results", "Authentication-Results", "Received-SPF",
+	"MIME-Version", "From", "To", "Cc", "Subject", "Date", "Message-ID", "In-Reply-To", "References",
+	"Content-Type", "Chat-Version", "Chat-Group-ID", "Chat-Group-Name", "Autocrypt", "X-Mailer",
+	"List-Id", "List-Unsubscribe", NULL };
+static const char* s_bench_hash_lookups[] = { "Date", "Subject", "Chat-Version", "chat-version", "Chat-Group-ID",
+	"Chat-Group-Name", "Chat-Group-Name-Changed", "Chat-Group-Image", "Chat-Group-Member-Removed",
+	"Chat-Group-Member-Added", "Chat-Disposition-Notification-To", "Disposition-Notification-To",
+	"Autocrypt-Setup-Message", "Secure-Join", "List-Id", "Chat-Voice-Message", "Chat-Duration",
+	"X-MrMsg", "X-MrGrpId", "Content-Type", NULL };
+static char s_bench_hash_addrs[150][64], s_bench_hash_lookup_addrs[30][64];
+
+static int bench_hash_mrhash(int loop_cnt, double* ms)
+{
+	const char**   fields = s_bench_hash_fields, **lookups = s_bench_hash_lookups;
+	struct timeval start, end;
+	int            i, j, sum = 0;
+	mrhash_t       hash;
+
+	gettimeofday(&start, NULL);
+		for( i = 0; i < loop_cnt; i++ ) {
+			mrhash_init(&hash, MRHASH_STRING, MRHASH_NO_COPY);
+			for( j = 0; fields[j]; j++ ) {
+				int len = strlen(fields[j]);
+				if( mrhash_find(&hash, fields[j], len)==NULL ) {
+					mrhash_insert(&hash, fields[j], len, (void*)fields[j]);
+				}
+			}
+			for( j = 0; lookups[j]; j++ ) {
+				sum += mrhash_find_str(&hash, lookups[j])? 1 : 0;
+			}
+			mrhash_clear(&hash);
+		}
+	gettimeofday(&end, NULL);
+	ms[0] = (end.tv_sec-start.tv_sec)*1000.0 + (end.tv_usec-start.tv_usec)/1000.0;
+
+	gettimeofday(&start, NULL);
+		for( i = 0; i < loop_cnt/10; i++ ) {
+			mrhash_init(&hash, MRHASH_STRING, MRHASH_COPY_TO_ARENA);
+			for( j = 0; j < 150; j++ ) {
+				mrhash_insert(&hash, s_bench_hash_addrs[j], strlen(s_bench_hash_addrs[j]), (void*)1);
+			}
+			for( j = 0; j < 30; j++ ) {
+				sum += mrhash_find_str(&hash, s_bench_hash_lookup_addrs[j])? 1 : 0;
+			}
+			mrhash_clear(&hash);
+		}
+	gettimeofday(&end, NULL);
+	ms[1] = (end.tv_sec-start.tv_sec)*1000.0 + (end.tv_usec-start.tv_usec)/1000.0;
+
+	return sum;
+}
+
+static int bench_hash_chained(int loop_cnt, double* ms)
+{
+	const char**   fields = s_bench_hash_fields, **lookups = s_bench_hash_lookups;
+	struct timeval start, end;
+	int            i, j, sum = 0;
+	chainedhash_t  hash;
+
+	gettimeofday(&start, NULL);
+		for( i = 0; i < loop_cnt; i++ ) {
+			chainedhash_init(&hash, CHAINEDHASH_STRING, 0);
+			for( j = 0; fields[j]; j++ ) {
+				int len = strlen(fields[j]);
+				if( chainedhash_find(&hash, fields[j], len)==NULL ) {
+					chainedhash_insert(&hash, fields[j], len, (void*)fields[j]);
+				}
+			}
+			for( j = 0; lookups[j]; j++ ) {
+				sum += chainedhash_find_str(&hash, lookups[j])? 1 : 0;
+			}
+			chainedhash_clear(&hash);
+		}
+	gettimeofday(&end, NULL);
+	ms[0] = (end.tv_sec-start.tv_sec)*1000.0 + (end.tv_usec-start.tv_usec)/1000.0;
+
+	gettimeofday(&start, NULL);
+		for( i = 0; i < loop_cnt/10; i++ ) {
+			chainedhash_init(&hash, CHAINEDHASH_STRING, 1/*copy keys*/);
+			for( j = 0; j < 150; j++ ) {
+				chainedhash_insert(&hash, s_bench_hash_addrs[j], strlen(s_bench_hash_addrs[j]), (void*)1);
+			}
+			for( j = 0; j < 30; j++ ) {
+				sum += chainedhash_find_str(&hash, s_bench_hash_lookup_addrs[j])? 1 : 0;
+			}
+			chainedhash_clear(&hash);
+		}
+	gettimeofday(&end, NULL);
+	ms[1] = (end.tv_sec-start.tv_sec)*1000.0 + (end.tv_usec-start.tv_usec)/1000.0;
+
+	return sum;
+}
+
+static char* bench_hash(int loop_cnt)
+{
+	int    j, sum, sum_chained;
+	double ms[2], ms_chained[2];
+
+	for( j = 0; j < 150; j++ ) {
+		snprintf(s_bench_hash_addrs[j], sizeof(s_bench_hash_addrs[j]), "member%i@list%i.example.org", j, j%7);
+	}
+	for( j = 0; j < 30; j++ ) {
+		snprintf(s_bench_hash_lookup_addrs[j], sizeof(s_bench_hash_lookup_addrs[j]), "Member%i@List%i.example.org", j*5, (j*5)%7);
+	}
+
+	sum_chained = bench_hash_chained(loop_cnt, ms_chained);
+	sum         = bench_hash_mrhash(loop_cnt, ms);
+
+	return mr_mprintf("%i header sets hashed in %.0f ms (chained: %.0f ms), %i recipient lists with 150 addresses in %.0f ms (chained: %.0f ms), checksum %i%s.",
+		loop_cnt, ms[0], ms_chained[0], loop_cnt/10, ms[1], ms_chained[1], sum, sum==sum_chained? "" : " (MISMATCH)");
+}
+
+/*
+ * Look up contacts by address as done when receiving messages to large groups,
+ * used by the command "benchcontacts".  All changes are rolled back afterwards.
+ */
+static char* bench_contacts(mrmailbox_t* mailbox, int lookup_cnt, int addr_cnt, int use_cache)
+{
+	char           addr[64], name[64];
+	struct timeval start, end;
+	uint32_t       hits, misses, rnd = 1;
+	int            i;
+
+	if( addr_cnt <= 0 ) {
+		addr_cnt = 1;
+	}
+
+	mrsqlite3_lock(mailbox->m_sql);
+	mrsqlite3_begin_transaction__(mailbox->m_sql);
+
+		hits   = mailbox->m_contact_cache_hits;
+		misses = mailbox->m_contact_cache_misses;
+
+		gettimeofday(&start, NULL);
+			for( i = 0; i < lookup_cnt; i++ ) {
+				rnd = rnd*1103515245 + 12345;
+				int n = (int)((rnd>>16)&0x7FFF) % addr_cnt;
+				snprintf(addr, sizeof(addr), "%s%i@bench.example.org", (i&7)? "bench" : "BENCH", n);
+				snprintf(name, sizeof(name), "Bench %i", n);
+				if( !use_cache ) {
+					mrmailbox_clear_contact_cache__(mailbox);
+				}
+				mrmailbox_add_or_lookup_contact__(mailbox, name, addr, MR_ORIGIN_INCOMING_UNKNOWN_TO, NULL);
+			}
+		gettimeofday(&end, NULL);
+
+		hits   = mailbox->m_contact_cache_hits - hits;
+		misses = mailbox->m_contact_cache_misses - misses;
+
+	mrsqlite3_rollback__(mailbox->m_sql);
+	mrsqlite3_unlock(mailbox->m_sql);
+
+	double ms = (end.tv_sec-start.tv_sec)*1000.0 + (end.tv_usec-start.tv_usec)/1000.0;
+	return mr_mprintf("%s: %i lookups of %i addresses in %.0f ms, %i cache hits, %i cache misses.",
+		use_cache? "cached" : "uncached", lookup_cnt, addr_cnt, ms, (int)hits, (int)misses);
+}
+
+/*
+ * Create `cnt` accounts in `dir` and provision them with keypairs using
+ * mrmailbox_provision_keypairs(), used by the command "provision".
+ */
+static char* provision(mrmailbox_t* mailbox, const char* dir, int cnt)
+{
+	mrmailbox_t**   mailboxes = NULL;
+	char*           path = NULL;
+	char            addr[64];
+	struct timeval  start, end;
+	int             i, ready_cnt;
+
+	if( cnt <= 0 || (mailboxes=calloc(cnt, sizeof(mrmailbox_t*)))==NULL ) {
+		return safe_strdup("ERROR: Bad <cnt>.");
+	}
+
+	for( i = 0; i < cnt; i++ ) {
+		mailboxes[i] = mrmailbox_new(mailbox->m_cb, NULL, "cmdline");
+		path = mr_mprintf("%s/provision%i.db", dir, i);
+		snprintf(addr, sizeof(addr), "provision%i@example.org", i);
+		if( mrmailbox_open(mailboxes[i], path, NULL) ) {
+			mrmailbox_set_config(mailboxes[i], "addr", addr);
+		}
+		free(path);
+	}
+
+	gettimeofday(&start, NULL);
+		ready_cnt = mrmailbox_provision_keypairs(mailboxes, cnt);
+	gettimeofday(&end, NULL);
+
+	for( i = 0; i < cnt; i++ ) {
+		mrmailbox_close(mailboxes[i]);
+		mrmailbox_unref(mailboxes[i]);
+	}
+	free(mailboxes);
+
+	double ms = (end.tv_sec-start.tv_sec)*1000.0 + (end.tv_usec-start.tv_usec)/1000.0;
+	return mr_mprintf("%i of %i accounts in %s have a keypair; provisioning took %.0f ms (%.0f ms/account) on %i CPU(s).",
+		ready_cnt, cnt, dir, ms, ms/cnt, (int)sysconf(_SC_NPROCESSORS_ONLN));
+}
+
+
+/*
+ * Encrypt messages to a group as done by mrmailbox_e2ee_encrypt(), used by the
+ * command "benchencrypt": the peerstates of all recipients are loaded and the
+ * message is signed and encrypted to their keys.  The peerstates are added in
+ * a transaction that is rolled back afterwards.
+ */
+static char* bench_encrypt(mrmailbox_t* mailbox, int rcpt_cnt, int msg_cnt)
+{
+	char*           ret = NULL;
+	char            addr[64];
+	mrkey_t*        self_public = mrkey_new(), *self_private = mrkey_new();
+	mraheader_t*    header = mraheader_new();
+	struct timeval  start, end;
+	double          ms[3];
+	int             i, m, use_cache, ok = 1;
+	const char*     text = "Hi all, this is a message to a larger group; the text does not matter for the benchmark.";
+
+	if( rcpt_cnt <= 0 ) {
+		rcpt_cnt = 50;
+	}
+
+	if( msg_cnt <= 0 ) {
+		msg_cnt = 10;
+	}
+
+	/* create the keys; this is not part of the measured operation */
+	gettimeofday(&start, NULL);
+		mrpgp_create_keypair(mailbox, "self@bench.example.org", self_public, self_private);
+
+		mrsqlite3_lock(mailbox->m_sql);
+		mrsqlite3_begin_transaction__(mailbox->m_sql);
+
+		for( i = 0; i < rcpt_cnt; i++ ) {
+			mrkey_t*        private_key = mrkey_new();
+			mrapeerstate_t* peerstate = mrapeerstate_new(mailbox);
+			snprintf(addr, sizeof(addr), "bench%i@bench.example.org", i);
+			free(header->m_addr);
+			header->m_addr = safe_strdup(addr);
+			header->m_prefer_encrypt = MRA_PE_MUTUAL;
+			mrpgp_create_keypair(mailbox, addr, header->m_public_key, private_key);
+			mrapeerstate_init_from_header(peerstate, header, time(NULL));
+			mrapeerstate_save_to_db__(peerstate, mailbox->m_sql, 1/*create*/);
+			mrapeerstate_unref(peerstate);
+			mrkey_unref(private_key);
+		}
+	gettimeofday(&end, NULL);
+	ms[0] = (end.tv_sec-start.tv_sec)*1000.0 + (end.tv_usec-start.tv_usec)/1000.0;
+
+	for( use_cache = 0; use_cache <= 1; use_cache++ )
+	{
+		gettimeofday(&start, NULL);
+			for( m = 0; m < msg_cnt; m++ ) {
+				mrkeyring_t* keyring = mrkeyring_new();
+				mrarray_t*   peerstates = mrarray_new(NULL, rcpt_cnt);
+				void*        ctext = NULL;
+				size_t       ctext_bytes = 0;
+
+				if( !use_cache ) {
+					mrapeerstate_clear_cache__(mailbox);
+					mrpgp_clear_key_cache();
+				}
+
+				for( i = 0; i < rcpt_cnt; i++ ) {
+					mrapeerstate_t* peerstate = mrapeerstate_new(mailbox);
+					snprintf(addr, sizeof(addr), "bench%i@bench.example.org", i);
+					if( mrapeerstate_load_by_addr__(peerstate, mailbox->m_sql, addr) ) {
+						mrkeyring_add(keyring, mrapeerstate_peek_key(peerstate, MRV_NOT_VERIFIED));
+					}
+					mrarray_add_ptr(peerstates, peerstate);
+				}
+				mrkeyring_add(keyring, self_public);
+
+				if( keyring->m_count != rcpt_cnt+1
+				 || !mrpgp_pk_encrypt(mailbox, text, strlen(text), keyring, self_private, 1/*use_armor*/, &ctext, &ctext_bytes) ) {
+					ok = 0;
+				}
+
+				free(ctext);
+				for( i = mrarray_get_cnt(peerstates)-1; i >= 0; i-- ) { mrapeerstate_unref((mrapeerstate_t*)mrarray_get_ptr(peerstates, i)); }
+				mrarray_unref(peerstates);
+				mrkeyring_unref(keyring);
+			}
+		gettimeofday(&end, NULL);
+		ms[1+use_cache] = (end.tv_sec-start.tv_sec)*1000.0 + (end.tv_usec-start.tv_usec)/1000.0;
+	}
+
+	mrsqlite3_rollback__(mailbox->m_sql);
+	mrsqlite3_unlock(mailbox->m_sql);
+
+	ret = mr_mprintf("%s%i messages encrypted to %i recipients: uncached %.0f ms (%.1f ms/message), cached %.0f ms (%.1f ms/message); creating the keys took %.0f ms.",
+		ok? "" : "ERROR: Encryption failed. ", msg_cnt, rcpt_cnt, ms[1], ms[1]/msg_cnt, ms[2], ms[2]/msg_cnt, ms[0]);
+
+	mraheader_unref(header);
+	mrkey_unref(self_public);
+	mrkey_unref(self_private);
+	return ret;
+}
+
+
+static void delete_files(const char* dir)
+{
+	/* delete the files in `dir` and `dir` itself, used for the temporary folders of the benchmarks */
+	DIR*           dir_handle;
+	struct dirent* dir_entry;
+	if( (dir_handle=opendir(dir))!=NULL ) {
+		while( (dir_entry=readdir(dir_handle))!=NULL ) {
+			if( strcmp(dir_entry->d_name, ".")!=0 && strcmp(dir_entry->d_name, "..")!=0 ) {
+				char* path_plus_name = mr_mprintf("%s/%s", dir, dir_entry->d_name);
+				unlink(path_plus_name);
+				free(path_plus_name);
+			}
+		}
+		closedir(dir_handle);
+	}
+	rmdir(dir);
+}
+
+
+/*
+ * Parse messages as done by the first stage of mrmailbox_receive_imf_batch(),
+ * used by the command "benchparse".  The parser is reused for all messages,
+ * attachments are written to a temporary folder that is deleted afterwards.
+ */
+static char* bench_parse(mrmailbox_t* mailbox, const char* spec, int loop_cnt)
+{
+	char*           ret = NULL;
+	char*           tmp_dir = NULL;
+	DIR*            dir = NULL;
+	struct dirent*  dir_entry;
+	mrimapfetched_t* msgs = NULL;
+	int             msgs_cnt = 0, msgs_alloc = 0, i, l, parts_cnt = 0, counted;
+	size_t          bytes = 0;
+	mrmimeparser_t* parser = NULL;
+	mallocstat_t    before, after;
+	struct timeval  start, end;
+
+	if( loop_cnt <= 0 ) {
+		loop_cnt = 1;
+	}
+
+	/* read all messages first, so that reading the files is not measured */
+	if( (dir=opendir(spec))==NULL ) {
+		ret = mr_mprintf("ERROR: Cannot open directory \"%s\".", spec);
+		goto cleanup;
+	}
+
+	while( (dir_entry=readdir(dir))!=NULL ) {
+		const char* name = dir_entry->d_name;
+		if( strlen(name)>=4 && strcmp(&name[strlen(name)-4], ".eml")==0 ) {
+			char*  path_plus_name = mr_mprintf("%s/%s", spec, name);
+			char*  data = NULL;
+			size_t data_bytes = 0;
+			if( mr_read_file(path_plus_name, (void**)&data, &data_bytes, mailbox) ) {
+				if( msgs_cnt >= msgs_alloc ) {
+					mrimapfetched_t* msgs_new;
+					msgs_alloc = MR_MAX(msgs_alloc*2, 16);
+					if( (msgs_new=realloc(msgs, sizeof(mrimapfetched_t)*msgs_alloc))==NULL ) {
+						exit(1);
+					}
+					msgs = msgs_new;
+				}
+				memset(&msgs[msgs_cnt], 0, sizeof(mrimapfetched_t));
+				msgs[msgs_cnt].m_imf_raw_not_terminated = data;
+				msgs[msgs_cnt].m_imf_raw_bytes = data_bytes;
+				bytes += data_bytes;
+				msgs_cnt++;
+			}
+			free(path_plus_name);
+		}
+	}
+
+	if( msgs_cnt == 0 ) {
+		ret = mr_mprintf("ERROR: No .eml-files in \"%s\".", spec);
+		goto cleanup;
+	}
+
+	tmp_dir = mr_mprintf("%s/benchparse.tmp", mailbox->m_blobdir);
+	if( !mr_create_folder(tmp_dir, mailbox) ) {
+		ret = mr_mprintf("ERROR: Cannot create \"%s\".", tmp_dir);
+		goto cleanup;
+	}
+
+	parser = mrmimeparser_new(tmp_dir, mailbox);
+
+	mallocstat_get(&before);
+	counted = mallocstat_enable(1);
+	gettimeofday(&start, NULL);
+		for( l = 0; l < loop_cnt; l++ ) {
+			for( i = 0; i < msgs_cnt; i++ ) {
+				mrmimeparser_parse(parser, msgs[i].m_imf_raw_not_terminated, msgs[i].m_imf_raw_bytes);
+				parts_cnt += carray_count(parser->m_parts);
+			}
+			mrmimeparser_empty(parser);
+		}
+	gettimeofday(&end, NULL);
+	mallocstat_enable(0);
+	mallocstat_get(&after);
+
+	mrmimeparser_unref(parser);
+
+	/* delete the written attachments */
+	delete_files(tmp_dir);
+
+	double ms = (end.tv_sec-start.tv_sec)*1000.0 + (end.tv_usec-start.tv_usec)/1000.0;
+	int    n = msgs_cnt*loop_cnt;
+	if( counted ) {
+		ret = mr_mprintf("%i messages (%i KB) parsed %i times in %.0f ms, %.1f parts, %.0f mallocs, %.0f reallocs, %.0f frees and %.0f KB requested per message, peak heap usage %.0f KB.",
+			msgs_cnt, (int)(bytes/1024), loop_cnt, ms, parts_cnt/(double)n,
+			(after.m_allocs-before.m_allocs)/(double)n, (after.m_reallocs-before.m_reallocs)/(double)n,
+			(after.m_frees-before.m_frees)/(double)n, (after.m_bytes-before.m_bytes)/1024.0/n,
+			(after.m_peak_bytes-before.m_in_use_bytes)/1024.0);
+	}
+	else {
+		ret = mr_mprintf("%i messages (%i KB) parsed %i times in %.0f ms, %.1f parts per message; mallocs are not counted, configure with -Dmallocstat=true on glibc to count them.",
+			msgs_cnt, (int)(bytes/1024), loop_cnt, ms, parts_cnt/(double)n);
+	}
+
+cleanup:
+	if( dir ) { closedir(dir); }
+	for( i = 0; i < msgs_cnt; i++ ) {
+		free((char*)msgs[i].m_imf_raw_not_terminated);
+	}
+	free(msgs);
+	free(tmp_dir);
+	return ret;
+}
+
+
+/*
+ * Measure the throughput of the base64 and quoted-printable codecs and of the
+ * UTF-8 validation for all implementations supported by the CPU and for
+ * libetpan, used by the command "benchcodec".
+ */
+static double mb_per_sec(size_t bytes, struct timeval* start, struct timeval* end)
+{
+	double sec = (end->tv_sec-start->tv_sec) + (end->tv_usec-start->tv_usec)/1000000.0;
+	return sec>0? bytes/(1024.0*1024.0)/sec : 0;
+}
+
+
+static char* bench_codec(int mb)
+{
+	size_t         binary_bytes = (size_t)(mb>0? mb : 8)*1024*1024, base64_bytes, qp_bytes = 0, i, consumed;
+	char*          binary = malloc(binary_bytes);
+	char*          base64 = NULL, *qp = NULL, *out = NULL;
+	int            impl, impl_used = mr_codec_get_impl(), impl_max = mr_codec_set_impl(MR_CODEC_AVX2);
+	struct timeval start, end;
+	mrstrbuilder_t ret;
+
+	mrstrbuilder_init(&ret, 0);
+	mrstrbuilder_catf(&ret, "%i MB of data, MB/s of the encoded side:\n", (int)(binary_bytes/(1024*1024)));
+
+	/* binary data for base64, some text with special characters for quoted-printable */
+	srand(1);
+	for( i = 0; i < binary_bytes; i++ ) { binary[i] = (char)rand(); }
+	base64 = mr_base64_encode(binary, binary_bytes, 76, "\r\n");
+	base64_bytes = strlen(base64);
+
+	qp = malloc(binary_bytes+4);
+	while( qp_bytes < binary_bytes ) {
+		const char* line = (rand()%4)? "Das ist ein ganz normaler Text mit Umlauten: =C3=A4=C3=B6=C3=BC und einem =3D Zeichen,=\r\n"
+		                             : "eine kurze Zeile.\r\n";
+		size_t line_bytes = strlen(line);
+		if( qp_bytes+line_bytes > binary_bytes ) { break; }
+		memcpy(qp+qp_bytes, line, line_bytes);
+		qp_bytes += line_bytes;
+	}
+
+	out = malloc(mr_qp_decode_bound(MR_MAX(base64_bytes, qp_bytes)));
+
+	for( impl = MR_CODEC_SCALAR; impl <= impl_max; impl++ )
+	{
+		char* encoded;
+		double enc, dec, qpdec;
+		mr_codec_set_impl(impl);
+
+		gettimeofday(&start, NULL);
+			encoded = mr_base64_encode(binary, binary_bytes, 76, "\r\n");
+		gettimeofday(&end, NULL);
+		enc = mb_per_sec(base64_bytes, &start, &end);
+		free(encoded);
+
+		gettimeofday(&start, NULL);
+			mr_base64_decode(base64, base64_bytes, 0, &consumed, out);
+		gettimeofday(&end, NULL);
+		dec = mb_per_sec(base64_bytes, &start, &end);
+
+		gettimeofday(&start, NULL);
+			mr_qp_decode(qp, qp_bytes, 0, &consumed, out);
+		gettimeofday(&end, NULL);
+		qpdec = mb_per_sec(qp_bytes, &start, &end);
+
+		mrstrbuilder_catf(&ret, "%-8s base64 encode %6.0f, base64 decode %6.0f, qp decode %6.0f\n", mr_codec_impl_name(impl), enc, dec, qpdec);
+	}
+
+	/* UTF-8 validation of mostly-ASCII text and of mixed-script text; the text is valid, so it is not changed by the runs */
+	{
+		static const char* latin[] = { "Das ist ein ganz normaler Text mit Umlauten: \xC3\xA4\xC3\xB6\xC3\xBC.\r\n", "A short line in English.\r\n" };
+		static const char* mixed[] = { "\xD0\x9F\xD1\x80\xD0\xB8\xD0\xB2\xD0\xB5\xD1\x82, \xD0\xBA\xD0\xB0\xD0\xBA \xD0\xB4\xD0\xB5\xD0\xBB\xD0\xB0?\r\n",
+		                               "\xE4\xBD\xA0\xE5\xA5\xBD\xEF\xBC\x8C\xE4\xB8\x96\xE7\x95\x8C\xE3\x80\x82\r\n",
+		                               "Gr\xC3\xBC\xC3\x9F\x65 \xF0\x9F\x98\x80 and some ASCII text.\r\n" };
+		char*  texts[2];
+		size_t texts_bytes = binary_bytes/2, t;
+		for( t = 0; t < 2; t++ ) {
+			size_t bytes = 0;
+			texts[t] = malloc(texts_bytes+1);
+			while( 1 ) {
+				const char* line = t==0? latin[rand()%4? 1 : 0] : mixed[rand()%3];
+				size_t line_bytes = strlen(line);
+				if( bytes+line_bytes > texts_bytes ) { break; }
+				memcpy(texts[t]+bytes, line, line_bytes);
+				bytes += line_bytes;
+			}
+			texts[t][bytes] = 0;
+		}
+
+		for( impl = MR_CODEC_SCALAR; impl <= impl_max; impl++ )
+		{
+			double utf8[2];
+			mr_codec_set_impl(impl);
+			for( t = 0; t < 2; t++ ) {
+				gettimeofday(&start, NULL);
+					mr_utf8_repair(texts[t]);
+				gettimeofday(&end, NULL);
+				utf8[t] = mb_per_sec(strlen(texts[t]), &start, &end);
+			}
+			mrstrbuilder_catf(&ret, "%-8s utf-8 validate latin %6.0f, mixed-script %6.0f\n", mr_codec_impl_name(impl), utf8[0], utf8[1]);
+		}
+
+		free(texts[0]);
+		free(texts[1]);
+	}
+
+	mr_codec_set_impl(impl_used);
+
+	/* libetpan, for comparison */
+	{
+		char*  encoded, *decoded = NULL, *broken;
+		size_t index = 0, decoded_bytes = 0;
+		double enc, dec, qpdec;
+
+		gettimeofday(&start, NULL);
+			encoded = encode_base64(binary, binary_bytes);
+			broken = mr_insert_breaks(encoded, 76, "\r\n");
+		gettimeofday(&end, NULL);
+		enc = mb_per_sec(base64_bytes, &start, &end);
+		free(encoded);
+		free(broken);
+
+		gettimeofday(&start, NULL);
+			mailmime_base64_body_parse(base64, base64_bytes, &index, &decoded, &decoded_bytes);
+		gettimeofday(&end, NULL);
+		dec = mb_per_sec(base64_bytes, &start, &end);
+		if( decoded ) { mmap_string_unref(decoded); decoded = NULL; }
+
+		index = 0;
+		gettimeofday(&start, NULL);
+			mailmime_quoted_printable_body_parse(qp, qp_bytes, &index, &decoded, &decoded_bytes, 0);
+		gettimeofday(&end, NULL);
+		qpdec = mb_per_sec(qp_bytes, &start, &end);
+		if( decoded ) { mmap_string_unref(decoded); }
+
+		mrstrbuilder_catf(&ret, "%-8s base64 encode %6.0f, base64 decode %6.0f, qp decode %6.0f\n", "libetpan", enc, dec, qpdec);
+	}
+
+	mrstrbuilder_catf(&ret, "Used implementation: %s", mr_codec_impl_name(impl_used));
+
+	free(out);
+	free(qp);
+	free(base64);
+	free(binary);
+	return ret.m_buf;
+}
+
+
+/*
+ * Write a synthetic corpus generated by mockcorpus_t to a folder, used by the
+ * command "gencorpus".  The messages are addressed to the configured address;
+ * encrypted messages are encrypted to the self-key, so they can be received
+ * using "poke".
+ */
+#define CORPUS_START_TIMESTAMP 1500000000 /* fixed, so that a corpus can be regenerated identically */
+
+
+static char* gen_corpus(mrmailbox_t* mailbox, const char* dir, int msg_cnt, uint32_t seed, const char* mix)
+{
+	mockcorpus_t* corpus = NULL;
+	char*         self_addr = mrmailbox_get_config(mailbox, "configured_addr", "me@corpus.example");
+	char*         msg = NULL, *path = NULL, *ret = NULL;
+	int           i, kind, kind_cnt[MOCKCORPUS_KINDS];
+	size_t        bytes = 0;
+
+	memset(kind_cnt, 0, sizeof(kind_cnt));
+
+	mrmailbox_ensure_secret_key_exists(mailbox); /* needed for encrypted messages, fails silently if the mailbox is not configured */
+
+	if( msg_cnt <= 0 ) {
+		ret = safe_strdup("ERROR: Bad <msg-cnt>.");
+		goto cleanup;
+	}
+
+	if( (corpus=mockcorpus_new(mailbox, self_addr, seed, mix))==NULL ) {
+		ret = safe_strdup("ERROR: Bad <mix> or no self-key for encrypted messages.");
+		goto cleanup;
+	}
+
+	if( !mr_create_folder(dir, mailbox) ) {
+		ret = mr_mprintf("ERROR: Cannot create \"%s\".", dir);
+		goto cleanup;
+	}
+
+	for( i = 0; i < msg_cnt; i++ ) {
+		msg = mockcorpus_render(corpus, i, CORPUS_START_TIMESTAMP+i*60, &kind);
+		path = mr_mprintf("%s/%06i.eml", dir, i);
+		if( !mr_write_file(path, msg, strlen(msg), mailbox) ) {
+			ret = mr_mprintf("ERROR: Cannot write \"%s\".", path);
+			goto cleanup;
+		}
+		kind_cnt[kind]++;
+		bytes += strlen(msg);
+		free(msg);  msg = NULL;
+		free(path); path = NULL;
+	}
+
+	{
+		mrstrbuilder_t strbuilder;
+		mrstrbuilder_init(&strbuilder, 0);
+		mrstrbuilder_catf(&strbuilder, "%i messages (%i KB) for %s written to \"%s\":", msg_cnt, (int)(bytes/1024), self_addr, dir);
+		for( i = 0; i < MOCKCORPUS_KINDS; i++ ) {
+			mrstrbuilder_catf(&strbuilder, " %i %s%s", kind_cnt[i], mockcorpus_get_kind_name(i), i<MOCKCORPUS_KINDS-1? "," : ".");
+		}
+		ret = strbuilder.m_buf;
+	}
+
+cleanup:
+	mockcorpus_unref(corpus);
+	free(msg);
+	free(path);
+	free(self_addr);
+	return ret;
+}
+
+
+/*
+ * Receive a synthetic corpus by mrmailbox_receive_imf(), used by the command
+ * "benchreceive".  The messages are received by a temporary mailbox, so the
+ * opened mailbox is not changed.  The time taken by the stages of receiving
+ * is taken from the statistics shown by mrmailbox_get_info().
+ */
+static uintptr_t bench_receive_event(mrmailbox_t* mailbox, int event, uintptr_t data1, uintptr_t data2)
+{
+	return 0; /* the benchmark is not slowed down by logging */
+}
+
+
+static char* bench_receive(mrmailbox_t* mailbox, int msg_cnt, uint32_t seed, const char* mix)
+{
+	mrmailbox_t*    tmp_mailbox = mrmailbox_new(bench_receive_event, NULL, "cmdline");
+	mockcorpus_t*   corpus = NULL;
+	char*           tmp_dir = mr_mprintf("%s/benchreceive.tmp", mailbox->m_blobdir), *tmp_db = mr_mprintf("%s/db.sqlite", tmp_dir);
+	char*           tmp_blobdir = mr_mprintf("%s/blobs", tmp_dir), *ret = NULL;
+	char**          msgs = NULL;
+	int             i, kind_cnt[MOCKCORPUS_KINDS];
+	size_t          bytes = 0;
+	struct timeval  start, end;
+
+	memset(kind_cnt, 0, sizeof(kind_cnt));
+
+	if( msg_cnt <= 0 || (msgs=calloc(msg_cnt, sizeof(char*)))==NULL ) {
+		ret = safe_strdup("ERROR: Bad <msg-cnt>.");
+		goto cleanup;
+	}
+
+	/* set up the temporary mailbox and generate the messages; this is not part of the measured operation */
+	if( !mr_create_folder(tmp_dir, mailbox) || !mr_create_folder(tmp_blobdir, mailbox) || !mrmailbox_open(tmp_mailbox, tmp_db, tmp_blobdir) ) {
+		ret = mr_mprintf("ERROR: Cannot create a mailbox in \"%s\".", tmp_dir);
+		goto cleanup;
+	}
+	mrmailbox_set_config(tmp_mailbox, "configured_addr", "me@corpus.example");
+	mrmailbox_set_config_int(tmp_mailbox, "configured", 1);
+	mrmailbox_ensure_secret_key_exists(tmp_mailbox);
+
+	if( (corpus=mockcorpus_new(tmp_mailbox, "me@corpus.example", seed, mix))==NULL ) {
+		ret = safe_strdup("ERROR: Bad <mix>.");
+		goto cleanup;
+	}
+
+	for( i = 0; i < msg_cnt; i++ ) {
+		int kind;
+		msgs[i] = mockcorpus_render(corpus, i, CORPUS_START_TIMESTAMP+i*60, &kind);
+		kind_cnt[kind]++;
+		bytes += strlen(msgs[i]);
+	}
+
+	gettimeofday(&start, NULL);
+		for( i = 0; i < msg_cnt; i++ ) {
+			mrmailbox_receive_imf(tmp_mailbox, msgs[i], strlen(msgs[i]), "INBOX", i+1, 0);
+		}
+	gettimeofday(&end, NULL);
+
+	{
+		double         ms = (end.tv_sec-start.tv_sec)*1000.0 + (end.tv_usec-start.tv_usec)/1000.0;
+		mrstrbuilder_t strbuilder;
+		mrstrbuilder_init(&strbuilder, 0);
+		mrstrbuilder_catf(&strbuilder, "%i messages (%i KB) received in %.0f ms, %.0f messages/s; per message %.3f ms parsing, %.3f ms decrypting, %.3f ms simplifying, %.3f ms database. Corpus:",
+			msg_cnt, (int)(bytes/1024), ms, msg_cnt*1000.0/(ms>0? ms : 1),
+			tmp_mailbox->m_receive_parse_us/1000.0/msg_cnt, tmp_mailbox->m_receive_decrypt_us/1000.0/msg_cnt,
+			tmp_mailbox->m_receive_simplify_us/1000.0/msg_cnt, tmp_mailbox->m_receive_apply_us/1000.0/msg_cnt);
+		for( i = 0; i < MOCKCORPUS_KINDS; i++ ) {
+			mrstrbuilder_catf(&strbuilder, " %i %s%s", kind_cnt[i], mockcorpus_get_kind_name(i), i<MOCKCORPUS_KINDS-1? "," : ".");
+		}
+		ret = strbuilder.m_buf;
+	}
+
+cleanup:
+	mockcorpus_unref(corpus);
+	mrmailbox_close(tmp_mailbox);
+	mrmailbox_unref(tmp_mailbox);
+	delete_files(tmp_blobdir);
+	delete_files(tmp_dir);
+	for( i = 0; msgs && i < msg_cnt; i++ ) {
+		free(msgs[i]);
+	}
+	free(msgs);
+	free(tmp_blobdir);
+	free(tmp_db);
+	free(tmp_dir);
+	return ret;
+}
+
+
 /*
  * Reset database tables. This function is called from Core cmdline.
  *
@@ -52,16 +1030,19 @@ int mrmailbox_reset_tables(mrmailbox_t* ths, int bits)
 
 		if( bits & 1 ) {
 			mrsqlite3_execute__(ths->m_sql, "DELETE FROM jobs;");
+			mrjob_clear_queues(ths);
 			mrmailbox_log_info(ths, 0, "(1) Jobs reset.");
 		}
 
 		if( bits & 2 ) {
 			mrsqlite3_execute__(ths->m_sql, "DELETE FROM acpeerstates;");
+			mrapeerstate_clear_cache__(ths);
 			mrmailbox_log_info(ths, 0, "(2) Peerstates reset.");
 		}
 
 		if( bits & 4 ) {
 			mrsqlite3_execute__(ths->m_sql, "DELETE FROM keypairs;");
+			mrkeyring_clear_self_cache__(ths);
 			mrmailbox_log_info(ths, 0, "(4) Private keypairs reset.");
 		}
 
@@ -72,6 +1053,7 @@ int mrmailbox_reset_tables(mrmailbox_t* ths, int bits)
 			mrsqlite3_execute__(ths->m_sql, "DELETE FROM msgs WHERE id>" MR_STRINGIFY(MR_MSG_ID_LAST_SPECIAL) ";");
 			mrsqlite3_execute__(ths->m_sql, "DELETE FROM config WHERE keyname LIKE 'imap.%' OR keyname LIKE 'configured%';");
 			mrsqlite3_execute__(ths->m_sql, "DELETE FROM leftgrps;");
+			mrmailbox_clear_contact_cache__(ths);
 			mrmailbox_log_info(ths, 0, "(8) Rest but server config reset.");
 		}
 
@@ -256,17 +1238,40 @@ static int poke_spec(mrmailbox_t* mailbox, const char* spec)
 			goto cleanup;
 		}
 
+		/* the files are read first and then given to mrmailbox_receive_imf_batch() as if they were fetched by one IMAP command */
+		mrimapfetched_t* msgs = NULL;
+		int              msgs_alloc = 0, i;
 		while( (dir_entry=readdir(dir))!=NULL ) {
 			name = dir_entry->d_name; /* name without path; may also be `.` or `..` */
 			if( strlen(name)>=4 && strcmp(&name[strlen(name)-4], ".eml")==0 ) {
-				char* path_plus_name = mr_mprintf("%s/%s", real_spec, name);
+				char*  path_plus_name = mr_mprintf("%s/%s", real_spec, name);
+				char*  data = NULL;
+				size_t data_bytes = 0;
 				mrmailbox_log_info(mailbox, 0, "Import: %s", path_plus_name);
-				if( mrmailbox_poke_eml_file(mailbox, path_plus_name) ) { /* no abort on single errors errors are logged in any case */
+				if( mr_read_file(path_plus_name, (void**)&data, &data_bytes, mailbox) ) { /* no abort on single errors errors are logged in any case */
+					if( read_cnt >= msgs_alloc ) {
+						mrimapfetched_t* msgs_new;
+						msgs_alloc = MR_MAX(msgs_alloc*2, 16);
+						if( (msgs_new=realloc(msgs, sizeof(mrimapfetched_t)*msgs_alloc))==NULL ) {
+							exit(1);
+						}
+						msgs = msgs_new;
+					}
+					memset(&msgs[read_cnt], 0, sizeof(mrimapfetched_t));
+					msgs[read_cnt].m_imf_raw_not_terminated = data;
+					msgs[read_cnt].m_imf_raw_bytes = data_bytes;
 					read_cnt++;
 				}
 				free(path_plus_name);
             }
 		}
+
+		mrmailbox_receive_imf_batch(mailbox, msgs, read_cnt, "import");
+
+		for( i = 0; i < read_cnt; i++ ) {
+			free((char*)msgs[i].m_imf_raw_not_terminated);
+		}
+		free(msgs);
 	}
 
 	mrmailbox_log_info(mailbox, 0, "Import: %i items read from \"%s\".", read_cnt, real_spec);
@@ -438,6 +1443,18 @@ char* mrmailbox_cmdline(mrmailbox_t* mailbox, const char* cmdline)
 				"import-keys\n"
 				"export-setup\n"
 				"poke [<eml-file>|<folder>|<addr> <key-file>]\n"
+				"benchimap <msg-cnt> [<latency-ms>]\n"
+				"benchmarkseen <msg-cnt> [<latency-ms>]\n"
+				"benchcontacts <lookup-cnt> [<addr-cnt>]\n"
+				"preparekeys <cnt> [<max-threads>]\n"
+				"provision <dir> <cnt>\n"
+				"benchencrypt [<rcpt-cnt>] [<msg-cnt>]\n"
+				"benchparam <loop-cnt>\n"
+				"benchhash <loop-cnt>\n"
+				"benchparse <folder> [<loop-cnt>]\n"
+				"benchcodec [<mb>]\n"
+				"gencorpus <folder> <msg-cnt> [<seed>] [<mix>]\n"
+				"benchreceive <msg-cnt> [<seed>] [<mix>]\n"
 				"reset <flags>\n"
 				"============================================="
 			);
@@ -460,6 +1477,7 @@ char* mrmailbox_cmdline(mrmailbox_t* mailbox, const char* cmdline)
 				"listchats [<query>]\n"
 				"listarchived\n"
 				"chat [<chat-id>|0]\n"
+				"chatwindow <anchor-msg-id>|0 <cnt>\n"
 				"createchat <contact-id>\n"
 				"createchatbymsg <msg-id>\n"
 				"creategroup <name>\n"
@@ -479,6 +1497,7 @@ char* mrmailbox_cmdline(mrmailbox_t* mailbox, const char* cmdline)
 				"delchat <chat-id>\n"
 				"===========================Message commands==\n"
 				"listmsgs <query>\n"
+				"benchsearch <query>\n"
 				"msginfo <msg-id>\n"
 				"listfresh\n"
 				"forward <msg-id> <chat-id>\n"
@@ -647,6 +1666,138 @@ char* mrmailbox_cmdline(mrmailbox_t* mailbox, const char* cmdline)
 			ret = safe_strdup("ERROR: Argument <bits> missing: 1=jobs, 2=peerstates, 4=private keys, 8=rest but server config");
 		}
 	}
+	else if( strcmp(cmd, "benchimap")==0 )
+	{
+		if( arg1 ) {
+			char* arg2 = strchr(arg1, ' ');
+			int   msg_cnt = atoi(arg1), latency_ms = arg2? atoi(arg2) : 0;
+			char* single = bench_imap(mailbox, msg_cnt, latency_ms, "1"); /* one message per command as before batching */
+			char* batched = bench_imap(mailbox, msg_cnt, latency_ms, NULL);
+			ret = mr_mprintf("%s\n%s", single, batched);
+			free(single);
+			free(batched);
+		}
+		else {
+			ret = safe_strdup("ERROR: Argument <msg-cnt> missing.");
+		}
+	}
+	else if( strcmp(cmd, "benchmarkseen")==0 )
+	{
+		if( arg1 ) {
+			char* arg2 = strchr(arg1, ' ');
+			int   msg_cnt = atoi(arg1), latency_ms = arg2? atoi(arg2) : 0;
+			char* single = bench_markseen(mailbox, msg_cnt, latency_ms, 0);
+			char* batched = bench_markseen(mailbox, msg_cnt, latency_ms, 1);
+			ret = mr_mprintf("%s\n%s", single, batched);
+			free(single);
+			free(batched);
+		}
+		else {
+			ret = safe_strdup("ERROR: Argument <msg-cnt> missing.");
+		}
+	}
+	else if( strcmp(cmd, "benchcontacts")==0 )
+	{
+		if( arg1 ) {
+			char* arg2 = strchr(arg1, ' ');
+			int   lookup_cnt = atoi(arg1), addr_cnt = arg2? atoi(arg2) : 500;
+			char* uncached = bench_contacts(mailbox, lookup_cnt, addr_cnt, 0);
+			char* cached = bench_contacts(mailbox, lookup_cnt, addr_cnt, 1);
+			ret = mr_mprintf("%s\n%s", uncached, cached);
+			free(uncached);
+			free(cached);
+		}
+		else {
+			ret = safe_strdup("ERROR: Argument <lookup-cnt> missing.");
+		}
+	}
+	else if( strcmp(cmd, "preparekeys")==0 )
+	{
+		if( arg1 ) {
+			char* arg2 = strchr(arg1, ' ');
+			mrmailbox_prepare_keypairs(mailbox, atoi(arg1), arg2? atoi(arg2) : 0);
+			ret = COMMAND_SUCCEEDED;
+		}
+		else {
+			ret = safe_strdup("ERROR: Argument <cnt> missing.");
+		}
+	}
+	else if( strcmp(cmd, "provision")==0 )
+	{
+		char* arg2 = arg1? strchr(arg1, ' ') : NULL;
+		if( arg2 ) {
+			*arg2 = 0; arg2++;
+			ret = provision(mailbox, arg1, atoi(arg2));
+		}
+		else {
+			ret = safe_strdup("ERROR: Arguments <dir> <cnt> expected.");
+		}
+	}
+	else if( strcmp(cmd, "benchencrypt")==0 )
+	{
+		char* arg2 = arg1? strchr(arg1, ' ') : NULL;
+		ret = bench_encrypt(mailbox, arg1? atoi(arg1) : 0, arg2? atoi(arg2) : 0);
+	}
+	else if( strcmp(cmd, "benchparam")==0 )
+	{
+		if( arg1 ) {
+			ret = bench_param(atoi(arg1));
+		}
+		else {
+			ret = safe_strdup("ERROR: Argument <loop-cnt> missing.");
+		}
+	}
+	else if( strcmp(cmd, "benchhash")==0 )
+	{
+		if( arg1 ) {
+			ret = bench_hash(atoi(arg1));
+		}
+		else {
+			ret = safe_strdup("ERROR: Argument <loop-cnt> missing.");
+		}
+	}
+	else if( strcmp(cmd, "benchparse")==0 )
+	{
+		if( arg1 ) {
+			char* arg2 = strchr(arg1, ' ');
+			if( arg2 ) {
+				*arg2 = 0;
+				arg2++;
+			}
+			ret = bench_parse(mailbox, arg1, arg2? atoi(arg2) : 1);
+		}
+		else {
+			ret = safe_strdup("ERROR: Argument <folder> missing.");
+		}
+	}
+	else if( strcmp(cmd, "benchcodec")==0 )
+	{
+		ret = bench_codec(arg1? atoi(arg1) : 0);
+	}
+	else if( strcmp(cmd, "gencorpus")==0 )
+	{
+		char folder[256] = "", mix[256] = "";
+		int  msg_cnt = 0;
+		unsigned int seed = 0;
+		if( arg1 && sscanf(arg1, "%255s %i %u %255s", folder, &msg_cnt, &seed, mix) >= 2 ) {
+			ret = gen_corpus(mailbox, folder, msg_cnt, seed, mix[0]? mix : NULL);
+		}
+		else {
+			ret = safe_strdup("ERROR: Arguments <folder> <msg-cnt> expected.");
+		}
+	}
+	else if( strcmp(cmd, "benchreceive")==0 )
+	{
+		char mix[256] = "";
+		int  msg_cnt = 0;
+		unsigned int seed = 0;
+		if( arg1 && sscanf(arg1, "%i %u %255s", &msg_cnt, &seed, mix) >= 1 ) {
+			ret = bench_receive(mailbox, msg_cnt, seed, mix[0]? mix : NULL);
+		}
+		else {
+			ret = safe_strdup("ERROR: Argument <msg-cnt> missing.");
+		}
+	}
 	else if( strcmp(cmd, "set")==0 )
 	{
 		if( arg1 ) {
@@ -787,6 +1938,31 @@ char* mrmailbox_cmdline(mrmailbox_t* mailbox, const char* cmdline)
 			ret = safe_strdup("No chat selected.");
 		}
 	}
+	else if( strcmp(cmd, "chatwindow")==0 )
+	{
+		if( sel_chat ) {
+			char* arg2 = arg1? strchr(arg1, ' ') : NULL;
+			if( arg2 ) {
+				*arg2 = 0;
+				arg2++;
+				mrarray_t* msglist = mrmailbox_get_chat_msgs_window(mailbox, mrchat_get_id(sel_chat), MR_GCM_ADDDAYMARKER, 0, atoi(arg1), atoi(arg2));
+				if( msglist ) {
+					log_msglist(mailbox, msglist);
+					ret = mr_mprintf("%i items.", (int)mrarray_get_cnt(msglist));
+					mrarray_unref(msglist);
+				}
+				else {
+					ret = COMMAND_FAILED;
+				}
+			}
+			else {
+				ret = safe_strdup("ERROR: Arguments <anchor-msg-id> <cnt> expected.");
+			}
+		}
+		else {
+			ret = safe_strdup("No chat selected.");
+		}
+	}
 	else if( strcmp(cmd, "createchat")==0 )
 	{
 		if( arg1 ) {
@@ -987,6 +2163,60 @@ char* mrmailbox_cmdline(mrmailbox_t* mailbox, const char* cmdline)
 			ret = safe_strdup("ERROR: Argument <query> missing.");
 		}
 	}
+	else if( strcmp(cmd, "benchsearch")==0 )
+	{
+		/* compare the full-text index used by mrmailbox_search_msgs() with the former LIKE-search over all messages */
+		#define BENCH_ROUNDS 10
+		if( arg1 && arg1[0] ) {
+			int        i, fts_cnt = 0, like_cnt = 0;
+			clock_t    start;
+			double     fts_ms, like_ms;
+			char*      strLikeInText = mr_mprintf("%%%s%%", arg1);
+
+			start = clock();
+			for( i = 0; i < BENCH_ROUNDS; i++ ) {
+				mrarray_t* msglist = mrmailbox_search_msgs(mailbox, 0, arg1);
+				fts_cnt = (int)mrarray_get_cnt(msglist);
+				if( i == 0 ) {
+					int j;
+					for( j = 0; j < fts_cnt && j < 5; j++ ) {
+						char* snippet = mrmailbox_get_msg_search_snippet(mailbox, mrarray_get_id(msglist, j), arg1, "[", "]");
+						mrmailbox_log_info(mailbox, 0, "Msg#%i: %s", (int)mrarray_get_id(msglist, j), snippet? snippet : "(no snippet)");
+						free(snippet);
+					}
+				}
+				mrarray_unref(msglist);
+			}
+			fts_ms = (double)(clock()-start)*1000.0/CLOCKS_PER_SEC/BENCH_ROUNDS;
+
+			start = clock();
+			mrsqlite3_lock(mailbox->m_sql);
+				for( i = 0; i < BENCH_ROUNDS; i++ ) {
+					sqlite3_stmt* stmt = mrsqlite3_prepare_v2_(mailbox->m_sql,
+						"SELECT m.id FROM msgs m"
+						" LEFT JOIN contacts ct ON m.from_id=ct.id"
+						" LEFT JOIN chats c ON m.chat_id=c.id"
+						" WHERE m.chat_id>" MR_STRINGIFY(MR_CHAT_ID_LAST_SPECIAL) " AND m.hidden=0 AND c.blocked=0"
+						" AND ct.blocked=0 AND m.txt LIKE ?"
+						" ORDER BY m.timestamp DESC,m.id DESC;");
+					sqlite3_bind_text(stmt, 1, strLikeInText, -1, SQLITE_STATIC);
+					like_cnt = 0;
+					while( sqlite3_step(stmt) == SQLITE_ROW ) {
+						like_cnt++;
+					}
+					sqlite3_finalize(stmt);
+				}
+			mrsqlite3_unlock(mailbox->m_sql);
+			like_ms = (double)(clock()-start)*1000.0/CLOCKS_PER_SEC/BENCH_ROUNDS;
+
+			ret = mr_mprintf("Full-text index%s: %i messages in %.3f ms, LIKE: %i messages in %.3f ms (average of %i searches).",
+				mailbox->m_sql->m_has_fts? "" : " (not available, LIKE used)", fts_cnt, fts_ms, like_cnt, like_ms, BENCH_ROUNDS);
+			free(strLikeInText);
+		}
+		else {
+			ret = safe_strdup("ERROR: Argument <query> missing.");
+		}
+	}
 	else if( strcmp(cmd, "draft")==0 )
 	{
 		if( sel_chat ) {
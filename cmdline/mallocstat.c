@@ -0,0 +1,141 @@
+/*******************************************************************************
+ *
+ *                              Delta Chat Core
+ *                      Copyright (C) 2017 Björn Petersen
+ *                   Contact: r10s@b44t.com, http://b44t.com
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see http://www.gnu.org/licenses/ .
+ *
+ ******************************************************************************/
+
+
+
+#include <stdlib.h>
+#include <string.h>
+#include "mallocstat.h"
+
+
+static mallocstat_t s_stat;
+
+
+#if defined(MR_MALLOCSTAT) && defined(__GLIBC__)
+
+
+static int s_enabled = 0;
+
+
+/* glibc allows replacing the allocator by defining the functions in the program,
+the original implementation stays available under the __libc_ names */
+extern void* __libc_malloc  (size_t);
+extern void* __libc_calloc  (size_t, size_t);
+extern void* __libc_realloc (void*, size_t);
+extern void  __libc_free    (void*);
+extern size_t malloc_usable_size (void*);
+
+
+static void add_in_use(long bytes)
+{
+	long in_use = __sync_add_and_fetch(&s_stat.m_in_use_bytes, bytes);
+	if( s_enabled && in_use > s_stat.m_peak_bytes ) {
+		s_stat.m_peak_bytes = in_use;
+	}
+}
+
+
+void* malloc(size_t bytes)
+{
+	void* ptr;
+	if( s_enabled ) {
+		__sync_fetch_and_add(&s_stat.m_allocs, 1);
+		__sync_fetch_and_add(&s_stat.m_bytes, bytes);
+	}
+	if( (ptr=__libc_malloc(bytes))!=NULL ) {
+		add_in_use(malloc_usable_size(ptr));
+	}
+	return ptr;
+}
+
+
+void* calloc(size_t cnt, size_t bytes)
+{
+	void* ptr;
+	if( s_enabled ) {
+		__sync_fetch_and_add(&s_stat.m_allocs, 1);
+		__sync_fetch_and_add(&s_stat.m_bytes, cnt*bytes);
+	}
+	if( (ptr=__libc_calloc(cnt, bytes))!=NULL ) {
+		add_in_use(malloc_usable_size(ptr));
+	}
+	return ptr;
+}
+
+
+void* realloc(void* ptr, size_t bytes)
+{
+	long  old_bytes = ptr? (long)malloc_usable_size(ptr) : 0;
+	void* ret;
+	if( s_enabled ) {
+		__sync_fetch_and_add(ptr? &s_stat.m_reallocs : &s_stat.m_allocs, 1);
+		__sync_fetch_and_add(&s_stat.m_bytes, bytes);
+	}
+	if( (ret=__libc_realloc(ptr, bytes))!=NULL ) {
+		add_in_use((long)malloc_usable_size(ret) - old_bytes);
+	}
+	else if( bytes==0 ) {
+		add_in_use(-old_bytes); /* realloc(ptr, 0) may free the pointer */
+	}
+	return ret;
+}
+
+
+void free(void* ptr)
+{
+	if( ptr ) {
+		if( s_enabled ) {
+			__sync_fetch_and_add(&s_stat.m_frees, 1);
+		}
+		add_in_use(-(long)malloc_usable_size(ptr));
+	}
+	__libc_free(ptr);
+}
+
+
+int mallocstat_enable(int enable)
+{
+	if( enable ) {
+		s_stat.m_peak_bytes = s_stat.m_in_use_bytes;
+	}
+	s_enabled = enable;
+	return 1;
+}
+
+
+#else
+
+
+int mallocstat_enable(int enable)
+{
+	return 0;
+}
+
+
+#endif
+
+
+void mallocstat_get(mallocstat_t* ret)
+{
+	if( ret ) {
+		memcpy(ret, &s_stat, sizeof(mallocstat_t));
+	}
+}
@@ -0,0 +1,56 @@
+/*******************************************************************************
+ *
+ *                              Delta Chat Core
+ *                      Copyright (C) 2017 Björn Petersen
+ *                   Contact: r10s@b44t.com, http://b44t.com
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see http://www.gnu.org/licenses/ .
+ *
+ ******************************************************************************/
+
+
+
+
+#ifndef __MALLOCSTAT_H__
+#define __MALLOCSTAT_H__
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/* Counting wrappers around malloc(), calloc(), realloc() and free(), used by
+benchmark commands such as benchparse to report the number of heap operations.
+Counting is off until mallocstat_enable() is called.  As the wrappers replace
+the allocator of the whole program, they are compiled in only if MR_MALLOCSTAT
+is defined, see the meson option `mallocstat`; without it or if the C library
+does not allow to replace the allocator, mallocstat_enable() returns 0 and
+nothing is counted. */
+typedef struct mallocstat_t
+{
+	unsigned long m_allocs;       /* calls to malloc(), calloc() and realloc() with a NULL pointer */
+	unsigned long m_reallocs;     /* calls to realloc() with an existing pointer */
+	unsigned long m_frees;        /* calls to free() with a non-NULL pointer */
+	unsigned long m_bytes;        /* bytes requested by all calls */
+	long          m_in_use_bytes; /* bytes currently allocated, counted also while counting is off */
+	long          m_peak_bytes;   /* max. of m_in_use_bytes since counting was enabled */
+} mallocstat_t;
+
+int  mallocstat_enable   (int enable);
+void mallocstat_get      (mallocstat_t*);
+
+
+#ifdef __cplusplus
+} /* /extern "C" */
+#endif
+#endif /* __MALLOCSTAT_H__ */
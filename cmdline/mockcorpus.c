@@ -0,0 +1,619 @@
+/*******************************************************************************
+ *
+ *                              Delta Chat Core
+ *                      Copyright (C) 2017 Björn Petersen
+ *                   Contact: r10s@b44t.com, http://b44t.com
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see http://www.gnu.org/licenses/ .
+ *
+ ******************************************************************************/
+
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../src/mrmailbox_internal.h"
+#include "../src/mrapeerstate.h"
+#include "../src/mraheader.h"
+#include "../src/mrkey.h"
+#include "../src/mrkeyring.h"
+#include "../src/mrpgp.h"
+#include "../src/mrcodec.h"
+#include "mockcorpus.h"
+
+
+#define MOCKCORPUS_KEYED_SENDERS 2 /* sender0 and sender1 have keys and send the encrypted messages */
+
+
+struct mockcorpus_t
+{
+	uint32_t       m_seed;
+	int            m_weights[MOCKCORPUS_KINDS];
+	int            m_weight_sum;
+	int            m_sender_cnt;
+	int            m_group_cnt;
+	int            m_attachment_bytes;
+	char*          m_recipient_addr;
+
+	mrmailbox_t*   m_mailbox;
+	mrkey_t*       m_sender_private[MOCKCORPUS_KEYED_SENDERS];
+	mrkeyring_t*   m_encrypt_to[MOCKCORPUS_KEYED_SENDERS];   /* the recipient and the sender itself, as done by mrmailbox_e2ee_encrypt() */
+	char*          m_autocrypt[MOCKCORPUS_KEYED_SENDERS];    /* folded Autocrypt-header of the senders */
+	char*          m_gossip[MOCKCORPUS_KEYED_SENDERS+1];     /* folded Autocrypt-Gossip-header of the senders and of the recipient */
+};
+
+
+static const char* s_kind_names[MOCKCORPUS_KINDS] = { "plain", "html", "multipart", "encrypted", "group", "mdn", "attachment", "list" };
+
+
+static const char* s_words[] = { "hello", "world", "meeting", "tomorrow", "lunch", "where", "are", "you", "the", "a", "see", "later",
+	"photo", "nice", "thanks", "ok", "maybe", "weekend", "train", "late", "coffee", "call", "me", "when", "ready", "Grüße", "ça", "va" };
+
+
+static uint32_t rnd(uint32_t* state, uint32_t max)
+{
+	/* xorshift32, we need reproducible numbers, not good ones */
+	*state ^= *state << 13;
+	*state ^= *state >> 17;
+	*state ^= *state << 5;
+	return *state % max;
+}
+
+
+static void cat_words(mrstrbuilder_t* strbuilder, uint32_t* state, int cnt)
+{
+	int i;
+	for( i = 0; i < cnt; i++ ) {
+		mrstrbuilder_cat(strbuilder, i? " " : "");
+		mrstrbuilder_cat(strbuilder, s_words[rnd(state, sizeof(s_words)/sizeof(s_words[0]))]);
+	}
+}
+
+
+static void cat_qp(mrstrbuilder_t* strbuilder, const char* text)
+{
+	/* encode `text` as quoted-printable, line ends in `text` are kept */
+	char buf[8];
+	int  line_len = 0;
+	for( ; *text; text++ ) {
+		unsigned char c = (unsigned char)*text;
+		if( c=='\r' || c=='\n' ) {
+			buf[0] = c; buf[1] = 0;
+			line_len = 0;
+		}
+		else if( c>=128 || c=='=' ) {
+			snprintf(buf, sizeof(buf), "=%02X", c);
+		}
+		else {
+			buf[0] = c; buf[1] = 0;
+		}
+
+		if( line_len+strlen(buf) > 75 ) {
+			mrstrbuilder_cat(strbuilder, "=\r\n");
+			line_len = 0;
+		}
+		mrstrbuilder_cat(strbuilder, buf);
+		if( c!='\r' && c!='\n' ) {
+			line_len += strlen(buf);
+		}
+	}
+}
+
+
+static char* render_aheader(const char* addr, const mrkey_t* public_key, int prefer_encrypt)
+{
+	/* mraheader_render() inserts a space every 78 characters of the key, the header is folded there */
+	mraheader_t*   aheader = mraheader_new();
+	char*          rendered, *p;
+	mrstrbuilder_t ret;
+	mrstrbuilder_init(&ret, 0);
+
+	aheader->m_addr = safe_strdup(addr);
+	mrkey_set_from_key(aheader->m_public_key, public_key);
+	aheader->m_prefer_encrypt = prefer_encrypt;
+	if( (rendered=mraheader_render(aheader))!=NULL && (p=strstr(rendered, "keydata= "))!=NULL ) {
+		p[8] = 0;
+		mrstrbuilder_cat(&ret, rendered);
+		for( p = strtok(&p[9], " "); p; p = strtok(NULL, " ") ) {
+			mrstrbuilder_cat(&ret, "\r\n ");
+			mrstrbuilder_cat(&ret, p);
+		}
+	}
+
+	free(rendered);
+	mraheader_unref(aheader);
+	return ret.m_buf;
+}
+
+
+static int create_keys(mockcorpus_t* ths)
+{
+	int      success = 0, i;
+	mrkey_t* recipient_public = mrkey_new(), *sender_public = NULL;
+	char*    addr = NULL;
+
+	if( ths->m_mailbox == NULL ) {
+		goto cleanup;
+	}
+
+	mrsqlite3_lock(ths->m_mailbox->m_sql);
+		mrkey_load_self_public__(recipient_public, ths->m_recipient_addr, ths->m_mailbox->m_sql);
+	mrsqlite3_unlock(ths->m_mailbox->m_sql);
+	if( recipient_public->m_binary == NULL ) {
+		goto cleanup;
+	}
+	ths->m_gossip[MOCKCORPUS_KEYED_SENDERS] = render_aheader(ths->m_recipient_addr, recipient_public, MRA_PE_NOPREFERENCE);
+
+	for( i = 0; i < MOCKCORPUS_KEYED_SENDERS; i++ ) {
+		free(addr);
+		addr = mockcorpus_get_sender_addr(ths, i);
+		mrkey_unref(sender_public);
+		sender_public = mrkey_new();
+		ths->m_sender_private[i] = mrkey_new();
+		if( !mrpgp_create_keypair(ths->m_mailbox, addr, sender_public, ths->m_sender_private[i]) ) {
+			goto cleanup;
+		}
+		ths->m_encrypt_to[i] = mrkeyring_new();
+		mrkeyring_add(ths->m_encrypt_to[i], recipient_public);
+		mrkeyring_add(ths->m_encrypt_to[i], sender_public);
+		ths->m_autocrypt[i] = render_aheader(addr, sender_public, MRA_PE_MUTUAL);
+		ths->m_gossip[i] = render_aheader(addr, sender_public, MRA_PE_NOPREFERENCE);
+	}
+
+	success = 1;
+
+cleanup:
+	mrkey_unref(recipient_public);
+	mrkey_unref(sender_public);
+	free(addr);
+	return success;
+}
+
+
+/**
+ * Create a corpus generator.  Returns NULL if the mix cannot be parsed or if
+ * the mix contains encrypted messages and `mailbox` has no self-key for `recipient_addr`.
+ */
+mockcorpus_t* mockcorpus_new(mrmailbox_t* mailbox, const char* recipient_addr, uint32_t seed, const char* mix)
+{
+	mockcorpus_t* ths = NULL;
+	char*         mix_copy = safe_strdup(mix? mix : MOCKCORPUS_DEFAULT_MIX), *option, *value;
+	int           i, known;
+
+	if( (ths=calloc(1, sizeof(mockcorpus_t)))==NULL ) {
+		exit(1);
+	}
+
+	ths->m_seed             = seed? seed : 0x2545F491;
+	ths->m_sender_cnt       = 20;
+	ths->m_group_cnt        = 5;
+	ths->m_attachment_bytes = 100*1024;
+	ths->m_recipient_addr   = safe_strdup(recipient_addr);
+	ths->m_mailbox          = mailbox;
+
+	for( option = strtok(mix_copy, ", "); option; option = strtok(NULL, ", ") ) {
+		if( (value=strchr(option, '='))==NULL ) {
+			goto cleanup;
+		}
+		*value++ = 0;
+
+		known = 0;
+		for( i = 0; i < MOCKCORPUS_KINDS; i++ ) {
+			if( strcmp(option, s_kind_names[i])==0 ) {
+				ths->m_weights[i] = atoi(value);
+				known = 1;
+			}
+		}
+
+		if( strcmp(option, "senders")==0 ) {
+			ths->m_sender_cnt = MR_MAX(atoi(value), MOCKCORPUS_KEYED_SENDERS);
+		}
+		else if( strcmp(option, "groups")==0 ) {
+			ths->m_group_cnt = MR_MAX(atoi(value), 1);
+		}
+		else if( strcmp(option, "attachment-kb")==0 ) {
+			ths->m_attachment_bytes = MR_MAX(atoi(value), 1)*1024;
+		}
+		else if( !known ) {
+			goto cleanup;
+		}
+	}
+
+	for( i = 0; i < MOCKCORPUS_KINDS; i++ ) {
+		ths->m_weight_sum += MR_MAX(ths->m_weights[i], 0);
+	}
+
+	if( ths->m_weight_sum <= 0
+	 || (ths->m_weights[MOCKCORPUS_ENCRYPTED] > 0 && !create_keys(ths)) ) {
+		goto cleanup;
+	}
+
+	free(mix_copy);
+	return ths;
+
+cleanup:
+	free(mix_copy);
+	mockcorpus_unref(ths);
+	return NULL;
+}
+
+
+void mockcorpus_unref(mockcorpus_t* ths)
+{
+	int i;
+
+	if( ths == NULL ) {
+		return;
+	}
+
+	for( i = 0; i < MOCKCORPUS_KEYED_SENDERS; i++ ) {
+		mrkey_unref(ths->m_sender_private[i]);
+		mrkeyring_unref(ths->m_encrypt_to[i]);
+		free(ths->m_autocrypt[i]);
+	}
+	for( i = 0; i <= MOCKCORPUS_KEYED_SENDERS; i++ ) {
+		free(ths->m_gossip[i]);
+	}
+	free(ths->m_recipient_addr);
+	free(ths);
+}
+
+
+int mockcorpus_get_sender_cnt(mockcorpus_t* ths)
+{
+	return ths? ths->m_sender_cnt : 0;
+}
+
+
+char* mockcorpus_get_sender_addr(mockcorpus_t* ths, int sender)
+{
+	return mr_mprintf("sender%i@corpus.example", sender);
+}
+
+
+const char* mockcorpus_get_kind_name(int kind)
+{
+	return (kind>=0 && kind<MOCKCORPUS_KINDS)? s_kind_names[kind] : "?";
+}
+
+
+/*******************************************************************************
+ * Render messages
+ ******************************************************************************/
+
+
+static void cat_encrypted(mockcorpus_t* ths, mrstrbuilder_t* ret, uint32_t* state, int index, const char* boundary)
+{
+	/* the inner part is encrypted to the recipient and signed by the sender, as done by mrmailbox_e2ee_encrypt();
+	group messages gossip the keys of the other members */
+	int            sender = rnd(state, MOCKCORPUS_KEYED_SENDERS), group = rnd(state, 2), other = (sender+1)%MOCKCORPUS_KEYED_SENDERS;
+	void*          ctext = NULL;
+	size_t         ctext_bytes = 0;
+	char*          armored;
+	mrstrbuilder_t inner;
+	mrstrbuilder_init(&inner, 0);
+
+	if( group ) {
+		mrstrbuilder_catf(&inner, "Autocrypt-Gossip: %s\r\nAutocrypt-Gossip: %s\r\n", ths->m_gossip[MOCKCORPUS_KEYED_SENDERS], ths->m_gossip[other]);
+		mrstrbuilder_cat(&inner, "Chat-Group-ID: corpusencgrp\r\nChat-Group-Name: Encrypted group\r\n");
+	}
+	mrstrbuilder_cat(&inner, "Content-Type: text/plain; charset=utf-8\r\nContent-Transfer-Encoding: 8bit\r\n\r\n");
+	cat_words(&inner, state, rnd(state, 40)+1);
+	mrstrbuilder_cat(&inner, "\r\n");
+
+	if( !mrpgp_pk_encrypt(ths->m_mailbox, inner.m_buf, strlen(inner.m_buf), ths->m_encrypt_to[sender], ths->m_sender_private[sender], 1/*use_armor*/, &ctext, &ctext_bytes) ) {
+		exit(1);
+	}
+
+	mrstrbuilder_catf(ret, "From: Sender %i <sender%i@corpus.example>\r\n", sender, sender);
+	if( group ) {
+		mrstrbuilder_catf(ret, "To: %s, sender%i@corpus.example\r\n", ths->m_recipient_addr, other);
+		mrstrbuilder_catf(ret, "Message-ID: <Gr.corpusencgrp.%08x.%06i@corpus.example>\r\n", ths->m_seed, index);
+	}
+	else {
+		mrstrbuilder_catf(ret, "To: %s\r\n", ths->m_recipient_addr);
+		mrstrbuilder_catf(ret, "Message-ID: <Mr.corpus%08x.%06i@corpus.example>\r\n", ths->m_seed, index);
+	}
+	mrstrbuilder_catf(ret,
+		"Subject: ...\r\n"
+		"Chat-Version: 1.0\r\n"
+		"Autocrypt: %s\r\n"
+		"MIME-Version: 1.0\r\n"
+		"Content-Type: multipart/encrypted; protocol=\"application/pgp-encrypted\"; boundary=\"%s\"\r\n"
+		"\r\n"
+		"--%s\r\n"
+		"Content-Type: application/pgp-encrypted\r\n"
+		"Content-Description: PGP/MIME version identification\r\n"
+		"\r\n"
+		"Version: 1\r\n"
+		"\r\n"
+		"--%s\r\n"
+		"Content-Type: application/octet-stream; name=\"encrypted.asc\"\r\n"
+		"Content-Description: OpenPGP encrypted message\r\n"
+		"Content-Disposition: inline; filename=\"encrypted.asc\"\r\n"
+		"\r\n",
+		ths->m_autocrypt[sender], boundary, boundary, boundary);
+	armored = mr_null_terminate((const char*)ctext, ctext_bytes);
+	mrstrbuilder_cat(ret, armored);
+	mrstrbuilder_catf(ret, "\r\n--%s--\r\n", boundary);
+
+	free(armored);
+	free(ctext);
+	free(inner.m_buf);
+}
+
+
+static void cat_attachment(mockcorpus_t* ths, mrstrbuilder_t* ret, uint32_t* state, int index)
+{
+	/* random bytes with the magic of a JPEG file, random data do not compress and are a worst case for the transfer encoding */
+	unsigned char* data = malloc(ths->m_attachment_bytes);
+	char*          base64;
+	int            i;
+
+	if( data == NULL ) {
+		exit(1);
+	}
+
+	for( i = 0; i < ths->m_attachment_bytes; i++ ) {
+		data[i] = (unsigned char)rnd(state, 256);
+	}
+	memcpy(data, "\xFF\xD8\xFF\xE0", MR_MIN(4, ths->m_attachment_bytes));
+
+	if( (base64=mr_base64_encode(data, ths->m_attachment_bytes, 76, "\r\n"))==NULL ) {
+		exit(1);
+	}
+
+	mrstrbuilder_catf(ret,
+		"Content-Type: image/jpeg\r\n"
+		"Content-Disposition: attachment; filename=\"image%06i.jpg\"\r\n"
+		"Content-Transfer-Encoding: base64\r\n"
+		"\r\n", index);
+	mrstrbuilder_cat(ret, base64);
+	mrstrbuilder_cat(ret, "\r\n");
+
+	free(base64);
+	free(data);
+}
+
+
+/**
+ * Render the message with the given index.  The same seed and index always
+ * result in the same message except for the ciphertext of encrypted messages;
+ * the timestamp is used for the Date-header.
+ */
+char* mockcorpus_render(mockcorpus_t* ths, int index, time_t timestamp, int* ret_kind)
+{
+	uint32_t       state = (ths->m_seed ^ ((uint32_t)index*2654435761U)) | 1, pick;
+	int            kind, sender, group, i;
+	char           date[64], boundary[64];
+	mrstrbuilder_t ret;
+	mrstrbuilder_init(&ret, 0);
+
+	for( i = 0; i < 4; i++ ) {
+		rnd(&state, 2); /* neighbouring indices result in similar states otherwise */
+	}
+
+	pick = rnd(&state, ths->m_weight_sum);
+	for( kind = 0; kind < MOCKCORPUS_KINDS-1; kind++ ) {
+		if( pick < (uint32_t)MR_MAX(ths->m_weights[kind], 0) ) {
+			break;
+		}
+		pick -= MR_MAX(ths->m_weights[kind], 0);
+	}
+
+	sender = rnd(&state, ths->m_sender_cnt);
+	strftime(date, sizeof(date), "%a, %d %b %Y %H:%M:%S +0000", gmtime(&timestamp));
+	snprintf(boundary, sizeof(boundary), "----=_corpus%08x.%06i", ths->m_seed, index);
+	mrstrbuilder_catf(&ret, "Date: %s\r\n", date);
+
+	switch( kind )
+	{
+		case MOCKCORPUS_PLAIN:
+			mrstrbuilder_catf(&ret,
+				"From: Sender %i <sender%i@corpus.example>\r\n"
+				"To: %s\r\n"
+				"Subject: Chat: Message\r\n"
+				"Message-ID: <Mr.corpus%08x.%06i@corpus.example>\r\n"
+				"Chat-Version: 1.0\r\n"
+				"Chat-Disposition-Notification-To: sender%i@corpus.example\r\n"
+				"MIME-Version: 1.0\r\n"
+				"Content-Type: text/plain; charset=utf-8\r\n"
+				"Content-Transfer-Encoding: 8bit\r\n"
+				"\r\n",
+				sender, sender, ths->m_recipient_addr, ths->m_seed, index, sender);
+			cat_words(&ret, &state, rnd(&state, 40)+1);
+			mrstrbuilder_cat(&ret, "\r\n");
+			break;
+
+		case MOCKCORPUS_GROUP:
+			/* the group members are the recipient and two senders, one of them sends the message */
+			group = rnd(&state, ths->m_group_cnt);
+			sender = (group + rnd(&state, 2)) % ths->m_sender_cnt;
+			mrstrbuilder_catf(&ret,
+				"From: Sender %i <sender%i@corpus.example>\r\n"
+				"To: %s, sender%i@corpus.example, sender%i@corpus.example\r\n"
+				"Subject: Chat: Group %i\r\n"
+				"Message-ID: <Gr.corpusgrp%04i.%08x.%06i@corpus.example>\r\n"
+				"Chat-Version: 1.0\r\n"
+				"Chat-Group-ID: corpusgrp%04i\r\n"
+				"Chat-Group-Name: Group %i\r\n"
+				"Chat-Disposition-Notification-To: sender%i@corpus.example\r\n"
+				"MIME-Version: 1.0\r\n"
+				"Content-Type: text/plain; charset=utf-8\r\n"
+				"Content-Transfer-Encoding: 8bit\r\n"
+				"\r\n",
+				sender, sender, ths->m_recipient_addr, group%ths->m_sender_cnt, (group+1)%ths->m_sender_cnt,
+				group, group, ths->m_seed, index, group, group, sender);
+			cat_words(&ret, &state, rnd(&state, 40)+1);
+			mrstrbuilder_cat(&ret, "\r\n");
+			break;
+
+		case MOCKCORPUS_HTML:
+			mrstrbuilder_catf(&ret,
+				"From: Newsletter %i <news%i@corpus.example>\r\n"
+				"To: %s\r\n"
+				"Subject: Newsletter %i\r\n"
+				"Message-ID: <news%08x.%06i@corpus.example>\r\n"
+				"MIME-Version: 1.0\r\n"
+				"Content-Type: text/html; charset=utf-8\r\n"
+				"Content-Transfer-Encoding: quoted-printable\r\n"
+				"\r\n",
+				sender, sender, ths->m_recipient_addr, index, ths->m_seed, index);
+			{
+				mrstrbuilder_t html;
+				mrstrbuilder_init(&html, 0);
+				mrstrbuilder_cat(&html, "<!DOCTYPE html>\r\n<html><head><style>p { color: #333; }</style></head><body>\r\n<h1>");
+				cat_words(&html, &state, 3);
+				for( i = rnd(&state, 5)+1; i > 0; i-- ) {
+					mrstrbuilder_cat(&html, "</h1>\r\n<p>");
+					cat_words(&html, &state, rnd(&state, 60)+10);
+					mrstrbuilder_cat(&html, " <b>");
+					cat_words(&html, &state, 2);
+					mrstrbuilder_cat(&html, "</b> &amp; <a href=\"https://corpus.example/read\">more</a></p>\r\n<h1>");
+					cat_words(&html, &state, 3);
+				}
+				mrstrbuilder_cat(&html, "</h1>\r\n<p><a href=\"https://corpus.example/unsubscribe\">Unsubscribe</a></p>\r\n</body></html>\r\n");
+				cat_qp(&ret, html.m_buf);
+				free(html.m_buf);
+			}
+			break;
+
+		case MOCKCORPUS_MULTIPART:
+			/* a reply from another mail client, the text contains a quote and a signature to be removed by mrsimplify_t */
+			mrstrbuilder_catf(&ret,
+				"From: Sender %i <sender%i@corpus.example>\r\n"
+				"To: %s\r\n"
+				"Subject: Re: Meeting\r\n"
+				"Message-ID: <mp%08x.%06i@corpus.example>\r\n"
+				"In-Reply-To: <mp%08x.%06i@corpus.example>\r\n"
+				"MIME-Version: 1.0\r\n"
+				"Content-Type: multipart/alternative; boundary=\"%s\"\r\n"
+				"\r\n"
+				"--%s\r\n"
+				"Content-Type: text/plain; charset=utf-8\r\n"
+				"Content-Transfer-Encoding: quoted-printable\r\n"
+				"\r\n",
+				sender, sender, ths->m_recipient_addr, ths->m_seed, index, ths->m_seed, index/2, boundary, boundary);
+			{
+				mrstrbuilder_t text;
+				mrstrbuilder_init(&text, 0);
+				cat_words(&text, &state, rnd(&state, 60)+1);
+				mrstrbuilder_cat(&text, "\r\n\r\nOn Monday, you wrote:\r\n");
+				for( i = rnd(&state, 8)+1; i > 0; i-- ) {
+					mrstrbuilder_cat(&text, "> ");
+					cat_words(&text, &state, rnd(&state, 12)+1);
+					mrstrbuilder_cat(&text, "\r\n");
+				}
+				mrstrbuilder_catf(&text, "\r\n-- \r\nSender %i\r\nPhone +1 555 %04i\r\n", sender, sender);
+				cat_qp(&ret, text.m_buf);
+				mrstrbuilder_catf(&ret, "\r\n--%s\r\nContent-Type: text/html; charset=utf-8\r\nContent-Transfer-Encoding: quoted-printable\r\n\r\n", boundary);
+				mrstrbuilder_empty(&text);
+				mrstrbuilder_cat(&text, "<html><body><div>");
+				cat_words(&text, &state, rnd(&state, 60)+1);
+				mrstrbuilder_cat(&text, "</div><blockquote type=\"cite\">");
+				cat_words(&text, &state, rnd(&state, 60)+1);
+				mrstrbuilder_catf(&text, "</blockquote><div>-- <br>Sender %i</div></body></html>\r\n", sender);
+				cat_qp(&ret, text.m_buf);
+				mrstrbuilder_catf(&ret, "\r\n--%s--\r\n", boundary);
+				free(text.m_buf);
+			}
+			break;
+
+		case MOCKCORPUS_ENCRYPTED:
+			cat_encrypted(ths, &ret, &state, index, boundary);
+			break;
+
+		case MOCKCORPUS_MDN:
+			mrstrbuilder_catf(&ret,
+				"From: Sender %i <sender%i@corpus.example>\r\n"
+				"To: %s\r\n"
+				"Subject: Chat: Message opened\r\n"
+				"Message-ID: <Mr.corpus%08x.%06i@corpus.example>\r\n"
+				"Chat-Version: 1.0\r\n"
+				"MIME-Version: 1.0\r\n"
+				"Content-Type: multipart/report; report-type=disposition-notification; boundary=\"%s\"\r\n"
+				"\r\n"
+				"--%s\r\n"
+				"Content-Type: text/plain; charset=utf-8\r\n"
+				"\r\n"
+				"The message you sent was displayed on the screen of the recipient.\r\n"
+				"\r\n"
+				"--%s\r\n"
+				"Content-Type: message/disposition-notification\r\n"
+				"\r\n"
+				"Reporting-UA: Corpus\r\n"
+				"Original-Recipient: rfc822;sender%i@corpus.example\r\n"
+				"Final-Recipient: rfc822;sender%i@corpus.example\r\n"
+				"Original-Message-ID: <Mr.corpussent.%06i@corpus.example>\r\n"
+				"Disposition: manual-action/MDN-sent-automatically; displayed\r\n"
+				"\r\n"
+				"--%s--\r\n",
+				sender, sender, ths->m_recipient_addr, ths->m_seed, index, boundary, boundary, boundary,
+				sender, sender, (int)rnd(&state, index+1), boundary);
+			break;
+
+		case MOCKCORPUS_ATTACHMENT:
+			mrstrbuilder_catf(&ret,
+				"From: Sender %i <sender%i@corpus.example>\r\n"
+				"To: %s\r\n"
+				"Subject: Chat: Image\r\n"
+				"Message-ID: <Mr.corpus%08x.%06i@corpus.example>\r\n"
+				"Chat-Version: 1.0\r\n"
+				"MIME-Version: 1.0\r\n"
+				"Content-Type: multipart/mixed; boundary=\"%s\"\r\n"
+				"\r\n"
+				"--%s\r\n"
+				"Content-Type: text/plain; charset=utf-8\r\n"
+				"Content-Transfer-Encoding: 8bit\r\n"
+				"\r\n",
+				sender, sender, ths->m_recipient_addr, ths->m_seed, index, boundary, boundary);
+			cat_words(&ret, &state, rnd(&state, 10)+1);
+			mrstrbuilder_catf(&ret, "\r\n\r\n--%s\r\n", boundary);
+			cat_attachment(ths, &ret, &state, index);
+			mrstrbuilder_catf(&ret, "--%s--\r\n", boundary);
+			break;
+
+		default: /* MOCKCORPUS_LIST */
+			group = rnd(&state, ths->m_group_cnt);
+			mrstrbuilder_catf(&ret,
+				"From: Member %i <member%i@lists.corpus.example>\r\n"
+				"To: list%i@lists.corpus.example\r\n"
+				"Sender: list%i-bounces@lists.corpus.example\r\n"
+				"Subject: [list%i] Release planning\r\n"
+				"Message-ID: <list%08x.%06i@lists.corpus.example>\r\n"
+				"List-Id: Corpus list %i <list%i.lists.corpus.example>\r\n"
+				"List-Unsubscribe: <mailto:list%i-leave@lists.corpus.example>\r\n"
+				"Precedence: list\r\n"
+				"MIME-Version: 1.0\r\n"
+				"Content-Type: text/plain; charset=utf-8\r\n"
+				"Content-Transfer-Encoding: 8bit\r\n"
+				"\r\n",
+				sender, sender, group, group, group, ths->m_seed, index, group, group, group);
+			cat_words(&ret, &state, rnd(&state, 80)+1);
+			mrstrbuilder_cat(&ret, "\r\n\r\n");
+			for( i = rnd(&state, 6); i > 0; i-- ) {
+				mrstrbuilder_cat(&ret, "> ");
+				cat_words(&ret, &state, rnd(&state, 12)+1);
+				mrstrbuilder_cat(&ret, "\r\n");
+			}
+			mrstrbuilder_catf(&ret, "\r\n_______________________________________________\r\nlist%i mailing list\r\nhttps://lists.corpus.example/list%i\r\n", group, group);
+			break;
+	}
+
+	if( ret_kind ) {
+		*ret_kind = kind;
+	}
+	return ret.m_buf;
+}
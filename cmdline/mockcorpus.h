@@ -0,0 +1,74 @@
+/*******************************************************************************
+ *
+ *                              Delta Chat Core
+ *                      Copyright (C) 2017 Björn Petersen
+ *                   Contact: r10s@b44t.com, http://b44t.com
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see http://www.gnu.org/licenses/ .
+ *
+ ******************************************************************************/
+
+
+
+#ifndef __MOCKCORPUS_H__
+#define __MOCKCORPUS_H__
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+#include <stdint.h>
+#include <time.h>
+#include "../src/mrmailbox.h"
+
+
+/* Generator for synthetic messages as received from other clients, used to
+benchmark receiving without real mail, see the cmdline commands gencorpus and
+benchreceive and benche2e.c.  Each message depends only on the seed and its
+index, so a corpus can be regenerated identically, in any order.
+
+The kinds of messages are mixed as given by a string as
+"plain=40,html=10,group=20"; each weight is relative to the sum of all weights.
+Further options of the string are "senders=<n>" (number of distinct senders,
+default 20), "groups=<n>" (default 5) and "attachment-kb=<n>" (size of the
+attachments, default 100).  Encrypted messages are encrypted to the self-key
+of the mailbox given to mockcorpus_new() and signed by one of two senders
+with generated keys, so creating a corpus with encrypted messages takes some
+seconds.  The addresses of the senders are sender<n>@corpus.example. */
+#define MOCKCORPUS_PLAIN       0 /* 1:1 chat message, text/plain */
+#define MOCKCORPUS_HTML        1 /* newsletter from an unknown sender, text/html only */
+#define MOCKCORPUS_MULTIPART   2 /* multipart/alternative with a quote and a signature */
+#define MOCKCORPUS_ENCRYPTED   3 /* Autocrypt-encrypted chat message, about half of them to a group with Autocrypt-Gossip */
+#define MOCKCORPUS_GROUP       4 /* group chat message with Chat-Group-ID */
+#define MOCKCORPUS_MDN         5 /* read receipt, multipart/report */
+#define MOCKCORPUS_ATTACHMENT  6 /* chat message with a base64-encoded image */
+#define MOCKCORPUS_LIST        7 /* mailing list traffic with List-Id */
+#define MOCKCORPUS_KINDS       8
+
+#define MOCKCORPUS_DEFAULT_MIX "plain=30,html=5,multipart=10,encrypted=10,group=20,mdn=10,attachment=5,list=10"
+
+typedef struct mockcorpus_t mockcorpus_t;
+
+mockcorpus_t* mockcorpus_new          (mrmailbox_t* mailbox /*may be NULL if there are no encrypted messages*/, const char* recipient_addr, uint32_t seed, const char* mix /*NULL=MOCKCORPUS_DEFAULT_MIX*/);
+void          mockcorpus_unref        (mockcorpus_t*);
+char*         mockcorpus_render       (mockcorpus_t*, int index, time_t timestamp, int* ret_kind /*may be NULL*/); /* returns a null-terminated message that must be free()'d */
+int           mockcorpus_get_sender_cnt(mockcorpus_t*);
+char*         mockcorpus_get_sender_addr(mockcorpus_t*, int sender); /* the result must be free()'d */
+const char*   mockcorpus_get_kind_name(int kind);
+
+
+#ifdef __cplusplus
+} /* /extern "C" */
+#endif
+#endif /* __MOCKCORPUS_H__ */
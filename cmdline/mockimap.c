@@ -0,0 +1,1046 @@
+/*******************************************************************************
+ *
+ *                              Delta Chat Core
+ *                      Copyright (C) 2017 Björn Petersen
+ *                   Contact: r10s@b44t.com, http://b44t.com
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see http://www.gnu.org/licenses/ .
+ *
+ ******************************************************************************/
+
+
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include "mockimap.h"
+
+
+#define MOCKIMAP_MAX_FOLDERS  16
+#define MOCKIMAP_MAX_CONNS     8
+
+#define MOCK_SEEN           0x01
+#define MOCK_DELETED        0x02
+#define MOCK_MDNSENT        0x04
+
+
+typedef struct mockmsg_t
+{
+	uint32_t   m_uid;
+	int        m_flags;        /* MOCK_SEEN etc. */
+	uint64_t   m_modseq;       /* mod-sequence of the last change, see RFC 7162 */
+	char*      m_data;
+	size_t     m_bytes;
+} mockmsg_t;
+
+
+typedef struct mockfolder_t
+{
+	char*      m_name;
+	uint32_t   m_uidvalidity;
+	uint32_t   m_uidnext;
+	uint64_t   m_highestmodseq;
+	mockmsg_t* m_msgs;         /* the sequence number of a message is its index plus one */
+	int        m_cnt;
+	int        m_alloc;
+} mockfolder_t;
+
+
+typedef struct mockconn_t
+{
+	mockimap_t* m_server;
+	int         m_fd;
+	pthread_t   m_thread;
+	int         m_finished;    /* set by the connection thread when it is done, the thread can be joined then */
+
+	int         m_selected;    /* index of the selected folder, -1 if there is none */
+	int         m_idling;
+	char        m_idle_tag[64];
+
+	char        m_buf[65536];
+	size_t      m_buf_bytes;
+} mockconn_t;
+
+
+struct mockimap_t
+{
+	pthread_mutex_t m_critical;  /* protects all members below and serializes sending, commands are handled one after another */
+	mockfolder_t    m_folders[MOCKIMAP_MAX_FOLDERS];
+	int             m_folder_cnt;
+	uint64_t        m_modseq;    /* the last mod-sequence assigned, shared by all folders */
+	int             m_cmd_cnt;
+	int             m_seen_cnt;
+	mockconn_t*     m_conns[MOCKIMAP_MAX_CONNS];
+
+	int             m_latency_ms;  /* added before each tagged response to simulate a network round-trip */
+	int             m_listen_fd;
+	int             m_port;
+	pthread_t       m_thread;
+};
+
+
+/*******************************************************************************
+ * Folders and messages
+ ******************************************************************************/
+
+
+static char* render_msg(int uid, int msg_bytes, size_t* ret_bytes)
+{
+	char*  msg = malloc(msg_bytes + 512);
+	size_t bytes = sprintf(msg,
+		"From: Sender %i <sender%i@mock.example>\r\n"
+		"To: me@mock.example\r\n"
+		"Subject: Message %i\r\n"
+		"Message-ID: <mock-%i@mock.example>\r\n"
+		"Date: Mon, 1 Jan 2018 00:00:00 +0000\r\n"
+		"Chat-Version: 1.0\r\n"
+		"Content-Type: text/plain; charset=utf-8\r\n"
+		"\r\n", uid%50, uid%50, uid, uid);
+
+	while( bytes < (size_t)msg_bytes ) {
+		memcpy(&msg[bytes], "lorem ipsum dolor sit amet\r\n", 28);
+		bytes += 28;
+	}
+	msg[bytes] = 0;
+	*ret_bytes = bytes;
+	return msg;
+}
+
+
+static int find_folder__(mockimap_t* ths, const char* name)
+{
+	int i;
+	for( i = 0; i < ths->m_folder_cnt; i++ ) {
+		if( strcmp(ths->m_folders[i].m_name, name)==0
+		 || (strcasecmp(name, "INBOX")==0 && strcasecmp(ths->m_folders[i].m_name, "INBOX")==0) ) {
+			return i;
+		}
+	}
+	return -1;
+}
+
+
+static int add_folder__(mockimap_t* ths, const char* name)
+{
+	mockfolder_t* folder;
+
+	if( ths->m_folder_cnt >= MOCKIMAP_MAX_FOLDERS ) {
+		return -1;
+	}
+
+	folder = &ths->m_folders[ths->m_folder_cnt];
+	memset(folder, 0, sizeof(mockfolder_t));
+	folder->m_name          = strdup(name);
+	folder->m_uidvalidity   = ths->m_folder_cnt+1;
+	folder->m_uidnext       = 1;
+	folder->m_highestmodseq = ++ths->m_modseq;
+	return ths->m_folder_cnt++;
+}
+
+
+static mockmsg_t* add_msg__(mockimap_t* ths, int folder_idx, char* data /*takes ownership*/, size_t bytes, int flags)
+{
+	mockfolder_t* folder = &ths->m_folders[folder_idx];
+	mockmsg_t*    msg;
+
+	if( folder->m_cnt >= folder->m_alloc ) {
+		folder->m_alloc = folder->m_alloc*2 + 64;
+		if( (folder->m_msgs=realloc(folder->m_msgs, folder->m_alloc*sizeof(mockmsg_t)))==NULL ) {
+			exit(1);
+		}
+	}
+
+	msg = &folder->m_msgs[folder->m_cnt++];
+	msg->m_uid    = folder->m_uidnext++;
+	msg->m_flags  = flags;
+	msg->m_modseq = folder->m_highestmodseq = ++ths->m_modseq;
+	msg->m_data   = data;
+	msg->m_bytes  = bytes;
+	return msg;
+}
+
+
+static void send_str(int fd, const char* str, size_t bytes)
+{
+	size_t sent = 0;
+	while( sent < bytes ) {
+		ssize_t r = send(fd, &str[sent], bytes-sent, MSG_NOSIGNAL);
+		if( r <= 0 ) {
+			return;
+		}
+		sent += r;
+	}
+}
+
+
+static void sendf(int fd, const char* format, ...)
+{
+	/* most lines fit into the buffer on the stack; longer ones, eg. COPYUID with large sets, are allocated, a truncated line would break the protocol */
+	char    line[1024], *heap_line = NULL;
+	int     bytes;
+	va_list args;
+
+	va_start(args, format);
+		bytes = vsnprintf(line, sizeof(line), format, args);
+	va_end(args);
+
+	if( bytes >= (int)sizeof(line) ) {
+		if( (heap_line=malloc(bytes+1))==NULL ) {
+			exit(1);
+		}
+		va_start(args, format);
+			vsnprintf(heap_line, bytes+1, format, args);
+		va_end(args);
+	}
+
+	send_str(fd, heap_line? heap_line : line, bytes);
+	free(heap_line);
+}
+
+
+static void notify_exists__(mockimap_t* ths, int folder_idx)
+{
+	/* push the new number of messages to all clients idling in the folder, this lets mailstream_wait_idle() return */
+	int i;
+	for( i = 0; i < MOCKIMAP_MAX_CONNS; i++ ) {
+		mockconn_t* conn = ths->m_conns[i];
+		if( conn && !conn->m_finished && conn->m_idling && conn->m_selected==folder_idx ) {
+			sendf(conn->m_fd, "* %i EXISTS\r\n", ths->m_folders[folder_idx].m_cnt);
+		}
+	}
+}
+
+
+static void get_message_id(const mockmsg_t* msg, char* ret, size_t ret_bytes)
+{
+	/* get the Message-ID without angle brackets from the header */
+	const char *p = msg->m_data, *end = msg->m_data + msg->m_bytes;
+	ret[0] = 0;
+	while( p < end && !(p[0]=='\r' && p+1<end && p[1]=='\n') )
+	{
+		if( end-p > 11 && strncasecmp(p, "Message-ID:", 11)==0 ) {
+			const char* start = memchr(p, '<', end-p), *stop;
+			if( start && (stop=memchr(start, '>', end-start))!=NULL && (size_t)(stop-start) < ret_bytes ) {
+				memcpy(ret, start+1, stop-start-1);
+				ret[stop-start-1] = 0;
+			}
+			return;
+		}
+		while( p < end && *p!='\n' ) { p++; }
+		p++;
+	}
+}
+
+
+static const char* flags_str(int flags)
+{
+	static const char* str[] = { "", "\\Seen", "\\Deleted", "\\Seen \\Deleted", "$MDNSent", "\\Seen $MDNSent", "\\Deleted $MDNSent", "\\Seen \\Deleted $MDNSent" };
+	return str[flags&0x07];
+}
+
+
+static int parse_flags(const char* str)
+{
+	return (strstr(str, "\\Seen")? MOCK_SEEN : 0) | (strstr(str, "\\Deleted")? MOCK_DELETED : 0) | (strstr(str, "$MDNSent")? MOCK_MDNSENT : 0);
+}
+
+
+/*******************************************************************************
+ * Commands
+ ******************************************************************************/
+
+
+static int in_set(const char* set, uint32_t n, uint32_t max)
+{
+	/* check if n is in a set as `1,3:5,7:*`; as described in RFC 3501, `n:*` includes the largest number even if n is larger */
+	const char* p = set;
+	while( *p )
+	{
+		uint32_t first = (*p=='*')? max : (uint32_t)strtoul(p, NULL, 10), last = first;
+		while( *p && *p!=':' && *p!=',' ) { p++; }
+		if( *p==':' ) {
+			p++;
+			last = (*p=='*')? max : (uint32_t)strtoul(p, NULL, 10);
+			while( *p && *p!=',' ) { p++; }
+		}
+		if( first > last ) { uint32_t tmp = first; first = last; last = tmp; }
+		if( n >= first && n <= last ) {
+			return 1;
+		}
+		if( *p==',' ) { p++; }
+	}
+	return 0;
+}
+
+
+static int in_set_msg(mockfolder_t* folder, int i, const char* set, int by_uid)
+{
+	if( by_uid ) {
+		return in_set(set, folder->m_msgs[i].m_uid, folder->m_cnt? folder->m_msgs[folder->m_cnt-1].m_uid : 0);
+	}
+	return in_set(set, i+1, folder->m_cnt);
+}
+
+
+static void unquote(char* str)
+{
+	/* remove the quotes from a quoted string as `"Delta Chat"`, atoms are left as they are */
+	size_t len = strlen(str);
+	if( len >= 2 && str[0]=='"' && str[len-1]=='"' ) {
+		char *r = str+1, *w = str;
+		while( r < str+len-1 ) {
+			if( *r=='\\' && r+1 < str+len-1 ) { r++; }
+			*w++ = *r++;
+		}
+		*w = 0;
+	}
+}
+
+
+static const char* get_arg(const char* args, char* ret, size_t ret_bytes)
+{
+	/* get the next quoted string or atom from `args` and return the position after it */
+	size_t used = 0;
+	int    quoted = 0;
+	while( *args==' ' ) { args++; }
+	while( *args && (quoted || *args!=' ') && used+1 < ret_bytes ) {
+		if( *args=='"' && (used==0 || args[-1]!='\\') ) {
+			quoted = !quoted;
+		}
+		ret[used++] = *args++;
+	}
+	ret[used] = 0;
+	unquote(ret);
+	return args;
+}
+
+
+static void handle_fetch__(mockconn_t* conn, const char* set, const char* atts, int by_uid)
+{
+	mockimap_t*   ths = conn->m_server;
+	mockfolder_t* folder = &ths->m_folders[conn->m_selected];
+	const char*   changedsince = strstr(atts, "CHANGEDSINCE");
+	uint64_t      modseq = changedsince? strtoull(changedsince+12, NULL, 10) : 0;
+	int           with_uid = by_uid || strstr(atts, "UID")!=NULL, with_flags = strstr(atts, "FLAGS")!=NULL,
+	              with_size = strstr(atts, "RFC822.SIZE")!=NULL, with_envelope = strstr(atts, "ENVELOPE")!=NULL,
+	              with_body = strstr(atts, "BODY")!=NULL, i;
+	char          line[1024], msgid[256];
+
+	for( i = 0; i < folder->m_cnt; i++ )
+	{
+		mockmsg_t* msg = &folder->m_msgs[i];
+		size_t     used = 0;
+		if( !in_set_msg(folder, i, set, by_uid) || (changedsince && msg->m_modseq <= modseq) ) {
+			continue;
+		}
+
+		used += snprintf(&line[used], sizeof(line)-used, "* %i FETCH (", i+1);
+		if( with_uid )      { used += snprintf(&line[used], sizeof(line)-used, "UID %i ", (int)msg->m_uid); }
+		if( with_flags )    { used += snprintf(&line[used], sizeof(line)-used, "FLAGS (%s) ", flags_str(msg->m_flags)); }
+		if( changedsince )  { used += snprintf(&line[used], sizeof(line)-used, "MODSEQ (%llu) ", (unsigned long long)msg->m_modseq); }
+		if( with_size )     { used += snprintf(&line[used], sizeof(line)-used, "RFC822.SIZE %i ", (int)msg->m_bytes); }
+		if( with_envelope ) { get_message_id(msg, msgid, sizeof(msgid));
+		                      used += snprintf(&line[used], sizeof(line)-used, "ENVELOPE (NIL NIL NIL NIL NIL NIL NIL NIL NIL \"<%s>\") ", msgid); }
+		if( with_body )     { used += snprintf(&line[used], sizeof(line)-used, "BODY[] {%i}\r\n", (int)msg->m_bytes); }
+		else if( used > 0 && line[used-1]==' ' ) { used--; }
+
+		send_str(conn->m_fd, line, used);
+		if( with_body ) {
+			send_str(conn->m_fd, msg->m_data, msg->m_bytes);
+		}
+		sendf(conn->m_fd, ")\r\n");
+	}
+}
+
+
+static void handle_store__(mockconn_t* conn, const char* set, const char* args, int by_uid)
+{
+	/* `+FLAGS.SILENT (\Seen)`, `-FLAGS (\Deleted)`, `FLAGS ()` etc.; every change increases the mod-sequence */
+	mockimap_t*   ths = conn->m_server;
+	mockfolder_t* folder = &ths->m_folders[conn->m_selected];
+	int           flags = parse_flags(args), silent = strstr(args, ".SILENT")!=NULL, i;
+
+	for( i = 0; i < folder->m_cnt; i++ )
+	{
+		mockmsg_t* msg = &folder->m_msgs[i];
+		int        new_flags;
+		if( !in_set_msg(folder, i, set, by_uid) ) {
+			continue;
+		}
+
+		new_flags = args[0]=='+'? (msg->m_flags|flags) : (args[0]=='-'? (msg->m_flags&~flags) : flags);
+		if( new_flags != msg->m_flags ) {
+			if( (new_flags&MOCK_SEEN) && !(msg->m_flags&MOCK_SEEN) ) {
+				ths->m_seen_cnt++;
+			}
+			msg->m_flags = new_flags;
+			msg->m_modseq = folder->m_highestmodseq = ++ths->m_modseq;
+		}
+
+		if( !silent ) {
+			sendf(conn->m_fd, "* %i FETCH (%sFLAGS (%s))\r\n", i+1, by_uid? "UID " : "", flags_str(msg->m_flags));
+		}
+	}
+}
+
+
+static int expunge__(mockconn_t* conn, int folder_idx, int (*shall_remove)(mockmsg_t*, void*), void* userdata, int send_untagged)
+{
+	/* remove the messages selected by the callback, the sequence numbers of the following messages are decreased by one then */
+	mockimap_t*   ths = conn->m_server;
+	mockfolder_t* folder = &ths->m_folders[folder_idx];
+	int           r, w, removed = 0;
+
+	for( r = 0, w = 0; r < folder->m_cnt; r++ ) {
+		if( shall_remove(&folder->m_msgs[r], userdata) ) {
+			if( send_untagged ) {
+				sendf(conn->m_fd, "* %i EXPUNGE\r\n", w+1);
+			}
+			free(folder->m_msgs[r].m_data);
+			removed++;
+		}
+		else {
+			folder->m_msgs[w++] = folder->m_msgs[r];
+		}
+	}
+	folder->m_cnt = w;
+
+	if( removed ) {
+		folder->m_highestmodseq = ++ths->m_modseq;
+	}
+	return removed;
+}
+
+
+static int is_deleted(mockmsg_t* msg, void* userdata)
+{
+	return (msg->m_flags&MOCK_DELETED)!=0;
+}
+
+
+static int is_marked(mockmsg_t* msg, void* userdata)
+{
+	return msg->m_data == NULL;
+}
+
+
+static void handle_copy__(mockconn_t* conn, const char* tag, const char* set, const char* dest_name, int by_uid, int move)
+{
+	/* copy or move messages to another folder; the new UIDs are returned as COPYUID, see RFC 4315 and RFC 6851 */
+	mockimap_t*   ths = conn->m_server;
+	mockfolder_t* folder = &ths->m_folders[conn->m_selected];
+	int           dest_idx = find_folder__(ths, dest_name), i;
+	char          src_set[1024] = "", dest_set[1024] = "";
+	size_t        src_used = 0, dest_used = 0;
+
+	if( dest_idx < 0 ) {
+		sendf(conn->m_fd, "%s NO [TRYCREATE] folder does not exist\r\n", tag);
+		return;
+	}
+
+	for( i = 0; i < folder->m_cnt; i++ )
+	{
+		mockmsg_t* msg = &folder->m_msgs[i], *copy;
+		char*      data;
+		if( !in_set_msg(folder, i, set, by_uid) || dest_idx == conn->m_selected ) {
+			continue;
+		}
+
+		if( move ) {
+			data = msg->m_data;
+			msg->m_data = NULL; /* marks the message for removal, see is_marked() */
+		}
+		else if( (data=malloc(msg->m_bytes+1))!=NULL ) {
+			memcpy(data, msg->m_data, msg->m_bytes+1);
+		}
+		else {
+			exit(1);
+		}
+
+		copy = add_msg__(ths, dest_idx, data, msg->m_bytes, msg->m_flags);
+		folder = &ths->m_folders[conn->m_selected];
+		msg = &folder->m_msgs[i];
+
+		if( src_used+24 < sizeof(src_set) && dest_used+24 < sizeof(dest_set) ) {
+			src_used += snprintf(&src_set[src_used], sizeof(src_set)-src_used, "%s%i", src_used? "," : "", (int)msg->m_uid);
+			dest_used += snprintf(&dest_set[dest_used], sizeof(dest_set)-dest_used, "%s%i", dest_used? "," : "", (int)copy->m_uid);
+		}
+	}
+
+	if( move ) {
+		expunge__(conn, conn->m_selected, is_marked, NULL, 1);
+	}
+
+	if( src_used ) {
+		/* RFC 6851 suggests an untagged OK for MOVE, however, libetpan reads COPYUID from the tagged response as well */
+		sendf(conn->m_fd, "%s OK [COPYUID %i %s %s] %s completed\r\n", tag, (int)ths->m_folders[dest_idx].m_uidvalidity, src_set, dest_set, move? "MOVE" : "COPY");
+	}
+	else {
+		sendf(conn->m_fd, "%s OK %s completed\r\n", tag, move? "MOVE" : "COPY");
+	}
+
+	if( src_used ) {
+		notify_exists__(ths, dest_idx);
+	}
+}
+
+
+static void handle_search__(mockconn_t* conn, const char* args, int by_uid)
+{
+	/* only `HEADER Message-ID <id>` and `ALL` are supported, this is what mrimap_t uses */
+	mockfolder_t* folder = &conn->m_server->m_folders[conn->m_selected];
+	const char*   header = strstr(args, "HEADER");
+	char          field[64] = "", value[256] = "", msgid[256];
+	int           i;
+
+	if( header ) {
+		get_arg(get_arg(header+6, field, sizeof(field)), value, sizeof(value));
+	}
+
+	sendf(conn->m_fd, "* SEARCH");
+	for( i = 0; i < folder->m_cnt; i++ )
+	{
+		if( header ) {
+			get_message_id(&folder->m_msgs[i], msgid, sizeof(msgid));
+			if( strcasecmp(field, "Message-ID")!=0 || strlen(value) < 2 || strncmp(value+1, msgid, strlen(value)-2)!=0 || strlen(msgid)!=strlen(value)-2 ) {
+				continue;
+			}
+		}
+		sendf(conn->m_fd, " %i", by_uid? (int)folder->m_msgs[i].m_uid : i+1);
+	}
+	sendf(conn->m_fd, "\r\n");
+}
+
+
+static void handle_status__(mockconn_t* conn, const char* tag, const char* args)
+{
+	mockimap_t*   ths = conn->m_server;
+	char          name[256];
+	const char*   atts = get_arg(args, name, sizeof(name));
+	int           folder_idx = find_folder__(ths, name), unseen = 0, i;
+	mockfolder_t* folder;
+	char          line[512];
+	size_t        used = 0;
+
+	if( folder_idx < 0 ) {
+		sendf(conn->m_fd, "%s NO folder does not exist\r\n", tag);
+		return;
+	}
+
+	folder = &ths->m_folders[folder_idx];
+	for( i = 0; i < folder->m_cnt; i++ ) {
+		if( !(folder->m_msgs[i].m_flags&MOCK_SEEN) ) { unseen++; }
+	}
+
+	used += snprintf(&line[used], sizeof(line)-used, "* STATUS \"%s\" (", folder->m_name);
+	if( strstr(atts, "MESSAGES") )      { used += snprintf(&line[used], sizeof(line)-used, "MESSAGES %i ", folder->m_cnt); }
+	if( strstr(atts, "UIDNEXT") )       { used += snprintf(&line[used], sizeof(line)-used, "UIDNEXT %i ", (int)folder->m_uidnext); }
+	if( strstr(atts, "UIDVALIDITY") )   { used += snprintf(&line[used], sizeof(line)-used, "UIDVALIDITY %i ", (int)folder->m_uidvalidity); }
+	if( strstr(atts, "UNSEEN") )        { used += snprintf(&line[used], sizeof(line)-used, "UNSEEN %i ", unseen); }
+	if( strstr(atts, "HIGHESTMODSEQ") ) { used += snprintf(&line[used], sizeof(line)-used, "HIGHESTMODSEQ %llu ", (unsigned long long)folder->m_highestmodseq); }
+	if( line[used-1]==' ' ) { used--; }
+	sendf(conn->m_fd, "%.*s)\r\n%s OK STATUS completed\r\n", (int)used, line, tag);
+}
+
+
+static void handle_select__(mockconn_t* conn, const char* tag, const char* cmd, const char* args)
+{
+	mockimap_t*   ths = conn->m_server;
+	char          name[256];
+	mockfolder_t* folder;
+
+	get_arg(args, name, sizeof(name));
+	if( (conn->m_selected=find_folder__(ths, name)) < 0 ) {
+		sendf(conn->m_fd, "%s NO folder does not exist\r\n", tag);
+		return;
+	}
+
+	folder = &ths->m_folders[conn->m_selected];
+	sendf(conn->m_fd,
+		"* FLAGS (\\Seen \\Deleted $MDNSent)\r\n"
+		"* OK [PERMANENTFLAGS (\\Seen \\Deleted $MDNSent \\*)] flags permitted\r\n"
+		"* %i EXISTS\r\n"
+		"* 0 RECENT\r\n"
+		"* OK [UIDVALIDITY %i] UIDs valid\r\n"
+		"* OK [UIDNEXT %i] next UID\r\n"
+		"* OK [HIGHESTMODSEQ %llu] highest modseq\r\n"
+		"%s OK [%s] %s completed\r\n",
+		folder->m_cnt, (int)folder->m_uidvalidity, (int)folder->m_uidnext, (unsigned long long)folder->m_highestmodseq,
+		tag, strcasecmp(cmd, "EXAMINE")==0? "READ-ONLY" : "READ-WRITE", cmd);
+}
+
+
+static void handle_append__(mockconn_t* conn, const char* tag, const char* args, char* data /*takes ownership*/, size_t bytes)
+{
+	/* `APPEND <folder> [(<flags>)] [<date>] {<bytes>}`, the literal is already read; the UID is returned as APPENDUID, see RFC 4315 */
+	mockimap_t* ths = conn->m_server;
+	char        name[256];
+	const char* rest = get_arg(args, name, sizeof(name)), *flags = strchr(rest, '(');
+	int         folder_idx = find_folder__(ths, name);
+	mockmsg_t*  msg;
+
+	if( folder_idx < 0 ) {
+		free(data);
+		sendf(conn->m_fd, "%s NO [TRYCREATE] folder does not exist\r\n", tag);
+		return;
+	}
+
+	msg = add_msg__(ths, folder_idx, data, bytes, flags? parse_flags(flags) : 0);
+	sendf(conn->m_fd, "%s OK [APPENDUID %i %i] APPEND completed\r\n", tag, (int)ths->m_folders[folder_idx].m_uidvalidity, (int)msg->m_uid);
+	notify_exists__(ths, folder_idx);
+}
+
+
+static void handle_list__(mockconn_t* conn, const char* tag, const char* cmd)
+{
+	mockimap_t* ths = conn->m_server;
+	int         i;
+	for( i = 0; i < ths->m_folder_cnt; i++ ) {
+		sendf(conn->m_fd, "* %s (\\HasNoChildren) \".\" \"%s\"\r\n", cmd, ths->m_folders[i].m_name);
+	}
+	sendf(conn->m_fd, "%s OK %s completed\r\n", tag, cmd);
+}
+
+
+/*******************************************************************************
+ * Connections
+ ******************************************************************************/
+
+
+static int fill_buf(mockconn_t* conn)
+{
+	ssize_t r;
+	if( conn->m_buf_bytes >= sizeof(conn->m_buf) ) {
+		return 0; /* line too long */
+	}
+	r = recv(conn->m_fd, &conn->m_buf[conn->m_buf_bytes], sizeof(conn->m_buf)-conn->m_buf_bytes, 0);
+	if( r <= 0 ) {
+		return 0;
+	}
+	conn->m_buf_bytes += r;
+	return 1;
+}
+
+
+static void consume(mockconn_t* conn, size_t bytes)
+{
+	conn->m_buf_bytes -= bytes;
+	memmove(conn->m_buf, &conn->m_buf[bytes], conn->m_buf_bytes);
+}
+
+
+static char* read_line(mockconn_t* conn)
+{
+	/* read a line without the CRLF, the returned string must be free()'d */
+	while( 1 )
+	{
+		size_t bytes;
+		for( bytes = 0; bytes+1 < conn->m_buf_bytes; bytes++ ) {
+			if( conn->m_buf[bytes]=='\r' && conn->m_buf[bytes+1]=='\n' ) {
+				break;
+			}
+		}
+
+		if( bytes+1 < conn->m_buf_bytes ) {
+			char* line = malloc(bytes+1);
+			if( line == NULL ) {
+				exit(1);
+			}
+			memcpy(line, conn->m_buf, bytes);
+			line[bytes] = 0;
+			consume(conn, bytes+2);
+			return line;
+		}
+
+		if( !fill_buf(conn) ) {
+			return NULL;
+		}
+	}
+}
+
+
+static char* read_literal(mockconn_t* conn, size_t bytes)
+{
+	/* read the `bytes` following a `{<bytes>}` line, the returned data is null-terminated and must be free()'d */
+	char*  data = malloc(bytes+1);
+	size_t got = 0;
+	if( data == NULL ) {
+		exit(1);
+	}
+
+	while( got < bytes ) {
+		size_t n;
+		if( conn->m_buf_bytes == 0 && !fill_buf(conn) ) {
+			free(data);
+			return NULL;
+		}
+		n = conn->m_buf_bytes < bytes-got? conn->m_buf_bytes : bytes-got;
+		memcpy(&data[got], conn->m_buf, n);
+		consume(conn, n);
+		got += n;
+	}
+
+	data[bytes] = 0;
+	return data;
+}
+
+
+static void* conn_thread_entry_point(void* entry_arg)
+{
+	mockconn_t* conn = (mockconn_t*)entry_arg;
+	mockimap_t* ths = conn->m_server;
+	char*       line = NULL, *literal = NULL;
+	size_t      literal_bytes = 0;
+	int         logout = 0;
+
+	sendf(conn->m_fd, "* OK [CAPABILITY IMAP4rev1 IDLE CONDSTORE UIDPLUS MOVE] mockimap ready\r\n");
+
+	while( !logout && (line=read_line(conn))!=NULL )
+	{
+		char        tag[64] = "", cmd[64] = "", sub[64] = "", set[16384] = "";
+		const char* args, *p;
+		int         by_uid = 0;
+
+		sscanf(line, "%63s %63s", tag, cmd);
+		args = line + strlen(tag);
+		while( *args==' ' ) { args++; }
+		args += strlen(cmd);
+		while( *args==' ' ) { args++; }
+
+		/* read a trailing literal as used by APPEND, the rest of the command follows in the next line */
+		if( (p=strrchr(line, '{'))!=NULL && line[strlen(line)-1]=='}' ) {
+			literal_bytes = strtoul(p+1, NULL, 10);
+			if( strchr(p, '+')==NULL ) { /* non-synchronizing literals `{n+}` need no continuation, see RFC 7888 */
+				sendf(conn->m_fd, "+ Ready for literal data\r\n");
+			}
+			if( (literal=read_literal(conn, literal_bytes))==NULL ) {
+				break;
+			}
+			free(read_line(conn));
+		}
+
+		pthread_mutex_lock(&ths->m_critical);
+			ths->m_cmd_cnt++;
+		pthread_mutex_unlock(&ths->m_critical);
+
+		if( ths->m_latency_ms ) {
+			usleep(ths->m_latency_ms*1000);
+		}
+
+		/* `UID <cmd> <set> ...` is handled as `<cmd> <set> ...` with UIDs instead of sequence numbers */
+		if( strcasecmp(cmd, "UID")==0 ) {
+			by_uid = 1;
+			sscanf(args, "%63s", cmd);
+			args += strlen(cmd);
+			while( *args==' ' ) { args++; }
+		}
+
+		pthread_mutex_lock(&ths->m_critical);
+
+			if( strcasecmp(tag, "DONE")==0 ) {
+				conn->m_idling = 0;
+				sendf(conn->m_fd, "%s OK IDLE terminated\r\n", conn->m_idle_tag);
+			}
+			else if( strcasecmp(cmd, "CAPABILITY")==0 ) {
+				sendf(conn->m_fd, "* CAPABILITY IMAP4rev1 IDLE CONDSTORE UIDPLUS MOVE\r\n%s OK CAPABILITY completed\r\n", tag);
+			}
+			else if( strcasecmp(cmd, "LIST")==0 || strcasecmp(cmd, "XLIST")==0 || strcasecmp(cmd, "LSUB")==0 ) {
+				handle_list__(conn, tag, cmd);
+			}
+			else if( strcasecmp(cmd, "CREATE")==0 ) {
+				get_arg(args, sub, sizeof(sub));
+				if( find_folder__(ths, sub) >= 0 || add_folder__(ths, sub) < 0 ) {
+					sendf(conn->m_fd, "%s NO [ALREADYEXISTS] cannot create folder\r\n", tag);
+				}
+				else {
+					sendf(conn->m_fd, "%s OK CREATE completed\r\n", tag);
+				}
+			}
+			else if( strcasecmp(cmd, "SELECT")==0 || strcasecmp(cmd, "EXAMINE")==0 ) {
+				handle_select__(conn, tag, cmd, args);
+			}
+			else if( strcasecmp(cmd, "STATUS")==0 ) {
+				handle_status__(conn, tag, args);
+			}
+			else if( strcasecmp(cmd, "APPEND")==0 && literal ) {
+				handle_append__(conn, tag, args, literal, literal_bytes);
+				literal = NULL;
+			}
+			else if( (strcasecmp(cmd, "FETCH")==0 || strcasecmp(cmd, "STORE")==0 || strcasecmp(cmd, "COPY")==0 || strcasecmp(cmd, "MOVE")==0
+			       || strcasecmp(cmd, "SEARCH")==0 || strcasecmp(cmd, "EXPUNGE")==0 || strcasecmp(cmd, "CLOSE")==0) && conn->m_selected < 0 ) {
+				sendf(conn->m_fd, "%s BAD no folder selected\r\n", tag);
+			}
+			else if( strcasecmp(cmd, "FETCH")==0 ) {
+				args = get_arg(args, set, sizeof(set));
+				handle_fetch__(conn, set, args, by_uid);
+				sendf(conn->m_fd, "%s OK FETCH completed\r\n", tag);
+			}
+			else if( strcasecmp(cmd, "STORE")==0 ) {
+				args = get_arg(args, set, sizeof(set));
+				while( *args==' ' ) { args++; }
+				handle_store__(conn, set, args, by_uid);
+				sendf(conn->m_fd, "%s OK STORE completed\r\n", tag);
+			}
+			else if( strcasecmp(cmd, "COPY")==0 || strcasecmp(cmd, "MOVE")==0 ) {
+				get_arg(get_arg(args, set, sizeof(set)), sub, sizeof(sub));
+				handle_copy__(conn, tag, set, sub, by_uid, strcasecmp(cmd, "MOVE")==0);
+			}
+			else if( strcasecmp(cmd, "SEARCH")==0 ) {
+				handle_search__(conn, args, by_uid);
+				sendf(conn->m_fd, "%s OK SEARCH completed\r\n", tag);
+			}
+			else if( strcasecmp(cmd, "EXPUNGE")==0 ) {
+				expunge__(conn, conn->m_selected, is_deleted, NULL, 1);
+				sendf(conn->m_fd, "%s OK EXPUNGE completed\r\n", tag);
+			}
+			else if( strcasecmp(cmd, "CLOSE")==0 ) {
+				expunge__(conn, conn->m_selected, is_deleted, NULL, 0);
+				conn->m_selected = -1;
+				sendf(conn->m_fd, "%s OK CLOSE completed\r\n", tag);
+			}
+			else if( strcasecmp(cmd, "IDLE")==0 ) {
+				snprintf(conn->m_idle_tag, sizeof(conn->m_idle_tag), "%s", tag);
+				conn->m_idling = 1;
+				sendf(conn->m_fd, "+ idling\r\n");
+			}
+			else if( strcasecmp(cmd, "LOGOUT")==0 ) {
+				sendf(conn->m_fd, "* BYE mockimap logging out\r\n%s OK LOGOUT completed\r\n", tag);
+				logout = 1;
+			}
+			else {
+				/* LOGIN, NOOP, SUBSCRIBE, ENABLE etc. are just confirmed */
+				sendf(conn->m_fd, "%s OK %s completed\r\n", tag, cmd);
+			}
+
+		pthread_mutex_unlock(&ths->m_critical);
+
+		free(literal);
+		literal = NULL;
+		free(line);
+		line = NULL;
+	}
+
+	free(line);
+
+	pthread_mutex_lock(&ths->m_critical);
+		conn->m_finished = 1;
+	pthread_mutex_unlock(&ths->m_critical);
+	return NULL;
+}
+
+
+static void* server_thread_entry_point(void* entry_arg)
+{
+	mockimap_t* ths = (mockimap_t*)entry_arg;
+	int         fd, i;
+
+	while( (fd=accept(ths->m_listen_fd, NULL, NULL)) >= 0 )
+	{
+		mockconn_t* conn = NULL;
+		int        nodelay = 1;
+
+		/* responses are sent in several parts, without TCP_NODELAY, Nagle's algorithm and delayed ACKs add 40 ms to many round-trips */
+		setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));
+
+		/* each connection is handled by a thread, finished connections are reaped here */
+		pthread_mutex_lock(&ths->m_critical);
+			for( i = 0; i < MOCKIMAP_MAX_CONNS; i++ ) {
+				if( ths->m_conns[i] && ths->m_conns[i]->m_finished ) {
+					pthread_join(ths->m_conns[i]->m_thread, NULL);
+					close(ths->m_conns[i]->m_fd);
+					free(ths->m_conns[i]);
+					ths->m_conns[i] = NULL;
+				}
+				if( ths->m_conns[i] == NULL && conn == NULL && (conn=calloc(1, sizeof(mockconn_t)))!=NULL ) {
+					conn->m_server   = ths;
+					conn->m_fd       = fd;
+					conn->m_selected = -1;
+					ths->m_conns[i]  = conn;
+				}
+			}
+			if( conn ) {
+				pthread_create(&conn->m_thread, NULL, conn_thread_entry_point, conn);
+			}
+		pthread_mutex_unlock(&ths->m_critical);
+
+		if( conn == NULL ) {
+			close(fd); /* too many connections */
+		}
+	}
+	return NULL;
+}
+
+
+mockimap_t* mockimap_new(int msg_cnt, int msg_bytes, int latency_ms)
+{
+	mockimap_t*        ths = calloc(1, sizeof(mockimap_t));
+	struct sockaddr_in addr;
+	socklen_t          addr_len = sizeof(addr);
+	int                i;
+
+	if( ths == NULL ) {
+		return NULL;
+	}
+
+	pthread_mutex_init(&ths->m_critical, NULL);
+	ths->m_latency_ms = latency_ms;
+
+	add_folder__(ths, "INBOX");
+	for( i = 1; i <= msg_cnt; i++ ) {
+		size_t bytes;
+		char*  msg = render_msg(i, msg_bytes, &bytes);
+		add_msg__(ths, 0, msg, bytes, 0); /* the messages have the UIDs and sequence numbers 1..msg_cnt */
+	}
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family      = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	addr.sin_port        = 0; /* let the system choose a free port */
+
+	if( (ths->m_listen_fd=socket(AF_INET, SOCK_STREAM, 0)) < 0
+	 || bind(ths->m_listen_fd, (struct sockaddr*)&addr, sizeof(addr)) != 0
+	 || listen(ths->m_listen_fd, 4) != 0
+	 || getsockname(ths->m_listen_fd, (struct sockaddr*)&addr, &addr_len) != 0 ) {
+		if( ths->m_listen_fd >= 0 ) { close(ths->m_listen_fd); }
+		ths->m_listen_fd = -1;
+		mockimap_unref(ths);
+		return NULL;
+	}
+	ths->m_port = ntohs(addr.sin_port);
+
+	pthread_create(&ths->m_thread, NULL, server_thread_entry_point, ths);
+	return ths;
+}
+
+
+void mockimap_unref(mockimap_t* ths)
+{
+	int i, j;
+
+	if( ths == NULL ) {
+		return;
+	}
+
+	if( ths->m_listen_fd >= 0 ) {
+		shutdown(ths->m_listen_fd, SHUT_RDWR); /* makes accept() return */
+		close(ths->m_listen_fd);
+		pthread_join(ths->m_thread, NULL);
+	}
+
+	for( i = 0; i < MOCKIMAP_MAX_CONNS; i++ ) {
+		if( ths->m_conns[i] ) {
+			shutdown(ths->m_conns[i]->m_fd, SHUT_RDWR); /* makes recv() return */
+			pthread_join(ths->m_conns[i]->m_thread, NULL);
+			close(ths->m_conns[i]->m_fd);
+			free(ths->m_conns[i]);
+		}
+	}
+
+	for( i = 0; i < ths->m_folder_cnt; i++ ) {
+		for( j = 0; j < ths->m_folders[i].m_cnt; j++ ) {
+			free(ths->m_folders[i].m_msgs[j].m_data);
+		}
+		free(ths->m_folders[i].m_msgs);
+		free(ths->m_folders[i].m_name);
+	}
+
+	pthread_mutex_destroy(&ths->m_critical);
+	free(ths);
+}
+
+
+int mockimap_get_port(mockimap_t* ths)
+{
+	return ths? ths->m_port : 0;
+}
+
+
+uint32_t mockimap_add_msg(mockimap_t* ths, const char* folder, const char* data, size_t bytes)
+{
+	uint32_t uid = 0;
+	char*    copy;
+	int      folder_idx;
+
+	if( ths == NULL || folder == NULL || data == NULL || (copy=malloc(bytes+1))==NULL ) {
+		return 0;
+	}
+	memcpy(copy, data, bytes);
+	copy[bytes] = 0;
+
+	pthread_mutex_lock(&ths->m_critical);
+		if( (folder_idx=find_folder__(ths, folder)) < 0 ) {
+			folder_idx = add_folder__(ths, folder);
+		}
+		if( folder_idx >= 0 ) {
+			uid = add_msg__(ths, folder_idx, copy, bytes, 0)->m_uid;
+			notify_exists__(ths, folder_idx);
+		}
+		else {
+			free(copy);
+		}
+	pthread_mutex_unlock(&ths->m_critical);
+
+	return uid;
+}
+
+
+int mockimap_get_cmd_cnt(mockimap_t* ths)
+{
+	int cnt;
+	if( ths == NULL ) {
+		return 0;
+	}
+	pthread_mutex_lock(&ths->m_critical);
+		cnt = ths->m_cmd_cnt;
+	pthread_mutex_unlock(&ths->m_critical);
+	return cnt;
+}
+
+
+int mockimap_get_seen_cnt(mockimap_t* ths)
+{
+	int cnt;
+	if( ths == NULL ) {
+		return 0;
+	}
+	pthread_mutex_lock(&ths->m_critical);
+		cnt = ths->m_seen_cnt;
+	pthread_mutex_unlock(&ths->m_critical);
+	return cnt;
+}
+
+
+int mockimap_get_idle_cnt(mockimap_t* ths)
+{
+	int cnt = 0, i;
+	if( ths == NULL ) {
+		return 0;
+	}
+	pthread_mutex_lock(&ths->m_critical);
+		for( i = 0; i < MOCKIMAP_MAX_CONNS; i++ ) {
+			if( ths->m_conns[i] && !ths->m_conns[i]->m_finished && ths->m_conns[i]->m_idling ) {
+				cnt++;
+			}
+		}
+	pthread_mutex_unlock(&ths->m_critical);
+	return cnt;
+}
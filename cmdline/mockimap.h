@@ -0,0 +1,55 @@
+/*******************************************************************************
+ *
+ *                              Delta Chat Core
+ *                      Copyright (C) 2017 Björn Petersen
+ *                   Contact: r10s@b44t.com, http://b44t.com
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see http://www.gnu.org/licenses/ .
+ *
+ ******************************************************************************/
+
+
+
+#ifndef __MOCKIMAP_H__
+#define __MOCKIMAP_H__
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+#include <stdint.h>
+#include <stddef.h>
+
+
+/* A minimal IMAP server on 127.0.0.1 holding its folders and messages in memory.
+The server understands the commands used by mrimap_t incl. IDLE, CONDSTORE,
+UIDPLUS and MOVE; it is used to benchmark mrimap_t and the whole mailbox without
+network, see the cmdline commands benchimap and benchmarkseen and benche2e.c.
+mockimap_new() creates an INBOX with `msg_cnt` generated messages, more messages
+can be added by mockimap_add_msg() at any time; clients in IDLE are notified then. */
+typedef struct mockimap_t mockimap_t;
+
+mockimap_t* mockimap_new          (int msg_cnt, int msg_bytes, int latency_ms);
+void        mockimap_unref        (mockimap_t*);
+int         mockimap_get_port     (mockimap_t*);
+uint32_t    mockimap_add_msg      (mockimap_t*, const char* folder, const char* data, size_t bytes); /* the folder is created if needed, returns the UID */
+int         mockimap_get_cmd_cnt  (mockimap_t*); /* number of commands received, each command is one round-trip */
+int         mockimap_get_seen_cnt (mockimap_t*); /* number of messages marked as seen by STORE */
+int         mockimap_get_idle_cnt (mockimap_t*); /* number of clients currently in IDLE */
+
+
+#ifdef __cplusplus
+} /* /extern "C" */
+#endif
+#endif /* __MOCKIMAP_H__ */
@@ -0,0 +1,360 @@
+/*******************************************************************************
+ *
+ *                              Delta Chat Core
+ *                      Copyright (C) 2017 Björn Petersen
+ *                   Contact: r10s@b44t.com, http://b44t.com
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see http://www.gnu.org/licenses/ .
+ *
+ ******************************************************************************/
+
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include "mocksmtp.h"
+
+
+#define MOCKSMTP_MAX_CONNS 4
+
+
+typedef struct mocksmtpconn_t
+{
+	mocksmtp_t* m_server;
+	int         m_fd;
+	pthread_t   m_thread;
+	int         m_finished;
+
+	char        m_buf[65536];
+	size_t      m_buf_bytes;
+} mocksmtpconn_t;
+
+
+struct mocksmtp_t
+{
+	pthread_mutex_t  m_critical;
+	int              m_cmd_cnt;
+	int              m_msg_cnt;
+	mocksmtpconn_t*  m_conns[MOCKSMTP_MAX_CONNS];
+
+	mockimap_t*      m_deliver_to;
+	int              m_latency_ms;  /* added before each reply to simulate a network round-trip */
+	int              m_listen_fd;
+	int              m_port;
+	pthread_t        m_thread;
+};
+
+
+static void send_str(int fd, const char* str)
+{
+	size_t bytes = strlen(str), sent = 0;
+	while( sent < bytes ) {
+		ssize_t r = send(fd, &str[sent], bytes-sent, MSG_NOSIGNAL);
+		if( r <= 0 ) {
+			return;
+		}
+		sent += r;
+	}
+}
+
+
+static char* read_line(mocksmtpconn_t* conn, size_t* ret_bytes)
+{
+	/* read a line without the CRLF, the returned string must be free()'d */
+	while( 1 )
+	{
+		size_t  bytes;
+		ssize_t r;
+		for( bytes = 0; bytes+1 < conn->m_buf_bytes; bytes++ ) {
+			if( conn->m_buf[bytes]=='\r' && conn->m_buf[bytes+1]=='\n' ) {
+				break;
+			}
+		}
+
+		if( bytes+1 < conn->m_buf_bytes ) {
+			char* line = malloc(bytes+1);
+			if( line == NULL ) {
+				exit(1);
+			}
+			memcpy(line, conn->m_buf, bytes);
+			line[bytes] = 0;
+			conn->m_buf_bytes -= bytes+2;
+			memmove(conn->m_buf, &conn->m_buf[bytes+2], conn->m_buf_bytes);
+			if( ret_bytes ) { *ret_bytes = bytes; }
+			return line;
+		}
+
+		if( conn->m_buf_bytes >= sizeof(conn->m_buf)
+		 || (r=recv(conn->m_fd, &conn->m_buf[conn->m_buf_bytes], sizeof(conn->m_buf)-conn->m_buf_bytes, 0)) <= 0 ) {
+			return NULL;
+		}
+		conn->m_buf_bytes += r;
+	}
+}
+
+
+static int read_data(mocksmtpconn_t* conn)
+{
+	/* read the message following DATA up to the line with a single dot, dots at the beginning of a line are unstuffed, see RFC 5321, 4.5.2 */
+	char*  msg = NULL, *line;
+	size_t msg_bytes = 0, msg_alloc = 0, line_bytes;
+
+	while( (line=read_line(conn, &line_bytes))!=NULL )
+	{
+		const char* p = line;
+		if( strcmp(line, ".")==0 ) {
+			free(line);
+			break;
+		}
+		if( p[0]=='.' ) {
+			p++;
+			line_bytes--;
+		}
+
+		if( msg_bytes+line_bytes+3 > msg_alloc ) {
+			msg_alloc = (msg_bytes+line_bytes+3)*2;
+			if( (msg=realloc(msg, msg_alloc))==NULL ) {
+				exit(1);
+			}
+		}
+		memcpy(&msg[msg_bytes], p, line_bytes);
+		msg_bytes += line_bytes;
+		msg[msg_bytes++] = '\r';
+		msg[msg_bytes++] = '\n';
+		free(line);
+	}
+
+	if( line == NULL ) {
+		free(msg);
+		return 0; /* connection closed */
+	}
+
+	pthread_mutex_lock(&conn->m_server->m_critical);
+		conn->m_server->m_msg_cnt++;
+	pthread_mutex_unlock(&conn->m_server->m_critical);
+
+	if( conn->m_server->m_deliver_to && msg ) {
+		mockimap_add_msg(conn->m_server->m_deliver_to, "INBOX", msg, msg_bytes);
+	}
+
+	free(msg);
+	return 1;
+}
+
+
+static void* conn_thread_entry_point(void* entry_arg)
+{
+	mocksmtpconn_t* conn = (mocksmtpconn_t*)entry_arg;
+	mocksmtp_t*     ths = conn->m_server;
+	char*           line;
+	int             quit = 0;
+
+	send_str(conn->m_fd, "220 mocksmtp ready\r\n");
+
+	while( !quit && (line=read_line(conn, NULL))!=NULL )
+	{
+		char cmd[16] = "", mech[16] = "", initial[1024] = "";
+		sscanf(line, "%15s %15s %1023s", cmd, mech, initial);
+
+		pthread_mutex_lock(&ths->m_critical);
+			ths->m_cmd_cnt++;
+		pthread_mutex_unlock(&ths->m_critical);
+
+		if( ths->m_latency_ms ) {
+			usleep(ths->m_latency_ms*1000);
+		}
+
+		if( strcasecmp(cmd, "EHLO")==0 ) {
+			send_str(conn->m_fd, "250-mocksmtp\r\n250-PIPELINING\r\n250-8BITMIME\r\n250-AUTH PLAIN LOGIN\r\n250 SIZE 52428800\r\n");
+		}
+		else if( strcasecmp(cmd, "HELO")==0 ) {
+			send_str(conn->m_fd, "250 mocksmtp\r\n");
+		}
+		else if( strcasecmp(cmd, "AUTH")==0 ) {
+			/* any credentials are accepted; PLAIN may come with an initial response, LOGIN asks for the user and the password */
+			int i, steps = strcasecmp(mech, "LOGIN")==0? 2 : (initial[0]? 0 : 1);
+			for( i = 0; i < steps; i++ ) {
+				send_str(conn->m_fd, strcasecmp(mech, "LOGIN")==0? (i==0? "334 VXNlcm5hbWU6\r\n" : "334 UGFzc3dvcmQ6\r\n") : "334 \r\n");
+				free(read_line(conn, NULL));
+			}
+			send_str(conn->m_fd, "235 2.7.0 Authentication successful\r\n");
+		}
+		else if( strcasecmp(cmd, "MAIL")==0 || strcasecmp(cmd, "RCPT")==0 || strcasecmp(cmd, "RSET")==0 || strcasecmp(cmd, "NOOP")==0 ) {
+			send_str(conn->m_fd, "250 2.0.0 OK\r\n");
+		}
+		else if( strcasecmp(cmd, "DATA")==0 ) {
+			send_str(conn->m_fd, "354 End data with <CR><LF>.<CR><LF>\r\n");
+			if( !read_data(conn) ) {
+				free(line);
+				break;
+			}
+			send_str(conn->m_fd, "250 2.0.0 OK queued\r\n");
+		}
+		else if( strcasecmp(cmd, "QUIT")==0 ) {
+			send_str(conn->m_fd, "221 2.0.0 Bye\r\n");
+			quit = 1;
+		}
+		else {
+			send_str(conn->m_fd, "502 5.5.2 Command not implemented\r\n");
+		}
+
+		free(line);
+	}
+
+	pthread_mutex_lock(&ths->m_critical);
+		conn->m_finished = 1;
+	pthread_mutex_unlock(&ths->m_critical);
+	return NULL;
+}
+
+
+static void* server_thread_entry_point(void* entry_arg)
+{
+	mocksmtp_t* ths = (mocksmtp_t*)entry_arg;
+	int         fd, i;
+
+	while( (fd=accept(ths->m_listen_fd, NULL, NULL)) >= 0 )
+	{
+		mocksmtpconn_t* conn = NULL;
+		int            nodelay = 1;
+
+		/* responses are sent in several parts, without TCP_NODELAY, Nagle's algorithm and delayed ACKs add 40 ms to many round-trips */
+		setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));
+
+		pthread_mutex_lock(&ths->m_critical);
+			for( i = 0; i < MOCKSMTP_MAX_CONNS; i++ ) {
+				if( ths->m_conns[i] && ths->m_conns[i]->m_finished ) {
+					pthread_join(ths->m_conns[i]->m_thread, NULL);
+					close(ths->m_conns[i]->m_fd);
+					free(ths->m_conns[i]);
+					ths->m_conns[i] = NULL;
+				}
+				if( ths->m_conns[i] == NULL && conn == NULL && (conn=calloc(1, sizeof(mocksmtpconn_t)))!=NULL ) {
+					conn->m_server  = ths;
+					conn->m_fd      = fd;
+					ths->m_conns[i] = conn;
+				}
+			}
+			if( conn ) {
+				pthread_create(&conn->m_thread, NULL, conn_thread_entry_point, conn);
+			}
+		pthread_mutex_unlock(&ths->m_critical);
+
+		if( conn == NULL ) {
+			close(fd); /* too many connections */
+		}
+	}
+	return NULL;
+}
+
+
+mocksmtp_t* mocksmtp_new(mockimap_t* deliver_to, int latency_ms)
+{
+	mocksmtp_t*        ths = calloc(1, sizeof(mocksmtp_t));
+	struct sockaddr_in addr;
+	socklen_t          addr_len = sizeof(addr);
+
+	if( ths == NULL ) {
+		return NULL;
+	}
+
+	pthread_mutex_init(&ths->m_critical, NULL);
+	ths->m_deliver_to = deliver_to;
+	ths->m_latency_ms = latency_ms;
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family      = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	addr.sin_port        = 0; /* let the system choose a free port */
+
+	if( (ths->m_listen_fd=socket(AF_INET, SOCK_STREAM, 0)) < 0
+	 || bind(ths->m_listen_fd, (struct sockaddr*)&addr, sizeof(addr)) != 0
+	 || listen(ths->m_listen_fd, 4) != 0
+	 || getsockname(ths->m_listen_fd, (struct sockaddr*)&addr, &addr_len) != 0 ) {
+		if( ths->m_listen_fd >= 0 ) { close(ths->m_listen_fd); }
+		pthread_mutex_destroy(&ths->m_critical);
+		free(ths);
+		return NULL;
+	}
+	ths->m_port = ntohs(addr.sin_port);
+
+	pthread_create(&ths->m_thread, NULL, server_thread_entry_point, ths);
+	return ths;
+}
+
+
+void mocksmtp_unref(mocksmtp_t* ths)
+{
+	int i;
+
+	if( ths == NULL ) {
+		return;
+	}
+
+	shutdown(ths->m_listen_fd, SHUT_RDWR); /* makes accept() return */
+	close(ths->m_listen_fd);
+	pthread_join(ths->m_thread, NULL);
+
+	for( i = 0; i < MOCKSMTP_MAX_CONNS; i++ ) {
+		if( ths->m_conns[i] ) {
+			shutdown(ths->m_conns[i]->m_fd, SHUT_RDWR); /* makes recv() return */
+			pthread_join(ths->m_conns[i]->m_thread, NULL);
+			close(ths->m_conns[i]->m_fd);
+			free(ths->m_conns[i]);
+		}
+	}
+
+	pthread_mutex_destroy(&ths->m_critical);
+	free(ths);
+}
+
+
+int mocksmtp_get_port(mocksmtp_t* ths)
+{
+	return ths? ths->m_port : 0;
+}
+
+
+int mocksmtp_get_cmd_cnt(mocksmtp_t* ths)
+{
+	int cnt;
+	if( ths == NULL ) {
+		return 0;
+	}
+	pthread_mutex_lock(&ths->m_critical);
+		cnt = ths->m_cmd_cnt;
+	pthread_mutex_unlock(&ths->m_critical);
+	return cnt;
+}
+
+
+int mocksmtp_get_msg_cnt(mocksmtp_t* ths)
+{
+	int cnt;
+	if( ths == NULL ) {
+		return 0;
+	}
+	pthread_mutex_lock(&ths->m_critical);
+		cnt = ths->m_msg_cnt;
+	pthread_mutex_unlock(&ths->m_critical);
+	return cnt;
+}
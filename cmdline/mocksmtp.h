@@ -0,0 +1,50 @@
+/*******************************************************************************
+ *
+ *                              Delta Chat Core
+ *                      Copyright (C) 2017 Björn Petersen
+ *                   Contact: r10s@b44t.com, http://b44t.com
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see http://www.gnu.org/licenses/ .
+ *
+ ******************************************************************************/
+
+
+
+#ifndef __MOCKSMTP_H__
+#define __MOCKSMTP_H__
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+#include "mockimap.h"
+
+
+/* A minimal SMTP server on 127.0.0.1 accepting any login and any message.
+The messages are counted and dropped; if a mockimap_t is given, they're
+delivered to its INBOX instead.  Used together with mockimap_t to benchmark
+sending without network, see benche2e.c. */
+typedef struct mocksmtp_t mocksmtp_t;
+
+mocksmtp_t* mocksmtp_new          (mockimap_t* deliver_to /*may be NULL*/, int latency_ms);
+void        mocksmtp_unref        (mocksmtp_t*);
+int         mocksmtp_get_port     (mocksmtp_t*);
+int         mocksmtp_get_cmd_cnt  (mocksmtp_t*); /* number of commands received, each command is one round-trip */
+int         mocksmtp_get_msg_cnt  (mocksmtp_t*); /* number of messages received */
+
+
+#ifdef __cplusplus
+} /* /extern "C" */
+#endif
+#endif /* __MOCKSMTP_H__ */
@@ -30,12 +30,17 @@ $ valgrind --leak-check=full --tool=memcheck ./deltachat-core <db>
 #include <assert.h>
 #include "../src/mrmailbox_internal.h"
 #include "../src/mrsimplify.h"
+#include "../src/mrsaxparser.h"
 #include "../src/mrmimeparser.h"
+#include "../src/mrcodec.h"
 #include "../src/mrmimefactory.h"
 #include "../src/mrpgp.h"
 #include "../src/mrapeerstate.h"
 #include "../src/mraheader.h"
 #include "../src/mrkeyring.h"
+#include "../src/mrkeypool.h"
+#include "../src/mrjob.h"
+#include "mockcorpus.h"
 
 
 /* some data used for testing
@@ -172,13 +177,75 @@ static const char* s_em_setupfile =
 "-----END PGP MESSAGE-----\n";
 
 
+static void stress_starttag_cb(void* userdata, const char* tag, char** attr)
+{
+	mrstrbuilder_catf((mrstrbuilder_t*)userdata, "<%s", tag);
+	for( ; attr[0]; attr += 2 ) {
+		mrstrbuilder_catf((mrstrbuilder_t*)userdata, " %s=%s", attr[0], attr[1]);
+	}
+	mrstrbuilder_cat((mrstrbuilder_t*)userdata, ">");
+}
+
+
+static void stress_endtag_cb(void* userdata, const char* tag)
+{
+	mrstrbuilder_catf((mrstrbuilder_t*)userdata, strcmp(tag, "br")==0? "|" : "</%s>", tag);
+}
+
+
+static void stress_text_cb(void* userdata, const char* text, int len)
+{
+	mrstrbuilder_cat((mrstrbuilder_t*)userdata, text); /* may be called several times for one text if the document is fed in chunks */
+}
+
+
+static int stress_is_utf8(const char* s)
+{
+	/* straightforward check as a reference for mr_utf8_repair(): decode the code points and check their ranges */
+	const unsigned char* p = (const unsigned char*)s;
+	while( *p ) {
+		uint32_t cp, min;
+		int      n, i;
+		     if( *p < 0x80 )           { p++; continue; }
+		else if( (*p & 0xE0) == 0xC0 ) { n = 1; cp = *p & 0x1F; min = 0x80; }
+		else if( (*p & 0xF0) == 0xE0 ) { n = 2; cp = *p & 0x0F; min = 0x800; }
+		else if( (*p & 0xF8) == 0xF0 ) { n = 3; cp = *p & 0x07; min = 0x10000; }
+		else                           { return 0; }
+		for( i = 1; i <= n; i++ ) {
+			if( (p[i] & 0xC0) != 0x80 ) { return 0; }
+			cp = (cp<<6) | (p[i] & 0x3F);
+		}
+		if( cp < min || cp > 0x10FFFF || (cp >= 0xD800 && cp <= 0xDFFF) ) { return 0; }
+		p += n+1;
+	}
+	return 1;
+}
+
+
+/* compare the counters maintained in the chats table against counting the messages, returns the number of chats with wrong counters */
+static int stress_count_bad_chat_counters(mrsqlite3_t* sql)
+{
+	int ret = -1;
+	sqlite3_stmt* stmt = mrsqlite3_prepare_v2_(sql,
+		"SELECT COUNT(*) FROM chats c"
+		" WHERE c.fresh_cnt!=(SELECT COUNT(*) FROM msgs WHERE chat_id=c.id AND state=" MR_STRINGIFY(MR_STATE_IN_FRESH) " AND hidden=0)"
+		"    OR c.noticed_cnt!=(SELECT COUNT(*) FROM msgs WHERE chat_id=c.id AND state=" MR_STRINGIFY(MR_STATE_IN_NOTICED) " AND hidden=0)"
+		"    OR c.total_cnt!=(SELECT COUNT(*) FROM msgs WHERE chat_id=c.id);");
+	if( stmt && sqlite3_step(stmt) == SQLITE_ROW ) {
+		ret = sqlite3_column_int(stmt, 0);
+	}
+	sqlite3_finalize(stmt);
+	return ret;
+}
+
+
 void stress_functions(mrmailbox_t* mailbox)
 {
 	/* test mrsimplify and mrsaxparser (indirectly used by mrsimplify)
 	 **************************************************************************/
 
 	{
-		mrsimplify_t* simplify = mrsimplify_new();
+		mrsimplify_t* simplify = mrsimplify_new(NULL);
 
 		const char* html = "\r\r\nline1<br>\r\n\r\n\r\rline2\n\r"; /* check, that `<br>\ntext` does not result in `\n text` */
 		char* plain = mrsimplify_simplify(simplify, html, strlen(html), 1);
@@ -200,9 +267,103 @@ void stress_functions(mrmailbox_t* mailbox)
 		assert( strcmp(plain, "<>\"'& äÄöÖüÜß fooÆçÇ ♦&noent;")==0 );
 		free(plain);
 
+		html = "<a =x>text</a>\r"; /* stray `=` in a tag and `\r` at the end of the text */
+		plain = mrsimplify_simplify(simplify, html, strlen(html), 1);
+		assert( strcmp(plain, "text")==0 );
+		free(plain);
+
+		html = "<p>&amp;lt;&#X41;</p>"; /* replaced text is not decoded again */
+		plain = mrsimplify_simplify(simplify, html, strlen(html), 1);
+		assert( strcmp(plain, "&lt;A")==0 );
+		free(plain);
+
+		/* the same events must be reported if a document is fed byte by byte */
+		{
+			html = "<!DOCTYPE x><p class=\"a&amp;b\">caf&eacute;\r\n<!-- c --><br/>x&#65;<![CDATA[&lt;]]></P>";
+			mrstrbuilder_t whole, bytewise;
+			mrsaxparser_t  saxparser;
+			int            i;
+			mrstrbuilder_init(&whole, 0);
+			mrsaxparser_init(&saxparser, &whole);
+			mrsaxparser_set_tag_handler(&saxparser, stress_starttag_cb, stress_endtag_cb);
+			mrsaxparser_set_text_handler(&saxparser, stress_text_cb);
+			mrsaxparser_parse(&saxparser, html);
+			assert( strcmp(whole.m_buf, "<p class=a&b>caf\xC3\xA9\n<br>|xA&lt;</p>")==0 );
+
+			mrstrbuilder_init(&bytewise, 0);
+			mrsaxparser_init(&saxparser, &bytewise);
+			mrsaxparser_set_tag_handler(&saxparser, stress_starttag_cb, stress_endtag_cb);
+			mrsaxparser_set_text_handler(&saxparser, stress_text_cb);
+			for( i = 0; html[i]; i++ ) {
+				mrsaxparser_feed(&saxparser, &html[i], 1, 0);
+			}
+			mrsaxparser_feed(&saxparser, NULL, 0, 1);
+			assert( strcmp(whole.m_buf, bytewise.m_buf)==0 );
+			free(whole.m_buf);
+			free(bytewise.m_buf);
+		}
+
+		const char* golden[] = { /* plain text and the expected result */
+			"line1\r\n\r\n\r\n\r\nline2\r\n-- \r\nfooter",                       "line1\n\nline2",
+			"answer\n\nOn Mon, someone wrote:\n> quote\n>\n> quote",           "answer [...]",
+			"> quote\n\nanswer\n----\nfooter",                                  "[...] answer [...]",
+			"---------- Forwarded message ----------\nFrom: a@b\n\ntext",      "text",
+			"text\n----- Original Message -----\nmore",                         "text [...]",
+			"no\rbreak\n--  ",                                                 "nobreak",
+			NULL };
+		int g;
+		for( g = 0; golden[g]; g += 2 ) {
+			plain = mrsimplify_simplify(simplify, golden[g], strlen(golden[g]), 0);
+			assert( strcmp(plain, golden[g+1])==0 );
+			free(plain);
+		}
+		assert( simplify->m_is_cut_at_begin==0 && simplify->m_is_cut_at_end==0 );
+
 		mrsimplify_unref(simplify);
 	}
 
+	/* test mrarena_t and mrsimplify with an arena
+	 **************************************************************************/
+
+	{
+		mrarena_t* arena = mrarena_new(256);
+
+		char* first = mrarena_strdup(arena, "foo");
+		assert( strcmp(first, "foo")==0 );
+		assert( strcmp(mrarena_strdup(arena, NULL), "")==0 );
+		assert( strcmp(mrarena_strndup(arena, "foobar", 3), "foo")==0 );
+		assert( strcmp(mrarena_mprintf(arena, "%s-%i", "foo", 42), "foo-42")==0 );
+		assert( strlen(mrarena_mprintf(arena, "%0300i", 1))==300 ); /* does not fit into the free memory of the block */
+
+		char* buf = mrarena_alloc(arena, 16);
+		strcpy(buf, "abc");
+		assert( mrarena_realloc(arena, buf, 16, 32)==buf ); /* the last allocation is extended in place */
+		char* big = mrarena_alloc(arena, 1000); /* gets a block of its own */
+		memset(big, 'x', 1000);
+		assert( strcmp(buf, "abc")==0 );
+		assert( strcmp(first, "foo")==0 );
+
+		mrarena_reset(arena);
+		assert( mrarena_alloc(arena, 8)==first ); /* the first block is kept */
+
+		const char* texts[] = { "<a href=url>text</a", "<p>line1</p><p>line2<br>line3</p>",
+			"line1\r\n\r\n> quote\r\n-- \r\nfooter", "> quote\n\nline1\n\n\n\nline2\n---\ncut", "", NULL };
+		int i;
+		for( i = 0; texts[i]; i++ ) {
+			mrsimplify_t* simplify_heap = mrsimplify_new(NULL);
+			mrsimplify_t* simplify_arena = mrsimplify_new(arena);
+			char* plain_heap = mrsimplify_simplify(simplify_heap, texts[i], strlen(texts[i]), i<2);
+			char* plain_arena = mrsimplify_simplify(simplify_arena, texts[i], strlen(texts[i]), i<2);
+			assert( strcmp(plain_heap, plain_arena)==0 );
+			assert( simplify_heap->m_is_cut_at_begin==simplify_arena->m_is_cut_at_begin && simplify_heap->m_is_cut_at_end==simplify_arena->m_is_cut_at_end );
+			free(plain_heap);
+			mrsimplify_unref(simplify_heap);
+			mrsimplify_unref(simplify_arena); /* does nothing, the object is released together with the arena */
+		}
+
+		mrarena_unref(arena);
+	}
+
 	/* test mailmime
 	**************************************************************************/
 
@@ -233,6 +394,209 @@ void stress_functions(mrmailbox_t* mailbox)
 		mailmime_free(mime);
 	}
 
+	/* test mailmime_transfer_decode_to_file(), the result must not depend on the buffer size
+	**************************************************************************/
+
+	if( mailbox->m_blobdir )
+	{
+		char  binary[3000];
+		int   i, k;
+		for( i = 0; i < sizeof(binary); i++ ) { binary[i] = (char)((i*7)^(i>>3)); }
+
+		char* base64 = mr_render_base64(binary, sizeof(binary), 76, "\r\n", 0);
+		const char* qp =
+			"line1 with =3D and =C3=A4=\r\n"
+			"continued soft break=\n"
+			"\r\n"
+			"trailing equals at the end of the text =3D\r\n"
+			"bare lf\nand a very long line without any breaks xxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxx=\r\n"
+			"last=3D";
+
+		const char* encoded[2] = { base64, qp };
+		int         encoding[2] = { MAILMIME_MECHANISM_BASE64, MAILMIME_MECHANISM_QUOTED_PRINTABLE };
+		size_t      buffer_bytes[] = { 1, 2, 3, 5, 7, 13, 64, 77, 78, 79, 1000, 1024*1024 };
+		char*       pathNfilename = mr_mprintf("%s/stress-decode.tmp", mailbox->m_blobdir);
+
+		assert( base64 );
+		for( k = 0; k < 2; k++ )
+		{
+			char*  expected = NULL;
+			size_t expected_bytes = 0, index = 0;
+			assert( mailmime_part_parse(encoded[k], strlen(encoded[k]), &index, encoding[k], &expected, &expected_bytes)==MAILIMF_NO_ERROR );
+			if( k==0 ) {
+				assert( expected_bytes==sizeof(binary) && memcmp(expected, binary, sizeof(binary))==0 );
+			}
+
+			for( i = 0; i < sizeof(buffer_bytes)/sizeof(buffer_bytes[0]); i++ )
+			{
+				void*  decoded = NULL;
+				size_t decoded_bytes = 0, written_bytes = 0;
+				assert( mailmime_transfer_decode_to_file(encoded[k], strlen(encoded[k]), encoding[k], buffer_bytes[i], pathNfilename, &written_bytes) );
+				assert( written_bytes==expected_bytes );
+				assert( mr_read_file(pathNfilename, &decoded, &decoded_bytes, mailbox) );
+				assert( decoded_bytes==expected_bytes && memcmp(decoded, expected, expected_bytes)==0 );
+				free(decoded);
+			}
+
+			mmap_string_unref(expected);
+		}
+
+		mr_delete_file(pathNfilename, mailbox);
+		free(pathNfilename);
+		free(base64);
+	}
+
+	/* test mrcodec, all implementations must give the same results as libetpan
+	**************************************************************************/
+
+	{
+		unsigned int seed = 1;
+		#define STRESS_RAND() (seed = seed*1103515245 + 12345, (seed>>16)&0x7FFF)
+		int    impl_used = mr_codec_get_impl(), impl_max = mr_codec_set_impl(MR_CODEC_AVX2), impl, round;
+		char   in[700], garbled[1400];
+		size_t in_bytes, garbled_bytes, i;
+
+		for( round = 0; round < 200; round++ )
+		{
+			/* base64: encode random data and decode it again after adding line breaks, spaces, padding and other garbage */
+			in_bytes = STRESS_RAND() % 300;
+			for( i = 0; i < in_bytes; i++ ) { in[i] = (char)STRESS_RAND(); }
+
+			char* expected_enc = encode_base64(in, in_bytes);
+			char* expected_enc_broken = mr_insert_breaks(expected_enc, 76, "\r\n");
+
+			garbled_bytes = 0;
+			for( i = 0; expected_enc[i]; i++ ) {
+				garbled[garbled_bytes++] = expected_enc[i];
+				if( STRESS_RAND()%20 == 0 ) { garbled[garbled_bytes++] = " \r\n=-\xC3\x80"[STRESS_RAND()%7]; }
+			}
+			garbled_bytes -= MR_MIN(garbled_bytes, (size_t)(STRESS_RAND()%3)); /* sometimes, the last group is incomplete */
+
+			for( impl = MR_CODEC_SCALAR; impl <= impl_max; impl++ )
+			{
+				mr_codec_set_impl(impl);
+
+				char* enc = mr_base64_encode(in, in_bytes, 0, NULL);
+				assert( strcmp(enc, expected_enc)==0 );
+				free(enc);
+
+				enc = mr_base64_encode(in, in_bytes, 76, "\r\n");
+				assert( strcmp(enc, expected_enc_broken)==0 );
+				free(enc);
+
+				int partial;
+				for( partial = 0; partial <= 1; partial++ )
+				{
+					char*  expected = NULL, decoded[1400];
+					size_t expected_bytes = 0, expected_index = 0, decoded_bytes, consumed = 0;
+					if( partial ) {
+						assert( mailmime_part_parse_partial(garbled, garbled_bytes, &expected_index, MAILMIME_MECHANISM_BASE64, &expected, &expected_bytes)==MAILIMF_NO_ERROR );
+					}
+					else {
+						assert( mailmime_base64_body_parse(garbled, garbled_bytes, &expected_index, &expected, &expected_bytes)==MAILIMF_NO_ERROR );
+					}
+					decoded_bytes = mr_base64_decode(garbled, garbled_bytes, partial, &consumed, decoded);
+					assert( decoded_bytes==expected_bytes && memcmp(decoded, expected, expected_bytes)==0 && consumed==expected_index );
+					mmap_string_unref(expected);
+				}
+			}
+
+			free(expected_enc);
+			free(expected_enc_broken);
+
+			/* quoted-printable: random text of characters that have a special meaning */
+			in_bytes = STRESS_RAND() % 300;
+			for( i = 0; i < in_bytes; i++ ) {
+				in[i] = "abcdefghijklmnopqrstuvwxyz0123456789ABCDEF=\r\n _\xC3\xA4"[STRESS_RAND()%48];
+				if( STRESS_RAND()%4 == 0 ) { in[i] = '='; }
+			}
+			if( in_bytes >= 2 && in[in_bytes-2]=='=' && in[in_bytes-1]!='\r' && in[in_bytes-1]!='\n' ) {
+				in[in_bytes-2] = 'x'; /* a truncated escape at the end makes libetpan read beyond the data */
+			}
+
+			for( impl = MR_CODEC_SCALAR; impl <= impl_max; impl++ )
+			{
+				mr_codec_set_impl(impl);
+
+				int partial;
+				for( partial = 0; partial <= 1; partial++ )
+				{
+					char*  expected = NULL, decoded[1400];
+					size_t expected_bytes = 0, expected_index = 0, decoded_bytes, consumed = 0;
+					assert( (partial? mailmime_part_parse_partial : mailmime_part_parse)(in, in_bytes, &expected_index, MAILMIME_MECHANISM_QUOTED_PRINTABLE, &expected, &expected_bytes)==MAILIMF_NO_ERROR );
+					decoded_bytes = mr_qp_decode(in, in_bytes, partial, &consumed, decoded);
+					assert( decoded_bytes==expected_bytes && memcmp(decoded, expected, expected_bytes)==0 && consumed==expected_index );
+					mmap_string_unref(expected);
+				}
+			}
+		}
+
+		mr_codec_set_impl(impl_used);
+	}
+
+	/* test mr_utf8_repair(), all implementations must give the same results,
+	valid UTF-8 must not be changed and the result must be valid UTF-8
+	**************************************************************************/
+
+	{
+		const char* tests[] = {
+			"ISO-String with Ae: \xC4",          "ISO-String with Ae: _",
+			"a\xC3\xA4" "b\xFF\xC3\xA4",          "a\xC3\xA4" "b_\xC3\xA4",  /* only the bad byte is replaced */
+			"\xE2\x82 \xE2\x82\xAC",               "__ \xE2\x82\xAC",       /* truncated sequence */
+			"\xED\xA0\x80 \xC0\xAF \xF4\x90\x80\x80", "___ __ ____",           /* surrogate, overlong, > U+10FFFF */
+			"\xF0\x9F\x98\x80\xF0\x9F\x98",        "\xF0\x9F\x98\x80___",
+			NULL };
+		char   in[700], work[700+32], expected[700];
+		int    impl_used = mr_codec_get_impl(), impl_max = mr_codec_set_impl(MR_CODEC_AVX2), impl, round, i, offset;
+		uint32_t seed = 4711;
+
+		for( i = 0; tests[i]; i += 2 ) {
+			for( impl = MR_CODEC_SCALAR; impl <= impl_max; impl++ ) {
+				mr_codec_set_impl(impl);
+				strcpy(work, tests[i]);
+				mr_utf8_repair(work);
+				assert( strcmp(work, tests[i+1])==0 );
+			}
+		}
+
+		for( round = 0; round < 2000; round++ )
+		{
+			/* random text of ASCII, valid sequences of all lengths and sometimes random bytes */
+			int in_bytes = 0, in_max = STRESS_RAND()%600, valid = round%2;
+			while( in_bytes < in_max ) {
+				int kind = STRESS_RAND()%(valid? 4 : 5);
+				uint32_t cp = STRESS_RAND();
+				     if( kind==0 ) { in[in_bytes++] = 1 + cp%0x7F; }
+				else if( kind==1 ) { cp = 0x80 + cp%0x780;  in[in_bytes++] = 0xC0|(cp>>6); in[in_bytes++] = 0x80|(cp&0x3F); }
+				else if( kind==2 ) { cp = 0x800 + cp%0xF800; if( cp>=0xD800 && cp<=0xDFFF ) { cp = 0xE000; }
+				                     in[in_bytes++] = 0xE0|(cp>>12); in[in_bytes++] = 0x80|((cp>>6)&0x3F); in[in_bytes++] = 0x80|(cp&0x3F); }
+				else if( kind==3 ) { cp = 0x10000 + ((cp<<5)^STRESS_RAND())%0x100000;
+				                     in[in_bytes++] = 0xF0|(cp>>18); in[in_bytes++] = 0x80|((cp>>12)&0x3F); in[in_bytes++] = 0x80|((cp>>6)&0x3F); in[in_bytes++] = 0x80|(cp&0x3F); }
+				else               { in[in_bytes++] = 0x80 + cp%0x80; }
+			}
+			in[in_bytes] = 0;
+
+			for( impl = MR_CODEC_SCALAR; impl <= impl_max; impl++ ) {
+				mr_codec_set_impl(impl);
+				for( offset = 0; offset < 32; offset += 7 ) { /* the blocks are aligned, so check different positions */
+					strcpy(work+offset, in);
+					mr_utf8_repair(work+offset);
+					if( impl == MR_CODEC_SCALAR && offset == 0 ) {
+						strcpy(expected, work);
+						assert( stress_is_utf8(expected) );
+						assert( !valid || strcmp(expected, in)==0 );
+						for( i = 0; i < in_bytes; i++ ) {
+							assert( expected[i]==in[i] || ((unsigned char)in[i]>=0x80 && expected[i]=='_') );
+						}
+					}
+					assert( strcmp(work+offset, expected)==0 );
+				}
+			}
+		}
+
+		mr_codec_set_impl(impl_used);
+	}
+
 	/* test mrmimeparser_t
 	**************************************************************************/
 
@@ -276,6 +640,162 @@ void stress_functions(mrmailbox_t* mailbox)
 		mrmimeparser_unref(mimeparser);
 	}
 
+	/* test mockcorpus_t
+	**************************************************************************/
+
+	{
+		mockcorpus_t* corpus = mockcorpus_new(NULL, "me@corpus.example", 42, "plain=1,html=1,multipart=1,group=1,mdn=1,list=1" /*no attachments, they would be written to the blobdir*/);
+		int i, kind, kind2;
+		for( i = 0; i < 20; i++ ) {
+			char* raw  = mockcorpus_render(corpus, i, 1500000000+i, &kind);
+			char* raw2 = mockcorpus_render(corpus, i, 1500000000+i, &kind2);
+			assert( raw && raw2 && strcmp(raw, raw2)==0 && kind==kind2 ); /* messages depend only on the seed and the index */
+			assert( kind != MOCKCORPUS_ENCRYPTED );
+
+			mrmimeparser_t* mimeparser = mrmimeparser_new(mailbox->m_blobdir, mailbox);
+			mrmimeparser_parse(mimeparser, raw, strlen(raw));
+			assert( carray_count(mimeparser->m_parts) >= 1 || kind == MOCKCORPUS_MDN );
+			mrmimeparser_unref(mimeparser);
+
+			free(raw);
+			free(raw2);
+		}
+		mockcorpus_unref(corpus);
+	}
+
+	/* test that jobs added during a transaction are queued on commit only; the changes are rolled back, so the database is not modified
+	**************************************************************************/
+
+	if( mrsqlite3_is_open(mailbox->m_sql) )
+	{
+		mrsqlite3_lock(mailbox->m_sql);
+
+			time_t next_due = mrjob_get_next_due(mailbox, MR_SMTP_THREAD);
+
+			mrsqlite3_begin_transaction__(mailbox->m_sql);
+				mrsqlite3_begin_transaction__(mailbox->m_sql);
+					assert( mrjob_add__(mailbox, MRJ_SEND_MDN, 1, NULL, 3600) != 0 );
+					assert( mailbox->m_jobs_pending != NULL );
+				mrsqlite3_rollback__(mailbox->m_sql); /* the savepoint is rolled back, the job is gone */
+				assert( mailbox->m_jobs_pending == NULL );
+
+				mrsqlite3_begin_transaction__(mailbox->m_sql);
+					assert( mrjob_add__(mailbox, MRJ_SEND_MDN, 2, NULL, 3600) != 0 );
+				mrsqlite3_commit__(mailbox->m_sql); /* the savepoint is released, the job is still pending as part of the outer transaction */
+				assert( mailbox->m_jobs_pending != NULL );
+				assert( mrjob_add__(mailbox, MRJ_SEND_MDN, 3, NULL, 3600) != 0 );
+			mrsqlite3_rollback__(mailbox->m_sql);
+
+			assert( mailbox->m_jobs_pending == NULL );
+			assert( mrjob_get_next_due(mailbox, MR_SMTP_THREAD) == next_due );
+
+		mrsqlite3_unlock(mailbox->m_sql);
+	}
+
+	/* test the message counters of the chats; the changes are rolled back, so the database is not modified
+	**************************************************************************/
+
+	if( mrsqlite3_is_open(mailbox->m_sql) )
+	{
+		mrsqlite3_lock(mailbox->m_sql);
+
+			assert( stress_count_bad_chat_counters(mailbox->m_sql) == 0 );
+
+			mrsqlite3_begin_transaction__(mailbox->m_sql);
+
+				mrsqlite3_execute__(mailbox->m_sql, "INSERT INTO chats (type, name) VALUES (" MR_STRINGIFY(MR_CHAT_TYPE_GROUP) ", 'stress');");
+				uint32_t chat_id = sqlite3_last_insert_rowid(mailbox->m_sql->m_cobj);
+				char* q = sqlite3_mprintf("INSERT INTO msgs (chat_id, state, hidden) VALUES (%i,%i,0), (%i,%i,0), (%i,%i,0), (%i,%i,0);",
+					chat_id, MR_STATE_IN_FRESH, chat_id, MR_STATE_IN_FRESH, chat_id, MR_STATE_IN_SEEN, chat_id, MR_STATE_OUT_DELIVERED);
+				mrsqlite3_execute__(mailbox->m_sql, q);
+				sqlite3_free(q);
+				uint32_t msg_id = sqlite3_last_insert_rowid(mailbox->m_sql->m_cobj);
+				int fresh_all = mrmailbox_get_fresh_msg_count_all__(mailbox);
+				assert( mrmailbox_get_fresh_msg_count__(mailbox, chat_id) == 2 );
+				assert( mrmailbox_get_total_msg_count__(mailbox, chat_id) == 4 );
+				assert( fresh_all >= 2 );
+
+				q = sqlite3_mprintf("UPDATE msgs SET state=%i WHERE chat_id=%i AND state=%i;", MR_STATE_IN_NOTICED, chat_id, MR_STATE_IN_FRESH);
+				mrsqlite3_execute__(mailbox->m_sql, q); /* as done by mrmailbox_marknoticed_chat() */
+				sqlite3_free(q);
+				assert( mrmailbox_get_fresh_msg_count__(mailbox, chat_id) == 0 );
+				assert( mrmailbox_get_fresh_msg_count_all__(mailbox) == fresh_all-2 );
+
+				mrmailbox_update_msg_chat_id__(mailbox, msg_id, MR_CHAT_ID_TRASH); /* as done when deleting messages */
+				assert( mrmailbox_get_total_msg_count__(mailbox, chat_id) == 3 );
+
+				mrmailbox_block_chat__(mailbox, chat_id, MR_CHAT_MANUALLY_BLOCKED);
+				q = sqlite3_mprintf("UPDATE msgs SET state=%i WHERE chat_id=%i;", MR_STATE_IN_FRESH, chat_id);
+				mrsqlite3_execute__(mailbox->m_sql, q);
+				sqlite3_free(q);
+				assert( mrmailbox_get_fresh_msg_count__(mailbox, chat_id) == 3 );
+				assert( mrmailbox_get_fresh_msg_count_all__(mailbox) == fresh_all-2 ); /* blocked chats are not counted */
+
+				q = sqlite3_mprintf("DELETE FROM msgs WHERE chat_id=%i;", chat_id);
+				mrsqlite3_execute__(mailbox->m_sql, q);
+				sqlite3_free(q);
+				assert( mrmailbox_get_total_msg_count__(mailbox, chat_id) == 0 );
+				assert( mrmailbox_get_fresh_msg_count__(mailbox, chat_id) == 0 );
+
+				assert( stress_count_bad_chat_counters(mailbox->m_sql) == 0 );
+
+			mrsqlite3_rollback__(mailbox->m_sql);
+
+		mrsqlite3_unlock(mailbox->m_sql);
+	}
+
+	/* test the keys of the contacts maintained by triggers; the changes are rolled back, so the database is not modified
+	**************************************************************************/
+
+	if( mrsqlite3_is_open(mailbox->m_sql) )
+	{
+		mrsqlite3_lock(mailbox->m_sql);
+
+			#define STRESS_CONTACTS_FOUND(query) \
+				"SELECT COUNT(*) FROM contacts WHERE id IN (SELECT rowid FROM contacts_fts WHERE contacts_fts MATCH '" query "') AND addr LIKE '%@stress.example';"
+			sqlite3_stmt* stmt = mrsqlite3_prepare_v2_(mailbox->m_sql,
+				"SELECT COUNT(*) FROM contacts"
+				" WHERE sort_key IS NOT LOWER(name||addr)"
+				"    OR verified!=EXISTS(SELECT 1 FROM acpeerstates WHERE addr=contacts.addr AND LENGTH(verified_key_fingerprint)!=0);");
+			assert( sqlite3_step(stmt) == SQLITE_ROW && sqlite3_column_int(stmt, 0) == 0 );
+			sqlite3_finalize(stmt);
+
+			mrsqlite3_begin_transaction__(mailbox->m_sql);
+
+				mrsqlite3_execute__(mailbox->m_sql, "INSERT INTO contacts (name, addr) VALUES ('Stress Tester', 'st.one@stress.example'), ('Other', 'two+Stress@stress.example');");
+				mrsqlite3_execute__(mailbox->m_sql, "UPDATE contacts SET name='Renamed' WHERE addr='st.one@stress.example';");
+				mrsqlite3_execute__(mailbox->m_sql, "INSERT INTO acpeerstates (addr, verified_key_fingerprint) VALUES ('TWO+stress@STRESS.example', 'ABCD');");
+
+				stmt = mrsqlite3_prepare_v2_(mailbox->m_sql, "SELECT sort_key, verified FROM contacts WHERE addr LIKE '%@stress.example' ORDER BY id;");
+				assert( sqlite3_step(stmt) == SQLITE_ROW && strcmp((const char*)sqlite3_column_text(stmt, 0), "renamedst.one@stress.example")==0 && sqlite3_column_int(stmt, 1)==0 );
+				assert( sqlite3_step(stmt) == SQLITE_ROW && strcmp((const char*)sqlite3_column_text(stmt, 0), "othertwo+stress@stress.example")==0 && sqlite3_column_int(stmt, 1)==1 );
+				sqlite3_finalize(stmt);
+
+				mrsqlite3_execute__(mailbox->m_sql, "DELETE FROM acpeerstates WHERE addr='two+stress@stress.example';");
+				stmt = mrsqlite3_prepare_v2_(mailbox->m_sql, "SELECT COUNT(*) FROM contacts WHERE addr LIKE '%@stress.example' AND verified=1;");
+				assert( sqlite3_step(stmt) == SQLITE_ROW && sqlite3_column_int(stmt, 0) == 0 );
+				sqlite3_finalize(stmt);
+
+				if( mailbox->m_sql->m_has_contacts_fts )
+				{
+					stmt = mrsqlite3_prepare_v2_(mailbox->m_sql, STRESS_CONTACTS_FOUND("\"stre\"*"));
+					assert( sqlite3_step(stmt) == SQLITE_ROW && sqlite3_column_int(stmt, 0) == 2 ); /* the domain of both, the local part of the second */
+					sqlite3_finalize(stmt);
+
+					stmt = mrsqlite3_prepare_v2_(mailbox->m_sql, STRESS_CONTACTS_FOUND("\"tester\"*"));
+					assert( sqlite3_step(stmt) == SQLITE_ROW && sqlite3_column_int(stmt, 0) == 0 ); /* the old name is no longer in the index */
+					sqlite3_finalize(stmt);
+
+					stmt = mrsqlite3_prepare_v2_(mailbox->m_sql, STRESS_CONTACTS_FOUND("\"ren\"* \"st.o\"*"));
+					assert( sqlite3_step(stmt) == SQLITE_ROW && sqlite3_column_int(stmt, 0) == 1 );
+					sqlite3_finalize(stmt);
+				}
+
+			mrsqlite3_rollback__(mailbox->m_sql);
+
+		mrsqlite3_unlock(mailbox->m_sql);
+	}
+
 	/* test message helpers
 	 **************************************************************************/
 
@@ -538,6 +1058,59 @@ void stress_functions(mrmailbox_t* mailbox)
 		mrarray_unref(arr);
 	}
 
+	/* test mrhash
+	 **************************************************************************/
+
+	{
+		int       i, copy_mode, cnt;
+		char      key[64];
+		mrhash_t  hash;
+		mrhashelem_t* elem;
+
+		for( copy_mode = MRHASH_COPY; copy_mode <= MRHASH_COPY_TO_ARENA; copy_mode++ )
+		{
+			mrhash_init(&hash, MRHASH_STRING, copy_mode);
+			for( i = 0; i < 1000; i++ ) {
+				snprintf(key, sizeof(key), (i&1)? "Header-%i" : "a-much-longer-key-that-is-not-stored-inline-%i", i);
+				assert( mrhash_insert(&hash, key, strlen(key), (void*)(uintptr_t)(i+1))==NULL );
+			}
+			assert( mrhash_count(&hash)==1000 );
+			assert( mrhash_find_str(&hash, "HEADER-1")==(void*)2 ); /* case is ignored */
+			assert( mrhash_find_str(&hash, "header-999")==(void*)1000 );
+			assert( mrhash_find_str(&hash, "A-MUCH-LONGER-KEY-THAT-IS-NOT-STORED-INLINE-998")==(void*)999 );
+			assert( mrhash_find_str(&hash, "header-1000")==NULL );
+			assert( mrhash_find_str(&hash, "header-")==NULL );
+			assert( mrhash_insert(&hash, "header-1", 8, (void*)4711)==(void*)2 );
+			assert( mrhash_find_str(&hash, "Header-1")==(void*)4711 );
+
+			for( i = 0; i < 1000; i += 3 ) { /* removing elements moves others, they must still be found */
+				snprintf(key, sizeof(key), (i&1)? "Header-%i" : "a-much-longer-key-that-is-not-stored-inline-%i", i);
+				assert( mrhash_insert(&hash, key, strlen(key), NULL)!=NULL );
+			}
+			for( i = 0; i < 1000; i++ ) {
+				snprintf(key, sizeof(key), (i&1)? "Header-%i" : "a-much-longer-key-that-is-not-stored-inline-%i", i);
+				assert( (mrhash_find_str(&hash, key)==NULL) == (i%3==0) );
+			}
+			assert( mrhash_count(&hash)==666 );
+
+			for( elem = mrhash_first(&hash), cnt = 0; elem; elem = mrhash_next(elem) ) {
+				assert( mrhash_find(&hash, mrhash_key(elem), mrhash_keysize(elem))==mrhash_data(elem) );
+				cnt++;
+			}
+			assert( cnt==666 );
+
+			mrhash_clear(&hash);
+			assert( mrhash_count(&hash)==0 && mrhash_first(&hash)==NULL && mrhash_find_str(&hash, "Header-1")==NULL );
+		}
+
+		mrhash_init(&hash, MRHASH_INT, MRHASH_NO_COPY);
+		for( i = 1; i <= 100; i++ ) {
+			mrhash_insert(&hash, NULL, i*7, (void*)(uintptr_t)i);
+		}
+		assert( mrhash_find(&hash, NULL, 700)==(void*)100 && mrhash_find(&hash, NULL, 701)==NULL );
+		mrhash_clear(&hash);
+	}
+
 	/* test mrparam
 	 **************************************************************************/
 
@@ -559,14 +1132,25 @@ void stress_functions(mrmailbox_t* mailbox)
 		mrparam_set_int(p1, 'b', 2);
 		mrparam_set    (p1, 'c', NULL);
 		mrparam_set_int(p1, 'd', 4);
-		assert( strcmp(p1->m_packed, "a=foo\nb=2\nd=4")==0 );
+		assert( strcmp(mrparam_get_packed(p1), "a=foo\nb=2\nd=4")==0 );
 
 		mrparam_set    (p1, 'b', NULL);
-		assert( strcmp(p1->m_packed, "a=foo\nd=4")==0 );
+		assert( strcmp(mrparam_get_packed(p1), "a=foo\nd=4")==0 );
 
 		mrparam_set    (p1, 'a', NULL);
 		mrparam_set    (p1, 'd', NULL);
-		assert( strcmp(p1->m_packed, "")==0 );
+		assert( strcmp(mrparam_get_packed(p1), "")==0 );
+
+		mrparam_set_packed(p1, "a=1\r\nb=foo\r\nc=3");
+		assert( mrparam_get_int(p1, 'a', 0)==1 );
+		char* str = mrparam_get(p1, 'b', NULL);
+		assert( strcmp(str, "foo")==0 );
+		free(str);
+		mrparam_set_int(p1, 'a', 5); /* modified parameters keep their position */
+		mrparam_set    (p1, 'e', "bar");
+		assert( mrparam_get_int(p1, 'a', 0)==5 );
+		assert( strcmp(mrparam_get_packed(p1), "a=5\nb=foo\r\nc=3\ne=bar")==0 );
+		assert( mrparam_get_int(p1, 'c', 0)==3 );
 
 		mrparam_unref(p1);
 	}
@@ -767,7 +1351,12 @@ void stress_functions(mrmailbox_t* mailbox)
 		}
 
 		mrkey_t *public_key2 = mrkey_new(), *private_key2 = mrkey_new();
-		mrpgp_create_keypair(mailbox, "two@zwo.de", public_key2, private_key2);
+		int pool_ready = 0, pool_generating = 0;
+		mrkeypool_get_stat(&pool_ready, &pool_generating, NULL, NULL);
+		mrkeypool_fill(pool_ready+pool_generating+1, 1); /* the second keypair is generated in the background, keypairs requested by mrmailbox_open() are kept */
+		assert( mrkeypool_take(public_key2, private_key2, 1/*wait*/) );
+		assert( mrpgp_is_valid_key(mailbox, public_key2) );
+		assert( mrpgp_is_valid_key(mailbox, private_key2) );
 
 		assert( !mrkey_equals(public_key, public_key2) );
 
@@ -866,6 +1455,37 @@ void stress_functions(mrmailbox_t* mailbox)
 			mrkeyring_unref(public_keyring);
 		}
 
+		{
+			/* parsed keys are cached, the results must be the same with and without cached keys */
+			char* fingerprint1 = mrkey_get_fingerprint(public_key);
+			mrpgp_clear_key_cache();
+			char* fingerprint2 = mrkey_get_fingerprint(public_key);
+			char* fingerprint3 = mrkey_get_fingerprint(public_key);
+			assert( strlen(fingerprint1)==40 );
+			assert( strcmp(fingerprint1, fingerprint2)==0 && strcmp(fingerprint2, fingerprint3)==0 );
+			free(fingerprint1);
+			free(fingerprint2);
+			free(fingerprint3);
+
+			int      cnt = 0;
+			uint32_t hits = 0, misses = 0, hits2 = 0;
+			mrpgp_get_key_cache_stat(&cnt, &hits, &misses);
+			assert( cnt == 1 );
+
+			mrkeyring_t* keyring = mrkeyring_new();
+			mrkeyring_add(keyring, private_key);
+			mrkeyring_t* public_keyring = mrkeyring_new();
+			mrkeyring_add(public_keyring, public_key);
+			void* plain = NULL;
+			int ok = mrpgp_pk_decrypt(mailbox, ctext_signed, ctext_signed_bytes, keyring, public_keyring/*for validate*/, 1, &plain, &plain_bytes, NULL);
+			assert( ok && plain && strcmp(plain, original_text)==0 );
+			free(plain);
+			mrpgp_get_key_cache_stat(&cnt, &hits2, NULL);
+			assert( cnt == 2 && hits2 == hits+1 );
+			mrkeyring_unref(keyring);
+			mrkeyring_unref(public_keyring);
+		}
+
 		free(ctext_signed);
 		free(ctext_unsigned);
 		mrkey_unref(public_key2);
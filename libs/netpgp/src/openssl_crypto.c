@@ -526,12 +526,9 @@ pgp_rsa_private_encrypt(uint8_t *out,
      /* p */ BN_dup(seckey->q));
 
 
-	/* debug */
-	if (RSA_check_key(orsa) != 1) {
-		(void) fprintf(stderr, "RSA_check_key is not set\n");
-		return 0;
-	}
-	/* end debug */
+	/* EDIT BY MR: RSA_check_key() was called here for every signature; as it
+	tests p and q for primality, it took much longer than the signature itself.
+	Callers check the key once using pgp_rsa_private_check(), see mrpgp.c */
 
 	n = RSA_private_encrypt((int)length, in, out, orsa, RSA_NO_PADDING);
 
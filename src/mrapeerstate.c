@@ -107,10 +107,142 @@ static void mrapeerstate_set_from_stmt__(mrapeerstate_t* peerstate, sqlite3_stmt
 }
 
 
+static mrkey_t* key_dup(const mrkey_t* key)
+{
+	mrkey_t* ret = NULL;
+	if( key ) {
+		ret = mrkey_new();
+		mrkey_set_from_key(ret, key);
+	}
+	return ret;
+}
+
+
+static void mrapeerstate_set_from_peerstate(mrapeerstate_t* peerstate, const mrapeerstate_t* src)
+{
+	/* copies the fields as loaded by mrapeerstate_set_from_stmt__(); the keys are copied and not only referenced
+	as the reference counters are not thread-safe and the objects may be used by parallel parsers */
+	peerstate->m_addr                     = safe_strdup(src->m_addr);
+	peerstate->m_last_seen                = src->m_last_seen;
+	peerstate->m_last_seen_autocrypt      = src->m_last_seen_autocrypt;
+	peerstate->m_prefer_encrypt           = src->m_prefer_encrypt;
+	peerstate->m_gossip_timestamp         = src->m_gossip_timestamp;
+	peerstate->m_public_key_fingerprint   = safe_strdup(src->m_public_key_fingerprint);
+	peerstate->m_gossip_key_fingerprint   = safe_strdup(src->m_gossip_key_fingerprint);
+	peerstate->m_verified_key_fingerprint = safe_strdup(src->m_verified_key_fingerprint);
+	peerstate->m_public_key               = key_dup(src->m_public_key);
+	peerstate->m_gossip_key               = key_dup(src->m_gossip_key);
+	peerstate->m_verified_key             = key_dup(src->m_verified_key);
+}
+
+
+/*******************************************************************************
+ * Peerstate cache
+ ******************************************************************************/
+
+
+/* Sending a message loads the peerstate of each recipient, so the last
+MR_PEERSTATE_CACHE_SIZE peerstates loaded by mrapeerstate_load_by_addr__() are
+kept in an LRU cache in mrmailbox_t.  Addresses without a peerstate are cached
+as well (m_peerstate is NULL then) as they are typical for unencrypted chats.
+The entries are copies of database rows; mrapeerstate_save_to_db__() drops the
+entry of the saved address. */
+struct mrpeerstatecacheentry_t
+{
+	char*                    m_addr;      /* the address as given to mrapeerstate_load_by_addr__(), used as the key */
+	mrapeerstate_t*          m_peerstate; /* NULL if there is no peerstate for the address */
+	mrpeerstatecacheentry_t* m_prev;      /* more recently used entry */
+	mrpeerstatecacheentry_t* m_next;      /* less recently used entry */
+};
+
+
+static mrmailbox_t* cache_mailbox(mrsqlite3_t* sql)
+{
+	/* the cache is used only for the database of the mailbox, not eg. for a backup opened by the same mailbox */
+	if( sql && sql->m_mailbox && sql->m_mailbox->m_sql == sql && sql->m_mailbox->m_peerstate_cache ) {
+		return sql->m_mailbox;
+	}
+	return NULL;
+}
+
+
+static void peerstate_cache_unlink__(mrmailbox_t* mailbox, mrpeerstatecacheentry_t* entry)
+{
+	if( entry->m_prev ) { entry->m_prev->m_next = entry->m_next; } else { mailbox->m_peerstate_cache_first = entry->m_next; }
+	if( entry->m_next ) { entry->m_next->m_prev = entry->m_prev; } else { mailbox->m_peerstate_cache_last = entry->m_prev; }
+	entry->m_prev = NULL;
+	entry->m_next = NULL;
+}
+
+
+static void peerstate_cache_link_first__(mrmailbox_t* mailbox, mrpeerstatecacheentry_t* entry)
+{
+	entry->m_prev = NULL;
+	entry->m_next = mailbox->m_peerstate_cache_first;
+	if( mailbox->m_peerstate_cache_first ) { mailbox->m_peerstate_cache_first->m_prev = entry; } else { mailbox->m_peerstate_cache_last = entry; }
+	mailbox->m_peerstate_cache_first = entry;
+}
+
+
+static void peerstate_cache_remove__(mrmailbox_t* mailbox, mrpeerstatecacheentry_t* entry)
+{
+	peerstate_cache_unlink__(mailbox, entry);
+	mrhash_insert(mailbox->m_peerstate_cache, entry->m_addr, strlen(entry->m_addr), NULL);
+	mrapeerstate_unref(entry->m_peerstate);
+	free(entry->m_addr);
+	free(entry);
+}
+
+
+static void peerstate_cache_add__(mrmailbox_t* mailbox, const char* addr, const mrapeerstate_t* peerstate /*may be NULL*/)
+{
+	mrpeerstatecacheentry_t* entry = NULL;
+
+	if( mrhash_count(mailbox->m_peerstate_cache) >= MR_PEERSTATE_CACHE_SIZE && mailbox->m_peerstate_cache_last ) {
+		peerstate_cache_remove__(mailbox, mailbox->m_peerstate_cache_last);
+	}
+
+	if( (entry=calloc(1, sizeof(mrpeerstatecacheentry_t)))==NULL ) {
+		exit(61);
+	}
+	entry->m_addr = safe_strdup(addr);
+	if( peerstate ) {
+		entry->m_peerstate = mrapeerstate_new(peerstate->m_mailbox);
+		mrapeerstate_set_from_peerstate(entry->m_peerstate, peerstate);
+	}
+
+	mrhash_insert(mailbox->m_peerstate_cache, entry->m_addr, strlen(entry->m_addr), entry);
+	peerstate_cache_link_first__(mailbox, entry);
+}
+
+
+static void peerstate_cache_invalidate__(mrmailbox_t* mailbox, const char* addr)
+{
+	mrpeerstatecacheentry_t* entry = (mrpeerstatecacheentry_t*)mrhash_find_str(mailbox->m_peerstate_cache, addr);
+	if( entry ) {
+		peerstate_cache_remove__(mailbox, entry);
+	}
+}
+
+
+void mrapeerstate_clear_cache__(mrmailbox_t* mailbox)
+{
+	if( mailbox == NULL || mailbox->m_peerstate_cache == NULL ) {
+		return;
+	}
+
+	while( mailbox->m_peerstate_cache_first ) {
+		peerstate_cache_remove__(mailbox, mailbox->m_peerstate_cache_first);
+	}
+}
+
+
 int mrapeerstate_load_by_addr__(mrapeerstate_t* peerstate, mrsqlite3_t* sql, const char* addr)
 {
-	int           success = 0;
-	sqlite3_stmt* stmt;
+	int                      success = 0;
+	sqlite3_stmt*            stmt;
+	mrmailbox_t*             mailbox = cache_mailbox(sql);
+	mrpeerstatecacheentry_t* entry = NULL;
 
 	if( peerstate==NULL || sql == NULL || addr == NULL ) {
 		return 0;
@@ -118,16 +250,39 @@ int mrapeerstate_load_by_addr__(mrapeerstate_t* peerstate, mrsqlite3_t* sql, con
 
 	mrapeerstate_empty(peerstate);
 
+	if( mailbox && (entry=(mrpeerstatecacheentry_t*)mrhash_find_str(mailbox->m_peerstate_cache, addr))!=NULL ) {
+		mailbox->m_peerstate_cache_hits++;
+		if( entry != mailbox->m_peerstate_cache_first ) {
+			peerstate_cache_unlink__(mailbox, entry);
+			peerstate_cache_link_first__(mailbox, entry);
+		}
+		if( entry->m_peerstate == NULL ) {
+			goto cleanup;
+		}
+		mrapeerstate_set_from_peerstate(peerstate, entry->m_peerstate);
+		success = 1;
+		goto cleanup;
+	}
+
 	stmt = mrsqlite3_predefine__(sql, SELECT_fields_FROM_acpeerstates_WHERE_addr,
 		"SELECT " PEERSTATE_FIELDS
 		 " FROM acpeerstates "
 		 " WHERE addr=? COLLATE NOCASE;");
 	sqlite3_bind_text(stmt, 1, addr, -1, SQLITE_STATIC);
 	if( sqlite3_step(stmt) != SQLITE_ROW ) {
+		if( mailbox ) {
+			mailbox->m_peerstate_cache_misses++;
+			peerstate_cache_add__(mailbox, addr, NULL);
+		}
 		goto cleanup;
 	}
 	mrapeerstate_set_from_stmt__(peerstate, stmt);
 
+	if( mailbox ) {
+		mailbox->m_peerstate_cache_misses++;
+		peerstate_cache_add__(mailbox, addr, peerstate);
+	}
+
 	success = 1;
 
 cleanup:
@@ -171,11 +326,16 @@ int mrapeerstate_save_to_db__(const mrapeerstate_t* ths, mrsqlite3_t* sql, int c
 {
 	int           success = 0;
 	sqlite3_stmt* stmt;
+	mrmailbox_t*  mailbox;
 
 	if( ths==NULL || sql==NULL || ths->m_addr==NULL ) {
 		return 0;
 	}
 
+	if( (mailbox=cache_mailbox(sql)) != NULL ) {
+		peerstate_cache_invalidate__(mailbox, ths->m_addr);
+	}
+
 	if( create ) {
 		stmt = mrsqlite3_predefine__(sql, INSERT_INTO_acpeerstates_a, "INSERT INTO acpeerstates (addr) VALUES(?);");
 		sqlite3_bind_text(stmt, 1, ths->m_addr, -1, SQLITE_STATIC);
@@ -249,9 +409,7 @@ void mrapeerstate_unref(mrapeerstate_t* ths)
 		return;
 	}
 
-	free(ths->m_addr);
-	mrkey_unref(ths->m_public_key);
-	mrkey_unref(ths->m_gossip_key);
+	mrapeerstate_empty(ths);
 	free(ths);
 }
 
@@ -0,0 +1,290 @@
+/*******************************************************************************
+ *
+ *                              Delta Chat Core
+ *                      Copyright (C) 2017 Björn Petersen
+ *                   Contact: r10s@b44t.com, http://b44t.com
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see http://www.gnu.org/licenses/ .
+ *
+ ******************************************************************************/
+
+
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include "mrarena.h"
+
+
+#define MRARENA_ALIGN(b) (((b)+7) & ~((size_t)7))
+
+
+struct mrarenablock_t
+{
+	mrarenablock_t* m_next;
+	size_t          m_bytes;        /* usable bytes following the block header */
+};
+
+
+static void* add_block(mrarena_t* ths, size_t bytes)
+{
+	/* the memory of the new block is returned; normal blocks become the current block,
+	larger ones are linked behind the current block so that its free memory is still used */
+	mrarenablock_t* block;
+	size_t          block_bytes = bytes > ths->m_block_bytes/4? bytes : ths->m_block_bytes;
+
+	if( (block=malloc(sizeof(mrarenablock_t)+block_bytes))==NULL ) {
+		exit(53);
+	}
+	block->m_bytes = block_bytes;
+
+	if( block_bytes == ths->m_block_bytes || ths->m_blocks == NULL ) {
+		block->m_next = ths->m_blocks;
+		ths->m_blocks = block;
+		ths->m_next   = (char*)(block+1) + bytes;
+		ths->m_free   = block_bytes - bytes;
+	}
+	else {
+		block->m_next = ths->m_blocks->m_next;
+		ths->m_blocks->m_next = block;
+	}
+
+	return (void*)(block+1);
+}
+
+
+/**
+ * Create a new arena.
+ *
+ * @private @memberof mrarena_t
+ *
+ * @param block_bytes The size of the blocks to allocate; the first block is
+ *     allocated with the first allocation and kept by mrarena_reset().
+ *
+ * @return The arena object, must be freed using mrarena_unref().
+ */
+mrarena_t* mrarena_new(size_t block_bytes)
+{
+	mrarena_t* ths = NULL;
+
+	if( (ths=calloc(1, sizeof(mrarena_t)))==NULL ) {
+		exit(53);
+	}
+
+	ths->m_block_bytes = MRARENA_ALIGN(block_bytes>=256? block_bytes : 256);
+
+	return ths;
+}
+
+
+/**
+ * Free an arena and all memory allocated from it.
+ *
+ * @private @memberof mrarena_t
+ */
+void mrarena_unref(mrarena_t* ths)
+{
+	if( ths == NULL ) {
+		return;
+	}
+
+	while( ths->m_blocks ) {
+		mrarenablock_t* next = ths->m_blocks->m_next;
+		free(ths->m_blocks);
+		ths->m_blocks = next;
+	}
+
+	free(ths);
+}
+
+
+/**
+ * Release all memory allocated from the arena at once.  The first normal
+ * block is kept, so an arena used for one object after another does not
+ * allocate anything as long as the objects fit into the first block.
+ *
+ * @private @memberof mrarena_t
+ */
+void mrarena_reset(mrarena_t* ths)
+{
+	mrarenablock_t* keep = NULL, *block;
+
+	if( ths == NULL ) {
+		return;
+	}
+
+	/* normal blocks are added to the head of the list, so the first one allocated is the last normal block in the list */
+	for( block = ths->m_blocks; block; block = block->m_next ) {
+		if( block->m_bytes == ths->m_block_bytes ) {
+			keep = block;
+		}
+	}
+
+	while( ths->m_blocks ) {
+		block = ths->m_blocks;
+		ths->m_blocks = block->m_next;
+		if( block != keep ) {
+			free(block);
+		}
+	}
+
+	if( keep ) {
+		keep->m_next = NULL;
+	}
+
+	ths->m_blocks = keep;
+	ths->m_next   = keep? (char*)(keep+1) : NULL;
+	ths->m_free   = keep? keep->m_bytes : 0;
+	ths->m_last   = NULL;
+}
+
+
+/**
+ * Allocate memory from the arena.  The memory is aligned to 8 bytes and is
+ * valid until mrarena_reset() or mrarena_unref() is called; it must not be
+ * free()'d.  If there is no memory, the program halts.
+ *
+ * @private @memberof mrarena_t
+ */
+void* mrarena_alloc(mrarena_t* ths, size_t bytes)
+{
+	void* ret;
+
+	bytes = MRARENA_ALIGN(bytes? bytes : 1);
+
+	if( bytes > ths->m_free ) {
+		ret = add_block(ths, bytes);
+	}
+	else {
+		ret = ths->m_next;
+		ths->m_next += bytes;
+		ths->m_free -= bytes;
+	}
+
+	ths->m_last = ret;
+	return ret;
+}
+
+
+/**
+ * Resize memory allocated by mrarena_alloc().  If the memory is the last
+ * allocation and there is enough space in the block, it is extended in place,
+ * otherwise a copy is made; this way, a string built in the arena typically
+ * does not need any copying.
+ *
+ * @private @memberof mrarena_t
+ */
+void* mrarena_realloc(mrarena_t* ths, void* ptr, size_t old_bytes, size_t new_bytes)
+{
+	void* ret;
+
+	if( ptr == NULL ) {
+		return mrarena_alloc(ths, new_bytes);
+	}
+
+	old_bytes = MRARENA_ALIGN(old_bytes? old_bytes : 1);
+	new_bytes = MRARENA_ALIGN(new_bytes? new_bytes : 1);
+
+	if( new_bytes <= old_bytes ) {
+		return ptr;
+	}
+
+	if( ptr == ths->m_last && (char*)ptr + old_bytes == ths->m_next && new_bytes-old_bytes <= ths->m_free ) {
+		ths->m_next += new_bytes-old_bytes;
+		ths->m_free -= new_bytes-old_bytes;
+		return ptr;
+	}
+
+	ret = mrarena_alloc(ths, new_bytes);
+	memcpy(ret, ptr, old_bytes);
+	return ret;
+}
+
+
+/**
+ * Copy a string to the arena.  Like safe_strdup(), NULL is copied as an
+ * empty string.
+ *
+ * @private @memberof mrarena_t
+ */
+char* mrarena_strdup(mrarena_t* ths, const char* s)
+{
+	if( s == NULL ) {
+		s = "";
+	}
+
+	size_t bytes = strlen(s)+1;
+	char*  ret = mrarena_alloc(ths, bytes);
+	memcpy(ret, s, bytes);
+	return ret;
+}
+
+
+/**
+ * Copy at most `bytes` characters of a string to the arena, the copy is
+ * always null-terminated.
+ *
+ * @private @memberof mrarena_t
+ */
+char* mrarena_strndup(mrarena_t* ths, const char* s, size_t bytes)
+{
+	char* ret;
+
+	if( s == NULL ) {
+		s = "";
+	}
+
+	bytes = strnlen(s, bytes);
+	ret = mrarena_alloc(ths, bytes+1);
+	memcpy(ret, s, bytes);
+	ret[bytes] = 0;
+	return ret;
+}
+
+
+/**
+ * Format a string as printf() does, the result is allocated in the arena.
+ *
+ * @private @memberof mrarena_t
+ */
+char* mrarena_mprintf(mrarena_t* ths, const char* format, ...)
+{
+	char*   ret;
+	int     char_cnt_without_zero;
+	va_list argp;
+	va_list argp_copy;
+
+	va_start(argp, format);
+	va_copy(argp_copy, argp);
+
+	/* try to format the string directly to the free memory of the current block */
+	char_cnt_without_zero = vsnprintf(ths->m_next, ths->m_free, format, argp);
+	va_end(argp);
+	if( char_cnt_without_zero < 0 ) {
+		va_end(argp_copy);
+		return mrarena_strdup(ths, "ErrFmt");
+	}
+
+	if( (size_t)char_cnt_without_zero < ths->m_free ) {
+		ret = mrarena_alloc(ths, char_cnt_without_zero+1); /* this is the memory just formatted */
+	}
+	else {
+		ret = mrarena_alloc(ths, char_cnt_without_zero+1);
+		vsnprintf(ret, char_cnt_without_zero+1, format, argp_copy);
+	}
+
+	va_end(argp_copy);
+	return ret;
+}
@@ -0,0 +1,62 @@
+/*******************************************************************************
+ *
+ *                              Delta Chat Core
+ *                      Copyright (C) 2017 Björn Petersen
+ *                   Contact: r10s@b44t.com, http://b44t.com
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see http://www.gnu.org/licenses/ .
+ *
+ ******************************************************************************/
+
+
+
+#ifndef __MRARENA_H__
+#define __MRARENA_H__
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+typedef struct mrarenablock_t mrarenablock_t;
+
+
+/* An arena hands out memory from larger blocks; single allocations are never
+freed, instead, all memory is released at once by mrarena_reset() or
+mrarena_unref().  This is used for the temporary data of a message that is
+received, see mrmimeparser_t::m_arena. */
+typedef struct mrarena_t
+{
+	mrarenablock_t* m_blocks;       /* the current block first, the first block allocated last */
+	char*           m_next;         /* free memory in the current block */
+	size_t          m_free;         /* bytes free at m_next */
+	size_t          m_block_bytes;  /* size of normal blocks, larger allocations get a block of their own */
+	char*           m_last;         /* the last allocation, can be extended by mrarena_realloc() */
+} mrarena_t;
+
+
+mrarena_t* mrarena_new      (size_t block_bytes);
+void       mrarena_unref    (mrarena_t*);
+void       mrarena_reset    (mrarena_t*);
+
+void*      mrarena_alloc    (mrarena_t*, size_t bytes);
+void*      mrarena_realloc  (mrarena_t*, void* ptr, size_t old_bytes, size_t new_bytes);
+char*      mrarena_strdup   (mrarena_t*, const char*);
+char*      mrarena_strndup  (mrarena_t*, const char*, size_t bytes);
+char*      mrarena_mprintf  (mrarena_t*, const char* format, ...);
+
+
+#ifdef __cplusplus
+} /* /extern "C" */
+#endif
+#endif /* __MRARENA_H__ */
@@ -467,7 +467,7 @@ int mrchat_update_param__(mrchat_t* ths)
 {
 	int success = 0;
 	sqlite3_stmt* stmt = mrsqlite3_prepare_v2_(ths->m_mailbox->m_sql, "UPDATE chats SET param=? WHERE id=?");
-	sqlite3_bind_text(stmt, 1, ths->m_param->m_packed, -1, SQLITE_STATIC);
+	sqlite3_bind_text(stmt, 1, mrparam_get_packed(ths->m_param), -1, SQLITE_STATIC);
 	sqlite3_bind_int (stmt, 2, ths->m_id);
 	success = sqlite3_step(stmt)==SQLITE_DONE? 1 : 0;
 	sqlite3_finalize(stmt);
@@ -514,7 +514,7 @@ static int mrchat_set_from_stmt__(mrchat_t* ths, sqlite3_stmt* row)
 	else if( ths->m_id == MR_CHAT_ID_ARCHIVED_LINK ) {
 		free(ths->m_name);
 		char* tempname = mrstock_str(MR_STR_ARCHIVEDCHATS);
-			ths->m_name = mr_mprintf("%s (%i)", tempname, mrmailbox_get_archived_count__(ths->m_mailbox));
+			ths->m_name = mr_mprintf("%s (%i)", tempname, mrmailbox_get_archived_count__(ths->m_mailbox->m_sql));
 		free(tempname);
 	}
 	else if( ths->m_id == MR_CHAT_ID_STARRED ) {
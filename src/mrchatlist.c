@@ -301,10 +301,11 @@ mrmailbox_t* mrchatlist_get_mailbox(mrchatlist_t* chatlist)
  * Library-internal.
  *
  * Calling this function is not thread-safe, locking is up to the caller.
+ * As the function only reads, `sql` may also be a reader returned by mrsqlite3_lock_reader().
  *
  * @private @memberof mrchatlist_t
  */
-int mrchatlist_load_from_db__(mrchatlist_t* ths, int listflags, const char* query__, uint32_t query_contact_id)
+int mrchatlist_load_from_db__(mrchatlist_t* ths, mrsqlite3_t* sql, int listflags, const char* query__, uint32_t query_contact_id)
 {
 	clock_t       start = clock();
 
@@ -313,18 +314,17 @@ int mrchatlist_load_from_db__(mrchatlist_t* ths, int listflags, const char* quer
 	sqlite3_stmt* stmt = NULL;
 	char*         strLikeCmd = NULL, *query = NULL;
 
-	if( ths == NULL || ths->m_magic != MR_CHATLIST_MAGIC || ths->m_mailbox == NULL ) {
+	if( ths == NULL || ths->m_magic != MR_CHATLIST_MAGIC || ths->m_mailbox == NULL || sql == NULL ) {
 		goto cleanup;
 	}
 
 	mrchatlist_empty(ths);
 
-	/* select example with left join and minimum: http://stackoverflow.com/questions/7588142/mysql-left-join-min */
-	#define QUR1 "SELECT c.id, m.id FROM chats c " \
-	                " LEFT JOIN msgs m ON (c.id=m.chat_id AND m.hidden=0 AND m.timestamp=(SELECT MAX(timestamp) FROM msgs WHERE chat_id=c.id AND hidden=0)) " /* not: `m.hidden` which would refer the outer select and takes lot of time*/ \
+	/* chats.last_msg_id and chats.last_timestamp are maintained by mrmailbox_update_chat_last_msg__(),
+	so there is no need to look up the newest message of each chat here */
+	#define QUR1 "SELECT c.id, c.last_msg_id FROM chats c " \
 	                " WHERE c.id>" MR_STRINGIFY(MR_CHAT_ID_LAST_SPECIAL) " AND c.blocked=0"
-	#define QUR2    " GROUP BY c.id " /* GROUP BY is needed as there may be several messages with the same timestamp */ \
-	                " ORDER BY MAX(c.draft_timestamp, IFNULL(m.timestamp,0)) DESC,m.id DESC;" /* the list starts with the newest chats */
+	#define QUR2    " ORDER BY MAX(c.draft_timestamp, c.last_timestamp) DESC, c.last_msg_id DESC;" /* the list starts with the newest chats */
 
 	// nb: the query currently shows messages from blocked contacts in groups.
 	// however, for normal-groups, this is okay as the message is also returned by mrmailbox_get_chat_msgs()
@@ -335,21 +335,21 @@ int mrchatlist_load_from_db__(mrchatlist_t* ths, int listflags, const char* quer
 	if( query_contact_id )
 	{
 		// show chats shared with a given contact
-		stmt = mrsqlite3_predefine__(ths->m_mailbox->m_sql, SELECT_ii_FROM_chats_LEFT_JOIN_msgs_WHERE_contact_id,
+		stmt = mrsqlite3_predefine__(sql, SELECT_ii_FROM_chats_WHERE_contact_id,
 			QUR1 " AND c.id IN(SELECT chat_id FROM chats_contacts WHERE contact_id=?) " QUR2);
 		sqlite3_bind_int(stmt, 1, query_contact_id);
 	}
 	else if( listflags & MR_GCL_ARCHIVED_ONLY )
 	{
 		/* show archived chats */
-		stmt = mrsqlite3_predefine__(ths->m_mailbox->m_sql, SELECT_ii_FROM_chats_LEFT_JOIN_msgs_WHERE_archived,
+		stmt = mrsqlite3_predefine__(sql, SELECT_ii_FROM_chats_WHERE_archived,
 			QUR1 " AND c.archived=1 " QUR2);
 	}
 	else if( query__==NULL )
 	{
 		/* show normal chatlist  */
 		if( !(listflags & MR_GCL_NO_SPECIALS) ) {
-			uint32_t last_deaddrop_fresh_msg_id = mrmailbox_get_last_deaddrop_fresh_msg__(ths->m_mailbox);
+			uint32_t last_deaddrop_fresh_msg_id = mrmailbox_get_last_deaddrop_fresh_msg__(sql);
 			if( last_deaddrop_fresh_msg_id > 0 ) {
 				mrarray_add_id(ths->m_chatNlastmsg_ids, MR_CHAT_ID_DEADDROP); /* show deaddrop with the last fresh message */
 				mrarray_add_id(ths->m_chatNlastmsg_ids, last_deaddrop_fresh_msg_id);
@@ -357,7 +357,7 @@ int mrchatlist_load_from_db__(mrchatlist_t* ths, int listflags, const char* quer
 			add_archived_link_item = 1;
 		}
 
-		stmt = mrsqlite3_predefine__(ths->m_mailbox->m_sql, SELECT_ii_FROM_chats_LEFT_JOIN_msgs_WHERE_unarchived,
+		stmt = mrsqlite3_predefine__(sql, SELECT_ii_FROM_chats_WHERE_unarchived,
 			QUR1 " AND c.archived=0 " QUR2);
 	}
 	else
@@ -370,7 +370,7 @@ int mrchatlist_load_from_db__(mrchatlist_t* ths, int listflags, const char* quer
 			goto cleanup;
 		}
 		strLikeCmd = mr_mprintf("%%%s%%", query);
-		stmt = mrsqlite3_predefine__(ths->m_mailbox->m_sql, SELECT_ii_FROM_chats_LEFT_JOIN_msgs_WHERE_query,
+		stmt = mrsqlite3_predefine__(sql, SELECT_ii_FROM_chats_WHERE_query,
 			QUR1 " AND c.name LIKE ? " QUR2);
 		sqlite3_bind_text(stmt, 1, strLikeCmd, -1, SQLITE_STATIC);
 	}
@@ -381,7 +381,7 @@ int mrchatlist_load_from_db__(mrchatlist_t* ths, int listflags, const char* quer
 		mrarray_add_id(ths->m_chatNlastmsg_ids, sqlite3_column_int(stmt, 1));
     }
 
-    if( add_archived_link_item && mrmailbox_get_archived_count__(ths->m_mailbox)>0 )
+    if( add_archived_link_item && mrmailbox_get_archived_count__(sql)>0 )
     {
 		mrarray_add_id(ths->m_chatNlastmsg_ids, MR_CHAT_ID_ARCHIVED_LINK);
 		mrarray_add_id(ths->m_chatNlastmsg_ids, 0);
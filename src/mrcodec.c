@@ -0,0 +1,674 @@
+/*******************************************************************************
+ *
+ *                              Delta Chat Core
+ *                      Copyright (C) 2017 Björn Petersen
+ *                   Contact: r10s@b44t.com, http://b44t.com
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see http://www.gnu.org/licenses/ .
+ *
+ ******************************************************************************/
+
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+#include "mrcodec.h"
+
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define MR_CODEC_X86 1
+#include <immintrin.h>
+#endif
+
+
+/*******************************************************************************
+ * Scalar implementation, also used for the characters not handled in blocks
+ ******************************************************************************/
+
+
+static const signed char s_base64_value[256] = {
+	-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1, -1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,
+	-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,62,-1,-1,-1,63, 52,53,54,55,56,57,58,59,60,61,-1,-1,-1,-1,-1,-1,
+	-1, 0, 1, 2, 3, 4, 5, 6, 7, 8, 9,10,11,12,13,14, 15,16,17,18,19,20,21,22,23,24,25,-1,-1,-1,-1,-1,
+	-1,26,27,28,29,30,31,32,33,34,35,36,37,38,39,40, 41,42,43,44,45,46,47,48,49,50,51,-1,-1,-1,-1,-1,
+	-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1, -1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,
+	-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1, -1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,
+	-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1, -1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,
+	-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1, -1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1
+};
+
+
+static const char s_base64_chars[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+
+static int hex_value(char c)
+{
+	/* invalid digits are regarded as 0, as libetpan does */
+	if( c >= '0' && c <= '9' ) { return c - '0'; }
+	if( c >= 'a' && c <= 'f' ) { return c - 'a' + 10; }
+	if( c >= 'A' && c <= 'F' ) { return c - 'A' + 10; }
+	return 0;
+}
+
+
+static size_t qp_find_special_scalar(const char* in, size_t in_bytes)
+{
+	size_t i;
+	for( i = 0; i < in_bytes; i++ ) {
+		if( in[i]=='=' || in[i]=='\r' || in[i]=='\n' ) {
+			break;
+		}
+	}
+	return i;
+}
+
+
+static void base64_encode_scalar(const unsigned char* in, size_t groups, char* out)
+{
+	/* encode `groups` groups of three bytes to four characters each */
+	while( groups-- ) {
+		out[0] = s_base64_chars[in[0] >> 2];
+		out[1] = s_base64_chars[((in[0] << 4) & 0x30) | (in[1] >> 4)];
+		out[2] = s_base64_chars[((in[1] << 2) & 0x3c) | (in[2] >> 6)];
+		out[3] = s_base64_chars[in[2] & 0x3f];
+		in += 3;
+		out += 4;
+	}
+}
+
+
+static size_t utf8_find_special_scalar(const char* in, size_t in_bytes)
+{
+	size_t i = 0;
+	while( i < in_bytes && (unsigned char)in[i] < 0x80 ) {
+		i++;
+	}
+	return i;
+}
+
+
+/*******************************************************************************
+ * SSE2 and AVX2 blocks
+ ******************************************************************************/
+
+
+/* a block decoder decodes MR_CODEC_BLOCK(impl) base64 characters at once;
+if a character is not part of the alphabet, nothing is written and the index of the character is returned, otherwise -1 */
+typedef int    (*base64_decode_block_t) (const char* in, char* out);
+typedef void   (*base64_encode_blocks_t)(const unsigned char* in, size_t groups, char* out);
+typedef size_t (*qp_find_special_t)     (const char* in, size_t in_bytes);
+
+/* returns the index of the first byte >= 0x80 or `in_bytes` if there is no such byte */
+typedef size_t (*utf8_find_special_t)   (const char* in, size_t in_bytes);
+
+
+#ifdef MR_CODEC_X86
+
+
+__attribute__((target("sse2")))
+static int base64_decode_block_sse2(const char* in, char* out)
+{
+	/* 16 characters -> 12 bytes */
+	__m128i c = _mm_loadu_si128((const __m128i*)in);
+
+	__m128i upper = _mm_and_si128(_mm_cmpgt_epi8(c, _mm_set1_epi8('A'-1)), _mm_cmpgt_epi8(_mm_set1_epi8('Z'+1), c));
+	__m128i lower = _mm_and_si128(_mm_cmpgt_epi8(c, _mm_set1_epi8('a'-1)), _mm_cmpgt_epi8(_mm_set1_epi8('z'+1), c));
+	__m128i digit = _mm_and_si128(_mm_cmpgt_epi8(c, _mm_set1_epi8('0'-1)), _mm_cmpgt_epi8(_mm_set1_epi8('9'+1), c));
+	__m128i plus  = _mm_cmpeq_epi8(c, _mm_set1_epi8('+'));
+	__m128i slash = _mm_cmpeq_epi8(c, _mm_set1_epi8('/'));
+
+	int valid = _mm_movemask_epi8(_mm_or_si128(_mm_or_si128(_mm_or_si128(upper, lower), _mm_or_si128(digit, plus)), slash));
+	if( valid != 0xFFFF ) {
+		return __builtin_ctz(~valid);
+	}
+
+	__m128i offset = _mm_or_si128(_mm_or_si128(_mm_and_si128(upper, _mm_set1_epi8(-65)), _mm_and_si128(lower, _mm_set1_epi8(-71))),
+	                 _mm_or_si128(_mm_or_si128(_mm_and_si128(digit, _mm_set1_epi8(4)), _mm_and_si128(plus, _mm_set1_epi8(19))),
+	                              _mm_and_si128(slash, _mm_set1_epi8(16))));
+	__m128i v = _mm_add_epi8(c, offset);
+
+	/* merge the 6-bit values: two per 16 bit, then two 12-bit values per 32 bit */
+	__m128i t = _mm_or_si128(_mm_slli_epi16(_mm_and_si128(v, _mm_set1_epi16(0x00FF)), 6), _mm_srli_epi16(v, 8));
+	__m128i u = _mm_madd_epi16(t, _mm_set1_epi32(0x00011000));
+
+	/* each 32 bit hold 24 bits of output in the wrong byte order; swap and pack them to 12 bytes */
+	__m128i w = _mm_or_si128(_mm_or_si128(_mm_slli_epi32(u, 16), _mm_and_si128(u, _mm_set1_epi32(0x0000FF00))),
+	                         _mm_and_si128(_mm_srli_epi32(u, 16), _mm_set1_epi32(0x000000FF)));
+	__m128i packed = _mm_or_si128(
+		_mm_or_si128(_mm_and_si128(w, _mm_set_epi32(0, 0, 0, 0x00FFFFFF)),
+		             _mm_srli_si128(_mm_and_si128(w, _mm_set_epi32(0, 0, 0x00FFFFFF, 0)), 1)),
+		_mm_or_si128(_mm_srli_si128(_mm_and_si128(w, _mm_set_epi32(0, 0x00FFFFFF, 0, 0)), 2),
+		             _mm_srli_si128(_mm_and_si128(w, _mm_set_epi32(0x00FFFFFF, 0, 0, 0)), 3)));
+
+	char tmp[16];
+	_mm_storeu_si128((__m128i*)tmp, packed);
+	memcpy(out, tmp, 12);
+	return -1;
+}
+
+
+__attribute__((target("sse2")))
+static __m128i base64_chars_sse2(__m128i idx)
+{
+	/* map values 0..63 to the base64 alphabet */
+	__m128i offset = _mm_set1_epi8(65);
+	offset = _mm_add_epi8(offset, _mm_and_si128(_mm_cmpgt_epi8(idx, _mm_set1_epi8(25)), _mm_set1_epi8(6)));
+	offset = _mm_add_epi8(offset, _mm_and_si128(_mm_cmpgt_epi8(idx, _mm_set1_epi8(51)), _mm_set1_epi8(-75)));
+	offset = _mm_add_epi8(offset, _mm_and_si128(_mm_cmpgt_epi8(idx, _mm_set1_epi8(61)), _mm_set1_epi8(-15)));
+	offset = _mm_add_epi8(offset, _mm_and_si128(_mm_cmpgt_epi8(idx, _mm_set1_epi8(62)), _mm_set1_epi8(3)));
+	return _mm_add_epi8(idx, offset);
+}
+
+
+__attribute__((target("sse2")))
+static void base64_encode_blocks_sse2(const unsigned char* in, size_t groups, char* out)
+{
+	/* SSE2 has no byte shuffle, so the 24-bit groups are loaded one by one and split in parallel */
+	while( groups >= 4 ) {
+		__m128i x = _mm_set_epi32((in[9]<<16)|(in[10]<<8)|in[11], (in[6]<<16)|(in[7]<<8)|in[8],
+		                          (in[3]<<16)|(in[4]<<8)|in[5],   (in[0]<<16)|(in[1]<<8)|in[2]);
+		__m128i idx = _mm_or_si128(
+			_mm_or_si128(_mm_srli_epi32(x, 18), _mm_slli_epi32(_mm_and_si128(_mm_srli_epi32(x, 12), _mm_set1_epi32(63)), 8)),
+			_mm_or_si128(_mm_slli_epi32(_mm_and_si128(_mm_srli_epi32(x, 6), _mm_set1_epi32(63)), 16), _mm_slli_epi32(x, 24)));
+		idx = _mm_and_si128(idx, _mm_set1_epi8(63));
+		_mm_storeu_si128((__m128i*)out, base64_chars_sse2(idx));
+		in += 12;
+		out += 16;
+		groups -= 4;
+	}
+	base64_encode_scalar(in, groups, out);
+}
+
+
+__attribute__((target("sse2")))
+static size_t qp_find_special_sse2(const char* in, size_t in_bytes)
+{
+	size_t i = 0;
+	while( i+16 <= in_bytes ) {
+		__m128i c = _mm_loadu_si128((const __m128i*)(in+i));
+		int mask = _mm_movemask_epi8(_mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(c, _mm_set1_epi8('=')),
+			_mm_cmpeq_epi8(c, _mm_set1_epi8('\r'))), _mm_cmpeq_epi8(c, _mm_set1_epi8('\n'))));
+		if( mask ) {
+			return i + __builtin_ctz(mask);
+		}
+		i += 16;
+	}
+	return i + qp_find_special_scalar(in+i, in_bytes-i);
+}
+
+
+__attribute__((target("sse2")))
+static size_t utf8_find_special_sse2(const char* in, size_t in_bytes)
+{
+	size_t i = 0;
+	while( i+16 <= in_bytes ) {
+		unsigned int mask = (unsigned int)_mm_movemask_epi8(_mm_loadu_si128((const __m128i*)(in+i)));
+		if( mask ) {
+			return i + __builtin_ctz(mask);
+		}
+		i += 16;
+	}
+	return i + utf8_find_special_scalar(in+i, in_bytes-i);
+}
+
+
+__attribute__((target("avx2")))
+static int base64_decode_block_avx2(const char* in, char* out)
+{
+	/* 32 characters -> 24 bytes */
+	__m256i c = _mm256_loadu_si256((const __m256i*)in);
+
+	__m256i upper = _mm256_and_si256(_mm256_cmpgt_epi8(c, _mm256_set1_epi8('A'-1)), _mm256_cmpgt_epi8(_mm256_set1_epi8('Z'+1), c));
+	__m256i lower = _mm256_and_si256(_mm256_cmpgt_epi8(c, _mm256_set1_epi8('a'-1)), _mm256_cmpgt_epi8(_mm256_set1_epi8('z'+1), c));
+	__m256i digit = _mm256_and_si256(_mm256_cmpgt_epi8(c, _mm256_set1_epi8('0'-1)), _mm256_cmpgt_epi8(_mm256_set1_epi8('9'+1), c));
+	__m256i plus  = _mm256_cmpeq_epi8(c, _mm256_set1_epi8('+'));
+	__m256i slash = _mm256_cmpeq_epi8(c, _mm256_set1_epi8('/'));
+
+	unsigned int valid = (unsigned int)_mm256_movemask_epi8(_mm256_or_si256(_mm256_or_si256(_mm256_or_si256(upper, lower), _mm256_or_si256(digit, plus)), slash));
+	if( valid != 0xFFFFFFFF ) {
+		return __builtin_ctz(~valid);
+	}
+
+	__m256i offset = _mm256_or_si256(_mm256_or_si256(_mm256_and_si256(upper, _mm256_set1_epi8(-65)), _mm256_and_si256(lower, _mm256_set1_epi8(-71))),
+	                 _mm256_or_si256(_mm256_or_si256(_mm256_and_si256(digit, _mm256_set1_epi8(4)), _mm256_and_si256(plus, _mm256_set1_epi8(19))),
+	                                 _mm256_and_si256(slash, _mm256_set1_epi8(16))));
+	__m256i v = _mm256_add_epi8(c, offset);
+
+	__m256i t = _mm256_maddubs_epi16(v, _mm256_set1_epi32(0x01400140));
+	__m256i u = _mm256_madd_epi16(t, _mm256_set1_epi32(0x00011000));
+	u = _mm256_shuffle_epi8(u, _mm256_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1,
+	                                            2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1));
+	u = _mm256_permutevar8x32_epi32(u, _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 3, 7));
+
+	char tmp[32];
+	_mm256_storeu_si256((__m256i*)tmp, u);
+	memcpy(out, tmp, 24);
+	return -1;
+}
+
+
+__attribute__((target("avx2")))
+static void base64_encode_blocks_avx2(const unsigned char* in, size_t groups, char* out)
+{
+	/* 24 bytes -> 32 characters; two loads of 16 bytes are needed, so the last block is handled by SSE2 */
+	while( groups >= 10 ) {
+		__m256i x = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128((const __m128i*)in)),
+		                                    _mm_loadu_si128((const __m128i*)(in+12)), 1);
+		x = _mm256_shuffle_epi8(x, _mm256_setr_epi8(1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10,
+		                                            1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10));
+		__m256i t0 = _mm256_mulhi_epu16(_mm256_and_si256(x, _mm256_set1_epi32(0x0fc0fc00)), _mm256_set1_epi32(0x04000040));
+		__m256i t1 = _mm256_mullo_epi16(_mm256_and_si256(x, _mm256_set1_epi32(0x003f03f0)), _mm256_set1_epi32(0x01000010));
+		__m256i idx = _mm256_or_si256(t0, t1);
+
+		__m256i offset = _mm256_set1_epi8(65);
+		offset = _mm256_add_epi8(offset, _mm256_and_si256(_mm256_cmpgt_epi8(idx, _mm256_set1_epi8(25)), _mm256_set1_epi8(6)));
+		offset = _mm256_add_epi8(offset, _mm256_and_si256(_mm256_cmpgt_epi8(idx, _mm256_set1_epi8(51)), _mm256_set1_epi8(-75)));
+		offset = _mm256_add_epi8(offset, _mm256_and_si256(_mm256_cmpgt_epi8(idx, _mm256_set1_epi8(61)), _mm256_set1_epi8(-15)));
+		offset = _mm256_add_epi8(offset, _mm256_and_si256(_mm256_cmpgt_epi8(idx, _mm256_set1_epi8(62)), _mm256_set1_epi8(3)));
+		_mm256_storeu_si256((__m256i*)out, _mm256_add_epi8(idx, offset));
+		in += 24;
+		out += 32;
+		groups -= 8;
+	}
+	base64_encode_blocks_sse2(in, groups, out);
+}
+
+
+__attribute__((target("avx2")))
+static size_t qp_find_special_avx2(const char* in, size_t in_bytes)
+{
+	size_t i = 0;
+	while( i+32 <= in_bytes ) {
+		__m256i c = _mm256_loadu_si256((const __m256i*)(in+i));
+		unsigned int mask = (unsigned int)_mm256_movemask_epi8(_mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(c, _mm256_set1_epi8('=')),
+			_mm256_cmpeq_epi8(c, _mm256_set1_epi8('\r'))), _mm256_cmpeq_epi8(c, _mm256_set1_epi8('\n'))));
+		if( mask ) {
+			return i + __builtin_ctz(mask);
+		}
+		i += 32;
+	}
+	return i + qp_find_special_sse2(in+i, in_bytes-i);
+}
+
+
+__attribute__((target("avx2")))
+static size_t utf8_find_special_avx2(const char* in, size_t in_bytes)
+{
+	size_t i = 0;
+	while( i+32 <= in_bytes ) {
+		unsigned int mask = (unsigned int)_mm256_movemask_epi8(_mm256_loadu_si256((const __m256i*)(in+i)));
+		if( mask ) {
+			return i + __builtin_ctz(mask);
+		}
+		i += 32;
+	}
+	return i + utf8_find_special_sse2(in+i, in_bytes-i);
+}
+
+
+#endif /* MR_CODEC_X86 */
+
+
+/*******************************************************************************
+ * Dispatching
+ ******************************************************************************/
+
+
+typedef struct mrcodecimpl_t
+{
+	const char*            m_name;
+	size_t                 m_block_chars;   /* characters handled by m_base64_decode_block */
+	base64_decode_block_t  m_base64_decode_block;
+	base64_encode_blocks_t m_base64_encode_blocks;
+	qp_find_special_t      m_qp_find_special;
+	utf8_find_special_t    m_utf8_find_special;
+} mrcodecimpl_t;
+
+
+static const mrcodecimpl_t s_impls[] = {
+	{ "scalar", 0,  NULL,                     base64_encode_scalar,      qp_find_special_scalar, utf8_find_special_scalar },
+#ifdef MR_CODEC_X86
+	{ "sse2",   16, base64_decode_block_sse2, base64_encode_blocks_sse2, qp_find_special_sse2,   utf8_find_special_sse2 },
+	{ "avx2",   32, base64_decode_block_avx2, base64_encode_blocks_avx2, qp_find_special_avx2,   utf8_find_special_avx2 },
+#endif
+};
+
+
+/* the parsing threads use the codecs concurrently, so the CPU is checked once using pthread_once() and the selected implementation
+is read and written atomically; s_impl_max is written by detect_impl() only */
+static pthread_once_t s_detect_once = PTHREAD_ONCE_INIT;
+static int            s_impl_max = MR_CODEC_SCALAR;
+static int            s_impl = MR_CODEC_SCALAR;
+
+
+static void detect_impl(void)
+{
+	int impl = MR_CODEC_SCALAR;
+	#ifdef MR_CODEC_X86
+		__builtin_cpu_init();
+		if( __builtin_cpu_supports("avx2") ) {
+			impl = MR_CODEC_AVX2;
+		}
+		else if( __builtin_cpu_supports("sse2") ) {
+			impl = MR_CODEC_SSE2;
+		}
+	#endif
+	s_impl_max = impl;
+	__atomic_store_n(&s_impl, impl, __ATOMIC_RELEASE);
+}
+
+
+static const mrcodecimpl_t* get_impl(void)
+{
+	pthread_once(&s_detect_once, detect_impl);
+	return &s_impls[__atomic_load_n(&s_impl, __ATOMIC_ACQUIRE)];
+}
+
+
+int mr_codec_get_impl(void)
+{
+	pthread_once(&s_detect_once, detect_impl);
+	return __atomic_load_n(&s_impl, __ATOMIC_ACQUIRE);
+}
+
+
+int mr_codec_set_impl(int impl)
+{
+	pthread_once(&s_detect_once, detect_impl);
+	impl = impl < MR_CODEC_SCALAR? MR_CODEC_SCALAR : (impl > s_impl_max? s_impl_max : impl);
+	__atomic_store_n(&s_impl, impl, __ATOMIC_RELEASE);
+	return impl;
+}
+
+
+const char* mr_codec_impl_name(int impl)
+{
+	if( impl < 0 || impl >= (int)(sizeof(s_impls)/sizeof(s_impls[0])) ) {
+		return "?";
+	}
+	return s_impls[impl].m_name;
+}
+
+
+/*******************************************************************************
+ * Base64
+ ******************************************************************************/
+
+
+size_t mr_base64_decode(const char* in, size_t in_bytes, int partial, size_t* ret_consumed, char* out)
+{
+	const mrcodecimpl_t* impl = get_impl();
+	size_t       i = 0, last_full_group_end = 0;
+	char*        o = out;
+	unsigned int group = 0;
+	int          group_chars = 0;
+
+	while( i < in_bytes )
+	{
+		if( group_chars == 0 && impl->m_block_chars && in_bytes-i >= impl->m_block_chars ) {
+			int bad = impl->m_base64_decode_block(in+i, o);
+			if( bad < 0 ) {
+				i += impl->m_block_chars;
+				o += impl->m_block_chars/4*3;
+				last_full_group_end = i;
+				continue;
+			}
+
+			/* decode up to the bad character, typically a line end, and try over with a block after it */
+			size_t block_end = i + bad + 1;
+			while( i < block_end ) {
+				int value = s_base64_value[(unsigned char)in[i++]];
+				if( value >= 0 ) {
+					group = (group<<6) | value;
+					if( ++group_chars == 4 ) {
+						o[0] = (char)(group>>16); o[1] = (char)(group>>8); o[2] = (char)group;
+						o += 3;
+						group = 0;
+						group_chars = 0;
+						last_full_group_end = i;
+					}
+				}
+			}
+			continue;
+		}
+
+		int value = s_base64_value[(unsigned char)in[i++]];
+		if( value >= 0 ) {
+			group = (group<<6) | value;
+			if( ++group_chars == 4 ) {
+				o[0] = (char)(group>>16); o[1] = (char)(group>>8); o[2] = (char)group;
+				o += 3;
+				group = 0;
+				group_chars = 0;
+				last_full_group_end = i;
+			}
+		}
+	}
+
+	if( group_chars && !partial ) {
+		/* an incomplete group at the end: write one byte or, for three characters, two bytes */
+		group <<= 6*(4-group_chars);
+		*o++ = (char)(group>>16);
+		if( group_chars >= 3 ) {
+			*o++ = (char)(group>>8);
+		}
+	}
+
+	if( ret_consumed ) {
+		*ret_consumed = partial? last_full_group_end : in_bytes;
+	}
+
+	return o - out;
+}
+
+
+char* mr_base64_encode(const void* in_, size_t in_bytes, int break_every, const char* break_chars)
+{
+	const mrcodecimpl_t* impl = get_impl();
+	const unsigned char* in = (const unsigned char*)in_;
+	size_t chars = (in_bytes+2)/3*4, breaks = 0, break_chars_len = 0, total, i;
+	char*  ret, *encoded;
+
+	if( break_every > 0 && break_chars && break_chars[0] && chars > 0 ) {
+		break_chars_len = strlen(break_chars);
+		breaks = (chars-1) / break_every;
+	}
+
+	total = chars + breaks*break_chars_len;
+	if( (ret=malloc(total+1))==NULL ) {
+		exit(56);
+	}
+
+	/* encode to the end of the buffer, the lines are moved to their final place afterwards */
+	encoded = ret + total - chars;
+	impl->m_base64_encode_blocks(in, in_bytes/3, encoded);
+	if( in_bytes%3 ) {
+		const unsigned char* tail = in + in_bytes/3*3;
+		char* o = encoded + in_bytes/3*4;
+		o[0] = s_base64_chars[tail[0] >> 2];
+		if( in_bytes%3 == 1 ) {
+			o[1] = s_base64_chars[(tail[0] << 4) & 0x30];
+			o[2] = '=';
+		}
+		else {
+			o[1] = s_base64_chars[((tail[0] << 4) & 0x30) | (tail[1] >> 4)];
+			o[2] = s_base64_chars[(tail[1] << 2) & 0x3c];
+		}
+		o[3] = '=';
+	}
+
+	if( breaks ) {
+		char* o = ret;
+		for( i = 0; i < breaks; i++ ) {
+			memmove(o, encoded + i*break_every, break_every);
+			o += break_every;
+			memcpy(o, break_chars, break_chars_len);
+			o += break_chars_len;
+		}
+		/* the last line is already at its place */
+	}
+
+	ret[total] = 0;
+	return ret;
+}
+
+
+/*******************************************************************************
+ * Quoted-printable
+ ******************************************************************************/
+
+
+size_t mr_qp_decode(const char* in, size_t in_bytes, int partial, size_t* ret_consumed, char* out)
+{
+	const mrcodecimpl_t* impl = get_impl();
+	size_t i = 0;
+	char*  o = out;
+
+	while( i < in_bytes )
+	{
+		char c = in[i];
+		if( c == '\n' ) {
+			*o++ = '\r'; *o++ = '\n';
+			i++;
+		}
+		else if( c == '\r' ) {
+			/* a single CR is converted to CRLF, a CR at the very end is dropped */
+			i++;
+			if( i >= in_bytes ) {
+				break;
+			}
+			*o++ = '\r'; *o++ = '\n';
+			if( in[i] == '\n' ) {
+				i++;
+			}
+		}
+		else if( c == '=' ) {
+			if( i+1 >= in_bytes ) {
+				if( partial ) {
+					goto incomplete;
+				}
+				*o++ = '=';
+				i++;
+			}
+			else if( in[i+1] == '\n' ) {
+				i += 2; /* soft line break */
+			}
+			else if( in[i+1] == '\r' ) {
+				if( i+2 >= in_bytes ) {
+					goto incomplete; /* `=CR` at the end is dropped, also if this is not partial */
+				}
+				i += in[i+2]=='\n'? 3 : 2; /* soft line break */
+			}
+			else if( i+2 >= in_bytes ) {
+				if( partial ) {
+					goto incomplete;
+				}
+				/* a truncated escape at the end is copied as is; libetpan would read beyond the data here */
+				*o++ = '=';
+				*o++ = in[i+1];
+				i += 2;
+			}
+			else {
+				*o++ = (char)((hex_value(in[i+1])<<4) | hex_value(in[i+2]));
+				i += 3;
+			}
+		}
+		else {
+			size_t run = impl->m_qp_find_special(in+i, in_bytes-i);
+			memcpy(o, in+i, run);
+			o += run;
+			i += run;
+		}
+	}
+
+	if( ret_consumed ) {
+		*ret_consumed = in_bytes;
+	}
+	return o - out;
+
+incomplete:
+	if( ret_consumed ) {
+		*ret_consumed = i;
+	}
+	return o - out;
+}
+
+
+/*******************************************************************************
+ * UTF-8
+ ******************************************************************************/
+
+
+static int utf8_sequence(const unsigned char* p)
+{
+	/* check the sequence starting with the byte >= 0x80 at `p` as of RFC 3629;
+	returns the length of a valid sequence or the negative length of the invalid
+	part, this is the lead byte and the continuation bytes that are correct so far.
+	A null-byte is never a continuation byte, so we never read beyond the string. */
+	unsigned char c = p[0], lo = 0x80, hi = 0xBF;
+	int           n, i;
+
+	     if( c >= 0xC2 && c <= 0xDF ) { n = 1; }
+	else if( c >= 0xE0 && c <= 0xEF ) { n = 2; if( c == 0xE0 ) { lo = 0xA0; /*overlong*/ } else if( c == 0xED ) { hi = 0x9F; /*surrogates*/ } }
+	else if( c >= 0xF0 && c <= 0xF4 ) { n = 3; if( c == 0xF0 ) { lo = 0x90; /*overlong*/ } else if( c == 0xF4 ) { hi = 0x8F; /*> U+10FFFF*/ } }
+	else                              { return -1; } /* continuation byte without lead byte, overlong 0xC0/0xC1 or 0xF5..0xFF */
+
+	for( i = 1; i <= n; i++ ) {
+		if( p[i] < lo || p[i] > hi ) {
+			return -i;
+		}
+		lo = 0x80;
+		hi = 0xBF;
+	}
+	return n+1;
+}
+
+
+size_t mr_utf8_repair(char* buf)
+{
+	const mrcodecimpl_t* impl = get_impl();
+	unsigned char*       p = (unsigned char*)buf;
+	unsigned char*       end;
+	size_t               replaced = 0;
+	int                  len;
+
+	if( buf == NULL ) {
+		return 0;
+	}
+
+	end = p + strlen(buf); /* the blocks are scanned up to the known length only, so nothing beyond the string is read */
+	while( 1 )
+	{
+		/* skip ASCII in blocks */
+		p += impl->m_utf8_find_special((const char*)p, end-p);
+		if( p >= end ) {
+			break;
+		}
+
+		/* non-ASCII text typically continues with non-ASCII characters, so check them one by one before searching blocks again */
+		while( *p >= 0x80 ) {
+			if( (len=utf8_sequence(p)) > 0 ) {
+				p += len;
+			}
+			else {
+				memset(p, '_', -len);
+				p += -len;
+				replaced += -len;
+			}
+		}
+	}
+
+	return replaced;
+}
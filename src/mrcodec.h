@@ -0,0 +1,73 @@
+/*******************************************************************************
+ *
+ *                              Delta Chat Core
+ *                      Copyright (C) 2017 Björn Petersen
+ *                   Contact: r10s@b44t.com, http://b44t.com
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see http://www.gnu.org/licenses/ .
+ *
+ ******************************************************************************/
+
+
+
+#ifndef __MRCODEC_H__
+#define __MRCODEC_H__
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/* Base64 and quoted-printable codecs as used for the transfer encoding of
+MIME parts and for key armor, and UTF-8 validation.  The results are the same
+as the ones of libetpan's mailmime_base64_body_parse(),
+mailmime_quoted_printable_body_parse() and encode_base64(), however, on x86,
+blocks of characters are handled by SSE2 or AVX2 instructions.  The
+implementation is selected at runtime depending on the CPU,
+mr_codec_set_impl() allows to select another one, eg. for testing. */
+#define MR_CODEC_SCALAR 0
+#define MR_CODEC_SSE2   1
+#define MR_CODEC_AVX2   2
+
+int     mr_codec_get_impl         (void);
+int     mr_codec_set_impl         (int impl); /* returns the implementation used, this may be less than `impl` if the CPU does not support it */
+const char* mr_codec_impl_name    (int impl);
+
+/* Decode base64 to `out` which must have space for mr_base64_decode_bound() bytes.
+Characters that are not part of the base64 alphabet are skipped.  If `partial`
+is set, an incomplete group of four characters at the end is not decoded and
+`ret_consumed` is set to the first character not decoded; the caller may
+continue there with more data.  Returns the number of bytes written to `out`. */
+#define mr_base64_decode_bound(in_bytes) ((in_bytes)/4*3+3)
+size_t  mr_base64_decode          (const char* in, size_t in_bytes, int partial, size_t* ret_consumed, char* out);
+
+/* Decode quoted-printable to `out` which must have space for mr_qp_decode_bound() bytes.
+Line ends are converted to CRLF, soft line breaks are removed.  For `partial`, see mr_base64_decode(). */
+#define mr_qp_decode_bound(in_bytes) ((in_bytes)*2+1)
+size_t  mr_qp_decode              (const char* in, size_t in_bytes, int partial, size_t* ret_consumed, char* out);
+
+/* Encode binary data to a null-terminated base64 string.  If `break_every` is
+larger than zero, `break_chars` are inserted every `break_every` characters
+as mr_insert_breaks() does.  The result must be free()'d. */
+char*   mr_base64_encode          (const void* in, size_t in_bytes, int break_every, const char* break_chars);
+
+/* Validate the null-terminated string `buf` as UTF-8 as of RFC 3629 and replace
+the bytes of invalid or incomplete sequences by `_`; valid sequences are left
+as they are.  ASCII is skipped in blocks.  Returns the number of bytes replaced. */
+size_t  mr_utf8_repair            (char* buf);
+
+
+#ifdef __cplusplus
+} /* /extern "C" */
+#endif
+#endif /* __MRCODEC_H__ */
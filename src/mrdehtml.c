@@ -22,6 +22,7 @@
 
 #include <stdlib.h>
 #include <string.h>
+#include <ctype.h>
 #include "mrmailbox.h"
 #include "mrdehtml.h"
 #include "mrsaxparser.h"
@@ -39,59 +40,93 @@ typedef struct dehtml_t
     #define DO_ADD_PRESERVE_LINEENDS 2
     int     m_add_text;
     char*   m_last_href;
+    mrarena_t* m_arena;
 
 } dehtml_t;
 
 
-static void dehtml_starttag_cb(void* userdata, const char* tag, char** attr)
+static char* dehtml_decode_attr(dehtml_t* dehtml, const mrsaxattr_t* attr)
+{
+	/* the value is decoded directly into the returned string */
+	char*       ret;
+	const char* decoded;
+	int         bytes;
+
+	if( dehtml->m_arena ) {
+		ret = mrarena_alloc(dehtml->m_arena, attr->m_value_bytes+1);
+	}
+	else if( (ret=malloc(attr->m_value_bytes+1)) == NULL ) {
+		exit(66);
+	}
+
+	if( (decoded=mrsaxparser_decode(attr->m_value, attr->m_value_bytes, 1, 0, ret, &bytes)) != ret ) {
+		memcpy(ret, decoded, bytes);
+	}
+	ret[bytes] = 0;
+	return ret;
+}
+
+
+static void dehtml_starttag_cb(void* userdata, const char* tag, int tag_bytes, const mrsaxattr_t* attr, int attr_cnt)
 {
 	dehtml_t* dehtml = (dehtml_t*)userdata;
 
-	if( strcmp(tag, "p")==0 || strcmp(tag, "div")==0 || strcmp(tag, "table")==0 || strcmp(tag, "td")==0 )
+	#define TAG_IS(a) mrsaxparser_tag_is(tag, tag_bytes, (a))
+	if( TAG_IS("p") || TAG_IS("div") || TAG_IS("table") || TAG_IS("td") )
 	{
 		mrstrbuilder_cat(&dehtml->m_strbuilder, "\n\n");
 		dehtml->m_add_text = DO_ADD_REMOVE_LINEENDS;
 	}
-	else if( strcmp(tag, "br")==0 )
+	else if( TAG_IS("br") )
 	{
 		mrstrbuilder_cat(&dehtml->m_strbuilder, "\n");
 		dehtml->m_add_text = DO_ADD_REMOVE_LINEENDS;
 	}
-	else if( strcmp(tag, "style")==0 || strcmp(tag, "script")==0 || strcmp(tag, "title")==0 )
+	else if( TAG_IS("style") || TAG_IS("script") || TAG_IS("title") )
 	{
 		dehtml->m_add_text = DO_NOT_ADD;
 	}
-	else if( strcmp(tag, "pre")==0 )
+	else if( TAG_IS("pre") )
 	{
 		mrstrbuilder_cat(&dehtml->m_strbuilder, "\n\n");
 		dehtml->m_add_text = DO_ADD_PRESERVE_LINEENDS;
 	}
-	else if( strcmp(tag, "a")==0 )
+	else if( TAG_IS("a") )
 	{
-		free(dehtml->m_last_href);
-		dehtml->m_last_href = strdup_keep_null(mrattr_find(attr, "href"));
+		const mrsaxattr_t* href = mrsaxattr_find_span(attr, attr_cnt, "href");
+		if( dehtml->m_arena == NULL ) {
+			free(dehtml->m_last_href);
+		}
+		dehtml->m_last_href = href? dehtml_decode_attr(dehtml, href) : NULL;
 		if( dehtml->m_last_href ) {
 			mrstrbuilder_cat(&dehtml->m_strbuilder, "[");
 		}
 	}
-	else if( strcmp(tag, "b")==0 || strcmp(tag, "strong")==0 )
+	else if( TAG_IS("b") || TAG_IS("strong") )
 	{
 		mrstrbuilder_cat(&dehtml->m_strbuilder, "*");
 	}
-	else if( strcmp(tag, "i")==0 || strcmp(tag, "em")==0 )
+	else if( TAG_IS("i") || TAG_IS("em") )
 	{
 		mrstrbuilder_cat(&dehtml->m_strbuilder, "_");
 	}
 }
 
 
-static void dehtml_text_cb(void* userdata, const char* text, int len)
+static void dehtml_text_cb(void* userdata, const char* text, int text_bytes, int is_cdata)
 {
 	dehtml_t* dehtml = (dehtml_t*)userdata;
 
 	if( dehtml->m_add_text != DO_NOT_ADD )
 	{
-		char* last_added = mrstrbuilder_cat(&dehtml->m_strbuilder, text);
+		/* decode the text directly to the end of the result, the decoded text is never longer */
+		char*       last_added = mrstrbuilder_reserve(&dehtml->m_strbuilder, text_bytes);
+		const char* decoded;
+		int         bytes;
+		if( (decoded=mrsaxparser_decode(text, text_bytes, 0, is_cdata, last_added, &bytes)) != last_added ) {
+			memcpy(last_added, decoded, bytes);
+		}
+		mrstrbuilder_commit(&dehtml->m_strbuilder, bytes);
 
 		if( dehtml->m_add_text==DO_ADD_REMOVE_LINEENDS )
 		{
@@ -121,43 +156,53 @@ static void dehtml_text_cb(void* userdata, const char* text, int len)
 }
 
 
-static void dehtml_endtag_cb(void* userdata, const char* tag)
+static void dehtml_endtag_cb(void* userdata, const char* tag, int tag_bytes)
 {
 	dehtml_t* dehtml = (dehtml_t*)userdata;
 
-	if( strcmp(tag, "p")==0 || strcmp(tag, "div")==0 || strcmp(tag, "table")==0 || strcmp(tag, "td")==0
-	 || strcmp(tag, "style")==0 || strcmp(tag, "script")==0 || strcmp(tag, "title")==0
-	 || strcmp(tag, "pre")==0 )
+	if( TAG_IS("p") || TAG_IS("div") || TAG_IS("table") || TAG_IS("td")
+	 || TAG_IS("style") || TAG_IS("script") || TAG_IS("title")
+	 || TAG_IS("pre") )
 	{
 		mrstrbuilder_cat(&dehtml->m_strbuilder, "\n\n"); /* do not expect an starting block element (which, of course, should come right now) */
 		dehtml->m_add_text = DO_ADD_REMOVE_LINEENDS;
 	}
-	else if( strcmp(tag, "a")==0 )
+	else if( TAG_IS("a") )
 	{
 		if( dehtml->m_last_href ) {
 			mrstrbuilder_cat(&dehtml->m_strbuilder, "](");
 			mrstrbuilder_cat(&dehtml->m_strbuilder, dehtml->m_last_href);
 			mrstrbuilder_cat(&dehtml->m_strbuilder, ")");
-			free(dehtml->m_last_href);
+			if( dehtml->m_arena == NULL ) {
+				free(dehtml->m_last_href);
+			}
 			dehtml->m_last_href = NULL;
 		}
 	}
-	else if( strcmp(tag, "b")==0 || strcmp(tag, "strong")==0 )
+	else if( TAG_IS("b") || TAG_IS("strong") )
 	{
 		mrstrbuilder_cat(&dehtml->m_strbuilder, "*");
 	}
-	else if( strcmp(tag, "i")==0 || strcmp(tag, "em")==0 )
+	else if( TAG_IS("i") || TAG_IS("em") )
 	{
 		mrstrbuilder_cat(&dehtml->m_strbuilder, "_");
 	}
 }
 
 
-char* mr_dehtml(char* buf_terminated)
+char* mr_dehtml(const char* buf, size_t buf_bytes, mrarena_t* arena)
 {
-	mr_trim(buf_terminated);
-	if( buf_terminated[0] == 0 ) {
-		return safe_strdup(""); /* support at least empty HTML-messages; for empty messages, we'll replace the message by the subject later */
+	/* trim the given span, the buffer itself is neither modified nor copied */
+	while( buf_bytes > 0 && isspace((unsigned char)buf[0]) ) {
+		buf++;
+		buf_bytes--;
+	}
+	while( buf_bytes > 0 && isspace((unsigned char)buf[buf_bytes-1]) ) {
+		buf_bytes--;
+	}
+
+	if( buf_bytes == 0 ) {
+		return arena? mrarena_strdup(arena, "") : safe_strdup(""); /* support at least empty HTML-messages; for empty messages, we'll replace the message by the subject later */
 	}
 	else {
 		dehtml_t      dehtml;
@@ -165,16 +210,21 @@ char* mr_dehtml(char* buf_terminated)
 
 		memset(&dehtml, 0, sizeof(dehtml_t));
 		dehtml.m_add_text   = DO_ADD_REMOVE_LINEENDS;
-		mrstrbuilder_init(&dehtml.m_strbuilder, strlen(buf_terminated));
+		dehtml.m_arena      = arena;
+		if( arena ) {
+			mrstrbuilder_init_arena(&dehtml.m_strbuilder, buf_bytes, arena);
+		}
+		else {
+			mrstrbuilder_init(&dehtml.m_strbuilder, buf_bytes);
+		}
 
 		mrsaxparser_init(&saxparser, &dehtml);
-		mrsaxparser_set_tag_handler(&saxparser, dehtml_starttag_cb, dehtml_endtag_cb);
-		mrsaxparser_set_text_handler(&saxparser, dehtml_text_cb);
-		mrsaxparser_parse(&saxparser, buf_terminated);
+		mrsaxparser_set_span_handler(&saxparser, dehtml_starttag_cb, dehtml_endtag_cb, dehtml_text_cb);
+		mrsaxparser_feed(&saxparser, buf, buf_bytes, 1);
 
-		free(dehtml.m_last_href);
+		if( arena == NULL ) {
+			free(dehtml.m_last_href);
+		}
 		return dehtml.m_strbuilder.m_buf;
 	}
 }
-
-
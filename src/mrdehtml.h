@@ -29,7 +29,10 @@ extern "C" {
 
 /*** library-internal *********************************************************/
 
-char* mr_dehtml(char* buf_terminated); /* mr_dehtml() returns way too many lineends; however, an optimisation on this issue is not needed as the lineends are typically remove in further processing by the caller */
+#include "mrarena.h"
+
+/* If an arena is given, the result is allocated there, otherwise it must be free()'d. */
+char* mr_dehtml(const char* buf, size_t buf_bytes, mrarena_t*); /* mr_dehtml() returns way too many lineends; however, an optimisation on this issue is not needed as the lineends are typically remove in further processing by the caller */
 
 
 #ifdef __cplusplus
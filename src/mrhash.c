@@ -29,402 +29,354 @@
 #include "mrhash.h"
 
 
-/*
-** Based upon hash.c from sqlite which author disclaims copyright to this source code. In place of
-** a legal notice, here is a blessing:
-**
-** May you do good and not evil.
-** May you find forgiveness for yourself and forgive others.
-** May you share freely, never taking more than you give.
-*/
-#define Addr(X)  ((uintptr_t)X)
-
-static void*    sjhashMalloc(long bytes) { void* p=malloc(bytes); if( p) memset(p, 0, bytes); return p; }
-#define         sjhashMallocRaw(a) malloc((a))
-#define         sjhashFree(a) free((a))
-
-
+/*******************************************************************************
+ * Hash functions
+ ******************************************************************************/
 
-/* An array to map all upper-case characters into their corresponding
- * lower-case character.
- */
-static const unsigned char sjhashUpperToLower[] = {
-	0,  1,  2,  3,  4,  5,  6,  7,  8,  9, 10, 11, 12, 13, 14, 15, 16, 17,
-	18, 19, 20, 21, 22, 23, 24, 25, 26, 27, 28, 29, 30, 31, 32, 33, 34, 35,
-	36, 37, 38, 39, 40, 41, 42, 43, 44, 45, 46, 47, 48, 49, 50, 51, 52, 53,
-	54, 55, 56, 57, 58, 59, 60, 61, 62, 63, 64, 97, 98, 99,100,101,102,103,
-	104,105,106,107,108,109,110,111,112,113,114,115,116,117,118,119,120,121,
-	122, 91, 92, 93, 94, 95, 96, 97, 98, 99,100,101,102,103,104,105,106,107,
-	108,109,110,111,112,113,114,115,116,117,118,119,120,121,122,123,124,125,
-	126,127,128,129,130,131,132,133,134,135,136,137,138,139,140,141,142,143,
-	144,145,146,147,148,149,150,151,152,153,154,155,156,157,158,159,160,161,
-	162,163,164,165,166,167,168,169,170,171,172,173,174,175,176,177,178,179,
-	180,181,182,183,184,185,186,187,188,189,190,191,192,193,194,195,196,197,
-	198,199,200,201,202,203,204,205,206,207,208,209,210,211,212,213,214,215,
-	216,217,218,219,220,221,222,223,224,225,226,227,228,229,230,231,232,233,
-	234,235,236,237,238,239,240,241,242,243,244,245,246,247,248,249,250,251,
-	252,253,254,255
-};
 
+/* The string functions work on 8 bytes at once; ASCII upper-case characters
+are mapped to lower-case in all 8 bytes using some bit arithmetic, other
+characters are not modified.  The loops are simple enough to be vectorized by
+the compiler, however, even without this, they are much faster than looking up
+each byte in a table. */
+#define ONES  UINT64_C(0x0101010101010101)
+#define HIGHS UINT64_C(0x8080808080808080)
 
 
-/* Some systems have stricmp().  Others have strcasecmp().  Because
- * there is no consistency, we will define our own.
- */
-static int sjhashStrNICmp(const char *zLeft, const char *zRight, int N)
+static inline uint64_t load8(const unsigned char* p)
 {
-	register unsigned char *a, *b;
-	a = (unsigned char *)zLeft;
-	b = (unsigned char *)zRight;
-	while( N-- > 0 && *a!=0 && sjhashUpperToLower[*a]==sjhashUpperToLower[*b]) { a++; b++; }
-	return N<0 ? 0 : sjhashUpperToLower[*a] - sjhashUpperToLower[*b];
+	uint64_t v;
+	memcpy(&v, p, 8); /* unaligned access, compiled to a single load */
+	return v;
 }
 
 
-
-/* This function computes a hash on the name of a keyword.
- * Case is not significant.
- */
-static int sjhashNoCase(const char *z, int n)
+/* Load the last 1..7 bytes of a key.  For keys of at least 8 bytes, the last
+8 bytes are loaded (overlapping with bytes already processed) as this is much
+faster than assembling the bytes one by one. */
+static inline uint64_t loadTail(const unsigned char* p, int nLeft, int nKey)
 {
-	int h = 0;
-	if( n<=0 ) n = strlen(z);
-	while( n > 0  ) {
-		h = (h<<3) ^ h ^ sjhashUpperToLower[(unsigned char)*z++];
-		n--;
+	uint64_t v = 0;
+	if( nKey >= 8 ) {
+		return load8(p+nLeft-8);
 	}
-	return h & 0x7fffffff;
+	while( nLeft-- > 0 ) {
+		v = (v<<8) | p[nLeft];
+	}
+	return v;
 }
 
 
-
-/* Turn bulk memory into a hash table object by initializing the
- * fields of the Hash structure.
- *
- * "pNew" is a pointer to the hash table that is to be initialized.
- * keyClass is one of the constants SJHASH_INT, SJHASH_POINTER,
- * SJHASH_BINARY, or SJHASH_STRING.  The value of keyClass
- * determines what kind of key the hash table will use.  "copyKey" is
- * true if the hash table should make its own private copy of keys and
- * false if it should just use the supplied pointer.  CopyKey only makes
- * sense for SJHASH_STRING and SJHASH_BINARY and is ignored
- * for other key classes.
- */
-void mrhash_init(mrhash_t *pNew, int keyClass, int copyKey)
+static inline uint64_t fold8(uint64_t v)
 {
-	assert( pNew!=0 );
-	assert( keyClass>=MRHASH_INT && keyClass<=MRHASH_BINARY );
-	pNew->keyClass = keyClass;
+	uint64_t heptets  = v & ~HIGHS;
+	uint64_t above_Z  = heptets + ONES*(0x7F-'Z');  /* high bit set for bytes > 'Z' */
+	uint64_t from_A   = heptets + ONES*(0x80-'A');  /* high bit set for bytes >= 'A' */
+	uint64_t is_upper = (from_A ^ above_Z) & ~v & HIGHS;
+	return v | (is_upper>>2);                        /* 0x80>>2 = 0x20, the difference between 'A' and 'a' */
+}
 
-	if( keyClass==MRHASH_POINTER || keyClass==MRHASH_INT ) copyKey = 0;
 
-	pNew->copyKey = copyKey;
-	pNew->first = 0;
-	pNew->count = 0;
-	pNew->htsize = 0;
-	pNew->ht = 0;
+static inline uint32_t mix(uint64_t h)
+{
+	h ^= h >> 33;
+	h *= UINT64_C(0xff51afd7ed558ccd);
+	h ^= h >> 33;
+	return (uint32_t)h;
 }
 
 
-
-/* Remove all entries from a hash table.  Reclaim all memory.
- * Call this routine to delete a hash table or to reset a hash table
- * to the empty state.
- */
-void mrhash_clear(mrhash_t *pH)
+static uint32_t strHash(const void* pKey, int nKey)
 {
-	mrhashelem_t *elem;         /* For looping over all elements of the table */
+	const unsigned char* p = (const unsigned char*)pKey;
+	uint64_t             h = (uint64_t)nKey * UINT64_C(0x9E3779B97F4A7C15);
+	int                  n = nKey;
 
-	if( pH == NULL ) {
-		return;
+	for( ; n >= 8; n -= 8, p += 8 ) {
+		h = (h ^ fold8(load8(p))) * UINT64_C(0x100000001B3);
 	}
-
-	elem = pH->first;
-	pH->first = 0;
-	if( pH->ht ) sjhashFree(pH->ht);
-	pH->ht = 0;
-	pH->htsize = 0;
-	while( elem )
-	{
-		mrhashelem_t *next_elem = elem->next;
-		if( pH->copyKey && elem->pKey )
-		{
-			sjhashFree(elem->pKey);
-		}
-		sjhashFree(elem);
-		elem = next_elem;
+	if( n > 0 ) {
+		h = (h ^ fold8(loadTail(p, n, nKey))) * UINT64_C(0x100000001B3);
 	}
-	pH->count = 0;
+	return mix(h);
 }
 
 
-
-/* Hash and comparison functions when the mode is SJHASH_INT
- */
-static int intHash(const void *pKey, int nKey)
+static uint32_t binHash(const void* pKey, int nKey)
 {
-	return nKey ^ (nKey<<8) ^ (nKey>>8);
+	const unsigned char* p = (const unsigned char*)pKey;
+	uint64_t             h = (uint64_t)nKey * UINT64_C(0x9E3779B97F4A7C15);
+	int                  n = nKey;
+
+	for( ; n >= 8; n -= 8, p += 8 ) {
+		h = (h ^ load8(p)) * UINT64_C(0x100000001B3);
+	}
+	if( n > 0 ) {
+		h = (h ^ loadTail(p, n, nKey)) * UINT64_C(0x100000001B3);
+	}
+	return mix(h);
 }
 
-static int intCompare(const void *pKey1, int n1, const void *pKey2, int n2)
+
+static int strEqual(const void* pKey1, const void* pKey2, int nKey)
 {
-	return n2 - n1;
-}
+	const unsigned char *a = (const unsigned char*)pKey1, *b = (const unsigned char*)pKey2;
+	int                  n = nKey;
 
+	for( ; n >= 8; n -= 8, a += 8, b += 8 ) {
+		if( fold8(load8(a)) != fold8(load8(b)) ) {
+			return 0;
+		}
+	}
+	return n==0 || fold8(loadTail(a, n, nKey))==fold8(loadTail(b, n, nKey));
+}
 
 
-/* Hash and comparison functions when the mode is SJHASH_POINTER
- */
-static int ptrHash(const void *pKey, int nKey)
+static uint32_t hashKey(const mrhash_t* pH, const void* pKey, int nKey)
 {
-	uintptr_t x = Addr(pKey);
-	return x ^ (x<<8) ^ (x>>8);
+	switch( pH->keyClass )
+	{
+		case MRHASH_INT:     return mix((uint64_t)(uint32_t)nKey);
+		case MRHASH_POINTER: return mix((uint64_t)(uintptr_t)pKey);
+		case MRHASH_STRING:  return strHash(pKey, nKey);
+		default:             return binHash(pKey, nKey);
+	}
 }
 
-static int ptrCompare(const void *pKey1, int n1, const void *pKey2, int n2)
+
+static int keysEqual(const mrhash_t* pH, const mrhashelem_t* elem, const void* pKey, int nKey)
 {
-	if( pKey1==pKey2 ) return 0;
-	if( pKey1<pKey2 ) return -1;
-	return 1;
+	switch( pH->keyClass )
+	{
+		case MRHASH_INT:     return elem->nKey==nKey;
+		case MRHASH_POINTER: return elem->pKey==pKey;
+		case MRHASH_STRING:  return elem->nKey==nKey && strEqual(elem->pKey, pKey, nKey);
+		default:             return elem->nKey==nKey && memcmp(elem->pKey, pKey, nKey)==0;
+	}
 }
 
 
+/*******************************************************************************
+ * Key arena
+ ******************************************************************************/
 
-/* Hash and comparison functions when the mode is SJHASH_STRING
- */
-static int strHash(const void *pKey, int nKey)
-{
-	return sjhashNoCase((const char*)pKey, nKey);
-}
 
-static int strCompare(const void *pKey1, int n1, const void *pKey2, int n2)
-{
-	if( n1!=n2 ) return 1;
-	return sjhashStrNICmp((const char*)pKey1,(const char*)pKey2,n1);
-}
+#define MRHASH_ARENA_BLOCK_BYTES 4096
 
+struct mrhasharena_t
+{
+	mrhasharena_t* next;
+	size_t         used;
+	size_t         size;
+	char           data[1];
+};
 
 
-/* Hash and comparison functions when the mode is SJHASH_BINARY
- */
-static int binHash(const void *pKey, int nKey)
+static void* arenaAlloc(mrhash_t* pH, int bytes)
 {
-	int h = 0;
-	const char *z = (const char *)pKey;
-	while( nKey-- > 0 )
-	{
-		h = (h<<3) ^ h ^ *(z++);
+	mrhasharena_t* block = pH->arena;
+
+	if( block == NULL || block->used + bytes > block->size ) {
+		size_t size = bytes > MRHASH_ARENA_BLOCK_BYTES? bytes : MRHASH_ARENA_BLOCK_BYTES;
+		if( (block=malloc(sizeof(mrhasharena_t)+size))==NULL ) {
+			return NULL;
+		}
+		block->next = pH->arena;
+		block->used = 0;
+		block->size = size;
+		pH->arena = block;
 	}
-	return h & 0x7fffffff;
-}
 
-static int binCompare(const void *pKey1, int n1, const void *pKey2, int n2)
-{
-	if( n1!=n2 ) return 1;
-	return memcmp(pKey1,pKey2,n1);
+	void* p = &block->data[block->used];
+	block->used += bytes;
+	return p;
 }
 
 
+/*******************************************************************************
+ * The table
+ ******************************************************************************/
+
 
-/* Return a pointer to the appropriate hash function given the key class.
+/* Turn bulk memory into a hash table object by initializing the
+ * fields of the Hash structure.
  *
- * About the syntax:
- * The name of the function is "hashFunction".  The function takes a
- * single parameter "keyClass".  The return value of hashFunction()
- * is a pointer to another function.  Specifically, the return value
- * of hashFunction() is a pointer to a function that takes two parameters
- * with types "const void*" and "int" and returns an "int".
+ * "pNew" is a pointer to the hash table that is to be initialized.
+ * keyClass is one of the constants MRHASH_INT, MRHASH_POINTER,
+ * MRHASH_BINARY, or MRHASH_STRING.  The value of keyClass
+ * determines what kind of key the hash table will use.  "copyKey" is
+ * MRHASH_COPY or MRHASH_COPY_TO_ARENA if the hash table should make its own
+ * private copy of keys and MRHASH_NO_COPY if it should just use the supplied
+ * pointer.  CopyKey only makes sense for MRHASH_STRING and MRHASH_BINARY
+ * and is ignored for other key classes.
  */
-static int (*hashFunction(int keyClass))(const void*,int)
+void mrhash_init(mrhash_t *pNew, int keyClass, int copyKey)
 {
-	switch( keyClass )
-	{
-		case MRHASH_INT:    return &intHash;
-		case MRHASH_POINTER:return &ptrHash;
-		case MRHASH_STRING: return &strHash;
-		case MRHASH_BINARY: return &binHash;;
-		default:            break;
-	}
-	return 0;
-}
+	assert( pNew!=0 );
+	assert( keyClass>=MRHASH_INT && keyClass<=MRHASH_BINARY );
+	pNew->keyClass = keyClass;
+
+	if( keyClass==MRHASH_POINTER || keyClass==MRHASH_INT ) copyKey = MRHASH_NO_COPY;
 
+	pNew->copyKey = copyKey;
+	pNew->count = 0;
+	pNew->htsize = 0;
+	pNew->ht = 0;
+	pNew->arena = 0;
+}
 
 
-/* Return a pointer to the appropriate hash function given the key class.
+/* Remove all entries from a hash table.  Reclaim all memory.
+ * Call this routine to delete a hash table or to reset a hash table
+ * to the empty state.
  */
-static int (*compareFunction(int keyClass))(const void*,int,const void*,int)
+void mrhash_clear(mrhash_t *pH)
 {
-	switch( keyClass )
-	{
-		case MRHASH_INT:     return &intCompare;
-		case MRHASH_POINTER: return &ptrCompare;
-		case MRHASH_STRING:  return &strCompare;
-		case MRHASH_BINARY:  return &binCompare;
-		default: break;
+	int i;
+
+	if( pH == NULL ) {
+		return;
 	}
-	return 0;
-}
 
+	if( pH->ht ) {
+		if( pH->copyKey == MRHASH_COPY ) {
+			for( i = 0; i < pH->htsize; i++ ) {
+				if( pH->ht[i].flags & MRHASH_ELEM_KEY_MALLOC ) {
+					free(pH->ht[i].pKey);
+				}
+			}
+		}
+		free(pH->ht);
+	}
 
+	while( pH->arena ) {
+		mrhasharena_t* next = pH->arena->next;
+		free(pH->arena);
+		pH->arena = next;
+	}
 
-/* Link an element into the hash table
+	pH->ht = 0;
+	pH->htsize = 0;
+	pH->count = 0;
+}
+
+
+/* Move the element from slot src to the unused slot dst.  Inline keys move
+ * with the element.
  */
-static void insertElement(mrhash_t *pH,           /* The complete hash table */
-                          struct _ht *pEntry,   /* The entry into which pNew is inserted */
-                          mrhashelem_t *pNew)     /* The element to be inserted */
+static void moveElement(mrhashelem_t* dst, mrhashelem_t* src)
 {
-	mrhashelem_t *pHead; /* First element already in pEntry */
-	pHead = pEntry->chain;
-	if( pHead )
-	{
-		pNew->next = pHead;
-		pNew->prev = pHead->prev;
-		if( pHead->prev ) { pHead->prev->next = pNew; }
-		else             { pH->first = pNew; }
-		pHead->prev = pNew;
+	*dst = *src;
+	if( dst->flags & MRHASH_ELEM_KEY_INLINE ) {
+		dst->pKey = dst->inlineKey;
 	}
-	else
-	{
-		pNew->next = pH->first;
-		if( pH->first ) { pH->first->prev = pNew; }
-		pNew->prev = 0;
-		pH->first = pNew;
-	}
-	pEntry->count++;
-	pEntry->chain = pNew;
+	src->data = NULL;
+	src->flags = 0;
 }
 
 
-
-/* Resize the hash table so that it cantains "new_size" buckets.
- * "new_size" must be a power of 2.  The hash table might fail
- * to resize if sjhashMalloc() fails.
+/* Return the slot holding the given key or the unused slot where the
+ * key would have to be inserted.
  */
-static void rehash(mrhash_t *pH, int new_size)
+static mrhashelem_t* findSlot(const mrhash_t* pH, const void* pKey, int nKey, uint32_t h)
 {
-	struct _ht *new_ht;            /* The new hash table */
-	mrhashelem_t *elem, *next_elem;    /* For looping over existing elements */
-	int (*xHash)(const void*,int); /* The hash function */
+	uint32_t mask = pH->htsize-1, i = h & mask;
 
-	assert( (new_size & (new_size-1))==0 );
-	new_ht = (struct _ht *)sjhashMalloc( new_size*sizeof(struct _ht) );
-	if( new_ht==0 ) return;
-	if( pH->ht ) sjhashFree(pH->ht);
-	pH->ht = new_ht;
-	pH->htsize = new_size;
-	xHash = hashFunction(pH->keyClass);
-	for(elem=pH->first, pH->first=0; elem; elem = next_elem)
-	{
-		int h = (*xHash)(elem->pKey, elem->nKey) & (new_size-1);
-		next_elem = elem->next;
-		insertElement(pH, &new_ht[h], elem);
+	while( 1 ) {
+		mrhashelem_t* elem = &pH->ht[i];
+		if( elem->data == NULL
+		 || (elem->hash == h && keysEqual(pH, elem, pKey, nKey)) ) {
+			return elem;
+		}
+		i = (i+1) & mask;
 	}
 }
 
 
-
-/* This function (for internal use only) locates an element in an
- * hash table that matches the given key.  The hash for this key has
- * already been computed and is passed as the 4th parameter.
+/* Return the first unused slot of the probe sequence of hash h.  Used for
+ * reinserting the elements on rehashing, where the keys are known to be
+ * unique and need not to be compared.
  */
-static mrhashelem_t *findElementGivenHash(const mrhash_t *pH,   /* The pH to be searched */
-                                        const void *pKey,   /* The key we are searching for */
-                                        int nKey,
-                                        int h)              /* The hash for this key. */
+static mrhashelem_t* findEmptySlot(const mrhash_t* pH, uint32_t h)
 {
-	mrhashelem_t *elem; /* Used to loop thru the element list */
-	int count; /* Number of elements left to test */
-	int (*xCompare)(const void*,int,const void*,int);  /* comparison function */
+	uint32_t mask = pH->htsize-1, i = h & mask;
 
-	if( pH->ht )
-	{
-		struct _ht *pEntry = &pH->ht[h];
-		elem = pEntry->chain;
-		count = pEntry->count;
-		xCompare = compareFunction(pH->keyClass);
-		while( count-- && elem )
-		{
-			if( (*xCompare)(elem->pKey,elem->nKey,pKey,nKey)==0 )
-			{
-				return elem;
-			}
-			elem = elem->next;
-		}
+	while( pH->ht[i].data != NULL ) {
+		i = (i+1) & mask;
 	}
-	return 0;
+	return &pH->ht[i];
 }
 
 
-
-/* Remove a single entry from the hash table given a pointer to that
- * element and a hash on the element's key.
+/* Resize the hash table so that it cantains "new_size" slots.
+ * "new_size" must be a power of 2.  Returns 0 if the memory cannot be allocated.
  */
-static void removeElementGivenHash(mrhash_t *pH,         /* The pH containing "elem" */
-                                   mrhashelem_t* elem,   /* The element to be removed from the pH */
-                                   int h)              /* Hash value for the element */
+static int rehash(mrhash_t *pH, int new_size)
 {
-	struct _ht *pEntry;
+	mrhashelem_t *old_ht = pH->ht, *new_ht;
+	int           old_size = pH->htsize, i;
 
-	if( elem->prev )
-	{
-		elem->prev->next = elem->next;
-	}
-	else
-	{
-		pH->first = elem->next;
+	assert( (new_size & (new_size-1))==0 );
+	if( (new_ht=calloc(new_size+1, sizeof(mrhashelem_t)))==NULL ) {
+		return 0;
 	}
+	new_ht[new_size].flags = MRHASH_ELEM_END;
 
-	if( elem->next )
-	{
-		elem->next->prev = elem->prev;
+	pH->ht = new_ht;
+	pH->htsize = new_size;
+
+	for( i = 0; i < old_size; i++ ) {
+		if( old_ht[i].data ) {
+			moveElement(findEmptySlot(pH, old_ht[i].hash), &old_ht[i]);
+		}
 	}
 
-	pEntry = &pH->ht[h];
+	free(old_ht);
+	return 1;
+}
 
-	if( pEntry->chain==elem )
-	{
-		pEntry->chain = elem->next;
-	}
 
-	pEntry->count--;
+/* Remove the element in the given slot; the following elements of the
+ * probe sequence are shifted back so that lookups need no tombstones.
+ */
+static void removeElement(mrhash_t* pH, mrhashelem_t* elem)
+{
+	uint32_t mask = pH->htsize-1, i = elem - pH->ht, j = i;
 
-	if( pEntry->count<=0 )
-	{
-		pEntry->chain = 0;
+	if( elem->flags & MRHASH_ELEM_KEY_MALLOC ) {
+		free(elem->pKey);
 	}
+	elem->data = NULL;
+	elem->flags = 0;
+	pH->count--;
 
-	if( pH->copyKey && elem->pKey )
-	{
-		sjhashFree(elem->pKey);
-	}
+	while( 1 ) {
+		j = (j+1) & mask;
+		if( pH->ht[j].data == NULL ) {
+			break;
+		}
 
-	sjhashFree( elem );
-	pH->count--;
+		/* move the element at j to the gap at i if its home slot is not in (i, j] */
+		uint32_t home = pH->ht[j].hash & mask;
+		if( ((j-home) & mask) >= ((j-i) & mask) ) {
+			moveElement(&pH->ht[i], &pH->ht[j]);
+			i = j;
+		}
+	}
 }
 
 
-
 /* Attempt to locate an element of the hash table pH with a key
  * that matches pKey,nKey.  Return the data for this element if it is
  * found, or NULL if there is no match.
  */
 void* mrhash_find(const mrhash_t *pH, const void *pKey, int nKey)
 {
-	int h;             /* A hash on key */
-	mrhashelem_t *elem;    /* The element that matches key */
-	int (*xHash)(const void*,int);  /* The hash function */
-
 	if( pH==0 || pH->ht==0 ) return 0;
-	xHash = hashFunction(pH->keyClass);
-	assert( xHash!=0 );
-	h = (*xHash)(pKey,nKey);
-	assert( (pH->htsize & (pH->htsize-1))==0 );
-	elem = findElementGivenHash(pH,pKey,nKey, h & (pH->htsize-1));
-	return elem ? elem->data : 0;
+	return findSlot(pH, pKey, nKey, hashKey(pH, pKey, nKey))->data;
 }
 
 
-
 /* Insert an element into the hash table pH.  The key is pKey,nKey
  * and the data is "data".
  *
@@ -442,79 +394,95 @@ void* mrhash_find(const mrhash_t *pH, const void *pKey, int nKey)
  */
 void* mrhash_insert(mrhash_t *pH, const void *pKey, int nKey, void *data)
 {
-	int hraw;                       /* Raw hash value of the key */
-	int h;                          /* the hash of the key modulo hash table size */
-	mrhashelem_t *elem;               /* Used to loop thru the element list */
-	mrhashelem_t *new_elem;           /* New element added to the pH */
-	int (*xHash)(const void*,int);  /* The hash function */
+	uint32_t      h;
+	mrhashelem_t* elem;
 
 	assert( pH!=0 );
-	xHash = hashFunction(pH->keyClass);
-	assert( xHash!=0 );
-	hraw = (*xHash)(pKey, nKey);
-	assert( (pH->htsize & (pH->htsize-1))==0 );
-	h = hraw & (pH->htsize-1);
-	elem = findElementGivenHash(pH,pKey,nKey,h);
-
-	if( elem )
+	h = hashKey(pH, pKey, nKey);
+
+	if( pH->ht )
 	{
-		void *old_data = elem->data;
-		if( data==0 )
+		elem = findSlot(pH, pKey, nKey, h);
+		if( elem->data )
 		{
-			removeElementGivenHash(pH,elem,h);
-		}
-		else
-		{
-			elem->data = data;
+			void *old_data = elem->data;
+			if( data==0 )
+			{
+				removeElement(pH, elem);
+			}
+			else
+			{
+				elem->data = data;
+			}
+			return old_data;
 		}
-		return old_data;
 	}
 
 	if( data==0 ) return 0;
 
-	new_elem = (mrhashelem_t*)sjhashMalloc( sizeof(mrhashelem_t) );
-
-	if( new_elem==0 ) return data;
-
-	if( pH->copyKey && pKey!=0 )
+	/* grow at a load factor of 3/4, linear probing gets slow above */
+	if( (pH->count+1)*4 > pH->htsize*3 )
 	{
-		new_elem->pKey = sjhashMallocRaw( nKey );
-		if( new_elem->pKey==0 )
-		{
-			sjhashFree(new_elem);
+		if( !rehash(pH, pH->htsize? pH->htsize*2 : 32) ) {
 			return data;
 		}
-		memcpy((void*)new_elem->pKey, pKey, nKey);
-	}
-	else
-	{
-		new_elem->pKey = (void*)pKey;
 	}
 
-	new_elem->nKey = nKey;
-	pH->count++;
+	elem = findSlot(pH, pKey, nKey, h);
+	elem->pKey = (void*)pKey;
+	elem->nKey = nKey;
+	elem->hash = h;
+	elem->flags = 0;
 
-	if( pH->htsize==0 )
+	if( pH->copyKey && pKey!=0 )
 	{
-		rehash(pH,8);
-		if( pH->htsize==0 )
+		if( nKey <= MRHASH_INLINE_KEY_BYTES )
 		{
-			pH->count = 0;
-			sjhashFree(new_elem);
-			return data;
+			elem->pKey = elem->inlineKey;
+			elem->flags = MRHASH_ELEM_KEY_INLINE;
+		}
+		else if( pH->copyKey == MRHASH_COPY_TO_ARENA )
+		{
+			elem->pKey = arenaAlloc(pH, nKey);
+		}
+		else
+		{
+			elem->pKey = malloc(nKey);
+			elem->flags = MRHASH_ELEM_KEY_MALLOC;
 		}
-	}
 
-	if( pH->count > pH->htsize )
-	{
-		rehash(pH,pH->htsize*2);
+		if( elem->pKey==0 ) {
+			elem->flags = 0;
+			return data;
+		}
+		memcpy(elem->pKey, pKey, nKey);
 	}
 
-	assert( pH->htsize>0 );
-	assert( (pH->htsize & (pH->htsize-1))==0 );
-	h = hraw & (pH->htsize-1);
-	insertElement(pH, &pH->ht[h], new_elem);
-	new_elem->data = data;
+	elem->data = data;
+	pH->count++;
 	return 0;
 }
 
+
+/* Get the first element for looping over all elements, see mrhash_first().
+ */
+mrhashelem_t* mrhash_first_elem_(const mrhash_t* pH)
+{
+	if( pH==0 || pH->ht==0 ) return 0;
+	return pH->ht[0].data? &pH->ht[0] : mrhash_next_elem_(&pH->ht[0]);
+}
+
+
+/* Get the next element for looping over all elements, see mrhash_next().
+ * The slots are followed by an end marker, so no pointer to the table is needed.
+ */
+mrhashelem_t* mrhash_next_elem_(const mrhashelem_t* elem)
+{
+	while( !(elem->flags & MRHASH_ELEM_END) ) {
+		elem++;
+		if( elem->data ) {
+			return (mrhashelem_t*)elem;
+		}
+	}
+	return 0;
+}
@@ -31,6 +31,7 @@ extern "C"
 /* Forward declarations of structures.
  */
 typedef struct mrhashelem_t   mrhashelem_t;
+typedef struct mrhasharena_t  mrhasharena_t;
 
 
 /* A complete hash table is an instance of the following structure.
@@ -40,36 +41,44 @@ typedef struct mrhashelem_t   mrhashelem_t;
  * However, many of the "procedures" and "functions" for modifying and
  * accessing this structure are really macros, so we can't really make
  * this structure opaque.
+ *
+ * The table uses open addressing with linear probing; all elements are
+ * stored in a single array, so inserting does not need an allocation
+ * unless the array grows or a long key must be copied.
  */
 typedef struct mrhash_t
 {
-	char              keyClass;       /* SJHASH_INT, _POINTER, _STRING, _BINARY */
-	char              copyKey;        /* True if copy of key made on insert */
+	char              keyClass;       /* MRHASH_INT, _POINTER, _STRING, _BINARY */
+	char              copyKey;        /* MRHASH_NO_COPY, MRHASH_COPY or MRHASH_COPY_TO_ARENA */
 	int               count;          /* Number of entries in this table */
-	mrhashelem_t*     first;          /* The first element of the array */
-	int               htsize;         /* Number of buckets in the hash table */
-	struct _ht
-	{	/* the hash table */
-		int           count;          /* Number of entries with this hash */
-		mrhashelem_t* chain;          /* Pointer to first entry with this hash */
-	} *ht;
+	int               htsize;         /* Number of slots in ht, a power of 2 or 0 */
+	mrhashelem_t*     ht;             /* htsize slots followed by an end marker */
+	mrhasharena_t*    arena;          /* Memory for keys copied with MRHASH_COPY_TO_ARENA */
 } mrhash_t;
 
 
-/* Each element in the hash table is an instance of the following
- * structure.  All elements are stored on a single doubly-linked list.
+/* Each slot of the hash table is an instance of the following
+ * structure.  Slots are moved when the table grows or elements are removed,
+ * so pointers to elements and to inline keys are valid only until the next modification.
  *
  * Again, this structure is intended to be opaque, but it can't really
  * be opaque because it is used by macros.
  */
+#define MRHASH_INLINE_KEY_BYTES 24
 typedef struct mrhashelem_t
 {
-	mrhashelem_t      *next, *prev;   /* Next and previous elements in the table */
-	void*             data;           /* Data associated with this element */
+	void*             data;           /* Data associated with this element, NULL for unused slots */
 	void*             pKey;           /* Key associated with this element */
 	int               nKey;           /* Key associated with this element */
+	uint32_t          hash;           /* Hash of the key, compared before the keys are */
+	char              flags;          /* MRHASH_ELEM_* */
+	char              inlineKey[MRHASH_INLINE_KEY_BYTES]; /* Short copied keys are stored here */
 } mrhashelem_t;
 
+#define MRHASH_ELEM_END        0x01   /* End marker after the last slot */
+#define MRHASH_ELEM_KEY_INLINE 0x02   /* pKey points to inlineKey */
+#define MRHASH_ELEM_KEY_MALLOC 0x04   /* pKey must be free()'d */
+
 
 /*
  * There are 4 different modes of operation for a hash table:
@@ -86,13 +95,20 @@ typedef struct mrhashelem_t
  *                      memcmp() is used to compare keys.
  *
  * A copy of the key is made for MRHASH_STRING and MRHASH_BINARY
- * if the copyKey parameter to mrhash_init() is 1.
+ * if the copyKey parameter to mrhash_init() is MRHASH_COPY (or 1).
+ * With MRHASH_COPY_TO_ARENA, longer keys are copied to memory blocks owned
+ * by the table that are released only by mrhash_clear(); this is faster for
+ * tables that live only as long as a message is parsed.
  */
 #define MRHASH_INT       1
 #define MRHASH_POINTER   2
 #define MRHASH_STRING    3
 #define MRHASH_BINARY    4
 
+#define MRHASH_NO_COPY        0
+#define MRHASH_COPY           1
+#define MRHASH_COPY_TO_ARENA  2
+
 
 /*
  * Access routines.  To delete an element, insert a NULL pointer.
@@ -116,9 +132,13 @@ void    mrhash_clear    (mrhash_t*);
  *     SomeStructure *pData = mrhash_data(p);
  *     // do something with pData
  *   }
+ *
+ * The table must not be modified while looping.
  */
-#define mrhash_first(H)      ((H)->first)
-#define mrhash_next(E)       ((E)->next)
+mrhashelem_t* mrhash_first_elem_ (const mrhash_t*);
+mrhashelem_t* mrhash_next_elem_  (const mrhashelem_t*);
+#define mrhash_first(H)      mrhash_first_elem_((H))
+#define mrhash_next(E)       mrhash_next_elem_((E))
 #define mrhash_data(E)       ((E)->data)
 #define mrhash_key(E)        ((E)->pKey)
 #define mrhash_keysize(E)    ((E)->nKey)
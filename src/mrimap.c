@@ -29,6 +29,7 @@
 #include "mrimap.h"
 #include "mrosnative.h"
 #include "mrloginparam.h"
+#include "mrjob.h"
 
 
 static int  setup_handle_if_needed__ (mrimap_t*);
@@ -60,16 +61,17 @@ static int is_error(mrimap_t* ths, int code)
 }
 
 
-static void get_config_lastseenuid(mrimap_t* imap, const char* folder, uint32_t* uidvalidity, uint32_t* lastseenuid)
+static void get_config_lastseenuid(mrimap_t* imap, const char* folder, uint32_t* uidvalidity, uint32_t* lastseenuid, uint64_t* modseq)
 {
 	*uidvalidity = 0;
 	*lastseenuid = 0;
+	*modseq = 0;
 
 	char* key = mr_mprintf("imap.mailbox.%s", folder);
-	char* val1 = imap->m_get_config(imap, key, NULL), *val2 = NULL, *val3 = NULL;
+	char* val1 = imap->m_get_config(imap, key, NULL), *val2 = NULL, *val3 = NULL, *val4 = NULL;
 	if( val1 )
 	{
-		/* the entry has the format `imap.mailbox.<folder>=<uidvalidity>:<lastseenuid>` */
+		/* the entry has the format `imap.mailbox.<folder>=<uidvalidity>:<lastseenuid>[:<highestmodseq>]`, the highestmodseq is only used with CONDSTORE */
 		val2 = strchr(val1, ':');
 		if( val2 )
 		{
@@ -77,21 +79,30 @@ static void get_config_lastseenuid(mrimap_t* imap, const char* folder, uint32_t*
 			val2++;
 
 			val3 = strchr(val2, ':');
-			if( val3 ) { *val3 = 0; /* ignore everything bethind an optional second colon to allow future enhancements */ }
+			if( val3 )
+			{
+				*val3 = 0;
+				val3++;
+
+				val4 = strchr(val3, ':');
+				if( val4 ) { *val4 = 0; /* ignore everything bethind an optional third colon to allow future enhancements */ }
+
+				*modseq = strtoull(val3, NULL, 10);
+			}
 
 			*uidvalidity = atol(val1);
 			*lastseenuid = atol(val2);
 		}
 	}
-	free(val1); /* val2 and val3 are only pointers inside val1 and MUST NOT be free()'d */
+	free(val1); /* val2, val3 and val4 are only pointers inside val1 and MUST NOT be free()'d */
 	free(key);
 }
 
 
-static void set_config_lastseenuid(mrimap_t* imap, const char* folder, uint32_t uidvalidity, uint32_t lastseenuid)
+static void set_config_lastseenuid(mrimap_t* imap, const char* folder, uint32_t uidvalidity, uint32_t lastseenuid, uint64_t modseq)
 {
 	char* key = mr_mprintf("imap.mailbox.%s", folder);
-	char* val = mr_mprintf("%lu:%lu", uidvalidity, lastseenuid);
+	char* val = modseq? mr_mprintf("%lu:%lu:%llu", uidvalidity, lastseenuid, (unsigned long long)modseq) : mr_mprintf("%lu:%lu", uidvalidity, lastseenuid);
 	imap->m_set_config(imap, key, val);
 	free(val);
 	free(key);
@@ -628,62 +639,136 @@ static void peek_body(struct mailimap_msg_att* msg_att, char** p_msg, size_t* p_
 }
 
 
-static int fetch_single_msg(mrimap_t* ths, const char* folder, uint32_t server_uid)
+static uint32_t peek_rfc822_size(struct mailimap_msg_att* msg_att)
 {
-	/* the function returns:
-	    0  the caller should try over again later
-	or  1  if the messages should be treated as received, the caller should not try to read the message again (even if no database entries are returned) */
-	char*       msg_content = NULL;
-	size_t      msg_bytes = 0;
-	int         r, retry_later = 0, deleted = 0;
-	uint32_t    flags = 0;
-	clist*      fetch_result = NULL;
-	clistiter*  cur;
-
-	if( ths==NULL ) {
-		goto cleanup;
+	/* search the size in a list of attributes returned by a FETCH command */
+	clistiter* iter1;
+	for( iter1=clist_begin(msg_att->att_list); iter1!=NULL; iter1=clist_next(iter1) )
+	{
+		struct mailimap_msg_att_item* item = (struct mailimap_msg_att_item*)clist_content(iter1);
+		if( item )
+		{
+			if( item->att_type == MAILIMAP_MSG_ATT_ITEM_STATIC )
+			{
+				if( item->att_data.att_static->att_type == MAILIMAP_MSG_ATT_RFC822_SIZE )
+				{
+					return item->att_data.att_static->att_data.att_rfc822_size;
+				}
+			}
+		}
 	}
 
-	if( ths->m_hEtpan==NULL ) {
-		goto cleanup;
-	}
+	return 0;
+}
 
 
-	{
-		struct mailimap_set* set = mailimap_set_new_single(server_uid);
-			r = mailimap_uid_fetch(ths->m_hEtpan, set, ths->m_fetch_type_body, &fetch_result);
-		mailimap_set_free(set);
+typedef struct mruid_size_t
+{
+	uint32_t m_uid;
+	uint32_t m_size;
+} mruid_size_t;
+
+
+static int cmp_uid_size(const void* p1, const void* p2)
+{
+	uint32_t uid1 = ((const mruid_size_t*)p1)->m_uid, uid2 = ((const mruid_size_t*)p2)->m_uid;
+	return uid1<uid2? -1 : (uid1>uid2? 1 : 0);
+}
+
+
+typedef struct mrfetch_batch_t
+{
+	mrimap_t*        m_imap;
+	const char*      m_folder;
+	mrimapfetched_t* m_msgs;
+	int              m_msgs_cnt;
+	int              m_msgs_alloc;
+} mrfetch_batch_t;
+
+
+static void fetch_batch_msg_att_handler(struct mailimap_msg_att* msg_att, void* context)
+{
+	/* called by libetpan for each message of a batch as soon as it is parsed, the message is freed after we return,
+	so we copy the message; all messages of the batch are given to m_receive_imf() at once when the batch is complete */
+	mrfetch_batch_t* batch = (mrfetch_batch_t*)context;
+	char*            msg_content = NULL;
+	size_t           msg_bytes = 0;
+	uint32_t         server_uid = peek_uid(msg_att), flags = 0;
+	int              deleted = 0;
+	char*            copy;
+
+	peek_body(msg_att, &msg_content, &msg_bytes, &flags, &deleted);
+	if( server_uid == 0 || msg_content == NULL  || msg_bytes <= 0 || deleted ) {
+		return; /* the message is empty or deleted, this is a quite usual situation, do not print a warning */
 	}
 
-	if( is_error(ths, r) || fetch_result == NULL ) {
-		fetch_result = NULL;
-		mrmailbox_log_warning(ths->m_mailbox, 0, "Error #%i on fetching message #%i from folder \"%s\"; retry=%i.", (int)r, (int)server_uid, folder, (int)ths->m_should_reconnect);
-		if( ths->m_should_reconnect ) {
-			retry_later = 1; /* maybe we should also retry on other errors, however, we should check this carefully, as this may result in a dead lock! */
+	if( batch->m_msgs_cnt >= batch->m_msgs_alloc ) {
+		batch->m_msgs_alloc = MR_MAX(batch->m_msgs_alloc*2, 16);
+		if( (batch->m_msgs=realloc(batch->m_msgs, sizeof(mrimapfetched_t)*batch->m_msgs_alloc))==NULL ) {
+			exit(48);
 		}
-		goto cleanup; /* this is an error that should be recovered; the caller should try over later to fetch the message again (if there is no such message, we simply get an empty result) */
 	}
 
-	if( (cur=clist_begin(fetch_result)) == NULL ) {
-		mrmailbox_log_warning(ths->m_mailbox, 0, "Message #%i does not exist in folder \"%s\".", (int)server_uid, folder);
-		goto cleanup; /* server response is fine, however, there is no such message, do not try to fetch the message again */
+	if( (copy=malloc(msg_bytes))==NULL ) {
+		exit(49);
 	}
+	memcpy(copy, msg_content, msg_bytes);
 
-	struct mailimap_msg_att* msg_att = (struct mailimap_msg_att*)clist_content(cur);
-	peek_body(msg_att, &msg_content, &msg_bytes, &flags, &deleted);
-	if( msg_content == NULL  || msg_bytes <= 0 || deleted ) {
-		/* mrmailbox_log_warning(ths->m_mailbox, 0, "Message #%i in folder \"%s\" is empty or deleted.", (int)server_uid, folder); -- this is a quite usual situation, do not print a warning */
-		goto cleanup;
-	}
+	batch->m_msgs[batch->m_msgs_cnt].m_imf_raw_not_terminated = copy;
+	batch->m_msgs[batch->m_msgs_cnt].m_imf_raw_bytes          = msg_bytes;
+	batch->m_msgs[batch->m_msgs_cnt].m_server_uid             = server_uid;
+	batch->m_msgs[batch->m_msgs_cnt].m_flags                  = flags;
+	batch->m_msgs_cnt++;
+}
 
-	ths->m_receive_imf(ths, msg_content, msg_bytes, folder, server_uid, flags);
 
-cleanup:
+static void fetch_batch_progress(size_t current, size_t maximum, void* context)
+{
+}
+
+
+static int fetch_batch(mrimap_t* ths, const char* folder, struct mailimap_set* set)
+{
+	/* fetch all messages of the set with one `UID FETCH` command. the function returns:
+	    0  the caller should try over again later
+	or  1  if the messages should be treated as received, the caller should not try to read the messages again (even if no database entries are returned) */
+	int             r, i;
+	clist*          fetch_result = NULL;
+	mrfetch_batch_t batch;
+
+	memset(&batch, 0, sizeof(mrfetch_batch_t));
+	batch.m_imap   = ths;
+	batch.m_folder = folder;
+
+	/* libetpan uses the handler only if there is also a progress callback */
+	mailimap_set_progress_callback(ths->m_hEtpan, NULL, fetch_batch_progress, NULL);
+	mailimap_set_msg_att_handler(ths->m_hEtpan, fetch_batch_msg_att_handler, &batch);
+		r = mailimap_uid_fetch(ths->m_hEtpan, set, ths->m_fetch_type_body, &fetch_result);
+	mailimap_set_msg_att_handler(ths->m_hEtpan, NULL, NULL);
+	mailimap_set_progress_callback(ths->m_hEtpan, NULL, NULL, NULL);
 
 	if( fetch_result ) {
-		mailimap_fetch_list_free(fetch_result);
+		mailimap_fetch_list_free(fetch_result); /* normally empty as all messages are given to the handler */
 	}
-	return retry_later? 0 : 1;
+
+	/* the messages are also received on errors; if the batch is fetched again, they are detected as being already in the database */
+	if( batch.m_msgs_cnt > 0 ) {
+		ths->m_receive_imf(ths, batch.m_msgs, batch.m_msgs_cnt, folder);
+	}
+
+	for( i = 0; i < batch.m_msgs_cnt; i++ ) {
+		free((char*)batch.m_msgs[i].m_imf_raw_not_terminated);
+	}
+	free(batch.m_msgs);
+
+	if( is_error(ths, r) ) {
+		mrmailbox_log_warning(ths->m_mailbox, 0, "Error #%i on fetching messages from folder \"%s\"; retry=%i.", (int)r, folder, (int)ths->m_should_reconnect);
+		if( ths->m_should_reconnect ) {
+			return 0; /* maybe we should also retry on other errors, however, we should check this carefully, as this may result in a dead lock! */
+		}
+	}
+
+	return 1;
 }
 
 
@@ -691,16 +776,20 @@ static int fetch_from_single_folder(mrimap_t* ths, const char* folder)
 {
 	int                  r;
 	uint32_t             uidvalidity = 0;
-	uint32_t             lastseenuid = 0, new_lastseenuid = 0;
+	uint32_t             lastseenuid = 0;
+	uint64_t             modseq = 0;
 	clist*               fetch_result = NULL;
 	size_t               read_cnt = 0, read_errors = 0;
 	clistiter*           cur;
 	struct mailimap_set* set;
+	mruid_size_t*        uids = NULL;
+	size_t               uids_cnt = 0, i, batch_start;
+	size_t               max_batch_cnt, max_batch_bytes, batch_bytes;
+	char*                val;
 
 	if( ths==NULL ) {
 		goto cleanup;
 	}
-
 	if( ths->m_hEtpan==NULL ) {
 		mrmailbox_log_info(ths->m_mailbox, 0, "Cannot fetch from \"%s\" - not connected.", folder);
 		goto cleanup;
@@ -712,7 +801,7 @@ static int fetch_from_single_folder(mrimap_t* ths, const char* folder)
 	}
 
 	/* compare last seen UIDVALIDITY against the current one */
-	get_config_lastseenuid(ths, folder, &uidvalidity, &lastseenuid);
+	get_config_lastseenuid(ths, folder, &uidvalidity, &lastseenuid, &modseq);
 	if( uidvalidity != ths->m_hEtpan->imap_selection_info->sel_uidvalidity )
 	{
 		/* first time this folder is selected or UIDVALIDITY has changed, init lastseenuid and save it to config */
@@ -757,14 +846,15 @@ static int fetch_from_single_folder(mrimap_t* ths, const char* folder)
 			lastseenuid -= 1;
 		}
 
-		/* store calculated uidvalidity/lastseenuid */
+		/* store calculated uidvalidity/lastseenuid; the highestmodseq belongs to the old UIDVALIDITY and is reset */
 		uidvalidity = ths->m_hEtpan->imap_selection_info->sel_uidvalidity;
-		set_config_lastseenuid(ths, folder, uidvalidity, lastseenuid);
+		modseq = 0;
+		set_config_lastseenuid(ths, folder, uidvalidity, lastseenuid, modseq);
 	}
 
-	/* fetch messages with larger UID than the last one seen (`UID FETCH lastseenuid+1:*)`, see RFC 4549 */
+	/* fetch UIDs and sizes of messages with larger UID than the last one seen (`UID FETCH lastseenuid+1:* (UID RFC822.SIZE)`, see RFC 4549 */
 	set = mailimap_set_new_interval(lastseenuid+1, 0);
-		r = mailimap_uid_fetch(ths->m_hEtpan, set, ths->m_fetch_type_uid, &fetch_result);
+		r = mailimap_uid_fetch(ths->m_hEtpan, set, ths->m_fetch_type_uid_size, &fetch_result);
 	mailimap_set_free(set);
 
 	if( is_error(ths, r) || fetch_result == NULL )
@@ -778,7 +868,10 @@ static int fetch_from_single_folder(mrimap_t* ths, const char* folder)
 		goto cleanup;
 	}
 
-	/* go through all mails in folder (this is typically _fast_ as we already have the whole list) */
+	if( (uids=malloc(sizeof(mruid_size_t)*(clist_count(fetch_result)+1)))==NULL ) {
+		goto cleanup;
+	}
+
 	for( cur = clist_begin(fetch_result); cur != NULL ; cur = clist_next(cur) )
 	{
 		struct mailimap_msg_att* msg_att = (struct mailimap_msg_att*)clist_content(cur); /* mailimap_msg_att is a list of attributes: list is a list of message attributes */
@@ -786,19 +879,55 @@ static int fetch_from_single_folder(mrimap_t* ths, const char* folder)
 		if( cur_uid > 0
 		 && cur_uid!=lastseenuid /* `UID FETCH <lastseenuid+1>:*` may include lastseenuid if "*" == lastseenuid */ )
 		{
-			read_cnt++;
-			if( fetch_single_msg(ths, folder, cur_uid) == 0/* 0=try again later*/ ) {
-				read_errors++;
-			}
-			else if( cur_uid > new_lastseenuid ) {
-				new_lastseenuid = cur_uid;
+			uids[uids_cnt].m_uid  = cur_uid;
+			uids[uids_cnt].m_size = peek_rfc822_size(msg_att);
+			uids_cnt++;
+		}
+	}
+
+	mailimap_fetch_list_free(fetch_result);
+	fetch_result = NULL;
+
+	/* download the messages in batches, each batch is a single `UID FETCH` command; the messages of a batch are given to m_receive_imf() together.
+	after each batch, lastseenuid is updated, so after a crash or a lost connection, we continue with the next batch.
+	the batch size is limited by the number of messages and by the number of bytes, however, there is always at least one message in a batch. */
+	qsort(uids, uids_cnt, sizeof(mruid_size_t), cmp_uid_size);
+
+	val = ths->m_get_config(ths, "imap_fetch_batch_cnt", NULL);
+	max_batch_cnt = (val && atol(val)>0)? atol(val) : MR_FETCH_BATCH_CNT;
+	free(val);
+
+	val = ths->m_get_config(ths, "imap_fetch_batch_bytes", NULL);
+	max_batch_bytes = (val && atol(val)>0)? atol(val) : MR_FETCH_BATCH_BYTES;
+	free(val);
+
+	for( batch_start = 0; batch_start < uids_cnt; batch_start = i )
+	{
+		batch_bytes = 0;
+		set = mailimap_set_new_empty();
+		for( i = batch_start; i < uids_cnt && (i==batch_start || (i-batch_start < max_batch_cnt && batch_bytes+uids[i].m_size <= max_batch_bytes)); i++ )
+		{
+			/* add ranges of subsequent UIDs as `first:last` */
+			uint32_t range_first = uids[i].m_uid;
+			batch_bytes += uids[i].m_size;
+			while( i+1 < uids_cnt && uids[i+1].m_uid == uids[i].m_uid+1
+			    && i+1-batch_start < max_batch_cnt && batch_bytes+uids[i+1].m_size <= max_batch_bytes ) {
+				i++;
+				batch_bytes += uids[i].m_size;
 			}
+			mailimap_set_add_interval(set, range_first, uids[i].m_uid);
+		}
 
+		read_cnt += i-batch_start;
+		r = fetch_batch(ths, folder, set);
+		mailimap_set_free(set);
+
+		if( r == 0/* 0=try again later*/ ) {
+			read_errors += i-batch_start;
+			break;
 		}
-	}
 
-	if( !read_errors && new_lastseenuid > 0 ) {
-		set_config_lastseenuid(ths, folder, uidvalidity, new_lastseenuid);
+		set_config_lastseenuid(ths, folder, uidvalidity, uids[i-1].m_uid, modseq);
 	}
 
 	/* done */
@@ -815,6 +944,182 @@ cleanup:
 		mailimap_fetch_list_free(fetch_result);
 	}
 
+	free(uids);
+	return read_cnt;
+}
+
+
+static int get_folder_status(mrimap_t* ths, const char* folder, uint32_t* uidvalidity, uint64_t* modseq)
+{
+	/* get UIDVALIDITY and HIGHESTMODSEQ with a single `STATUS <folder> (UIDVALIDITY HIGHESTMODSEQ)`, the folder is not selected for this purpose.
+	modseq is set to 0 if the folder does not support mod-sequences (NOMODSEQ, see RFC 7162, 3.1.2.2) */
+	int                                  r, success = 0;
+	struct mailimap_status_att_list*     att_list = mailimap_status_att_list_new_empty();
+	struct mailimap_mailbox_data_status* status = NULL;
+	clistiter*                           cur;
+
+	*uidvalidity = 0;
+	*modseq = 0;
+
+	mailimap_status_att_list_add(att_list, MAILIMAP_STATUS_ATT_UIDVALIDITY);
+	mailimap_status_att_list_add(att_list, MAILIMAP_STATUS_ATT_HIGHESTMODSEQ);
+	r = mailimap_status(ths->m_hEtpan, folder, att_list, &status);
+	if( is_error(ths, r) || status == NULL ) {
+		status = NULL;
+		mrmailbox_log_warning(ths->m_mailbox, 0, "Cannot get status of folder \"%s\".", folder);
+		goto cleanup;
+	}
+
+	for( cur = clist_begin(status->st_info_list); cur != NULL ; cur = clist_next(cur) )
+	{
+		struct mailimap_status_info* info = (struct mailimap_status_info*)clist_content(cur);
+		if( info->st_att == MAILIMAP_STATUS_ATT_UIDVALIDITY ) {
+			*uidvalidity = info->st_value;
+		}
+		else if( info->st_att == MAILIMAP_STATUS_ATT_EXTENSION && info->st_ext_data
+		      && info->st_ext_data->ext_extension == &mailimap_extension_condstore
+		      && info->st_ext_data->ext_type == MAILIMAP_CONDSTORE_TYPE_STATUS_INFO ) {
+			*modseq = ((struct mailimap_condstore_status_info*)info->st_ext_data->ext_data)->cs_highestmodseq_value;
+		}
+	}
+
+	success = 1;
+
+cleanup:
+	if( status ) { mailimap_mailbox_data_status_free(status); }
+	mailimap_status_att_list_free(att_list);
+	return success;
+}
+
+
+static int sync_flags(mrimap_t* ths, const char* folder, uint32_t lastseenuid, uint64_t modseq)
+{
+	/* report flag changes and - if QRESYNC is enabled - expunges of all messages up to lastseenuid that were modified after modseq:
+	`UID FETCH 1:<lastseenuid> (FLAGS) (CHANGEDSINCE <modseq> VANISHED)`, see RFC 7162.  Returns 0 on errors, the caller should not advance modseq then. */
+	int                               r, success = 0;
+	struct mailimap_set*              set = NULL;
+	clist*                            fetch_result = NULL;
+	struct mailimap_qresync_vanished* vanished = NULL;
+	clistiter*                        cur;
+	size_t                            changed_cnt = 0, vanished_cnt = 0;
+	mrarray_t*                        seen_uids = mrarray_new(ths->m_mailbox, 64);     /* pairs of the first and the last UID, see mr_sync_msgs_t */
+	mrarray_t*                        expunged_uids = mrarray_new(ths->m_mailbox, 64);
+
+	if( select_folder__(ths, folder)==0 ) {
+		mrmailbox_log_warning(ths->m_mailbox, 0, "Cannot select folder \"%s\".", folder);
+		goto cleanup;
+	}
+
+	set = mailimap_set_new_interval(1, lastseenuid);
+	if( ths->m_has_qresync ) {
+		r = mailimap_uid_fetch_qresync(ths->m_hEtpan, set, ths->m_fetch_type_flags, modseq, &fetch_result, &vanished);
+	}
+	else {
+		r = mailimap_uid_fetch_changedsince(ths->m_hEtpan, set, ths->m_fetch_type_flags, modseq, &fetch_result);
+	}
+
+	if( is_error(ths, r) ) {
+		fetch_result = NULL;
+		vanished = NULL;
+		mrmailbox_log_warning(ths->m_mailbox, 0, "Cannot fetch flag changes from folder \"%s\".", folder);
+		goto cleanup;
+	}
+
+	for( cur = clist_begin(fetch_result); cur != NULL ; cur = clist_next(cur) )
+	{
+		struct mailimap_msg_att* msg_att = (struct mailimap_msg_att*)clist_content(cur);
+		uint32_t server_uid = peek_uid(msg_att), flags = 0;
+		char*    dummy_content = NULL;
+		size_t   dummy_bytes = 0;
+		int      deleted = 0;
+
+		peek_body(msg_att, &dummy_content, &dummy_bytes, &flags, &deleted);
+		if( server_uid && (deleted || (flags&MR_IMAP_SEEN)) ) {
+			mrarray_t* uids = deleted? expunged_uids : seen_uids;
+			mrarray_add_id(uids, server_uid);
+			mrarray_add_id(uids, server_uid);
+			changed_cnt++;
+		}
+	}
+
+	if( vanished && vanished->qr_known_uids )
+	{
+		/* the ranges are passed as they are; they may be large, eg. `1:<lastseenuid>`, however, most UIDs are typically not stored locally */
+		for( cur = clist_begin(vanished->qr_known_uids->set_list); cur != NULL ; cur = clist_next(cur) )
+		{
+			struct mailimap_set_item* item = (struct mailimap_set_item*)clist_content(cur);
+			uint32_t first = item->set_first, last = item->set_last? item->set_last : lastseenuid;
+			if( first > last ) { uint32_t tmp = first; first = last; last = tmp; }
+			if( last > lastseenuid ) { last = lastseenuid; /* `*` or UIDs we have not seen yet */ }
+			if( first == 0 ) { first = 1; }
+			if( first <= last ) {
+				mrarray_add_id(expunged_uids, first);
+				mrarray_add_id(expunged_uids, last);
+				vanished_cnt += last-first+1;
+			}
+		}
+	}
+
+	if( ths->m_sync_msgs ) {
+		if( mrarray_get_cnt(seen_uids) ) {
+			ths->m_sync_msgs(ths, folder, seen_uids, MR_IMAP_SEEN);
+		}
+		if( mrarray_get_cnt(expunged_uids) ) {
+			ths->m_sync_msgs(ths, folder, expunged_uids, MR_IMAP_EXPUNGED);
+		}
+	}
+
+	mrmailbox_log_info(ths->m_mailbox, 0, "%i flag changes and %i expunges read from \"%s\".", (int)changed_cnt, (int)vanished_cnt, folder);
+	success = 1;
+
+cleanup:
+	if( fetch_result ) { mailimap_fetch_list_free(fetch_result); }
+	if( vanished ) { mailimap_qresync_vanished_free(vanished); }
+	if( set ) { mailimap_set_free(set); }
+	mrarray_unref(seen_uids);
+	mrarray_unref(expunged_uids);
+	return success;
+}
+
+
+static int sync_folder(mrimap_t* ths, const char* folder)
+{
+	/* resync a folder: fetch new messages and, if the server supports CONDSTORE, flag changes and expunges.
+	With CONDSTORE, an unchanged folder costs a single STATUS command as any change increases HIGHESTMODSEQ, see RFC 7162, 3.1.
+	Without CONDSTORE or for folders with NOMODSEQ, this is the same as fetch_from_single_folder(). */
+	uint32_t uidvalidity = 0, lastseenuid = 0, cur_uidvalidity = 0;
+	uint64_t modseq = 0, cur_modseq = 0;
+	int      read_cnt;
+
+	if( !ths->m_has_condstore
+	 || !get_folder_status(ths, folder, &cur_uidvalidity, &cur_modseq)
+	 || cur_modseq == 0 ) {
+		return fetch_from_single_folder(ths, folder);
+	}
+
+	get_config_lastseenuid(ths, folder, &uidvalidity, &lastseenuid, &modseq);
+	if( uidvalidity == cur_uidvalidity && modseq == cur_modseq ) {
+		mrmailbox_log_info(ths->m_mailbox, 0, "Folder \"%s\" unchanged.", folder);
+		return 0;
+	}
+
+	read_cnt = fetch_from_single_folder(ths, folder);
+
+	/* reload the state as fetch_from_single_folder() has updated lastseenuid and resets the modseq if the UIDVALIDITY has changed */
+	get_config_lastseenuid(ths, folder, &uidvalidity, &lastseenuid, &modseq);
+	if( uidvalidity != cur_uidvalidity ) {
+		return read_cnt; /* the folder was not selected or has changed meanwhile, try over later */
+	}
+
+	/* on the first sync, there are no flag changes to report, the flags are part of the fetched messages */
+	if( modseq > 0 && lastseenuid > 0 ) {
+		if( !sync_flags(ths, folder, lastseenuid, modseq) ) {
+			return read_cnt;
+		}
+	}
+
+	/* changes made after the STATUS command have a larger modseq and are reported the next time */
+	set_config_lastseenuid(ths, folder, uidvalidity, lastseenuid, cur_modseq);
 	return read_cnt;
 }
 
@@ -833,7 +1138,7 @@ static int fetch_from_all_folders(mrimap_t* ths)
 	{
 		mrimapfolder_t* folder = (mrimapfolder_t*)clist_content(cur);
 		if( folder->m_meaning == MEANING_INBOX ) {
-			total_cnt += fetch_from_single_folder(ths, folder->m_name_to_select);
+			total_cnt += sync_folder(ths, folder->m_name_to_select);
 		}
 	}
 
@@ -844,7 +1149,7 @@ static int fetch_from_all_folders(mrimap_t* ths)
 			mrmailbox_log_info(ths->m_mailbox, 0, "Ignoring \"%s\".", folder->m_name_utf8);
 		}
 		else if( folder->m_meaning != MEANING_INBOX ) {
-			total_cnt += fetch_from_single_folder(ths, folder->m_name_to_select);
+			total_cnt += sync_folder(ths, folder->m_name_to_select);
 		}
 	}
 
@@ -867,9 +1172,10 @@ int mrimap_fetch(mrimap_t* imap)
 
 	setup_handle_if_needed__(imap);
 
-	#define FULL_FETCH_EVERY_SECONDS (22*60)
+	#define FULL_FETCH_EVERY_SECONDS           (22*60)
+	#define FULL_FETCH_EVERY_SECONDS_CONDSTORE (5*60) /* with CONDSTORE, an unchanged folder costs only a STATUS command, see sync_folder() */
 
-	if( time(NULL) - imap->m_last_fullread_time > FULL_FETCH_EVERY_SECONDS ) {
+	if( time(NULL) - imap->m_last_fullread_time > (imap->m_has_condstore? FULL_FETCH_EVERY_SECONDS_CONDSTORE : FULL_FETCH_EVERY_SECONDS) ) {
 		fetch_from_all_folders(imap);
 		imap->m_last_fullread_time = time(NULL);
 	}
@@ -885,6 +1191,18 @@ int mrimap_fetch(mrimap_t* imap)
 }
 
 
+static int get_seconds_to_wait(mrimap_t* imap, int max_seconds)
+{
+	/* jobs of the IMAP-thread are performed when the watch returns; so we do not wait longer than until the next job is due.
+	new jobs interrupt the watch, see mrjob_add__() */
+	time_t next_due = mrjob_get_next_due(imap->m_mailbox, MR_IMAP_THREAD), now = time(NULL);
+	if( next_due && next_due < now+max_seconds ) {
+		return next_due > now? (int)(next_due-now) : 1;
+	}
+	return max_seconds;
+}
+
+
 void mrimap_watch_n_wait(mrimap_t* imap)
 {
 	int r, r2;
@@ -920,7 +1238,7 @@ void mrimap_watch_n_wait(mrimap_t* imap)
 		// we want a shorter timeout to allow the failed-smtp-sending to retry.
 		#define IDLE_DELAY_SECONDS (1*60)
 
-		r = mailstream_wait_idle(imap->m_hEtpan->imap_stream, IDLE_DELAY_SECONDS);
+		r = mailstream_wait_idle(imap->m_hEtpan->imap_stream, get_seconds_to_wait(imap, IDLE_DELAY_SECONDS));
 		r2 = mailimap_idle_done(imap->m_hEtpan);
 
 		if( r == MAILSTREAM_IDLE_ERROR /*0*/ || r==MAILSTREAM_IDLE_CANCELLED /*4*/ ) {
@@ -946,13 +1264,14 @@ void mrimap_watch_n_wait(mrimap_t* imap)
 		in this case, we're waiting for a configure job */
 
 		mrmailbox_log_info(imap->m_mailbox, 0, "IMAP-watch-thread will poll for messages.");
-		time_t fake_idle_start_time = time(NULL), seconds_to_wait;
+		time_t fake_idle_start_time = time(NULL), seconds_to_wait, poll_seconds;
 
 		int do_fake_idle = 1;
 		while( do_fake_idle )
 		{
 			// wait a moment: every 5 seconds in the first 3 minutes after a new message, after that every 60 seconds
-			seconds_to_wait = (time(NULL)-fake_idle_start_time < 3*60)? 5 : 60;
+			poll_seconds = (time(NULL)-fake_idle_start_time < 3*60)? 5 : 60;
+			seconds_to_wait = get_seconds_to_wait(imap, poll_seconds);
 			mrmailbox_log_info(imap->m_mailbox, 0, "IMAP-watch-thread waits %i seconds.", (int)seconds_to_wait);
 			pthread_mutex_lock(&imap->m_watch_condmutex);
 
@@ -974,6 +1293,11 @@ void mrimap_watch_n_wait(mrimap_t* imap)
 				goto cleanup;
 			}
 
+			// return to perform a delayed job that is due now
+			if( seconds_to_wait < poll_seconds ) {
+				goto cleanup;
+			}
+
 			// check for new messages. fetch_from_single_folder() has the side-effect that messages
 			// are also downloaded, however, typically this would take place in the FETCH command
 			// following IDLE otherwise, so this seems okay here - the fake-poll is only a fallback
@@ -1102,6 +1426,21 @@ static int setup_handle_if_needed__(mrimap_t* ths)
 
 	mrmailbox_log_info(ths->m_mailbox, 0, "IMAP-login as %s ok.", ths->m_imap_user);
 
+	/* CONDSTORE and QRESYNC are used for the resync of the folders, see sync_folder(); QRESYNC must be enabled for each session, see RFC 7162, 3.2.3 */
+	ths->m_has_condstore = mailimap_has_condstore(ths->m_hEtpan);
+	ths->m_has_qresync   = 0;
+	if( ths->m_has_condstore && mailimap_has_qresync(ths->m_hEtpan) ) {
+		clist* cap_list = clist_new();
+		clist_append(cap_list, mailimap_capability_new(MAILIMAP_CAPABILITY_NAME, NULL, safe_strdup("QRESYNC")));
+		struct mailimap_capability_data* cap_data = mailimap_capability_data_new(cap_list), *enabled = NULL;
+			r = mailimap_enable(ths->m_hEtpan, cap_data, &enabled);
+			if( !is_error(ths, r) ) {
+				ths->m_has_qresync = 1;
+			}
+		if( enabled ) { mailimap_capability_data_free(enabled); }
+		mailimap_capability_data_free(cap_data);
+	}
+
 	success = 1;
 
 cleanup:
@@ -1139,6 +1478,8 @@ static void unsetup_handle__(mrimap_t* ths)
 	}
 
 	ths->m_selected_folder[0] = 0;
+	ths->m_has_condstore = 0;
+	ths->m_has_qresync = 0;
 
 	/* we leave m_sent_folder set; normally this does not change in a normal reconnect; we'll update this folder if we get errors */
 }
@@ -1266,7 +1607,7 @@ int mrimap_is_connected(mrimap_t* ths)
  ******************************************************************************/
 
 
-mrimap_t* mrimap_new(mr_get_config_t get_config, mr_set_config_t set_config, mr_receive_imf_t receive_imf, void* userData, mrmailbox_t* mailbox)
+mrimap_t* mrimap_new(mr_get_config_t get_config, mr_set_config_t set_config, mr_receive_imf_t receive_imf, mr_sync_msgs_t sync_msgs, void* userData, mrmailbox_t* mailbox)
 {
 	mrimap_t* ths = NULL;
 
@@ -1280,6 +1621,7 @@ mrimap_t* mrimap_new(mr_get_config_t get_config, mr_set_config_t set_config, mr_
 	ths->m_get_config     = get_config;
 	ths->m_set_config     = set_config;
 	ths->m_receive_imf    = receive_imf;
+	ths->m_sync_msgs      = sync_msgs;
 	ths->m_userData       = userData;
 
 	pthread_mutex_init(&ths->m_watch_condmutex, NULL);
@@ -1295,6 +1637,10 @@ mrimap_t* mrimap_new(mr_get_config_t get_config, mr_set_config_t set_config, mr_
 	ths->m_fetch_type_uid = mailimap_fetch_type_new_fetch_att_list_empty(); /* object to fetch the ID */
 	mailimap_fetch_type_new_fetch_att_list_add(ths->m_fetch_type_uid, mailimap_fetch_att_new_uid());
 
+	ths->m_fetch_type_uid_size = mailimap_fetch_type_new_fetch_att_list_empty(); /* object to fetch the ID and the size, used to split downloads into batches */
+	mailimap_fetch_type_new_fetch_att_list_add(ths->m_fetch_type_uid_size, mailimap_fetch_att_new_uid());
+	mailimap_fetch_type_new_fetch_att_list_add(ths->m_fetch_type_uid_size, mailimap_fetch_att_new_rfc822_size());
+
 
 	ths->m_fetch_type_message_id = mailimap_fetch_type_new_fetch_att_list_empty();
 	mailimap_fetch_type_new_fetch_att_list_add(ths->m_fetch_type_message_id, mailimap_fetch_att_new_envelope());
@@ -1306,7 +1652,8 @@ mrimap_t* mrimap_new(mr_get_config_t get_config, mr_set_config_t set_config, mr_
 	mailimap_fetch_type_new_fetch_att_list_add(ths->m_fetch_type_message_id, fetch_att);*/
 
 
-	ths->m_fetch_type_body = mailimap_fetch_type_new_fetch_att_list_empty(); /* object to fetch flags+body */
+	ths->m_fetch_type_body = mailimap_fetch_type_new_fetch_att_list_empty(); /* object to fetch UID+flags+body */
+	mailimap_fetch_type_new_fetch_att_list_add(ths->m_fetch_type_body, mailimap_fetch_att_new_uid()); /* needed to assign the messages of a batch */
 	mailimap_fetch_type_new_fetch_att_list_add(ths->m_fetch_type_body, mailimap_fetch_att_new_flags());
 	mailimap_fetch_type_new_fetch_att_list_add(ths->m_fetch_type_body, mailimap_fetch_att_new_body_peek_section(mailimap_section_new(NULL)));
 
@@ -1331,6 +1678,7 @@ void mrimap_unref(mrimap_t* ths)
 	free(ths->m_selected_folder);
 
 	if( ths->m_fetch_type_uid )  { mailimap_fetch_type_free(ths->m_fetch_type_uid);  }
+	if( ths->m_fetch_type_uid_size ) { mailimap_fetch_type_free(ths->m_fetch_type_uid_size); }
 	if( ths->m_fetch_type_body ) { mailimap_fetch_type_free(ths->m_fetch_type_body); }
 	if( ths->m_fetch_type_flags ){ mailimap_fetch_type_free(ths->m_fetch_type_flags);}
 
@@ -1403,21 +1751,21 @@ cleanup:
 }
 
 
-static int add_flag__(mrimap_t* ths, uint32_t server_uid, struct mailimap_flag* flag)
+static int add_flag_to_set__(mrimap_t* ths, struct mailimap_set* set, struct mailimap_flag* flag)
 {
 	int                              r;
 	struct mailimap_flag_list*       flag_list = NULL;
 	struct mailimap_store_att_flags* store_att_flags = NULL;
-	struct mailimap_set*             set = mailimap_set_new_single(server_uid);
 
 	if( ths==NULL || ths->m_hEtpan==NULL ) {
+		if( flag ) { mailimap_flag_free(flag); }
 		goto cleanup;
 	}
 
 	flag_list = mailimap_flag_list_new_empty();
 	mailimap_flag_list_add(flag_list, flag);
 
-	store_att_flags = mailimap_store_att_flags_new_add_flags(flag_list); /* FLAGS.SILENT does not return the new value */
+	store_att_flags = mailimap_store_att_flags_new_add_flags_silent(flag_list); /* FLAGS.SILENT does not return the new value, so there is no untagged response per message */
 
 	r = mailimap_uid_store(ths->m_hEtpan, set, store_att_flags);
 	if( is_error(ths, r) ) {
@@ -1428,153 +1776,295 @@ cleanup:
 	if( store_att_flags ) {
 		mailimap_store_att_flags_free(store_att_flags);
 	}
-	if( set ) {
-		mailimap_set_free(set);
-	}
 	return ths->m_should_reconnect? 0 : 1; /* all non-connection states are treated as success - the mail may already be deleted or moved away on the server */
 }
 
 
-int mrimap_markseen_msg(mrimap_t* ths, const char* folder, uint32_t server_uid, int ms_flags,
-                        char** ret_server_folder, uint32_t* ret_server_uid, int* ret_ms_flags)
+static int add_flag__(mrimap_t* ths, uint32_t server_uid, struct mailimap_flag* flag)
+{
+	struct mailimap_set* set = mailimap_set_new_single(server_uid);
+	int                  ret = add_flag_to_set__(ths, set, flag);
+	mailimap_set_free(set);
+	return ret;
+}
+
+
+static int cmp_uid(const void* p1, const void* p2)
+{
+	uint32_t uid1 = *(const uint32_t*)p1, uid2 = *(const uint32_t*)p2;
+	return uid1<uid2? -1 : (uid1>uid2? 1 : 0);
+}
+
+
+static struct mailimap_set* uids_to_set(uint32_t* uids, int uids_cnt)
+{
+	/* create a compressed set as `1:5,7,9:12` from the given UIDs; the array is sorted by the function. returns NULL if there are no UIDs. */
+	struct mailimap_set* set = NULL;
+	int                  i, range_first;
+
+	if( uids_cnt <= 0 ) {
+		return NULL;
+	}
+
+	qsort(uids, uids_cnt, sizeof(uint32_t), cmp_uid);
+
+	set = mailimap_set_new_empty();
+	for( i = 0; i < uids_cnt; i++ ) {
+		range_first = i;
+		while( i+1 < uids_cnt && (uids[i+1]==uids[i] || uids[i+1]==uids[i]+1) ) {
+			i++;
+		}
+		mailimap_set_add_interval(set, uids[range_first], uids[i]);
+	}
+	return set;
+}
+
+
+static uint32_t* set_to_uids(struct mailimap_set* set, int* ret_cnt)
+{
+	/* expand a set as returned eg. by COPYUID to an array of UIDs in the order given in the set */
+	uint32_t*  uids = NULL;
+	int        cnt = 0, alloc = 0;
+	uint32_t   uid, last;
+	clistiter* cur;
+
+	*ret_cnt = 0;
+	if( set == NULL ) {
+		return NULL;
+	}
+
+	for( cur = clist_begin(set->set_list); cur != NULL; cur = clist_next(cur) ) {
+		struct mailimap_set_item* item = (struct mailimap_set_item*)clist_content(cur);
+		last = item->set_last >= item->set_first? item->set_last : item->set_first; /* `*` (0) is not expected here */
+		for( uid = item->set_first; uid <= last && uid != 0; uid++ ) {
+			if( cnt >= alloc ) {
+				alloc = MR_MAX(alloc*2, 64);
+				if( (uids=realloc(uids, sizeof(uint32_t)*alloc))==NULL ) {
+					exit(44);
+				}
+			}
+			uids[cnt++] = uid;
+			if( uid == UINT32_MAX ) {
+				break;
+			}
+		}
+	}
+
+	*ret_cnt = cnt;
+	return uids;
+}
+
+
+static int find_markseen(mrimapmarkseen_t* msgs, int msgs_cnt, uint32_t server_uid)
+{
+	int i;
+	for( i = 0; i < msgs_cnt; i++ ) {
+		if( msgs[i].m_server_uid == server_uid ) {
+			return i;
+		}
+	}
+	return -1;
+}
+
+
+static int can_create_flag__(mrimap_t* ths, const char* flag_keyword)
+{
+	/* check if the selected folder can handle the given flag (eg. `$MDNSent`, see RFC 3503) */
+	clistiter* iter;
+
+	if( ths->m_hEtpan->imap_selection_info==NULL || ths->m_hEtpan->imap_selection_info->sel_perm_flags==NULL ) {
+		return 0;
+	}
+
+	for( iter=clist_begin(ths->m_hEtpan->imap_selection_info->sel_perm_flags); iter!=NULL; iter=clist_next(iter) )
+	{
+		struct mailimap_flag_perm* fp = (struct mailimap_flag_perm*)clist_content(iter);
+		if( fp ) {
+			if( fp->fl_type==MAILIMAP_FLAG_PERM_ALL ) {
+				return 1;
+			}
+			else if( fp->fl_type==MAILIMAP_FLAG_PERM_FLAG && fp->fl_flag ) {
+				struct mailimap_flag* fl = (struct mailimap_flag*)fp->fl_flag;
+				if( fl->fl_type==MAILIMAP_FLAG_KEYWORD && fl->fl_data.fl_keyword && strcmp(fl->fl_data.fl_keyword, flag_keyword)==0 ) {
+					return 1;
+				}
+			}
+		}
+	}
+	return 0;
+}
+
+
+int mrimap_markseen_msgs(mrimap_t* ths, const char* folder, mrimapmarkseen_t* msgs, int msgs_cnt, char** ret_server_folder)
 {
 	// when marking as seen, there is no real need to check against the rfc724_mid - in the worst case, when the UID validity or the mailbox has changed, we mark the wrong message as "seen" - as the very most messages are seen, this is no big thing.
-	// command would be "STORE 123,456,678 +FLAGS (\Seen)"
-	int                  r;
+	// all messages are handled by one command per step, eg. "UID STORE 123:130,456 +FLAGS.SILENT (\Seen)" and "UID MOVE 123:130 Chats"
+	int                  r, i, uids_cnt = 0, src_cnt = 0, dest_cnt = 0;
+	uint32_t*            uids = NULL;
+	uint32_t*            src_uids = NULL;
+	uint32_t*            dest_uids = NULL;
 	struct mailimap_set* set = NULL;
+	clist*               fetch_result = NULL;
+	uint32_t             res_uid = 0;
+	struct mailimap_set* res_setsrc = NULL;
+	struct mailimap_set* res_setdest = NULL;
 
-	if( ths==NULL || folder==NULL || server_uid==0 || ret_server_folder==NULL || ret_server_uid==NULL || ret_ms_flags==NULL
-	 || *ret_server_folder!=NULL || *ret_server_uid!=0 || *ret_ms_flags!=0 ) {
+	if( ths==NULL || folder==NULL || msgs==NULL || msgs_cnt<=0 || ret_server_folder==NULL || *ret_server_folder!=NULL ) {
 		return 1; /* job done */
 	}
 
-	if( (set=mailimap_set_new_single(server_uid))==NULL ) {
-		goto cleanup;
+	for( i = 0; i < msgs_cnt; i++ ) {
+		msgs[i].m_new_server_uid = 0;
+		msgs[i].m_ret_ms_flags = 0;
 	}
 
 	if( ths->m_hEtpan==NULL ) {
 		goto cleanup;
 	}
 
-	mrmailbox_log_info(ths->m_mailbox, 0, "Marking message %s/%i as seen...", folder, (int)server_uid);
+	if( (uids=malloc(sizeof(uint32_t)*msgs_cnt))==NULL ) {
+		exit(45);
+	}
+
+	mrmailbox_log_info(ths->m_mailbox, 0, "Marking %i message(s) in %s as seen...", msgs_cnt, folder);
 
 	if( select_folder__(ths, folder)==0 ) {
 		mrmailbox_log_warning(ths->m_mailbox, 0, "Cannot select folder.");
 		goto cleanup;
 	}
 
-	if( add_flag__(ths, server_uid, mailimap_flag_new_seen())==0 ) {
-		mrmailbox_log_warning(ths->m_mailbox, 0, "Cannot mark message as seen.");
+	/* mark all messages as seen */
+	for( i = 0, uids_cnt = 0; i < msgs_cnt; i++ ) {
+		uids[uids_cnt++] = msgs[i].m_server_uid;
+	}
+	set = uids_to_set(uids, uids_cnt);
+	if( add_flag_to_set__(ths, set, mailimap_flag_new_seen())==0 ) {
+		mrmailbox_log_warning(ths->m_mailbox, 0, "Cannot mark messages as seen.");
 		goto cleanup;
 	}
+	mailimap_set_free(set);
+	set = NULL;
 
-	mrmailbox_log_info(ths->m_mailbox, 0, "Message marked as seen.");
+	mrmailbox_log_info(ths->m_mailbox, 0, "Messages marked as seen.");
 
-	if( (ms_flags&MR_MS_SET_MDNSent_FLAG)
-	 && ths->m_hEtpan->imap_selection_info!=NULL && ths->m_hEtpan->imap_selection_info->sel_perm_flags!=NULL )
-	{
-		/* Check if the folder can handle the `$MDNSent` flag (see RFC 3503).  If so, and not set: set the flags and return this information.
-		If the folder cannot handle the `$MDNSent` flag, we risk duplicated MDNs; it's up to the receiving MUA to handle this then (eg. Delta Chat has no problem with this). */
-		int can_create_flag = 0;
-		clistiter* iter;
-		for( iter=clist_begin(ths->m_hEtpan->imap_selection_info->sel_perm_flags); iter!=NULL; iter=clist_next(iter) )
-		{
-			struct mailimap_flag_perm* fp = (struct mailimap_flag_perm*)clist_content(iter);
-			if( fp ) {
-				if( fp->fl_type==MAILIMAP_FLAG_PERM_ALL ) {
-					can_create_flag = 1;
-					break;
-				}
-				else if( fp->fl_type==MAILIMAP_FLAG_PERM_FLAG && fp->fl_flag ) {
-					struct mailimap_flag* fl = (struct mailimap_flag*)fp->fl_flag;
-					if( fl->fl_type==MAILIMAP_FLAG_KEYWORD && fl->fl_data.fl_keyword && strcmp(fl->fl_data.fl_keyword, "$MDNSent")==0 ) {
-						can_create_flag = 1;
-						break;
-					}
-				}
-			}
+	/* set `$MDNSent` for the messages that want an MDN and do not have the flag yet; an MDN is sent only for these messages.
+	If the folder cannot handle the `$MDNSent` flag, we risk duplicated MDNs; it's up to the receiving MUA to handle this then (eg. Delta Chat has no problem with this). */
+	for( i = 0, uids_cnt = 0; i < msgs_cnt; i++ ) {
+		if( msgs[i].m_ms_flags&MR_MS_SET_MDNSent_FLAG ) {
+			uids[uids_cnt++] = msgs[i].m_server_uid;
 		}
+	}
 
-		if( can_create_flag )
+	if( uids_cnt > 0 && ths->m_hEtpan->imap_selection_info!=NULL && ths->m_hEtpan->imap_selection_info->sel_perm_flags!=NULL )
+	{
+		if( can_create_flag__(ths, "$MDNSent") )
 		{
-			clist* fetch_result = NULL;
+			set = uids_to_set(uids, uids_cnt);
 			r = mailimap_uid_fetch(ths->m_hEtpan, set, ths->m_fetch_type_flags, &fetch_result);
+			mailimap_set_free(set);
+			set = NULL;
+
+			uids_cnt = 0;
 			if( !is_error(ths, r) && fetch_result ) {
-				clistiter* cur=clist_begin(fetch_result);
-				if( cur ) {
-					if( !peek_flag_keyword((struct mailimap_msg_att*)clist_content(cur), "$MDNSent") ) {
-						add_flag__(ths, server_uid, mailimap_flag_new_flag_keyword(safe_strdup("$MDNSent")));
-						*ret_ms_flags |= MR_MS_MDNSent_JUST_SET;
+				clistiter* cur;
+				for( cur = clist_begin(fetch_result); cur != NULL; cur = clist_next(cur) ) {
+					struct mailimap_msg_att* msg_att = (struct mailimap_msg_att*)clist_content(cur);
+					int j = find_markseen(msgs, msgs_cnt, peek_uid(msg_att));
+					if( j >= 0 && (msgs[j].m_ms_flags&MR_MS_SET_MDNSent_FLAG) && !(msgs[j].m_ret_ms_flags&MR_MS_MDNSent_JUST_SET)
+					 && !peek_flag_keyword(msg_att, "$MDNSent") ) {
+						msgs[j].m_ret_ms_flags |= MR_MS_MDNSent_JUST_SET;
+						uids[uids_cnt++] = msgs[j].m_server_uid;
 					}
 				}
 				mailimap_fetch_list_free(fetch_result);
+				fetch_result = NULL;
 			}
-			mrmailbox_log_info(ths->m_mailbox, 0, ((*ret_ms_flags)&MR_MS_MDNSent_JUST_SET)? "$MDNSent just set and MDN will be sent." : "$MDNSent already set and MDN already sent.");
+
+			if( uids_cnt > 0 ) {
+				set = uids_to_set(uids, uids_cnt);
+				add_flag_to_set__(ths, set, mailimap_flag_new_flag_keyword(safe_strdup("$MDNSent")));
+				mailimap_set_free(set);
+				set = NULL;
+			}
+			mrmailbox_log_info(ths->m_mailbox, 0, "$MDNSent just set for %i message(s), MDNs will be sent for these.", uids_cnt);
 		}
 		else
 		{
-			*ret_ms_flags |= MR_MS_MDNSent_JUST_SET;
+			for( i = 0; i < msgs_cnt; i++ ) {
+				if( msgs[i].m_ms_flags&MR_MS_SET_MDNSent_FLAG ) {
+					msgs[i].m_ret_ms_flags |= MR_MS_MDNSent_JUST_SET;
+				}
+			}
 			mrmailbox_log_info(ths->m_mailbox, 0, "Cannot store $MDNSent flags, risk sending duplicate MDN.");
 		}
 	}
 
-	if( (ms_flags&MR_MS_ALSO_MOVE) && (ths->m_server_flags&MR_NO_MOVE_TO_CHATS)==0 )
+	/* move the messages to the chats folder */
+	if( (ths->m_server_flags&MR_NO_MOVE_TO_CHATS)==0 )
 	{
-		init_chat_folders__(ths);
-		if( ths->m_moveto_folder && strcmp(folder, ths->m_moveto_folder)==0 )
-		{
-			mrmailbox_log_info(ths->m_mailbox, 0, "Message %s/%i is already in %s...", folder, (int)server_uid, ths->m_moveto_folder);
-			/* avoid deadlocks as moving messages in the same folder may be result in a new server_uid and the state "fresh" -
-			we will catch these messages again on the next poll, try to move them away and so on, see also (***) in mrmailbox.c */
+		for( i = 0, uids_cnt = 0; i < msgs_cnt; i++ ) {
+			if( msgs[i].m_ms_flags&MR_MS_ALSO_MOVE ) {
+				uids[uids_cnt++] = msgs[i].m_server_uid;
+			}
 		}
-		else if( ths->m_moveto_folder )
-		{
-			mrmailbox_log_info(ths->m_mailbox, 0, "Moving message %s/%i to %s...", folder, (int)server_uid, ths->m_moveto_folder);
-
-			/* TODO/TOCHECK: MOVE may not be supported on servers, if this is often the case, we should fallback to a COPY/DELETE implementation.
-			Same for the UIDPLUS extension (if in doubt, we can find out the resulting UID using "imap_selection_info->sel_uidnext" then). */
-			uint32_t             res_uid = 0;
-			struct mailimap_set* res_setsrc = NULL;
-			struct mailimap_set* res_setdest = NULL;
-			r = mailimap_uidplus_uid_move(ths->m_hEtpan, set, ths->m_moveto_folder, &res_uid, &res_setsrc, &res_setdest); /* the correct folder is already selected in add_flag__() above */
-			if( is_error(ths, r) ) {
-								mrmailbox_log_info(ths->m_mailbox, 0, "Cannot move message, fallback to COPY/DELETE %s/%i to %s...", folder, (int)server_uid, ths->m_moveto_folder);
-								r = mailimap_uidplus_uid_copy(ths->m_hEtpan, set, ths->m_moveto_folder, &res_uid, &res_setsrc, &res_setdest);
-								if (is_error(ths, r)) {
-									mrmailbox_log_info(ths->m_mailbox, 0, "Cannot copy message. Leaving in INBOX");
-									goto cleanup;
-								}
-								else {
-									mrmailbox_log_info(ths->m_mailbox, 0, "Deleting msg ...");
-									if( add_flag__(ths, server_uid, mailimap_flag_new_deleted())==0 ) {
-											mrmailbox_log_warning(ths->m_mailbox, 0, "Cannot mark message as \"Deleted\".");/* maybe the message is already deleted */
-									}
-
-									/* force an EXPUNGE resp. CLOSE for the selected folder */
-									ths->m_selected_folder_needs_expunge = 1;
-								}
 
-							}
-
-			if( res_setsrc ) {
-				mailimap_set_free(res_setsrc);
+		if( uids_cnt > 0 )
+		{
+			init_chat_folders__(ths);
+			if( ths->m_moveto_folder && strcmp(folder, ths->m_moveto_folder)==0 )
+			{
+				mrmailbox_log_info(ths->m_mailbox, 0, "%i message(s) are already in %s...", uids_cnt, ths->m_moveto_folder);
+				/* avoid deadlocks as moving messages in the same folder may be result in a new server_uid and the state "fresh" -
+				we will catch these messages again on the next poll, try to move them away and so on, see also (***) in mrmailbox.c */
 			}
+			else if( ths->m_moveto_folder )
+			{
+				mrmailbox_log_info(ths->m_mailbox, 0, "Moving %i message(s) from %s to %s...", uids_cnt, folder, ths->m_moveto_folder);
+
+				/* if MOVE is not supported on the server, fallback to a COPY/DELETE implementation.
+				The new UIDs are taken from the COPYUID response code of the UIDPLUS extension, the source and destination sets are in the same order, see RFC 4315. */
+				set = uids_to_set(uids, uids_cnt);
+				r = mailimap_uidplus_uid_move(ths->m_hEtpan, set, ths->m_moveto_folder, &res_uid, &res_setsrc, &res_setdest); /* the correct folder is already selected above */
+				if( is_error(ths, r) ) {
+					mrmailbox_log_info(ths->m_mailbox, 0, "Cannot move messages, fallback to COPY/DELETE %s to %s...", folder, ths->m_moveto_folder);
+					r = mailimap_uidplus_uid_copy(ths->m_hEtpan, set, ths->m_moveto_folder, &res_uid, &res_setsrc, &res_setdest);
+					if( is_error(ths, r) ) {
+						mrmailbox_log_info(ths->m_mailbox, 0, "Cannot copy messages. Leaving in %s", folder);
+						goto cleanup;
+					}
+					else {
+						mrmailbox_log_info(ths->m_mailbox, 0, "Deleting msgs ...");
+						if( add_flag_to_set__(ths, set, mailimap_flag_new_deleted())==0 ) {
+							mrmailbox_log_warning(ths->m_mailbox, 0, "Cannot mark messages as \"Deleted\"."); /* maybe the messages are already deleted */
+						}
 
-			if( res_setdest ) {
-				clistiter* cur = clist_begin(res_setdest->set_list);
-				if (cur != NULL) {
-					struct mailimap_set_item* item;
-					item = clist_content(cur);
-					*ret_server_uid = item->set_first;
-					*ret_server_folder = safe_strdup(ths->m_moveto_folder);
+						/* force an EXPUNGE resp. CLOSE for the selected folder */
+						ths->m_selected_folder_needs_expunge = 1;
+					}
 				}
-				mailimap_set_free(res_setdest);
-			}
 
-			// TODO: If the new UID is equal to lastuid.Chats, we should increase lastuid.Chats by one
-			// (otherwise, we'll download the mail in moment again from the chats folder ...)
+				src_uids  = set_to_uids(res_setsrc, &src_cnt);
+				dest_uids = set_to_uids(res_setdest, &dest_cnt);
+				if( src_cnt == dest_cnt ) {
+					for( i = 0; i < src_cnt; i++ ) {
+						int j = find_markseen(msgs, msgs_cnt, src_uids[i]);
+						if( j >= 0 ) {
+							msgs[j].m_new_server_uid = dest_uids[i];
+						}
+					}
+					if( dest_cnt > 0 ) {
+						*ret_server_folder = safe_strdup(ths->m_moveto_folder);
+					}
+				}
+				else if( src_cnt || dest_cnt ) {
+					mrmailbox_log_warning(ths->m_mailbox, 0, "Bad COPYUID response, %i source and %i destination UIDs.", src_cnt, dest_cnt);
+				}
 
-			mrmailbox_log_info(ths->m_mailbox, 0, "Message moved.");
+				// TODO: If the new UID is equal to lastuid.Chats, we should increase lastuid.Chats by one
+				// (otherwise, we'll download the mail in moment again from the chats folder ...)
+
+				mrmailbox_log_info(ths->m_mailbox, 0, "Messages moved.");
+			}
 		}
 	}
 
@@ -1582,10 +2072,42 @@ cleanup:
 	if( set ) {
 		mailimap_set_free(set);
 	}
+	if( res_setsrc ) {
+		mailimap_set_free(res_setsrc);
+	}
+	if( res_setdest ) {
+		mailimap_set_free(res_setdest);
+	}
+	free(uids);
+	free(src_uids);
+	free(dest_uids);
 	return ths->m_should_reconnect? 0 : 1;
 }
 
 
+int mrimap_markseen_msg(mrimap_t* ths, const char* folder, uint32_t server_uid, int ms_flags,
+                        char** ret_server_folder, uint32_t* ret_server_uid, int* ret_ms_flags)
+{
+	mrimapmarkseen_t msg;
+	int              ret;
+
+	if( ths==NULL || folder==NULL || server_uid==0 || ret_server_folder==NULL || ret_server_uid==NULL || ret_ms_flags==NULL
+	 || *ret_server_folder!=NULL || *ret_server_uid!=0 || *ret_ms_flags!=0 ) {
+		return 1; /* job done */
+	}
+
+	memset(&msg, 0, sizeof(mrimapmarkseen_t));
+	msg.m_server_uid = server_uid;
+	msg.m_ms_flags   = ms_flags;
+
+	ret = mrimap_markseen_msgs(ths, folder, &msg, 1, ret_server_folder);
+
+	*ret_server_uid = msg.m_new_server_uid;
+	*ret_ms_flags   = msg.m_ret_ms_flags;
+	return ret;
+}
+
+
 int mrimap_delete_msg(mrimap_t* ths, const char* rfc724_mid, const char* folder, uint32_t server_uid)
 {
 	int    success = 0, r = 0;
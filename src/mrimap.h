@@ -35,11 +35,24 @@ extern "C" {
 typedef struct mrloginparam_t mrloginparam_t;
 typedef struct mrimap_t mrimap_t;
 
-#define MR_IMAP_SEEN 0x0001L
+#define MR_IMAP_SEEN     0x0001L
+#define MR_IMAP_EXPUNGED 0x0002L /* only used for mr_sync_msgs_t: the message was removed from the folder, eg. by another device */
+
+#define MR_FETCH_BATCH_CNT   100              /* default for the config-option imap_fetch_batch_cnt */
+#define MR_FETCH_BATCH_BYTES (4*1024*1024)    /* default for the config-option imap_fetch_batch_bytes */
+
+typedef struct mrimapfetched_t
+{
+	const char*   m_imf_raw_not_terminated;
+	size_t        m_imf_raw_bytes;
+	uint32_t      m_server_uid;
+	uint32_t      m_flags;          /* MR_IMAP_SEEN */
+} mrimapfetched_t;
 
 typedef char*    (*mr_get_config_t)    (mrimap_t*, const char*, const char*);
 typedef void     (*mr_set_config_t)    (mrimap_t*, const char*, const char*);
-typedef void     (*mr_receive_imf_t)   (mrimap_t*, const char* imf_raw_not_terminated, size_t imf_raw_bytes, const char* server_folder, uint32_t server_uid, uint32_t flags);
+typedef void     (*mr_receive_imf_t)   (mrimap_t*, const mrimapfetched_t* msgs, int msgs_cnt, const char* server_folder); /* called with all messages of a batch, the order is undefined */
+typedef void     (*mr_sync_msgs_t)     (mrimap_t*, const char* server_folder, const mrarray_t* server_uid_ranges, uint32_t flags); /* server_uid_ranges contains pairs of the first and the last UID of a range */
 
 
 /**
@@ -67,6 +80,8 @@ typedef struct mrimap_t
 
 	int                   m_can_idle;
 	int                   m_has_xlist;
+	int                   m_has_condstore; /* set per session, RFC 7162 */
+	int                   m_has_qresync;   /* set per session if QRESYNC is enabled */
 	char*                 m_moveto_folder;// Folder, where reveived chat messages should go to.  Normally MR_CHATS_FOLDER, may be NULL to leave them in the INBOX
 	char*                 m_sent_folder;  // Folder, where send messages should go to.  Normally MR_CHATS_FOLDER.
 	char                  m_imap_delimiter;/* IMAP Path separator. Set as a side-effect in list_folders__ */
@@ -78,6 +93,7 @@ typedef struct mrimap_t
 	//time_t                m_enter_watch_wait_time;
 
 	struct mailimap_fetch_type* m_fetch_type_uid;
+	struct mailimap_fetch_type* m_fetch_type_uid_size;
 	struct mailimap_fetch_type* m_fetch_type_message_id;
 	struct mailimap_fetch_type* m_fetch_type_body;
 	struct mailimap_fetch_type* m_fetch_type_flags;
@@ -85,6 +101,7 @@ typedef struct mrimap_t
 	mr_get_config_t       m_get_config;
 	mr_set_config_t       m_set_config;
 	mr_receive_imf_t      m_receive_imf;
+	mr_sync_msgs_t        m_sync_msgs;    /* called for flag changes and expunges detected by CONDSTORE/QRESYNC, may be NULL */
 	void*                 m_userData;
 	mrmailbox_t*          m_mailbox;
 
@@ -94,7 +111,7 @@ typedef struct mrimap_t
 } mrimap_t;
 
 
-mrimap_t* mrimap_new               (mr_get_config_t, mr_set_config_t, mr_receive_imf_t, void* userData, mrmailbox_t*);
+mrimap_t* mrimap_new               (mr_get_config_t, mr_set_config_t, mr_receive_imf_t, mr_sync_msgs_t, void* userData, mrmailbox_t*);
 void      mrimap_unref             (mrimap_t*);
 
 int       mrimap_connect           (mrimap_t*, const mrloginparam_t*);
@@ -112,6 +129,15 @@ int       mrimap_append_msg        (mrimap_t*, time_t timestamp, const char* dat
 #define   MR_MS_MDNSent_JUST_SET   0x10
 int       mrimap_markseen_msg      (mrimap_t*, const char* folder, uint32_t server_uid, int ms_flags, char** ret_server_folder, uint32_t* ret_server_uid, int* ret_ms_flags); /* only returns 0 on connection problems; we should try later again in this case */
 
+typedef struct mrimapmarkseen_t
+{
+	uint32_t m_server_uid;     /* in: the message to mark as seen */
+	int      m_ms_flags;       /* in: MR_MS_ALSO_MOVE, MR_MS_SET_MDNSent_FLAG */
+	uint32_t m_new_server_uid; /* out: the new UID in the folder returned by mrimap_markseen_msgs() if the message was moved, 0 otherwise */
+	int      m_ret_ms_flags;   /* out: MR_MS_MDNSent_JUST_SET */
+} mrimapmarkseen_t;
+int       mrimap_markseen_msgs     (mrimap_t*, const char* folder, mrimapmarkseen_t* msgs, int msgs_cnt, char** ret_server_folder); /* same as mrimap_markseen_msg() for several messages of one folder with a single command per step */
+
 int       mrimap_delete_msg        (mrimap_t*, const char* rfc724_mid, const char* folder, uint32_t server_uid); /* only returns 0 on connection problems; we should try later again in this case */
 
 
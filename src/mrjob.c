@@ -25,74 +25,468 @@
 #include "mrosnative.h"
 
 
-void mrjob_perform(mrmailbox_t* mailbox, int thread)
+/*******************************************************************************
+ * Job queue
+ ******************************************************************************/
+
+
+struct mrjobentry_t
+{
+	uint32_t      m_job_id;
+	int           m_action;
+	uint32_t      m_foreign_id;
+	char*         m_param;
+	time_t        m_desired_timestamp;
+	int           m_thread;
+	int           m_level;     /* for entries in mrmailbox_t::m_jobs_pending: the nesting level of the transaction that added the job */
+	mrjobentry_t* m_next;      /* next entry in the same wheel slot, in the overflow list or in mrmailbox_t::m_jobs_pending */
+};
+
+
+static void free_entry(mrjobentry_t* entry)
+{
+	if( entry ) {
+		free(entry->m_param);
+		free(entry);
+	}
+}
+
+
+static int higher_priority(const mrjobentry_t* e1, const mrjobentry_t* e2)
+{
+	/* this is the order formerly used by `ORDER BY action DESC, id` */
+	return e1->m_action > e2->m_action || (e1->m_action == e2->m_action && e1->m_job_id < e2->m_job_id);
+}
+
+
+static void due_push(mrjobqueue_t* queue, mrjobentry_t* entry)
+{
+	int i, parent;
+
+	if( queue->m_due_cnt >= queue->m_due_alloc ) {
+		queue->m_due_alloc = MR_MAX(queue->m_due_alloc*2, 16);
+		if( (queue->m_due=realloc(queue->m_due, sizeof(mrjobentry_t*)*queue->m_due_alloc))==NULL ) {
+			exit(43);
+		}
+	}
+
+	for( i = queue->m_due_cnt++; i > 0; i = parent ) {
+		parent = (i-1)/2;
+		if( !higher_priority(entry, queue->m_due[parent]) ) {
+			break;
+		}
+		queue->m_due[i] = queue->m_due[parent];
+	}
+	queue->m_due[i] = entry;
+}
+
+
+static mrjobentry_t* due_pop(mrjobqueue_t* queue)
+{
+	mrjobentry_t *ret, *last;
+	int          i, child;
+
+	if( queue->m_due_cnt <= 0 ) {
+		return NULL;
+	}
+
+	ret = queue->m_due[0];
+	last = queue->m_due[--queue->m_due_cnt];
+	for( i = 0; (child=i*2+1) < queue->m_due_cnt; i = child ) {
+		if( child+1 < queue->m_due_cnt && higher_priority(queue->m_due[child+1], queue->m_due[child]) ) {
+			child++;
+		}
+		if( !higher_priority(queue->m_due[child], last) ) {
+			break;
+		}
+		queue->m_due[i] = queue->m_due[child];
+	}
+	queue->m_due[i] = last;
+	return ret;
+}
+
+
+static void advance__(mrjobqueue_t* queue, time_t now)
+{
+	/* move all jobs due until `now` from the wheel to the heap, afterwards m_wheel_time is now+1.
+	jobs from the overflow list that fit into the wheel then are moved to the wheel or to the heap. */
+	mrjobentry_t *entry, *next, **prev;
+
+	if( now < queue->m_wheel_time ) {
+		return; /* nothing due since the last call (or the clock was set back, we'll catch up later) */
+	}
+
+	if( now - queue->m_wheel_time >= MR_JOB_WHEEL_SLOTS ) {
+		queue->m_wheel_time = now - MR_JOB_WHEEL_SLOTS + 1; /* all slots are due, handle each slot only once */
+	}
+
+	for( ; queue->m_wheel_time <= now; queue->m_wheel_time++ ) {
+		mrjobentry_t** slot = &queue->m_wheel[queue->m_wheel_time%MR_JOB_WHEEL_SLOTS];
+		for( entry = *slot; entry; entry = next ) {
+			next = entry->m_next;
+			due_push(queue, entry);
+		}
+		*slot = NULL;
+	}
+
+	if( queue->m_overflow_min && queue->m_overflow_min < queue->m_wheel_time+MR_JOB_WHEEL_SLOTS ) {
+		queue->m_overflow_min = 0;
+		for( prev = &queue->m_overflow, entry = queue->m_overflow; entry; entry = next ) {
+			next = entry->m_next;
+			if( entry->m_desired_timestamp < queue->m_wheel_time+MR_JOB_WHEEL_SLOTS ) {
+				*prev = next;
+				if( entry->m_desired_timestamp < queue->m_wheel_time ) {
+					due_push(queue, entry);
+				}
+				else {
+					mrjobentry_t** slot = &queue->m_wheel[entry->m_desired_timestamp%MR_JOB_WHEEL_SLOTS];
+					entry->m_next = *slot;
+					*slot = entry;
+				}
+			}
+			else {
+				if( queue->m_overflow_min == 0 || entry->m_desired_timestamp < queue->m_overflow_min ) {
+					queue->m_overflow_min = entry->m_desired_timestamp;
+				}
+				prev = &entry->m_next;
+			}
+		}
+	}
+}
+
+
+static void insert__(mrjobqueue_t* queue, mrjobentry_t* entry)
+{
+	advance__(queue, time(NULL));
+
+	if( entry->m_desired_timestamp < queue->m_wheel_time ) {
+		due_push(queue, entry);
+	}
+	else if( entry->m_desired_timestamp < queue->m_wheel_time+MR_JOB_WHEEL_SLOTS ) {
+		mrjobentry_t** slot = &queue->m_wheel[entry->m_desired_timestamp%MR_JOB_WHEEL_SLOTS];
+		entry->m_next = *slot;
+		*slot = entry;
+	}
+	else {
+		entry->m_next = queue->m_overflow;
+		queue->m_overflow = entry;
+		if( queue->m_overflow_min == 0 || entry->m_desired_timestamp < queue->m_overflow_min ) {
+			queue->m_overflow_min = entry->m_desired_timestamp;
+		}
+	}
+}
+
+
+static void remove_actions__(mrjobqueue_t* queue, int action1, int action2)
+{
+	/* remove the jobs with the given actions from all parts of the queue; the heap is rebuilt from the remaining entries */
+	mrjobentry_t *entry, *next, **prev, **old_due = queue->m_due;
+	int          i, old_due_cnt = queue->m_due_cnt;
+
+	#define IS_KILLED(e) ((e)->m_action==action1 || (e)->m_action==action2)
+
+	queue->m_due = NULL;
+	queue->m_due_cnt = 0;
+	queue->m_due_alloc = 0;
+	for( i = 0; i < old_due_cnt; i++ ) {
+		if( IS_KILLED(old_due[i]) ) {
+			free_entry(old_due[i]);
+		}
+		else {
+			due_push(queue, old_due[i]);
+		}
+	}
+	free(old_due);
+
+	for( i = 0; i < MR_JOB_WHEEL_SLOTS; i++ ) {
+		for( prev = &queue->m_wheel[i], entry = queue->m_wheel[i]; entry; entry = next ) {
+			next = entry->m_next;
+			if( IS_KILLED(entry) ) { *prev = next; free_entry(entry); } else { prev = &entry->m_next; }
+		}
+	}
+
+	for( prev = &queue->m_overflow, entry = queue->m_overflow; entry; entry = next ) {
+		next = entry->m_next;
+		if( IS_KILLED(entry) ) { *prev = next; free_entry(entry); } else { prev = &entry->m_next; }
+	}
+	/* m_overflow_min may be too small now, this only results in an unneeded scan in advance__() */
+}
+
+
+static void clear__(mrjobqueue_t* queue)
+{
+	mrjobentry_t *entry, *next;
+	int          i;
+
+	while( (entry=due_pop(queue))!=NULL ) {
+		free_entry(entry);
+	}
+
+	for( i = 0; i < MR_JOB_WHEEL_SLOTS; i++ ) {
+		for( entry = queue->m_wheel[i]; entry; entry = next ) { next = entry->m_next; free_entry(entry); }
+		queue->m_wheel[i] = NULL;
+	}
+
+	for( entry = queue->m_overflow; entry; entry = next ) { next = entry->m_next; free_entry(entry); }
+	queue->m_overflow = NULL;
+	queue->m_overflow_min = 0;
+}
+
+
+static mrjobqueue_t* get_queue(mrmailbox_t* mailbox, int thread)
+{
+	return thread==MR_IMAP_THREAD? mailbox->m_imap_jobs : mailbox->m_smtp_jobs;
+}
+
+
+mrjobqueue_t* mrjobqueue_new()
+{
+	mrjobqueue_t* queue = NULL;
+
+	if( (queue=calloc(1, sizeof(mrjobqueue_t)))==NULL ) {
+		exit(42); /* cannot allocate little memory, unrecoverable error */
+	}
+
+	pthread_mutex_init(&queue->m_critical, NULL);
+	queue->m_wheel_time = time(NULL);
+	return queue;
+}
+
+
+void mrjobqueue_unref(mrjobqueue_t* queue)
+{
+	if( queue == NULL ) {
+		return;
+	}
+
+	clear__(queue);
+	free(queue->m_due);
+	pthread_mutex_destroy(&queue->m_critical);
+	free(queue);
+}
+
+
+void mrjob_clear_queues(mrmailbox_t* mailbox)
+{
+	mrjobentry_t *entry, *next;
+	int          i;
+
+	for( entry = mailbox->m_jobs_pending; entry; entry = next ) { next = entry->m_next; free_entry(entry); }
+	mailbox->m_jobs_pending = NULL;
+
+	for( i = 0; i < 2; i++ ) {
+		mrjobqueue_t* queue = i==0? mailbox->m_imap_jobs : mailbox->m_smtp_jobs;
+		pthread_mutex_lock(&queue->m_critical);
+			clear__(queue);
+		pthread_mutex_unlock(&queue->m_critical);
+	}
+}
+
+
+void mrjob_load_queues__(mrmailbox_t* mailbox)
 {
 	sqlite3_stmt* stmt;
-	mrjob_t       job;
+
+	mrjob_clear_queues(mailbox);
+
+	stmt = mrsqlite3_prepare_v2_(mailbox->m_sql,
+		"SELECT id, thread, action, foreign_id, param, desired_timestamp FROM jobs;");
+	while( sqlite3_step(stmt) == SQLITE_ROW )
+	{
+		mrjobqueue_t* queue = get_queue(mailbox, sqlite3_column_int(stmt, 1));
+		mrjobentry_t* entry = calloc(1, sizeof(mrjobentry_t));
+		if( entry == NULL ) {
+			exit(44);
+		}
+		entry->m_job_id            = sqlite3_column_int  (stmt, 0);
+		entry->m_action            = sqlite3_column_int  (stmt, 2);
+		entry->m_foreign_id        = sqlite3_column_int  (stmt, 3);
+		entry->m_param             = safe_strdup((char*)sqlite3_column_text(stmt, 4));
+		entry->m_desired_timestamp = sqlite3_column_int64(stmt, 5);
+		entry->m_thread            = sqlite3_column_int  (stmt, 1);
+		pthread_mutex_lock(&queue->m_critical);
+			insert__(queue, entry);
+		pthread_mutex_unlock(&queue->m_critical);
+	}
+	sqlite3_finalize(stmt);
+}
+
+
+time_t mrjob_get_next_due(mrmailbox_t* mailbox, int thread)
+{
+	mrjobqueue_t* queue;
+	time_t        ret = 0, now = time(NULL), t;
+
+	if( mailbox == NULL || mailbox->m_magic != MR_MAILBOX_MAGIC ) {
+		return 0;
+	}
+
+	queue = get_queue(mailbox, thread);
+	pthread_mutex_lock(&queue->m_critical);
+
+		advance__(queue, now);
+
+		if( queue->m_due_cnt > 0 ) {
+			ret = now;
+		}
+		else {
+			for( t = queue->m_wheel_time; t < queue->m_wheel_time+MR_JOB_WHEEL_SLOTS; t++ ) {
+				if( queue->m_wheel[t%MR_JOB_WHEEL_SLOTS] ) {
+					ret = t;
+					break;
+				}
+			}
+
+			if( ret == 0 ) {
+				ret = queue->m_overflow_min;
+			}
+		}
+
+	pthread_mutex_unlock(&queue->m_critical);
+	return ret;
+}
+
+
+/*******************************************************************************
+ * Perform jobs
+ ******************************************************************************/
+
+
+static int can_batch(int action)
+{
+	/* jobs that can be performed together in one call, see mrmailbox_markseen_msgs_on_imap() */
+	return (action==MRJ_MARKSEEN_MSG_ON_IMAP);
+}
+
+
+static void finish_job__(mrmailbox_t* mailbox, mrjobqueue_t* queue, mrjobentry_t* entry, mrjob_t* job, int killed)
+{
+	/* delete job or execute job later again; a job killed meanwhile by mrjob_kill_actions__() is not put back to the queue.
+	the function takes the ownership of `entry` */
+	sqlite3_stmt* stmt;
+
+	if( job->m_start_again_at && !killed ) {
+		stmt = mrsqlite3_predefine__(mailbox->m_sql, UPDATE_jobs_SET_dp_WHERE_id,
+			"UPDATE jobs SET desired_timestamp=?, param=? WHERE id=?;");
+		sqlite3_bind_int64(stmt, 1, job->m_start_again_at);
+		sqlite3_bind_text (stmt, 2, mrparam_get_packed(job->m_param), -1, SQLITE_STATIC);
+		sqlite3_bind_int  (stmt, 3, job->m_job_id);
+		sqlite3_step(stmt);
+
+		free(entry->m_param);
+		entry->m_param = safe_strdup(mrparam_get_packed(job->m_param));
+		entry->m_desired_timestamp = job->m_start_again_at;
+		pthread_mutex_lock(&queue->m_critical);
+			insert__(queue, entry);
+		pthread_mutex_unlock(&queue->m_critical);
+		mrmailbox_log_info(mailbox, 0, "Job #%i delayed for %i seconds", (int)job->m_job_id, (int)(job->m_start_again_at-time(NULL)));
+	}
+	else {
+		stmt = mrsqlite3_predefine__(mailbox->m_sql, DELETE_FROM_jobs_WHERE_id,
+			"DELETE FROM jobs WHERE id=?;");
+		sqlite3_bind_int(stmt, 1, job->m_job_id);
+		sqlite3_step(stmt);
+		mrmailbox_log_info(mailbox, 0, "Job #%i done and deleted from database", (int)job->m_job_id);
+		free_entry(entry);
+	}
+}
+
+
+void mrjob_perform(mrmailbox_t* mailbox, int thread)
+{
+	mrjobqueue_t* queue;
+	mrjobentry_t* entries[MR_JOB_MAX_BATCH];
+	mrjob_t       jobs[MR_JOB_MAX_BATCH];
+	mrjob_t*      job_ptrs[MR_JOB_MAX_BATCH];
+	int           i, cnt, killed;
 
 	if( mailbox == NULL || mailbox->m_magic != MR_MAILBOX_MAGIC ) {
 		return;
 	}
 
-	memset(&job, 0, sizeof(mrjob_t));
-	job.m_param = mrparam_new();
+	queue = get_queue(mailbox, thread);
+
+	memset(jobs, 0, sizeof(jobs));
+	for( i = 0; i < MR_JOB_MAX_BATCH; i++ ) {
+		job_ptrs[i] = &jobs[i];
+	}
 
 		while( 1 )
 		{
-			/* get next waiting job */
-			job.m_job_id = 0;
-			stmt = mrsqlite3_prepare_v2_(mailbox->m_sql,
-				"SELECT id, action, foreign_id, param FROM jobs WHERE thread=? AND desired_timestamp<=? ORDER BY action DESC, id LIMIT 1;");
-			sqlite3_bind_int64(stmt, 1, thread);
-			sqlite3_bind_int64(stmt, 2, time(NULL));
-			if( sqlite3_step(stmt) == SQLITE_ROW ) {
-				job.m_job_id                         = sqlite3_column_int (stmt, 0);
-				job.m_action                         = sqlite3_column_int (stmt, 1);
-				job.m_foreign_id                     = sqlite3_column_int (stmt, 2);
-				mrparam_set_packed(job.m_param, (char*)sqlite3_column_text(stmt, 3));
-			}
-			sqlite3_finalize(stmt);
+			/* get next waiting job; as the heap is ordered by action, other due jobs with the same action follow directly
+			and are taken, too, if the action can be performed as a batch.  the entries are owned by us until they are put back to the queue */
+			cnt = 0;
+			pthread_mutex_lock(&queue->m_critical);
+				advance__(queue, time(NULL));
+				if( (entries[0]=due_pop(queue)) != NULL ) {
+					cnt = 1;
+					if( can_batch(entries[0]->m_action) ) {
+						while( cnt < MR_JOB_MAX_BATCH && queue->m_due_cnt > 0 && queue->m_due[0]->m_action == entries[0]->m_action ) {
+							entries[cnt++] = due_pop(queue);
+						}
+					}
+					queue->m_running_action = entries[0]->m_action;
+					queue->m_running_killed = 0;
+				}
+			pthread_mutex_unlock(&queue->m_critical);
 
-			if( job.m_job_id == 0 ) {
+			if( cnt == 0 ) {
 				break;
 			}
 
-			/* execute job */
-			mrmailbox_log_info(mailbox, 0, "Executing job #%i, action %i...", (int)job.m_job_id, (int)job.m_action);
-			job.m_start_again_at = 0;
-			switch( job.m_action ) {
-                case MRJ_SEND_MSG_TO_SMTP:     mrmailbox_send_msg_to_smtp     (mailbox, &job); break;
-                case MRJ_SEND_MSG_TO_IMAP:     mrmailbox_send_msg_to_imap     (mailbox, &job); break;
-                case MRJ_DELETE_MSG_ON_IMAP:   mrmailbox_delete_msg_on_imap   (mailbox, &job); break;
-                case MRJ_MARKSEEN_MSG_ON_IMAP: mrmailbox_markseen_msg_on_imap (mailbox, &job); break;
-                case MRJ_MARKSEEN_MDN_ON_IMAP: mrmailbox_markseen_mdn_on_imap (mailbox, &job); break;
-                case MRJ_SEND_MDN:             mrmailbox_send_mdn             (mailbox, &job); break;
-                case MRJ_CONFIGURE_IMAP:       mrmailbox_configure_imap       (mailbox, &job); break;
+			for( i = 0; i < cnt; i++ ) {
+				if( jobs[i].m_param == NULL ) {
+					jobs[i].m_param = mrparam_new();
+				}
+				jobs[i].m_job_id         = entries[i]->m_job_id;
+				jobs[i].m_action         = entries[i]->m_action;
+				jobs[i].m_foreign_id     = entries[i]->m_foreign_id;
+				jobs[i].m_start_again_at = 0;
+				mrparam_set_packed(jobs[i].m_param, entries[i]->m_param);
 			}
 
-			/* delete job or execute job later again */
-			if( job.m_start_again_at ) {
-				stmt = mrsqlite3_prepare_v2_(mailbox->m_sql,
-					"UPDATE jobs SET desired_timestamp=?, param=? WHERE id=?;");
-				sqlite3_bind_int64(stmt, 1, job.m_start_again_at);
-				sqlite3_bind_text (stmt, 2, job.m_param->m_packed, -1, SQLITE_STATIC);
-				sqlite3_bind_int  (stmt, 3, job.m_job_id);
-				sqlite3_step(stmt);
-				sqlite3_finalize(stmt);
-				mrmailbox_log_info(mailbox, 0, "Job #%i delayed for %i seconds", (int)job.m_job_id, (int)(job.m_start_again_at-time(NULL)));
+			/* execute job(s) */
+			if( cnt > 1 ) {
+				mrmailbox_log_info(mailbox, 0, "Executing %i jobs, action %i...", cnt, (int)jobs[0].m_action);
 			}
 			else {
-				stmt = mrsqlite3_prepare_v2_(mailbox->m_sql,
-					"DELETE FROM jobs WHERE id=?;");
-				sqlite3_bind_int(stmt, 1, job.m_job_id);
-				sqlite3_step(stmt);
-				sqlite3_finalize(stmt);
-				mrmailbox_log_info(mailbox, 0, "Job #%i done and deleted from database", (int)job.m_job_id);
+				mrmailbox_log_info(mailbox, 0, "Executing job #%i, action %i...", (int)jobs[0].m_job_id, (int)jobs[0].m_action);
 			}
-		}
+			switch( jobs[0].m_action ) {
+                case MRJ_SEND_MSG_TO_SMTP:     mrmailbox_send_msg_to_smtp      (mailbox, &jobs[0]); break;
+                case MRJ_SEND_MSG_TO_IMAP:     mrmailbox_send_msg_to_imap      (mailbox, &jobs[0]); break;
+                case MRJ_DELETE_MSG_ON_IMAP:   mrmailbox_delete_msg_on_imap    (mailbox, &jobs[0]); break;
+                case MRJ_MARKSEEN_MSG_ON_IMAP: mrmailbox_markseen_msgs_on_imap (mailbox, job_ptrs, cnt); break;
+                case MRJ_MARKSEEN_MDN_ON_IMAP: mrmailbox_markseen_mdn_on_imap  (mailbox, &jobs[0]); break;
+                case MRJ_SEND_MDN:             mrmailbox_send_mdn              (mailbox, &jobs[0]); break;
+                case MRJ_CONFIGURE_IMAP:       mrmailbox_configure_imap        (mailbox, &jobs[0]); break;
+			}
+
+			mrsqlite3_lock(mailbox->m_sql);
+
+				pthread_mutex_lock(&queue->m_critical);
+					killed = queue->m_running_killed;
+					queue->m_running_action = 0;
+				pthread_mutex_unlock(&queue->m_critical);
+
+				if( cnt > 1 ) {
+					mrsqlite3_begin_transaction__(mailbox->m_sql);
+				}
 
+				for( i = 0; i < cnt; i++ ) {
+					finish_job__(mailbox, queue, entries[i], &jobs[i], killed);
+				}
+
+				if( cnt > 1 ) {
+					mrsqlite3_commit__(mailbox->m_sql);
+				}
+
+			mrsqlite3_unlock(mailbox->m_sql);
+		}
 
-	mrparam_unref(job.m_param);
+	for( i = 0; i < MR_JOB_MAX_BATCH; i++ ) {
+		mrparam_unref(jobs[i].m_param);
+	}
 }
 
 
@@ -101,12 +495,31 @@ void mrjob_perform(mrmailbox_t* mailbox, int thread)
  ******************************************************************************/
 
 
+static void queue_entry__(mrmailbox_t* mailbox, mrjobentry_t* entry)
+{
+	mrjobqueue_t* queue = get_queue(mailbox, entry->m_thread);
+
+	entry->m_next = NULL;
+	pthread_mutex_lock(&queue->m_critical);
+		insert__(queue, entry);
+	pthread_mutex_unlock(&queue->m_critical);
+
+	if( entry->m_thread == MR_IMAP_THREAD ) {
+		mrmailbox_interrupt_idle(mailbox);
+	}
+	else {
+		mrmailbox_interrupt_smtp_idle(mailbox);
+	}
+}
+
+
 uint32_t mrjob_add__(mrmailbox_t* mailbox, int action, int foreign_id, const char* param, int delay_seconds)
 {
 	time_t        timestamp = time(NULL);
 	sqlite3_stmt* stmt;
 	uint32_t      job_id = 0;
 	int           thread;
+	mrjobentry_t* entry;
 
 	if( action >= MR_IMAP_THREAD && action < MR_IMAP_THREAD+1000 ) {
 		thread = MR_IMAP_THREAD;
@@ -118,7 +531,7 @@ uint32_t mrjob_add__(mrmailbox_t* mailbox, int action, int foreign_id, const cha
 		return 0;
 	}
 
-	stmt = mrsqlite3_prepare_v2_(mailbox->m_sql,
+	stmt = mrsqlite3_predefine__(mailbox->m_sql, INSERT_INTO_jobs_atafpd,
 		"INSERT INTO jobs (added_timestamp, thread, action, foreign_id, param, desired_timestamp) VALUES (?,?,?,?,?,?);");
 	sqlite3_bind_int64(stmt, 1, timestamp);
 	sqlite3_bind_int  (stmt, 2, thread);
@@ -126,22 +539,72 @@ uint32_t mrjob_add__(mrmailbox_t* mailbox, int action, int foreign_id, const cha
 	sqlite3_bind_int  (stmt, 4, foreign_id);
 	sqlite3_bind_text (stmt, 5, param? param : "",  -1, SQLITE_STATIC);
 	sqlite3_bind_int64(stmt, 6, delay_seconds>0? (timestamp+delay_seconds) : 0);
-	sqlite3_step(stmt);
-	sqlite3_finalize(stmt);
+	if( sqlite3_step(stmt) != SQLITE_DONE ) {
+		return 0;
+	}
 
 	job_id = sqlite3_last_insert_rowid(mailbox->m_sql->m_cobj);
 
-	if( thread == MR_IMAP_THREAD ) {
-		mrmailbox_interrupt_idle(mailbox);
+	if( (entry=calloc(1, sizeof(mrjobentry_t)))==NULL ) {
+		exit(45);
 	}
-	else {
-		mrmailbox_interrupt_smtp_idle(mailbox);
+	entry->m_job_id            = job_id;
+	entry->m_action            = action;
+	entry->m_foreign_id        = foreign_id;
+	entry->m_param             = safe_strdup(param);
+	entry->m_desired_timestamp = delay_seconds>0? (timestamp+delay_seconds) : 0;
+	entry->m_thread            = thread;
+
+	if( mailbox->m_sql->m_transactionCount > 0 )
+	{
+		/* the job must not be performed before the transaction is committed and must be forgotten if it is rolled back,
+		so it is queued by mrjob_commit_pending__() */
+		entry->m_level = mailbox->m_sql->m_transactionCount;
+		entry->m_next = mailbox->m_jobs_pending;
+		mailbox->m_jobs_pending = entry;
+	}
+	else
+	{
+		queue_entry__(mailbox, entry);
 	}
 
 	return job_id;
 }
 
 
+void mrjob_commit_pending__(mrmailbox_t* mailbox, int level)
+{
+	/* called by mrsqlite3_commit__() before the transaction or savepoint on the given nesting level is ended:
+	jobs added on this level are moved to the outer level or, if the outermost transaction is committed, to the queues */
+	mrjobentry_t *entry, *next, **prev;
+
+	for( prev = &mailbox->m_jobs_pending, entry = mailbox->m_jobs_pending; entry; entry = next ) {
+		next = entry->m_next;
+		if( entry->m_level >= level ) {
+			if( level <= 1 ) {
+				*prev = next;
+				queue_entry__(mailbox, entry);
+				continue;
+			}
+			entry->m_level = level-1;
+		}
+		prev = &entry->m_next;
+	}
+}
+
+
+void mrjob_rollback_pending__(mrmailbox_t* mailbox, int level)
+{
+	/* called by mrsqlite3_rollback__(): the jobs added on the given nesting level or deeper are no longer in the database */
+	mrjobentry_t *entry, *next, **prev;
+
+	for( prev = &mailbox->m_jobs_pending, entry = mailbox->m_jobs_pending; entry; entry = next ) {
+		next = entry->m_next;
+		if( entry->m_level >= level ) { *prev = next; free_entry(entry); } else { prev = &entry->m_next; }
+	}
+}
+
+
 void mrjob_try_again_later(mrjob_t* ths, int initial_delay_seconds)
 {
 	if( ths == NULL ) {
@@ -180,15 +643,31 @@ void mrjob_try_again_later(mrjob_t* ths, int initial_delay_seconds)
 
 void mrjob_kill_actions__(mrmailbox_t* mailbox, int action1, int action2)
 {
+	mrjobentry_t *entry, *next, **prev;
+	int          i;
+
 	if( mailbox == NULL ) {
 		return;
 	}
 
-	sqlite3_stmt* stmt = mrsqlite3_prepare_v2_(mailbox->m_sql,
+	sqlite3_stmt* stmt = mrsqlite3_predefine__(mailbox->m_sql, DELETE_FROM_jobs_WHERE_action,
 		"DELETE FROM jobs WHERE action=? OR action=?;");
 	sqlite3_bind_int(stmt, 1, action1);
 	sqlite3_bind_int(stmt, 2, action2);
 	sqlite3_step(stmt);
-	sqlite3_finalize(stmt);
-}
 
+	for( prev = &mailbox->m_jobs_pending, entry = mailbox->m_jobs_pending; entry; entry = next ) {
+		next = entry->m_next;
+		if( entry->m_action==action1 || entry->m_action==action2 ) { *prev = next; free_entry(entry); } else { prev = &entry->m_next; }
+	}
+
+	for( i = 0; i < 2; i++ ) {
+		mrjobqueue_t* queue = i==0? mailbox->m_imap_jobs : mailbox->m_smtp_jobs;
+		pthread_mutex_lock(&queue->m_critical);
+			remove_actions__(queue, action1, action2);
+			if( queue->m_running_action && (queue->m_running_action==action1 || queue->m_running_action==action2) ) {
+				queue->m_running_killed = 1;
+			}
+		pthread_mutex_unlock(&queue->m_critical);
+	}
+}
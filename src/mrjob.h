@@ -59,10 +59,14 @@ typedef struct mrjob_t
 	time_t     m_start_again_at; /* 1=on next loop, >1=on timestamp, 0=delete job (default) */
 } mrjob_t;
 
+#define  MR_JOB_MAX_BATCH      500 /* max. number of jobs with the same action performed by a single call, see mrmailbox_markseen_msgs_on_imap() */
 void     mrjob_perform         (mrmailbox_t*, int thread);
+time_t   mrjob_get_next_due    (mrmailbox_t*, int thread); /* returns the time the next job of the thread is due, may be in the past; 0 if there are no jobs */
 
 uint32_t mrjob_add__           (mrmailbox_t*, int action, int foreign_id, const char* param, int delay); /* returns the job_id or 0 on errors. the job may or may not be done if the function returns. */
 void     mrjob_kill_actions__  (mrmailbox_t*, int action1, int action2); /* delete all pending jobs with the given actions */
+void     mrjob_commit_pending__   (mrmailbox_t*, int level); /* called by mrsqlite3_commit__() and mrsqlite3_rollback__(), jobs added during a transaction are queued on commit only */
+void     mrjob_rollback_pending__ (mrmailbox_t*, int level);
 
 #define  MR_AT_ONCE            0
 #define  MR_INCREATION_POLL    2 /* this value does not increase the number of tries */
@@ -70,6 +74,41 @@ void     mrjob_kill_actions__  (mrmailbox_t*, int action1, int action2); /* dele
 void     mrjob_try_again_later (mrjob_t*, int initial_delay_seconds);
 
 
+/**
+ * Library-internal.
+ *
+ * The pending jobs of one thread.  The table `jobs` is only the durable log
+ * behind this queue, so finding the next job does not need any SQL:
+ * jobs that are due are kept in a heap ordered by priority (action DESC, id),
+ * delayed jobs are kept in a timer wheel with one slot per second and jobs
+ * due beyond the wheel in an overflow list.
+ */
+typedef struct mrjobentry_t mrjobentry_t;
+typedef struct mrjobqueue_t
+{
+	/** @privatesection */
+	pthread_mutex_t m_critical;
+
+	mrjobentry_t**  m_due;              /**< heap of jobs that are due, the job with the highest priority is m_due[0] */
+	int             m_due_cnt;
+	int             m_due_alloc;
+
+	#define         MR_JOB_WHEEL_SLOTS 64
+	mrjobentry_t*   m_wheel[MR_JOB_WHEEL_SLOTS]; /**< list of jobs per second; slot `t%MR_JOB_WHEEL_SLOTS` holds the jobs due at `t`, m_wheel_time <= t < m_wheel_time+MR_JOB_WHEEL_SLOTS */
+	time_t          m_wheel_time;       /**< all jobs due before this time are in m_due */
+	mrjobentry_t*   m_overflow;         /**< list of jobs due at or after m_wheel_time+MR_JOB_WHEEL_SLOTS */
+	time_t          m_overflow_min;     /**< the earliest time in m_overflow, 0 if m_overflow is empty */
+
+	int             m_running_action;   /**< the action of the job currently executed by mrjob_perform(), the job is not in the queue meanwhile */
+	int             m_running_killed;   /**< set if the running job is killed by mrjob_kill_actions__(), it is not put back to the queue then */
+} mrjobqueue_t;
+
+mrjobqueue_t* mrjobqueue_new       (void);
+void          mrjobqueue_unref     (mrjobqueue_t*);
+void          mrjob_load_queues__  (mrmailbox_t*); /* (re-)load the queues from the table `jobs`, called after the database is opened */
+void          mrjob_clear_queues   (mrmailbox_t*);
+
+
 #ifdef __cplusplus
 } /* /extern "C" */
 #endif
@@ -24,8 +24,10 @@
 #include <memory.h>
 #include "mrmailbox_internal.h"
 #include "mrkey.h"
+#include "mrkeyring.h"
 #include "mrpgp.h"
 #include "mrtools.h"
+#include "mrcodec.h"
 
 
 /*******************************************************************************
@@ -138,8 +140,8 @@ int mrkey_set_from_stmt(mrkey_t* ths, sqlite3_stmt* stmt, int index, int type)
 
 int mrkey_set_from_base64(mrkey_t* ths, const char* base64, int type)
 {
-	size_t indx = 0, result_len = 0;
-	char* result = NULL;
+	size_t base64_bytes, result_len = 0;
+	char*  result = NULL;
 
 	mrkey_empty(ths);
 
@@ -147,13 +149,18 @@ int mrkey_set_from_base64(mrkey_t* ths, const char* base64, int type)
 		return 0;
 	}
 
-	if( mailmime_base64_body_parse(base64, strlen(base64), &indx, &result/*must be freed using mmap_string_unref()*/, &result_len)!=MAILIMF_NO_ERROR
-	 || result == NULL || result_len == 0 ) {
+	base64_bytes = strlen(base64);
+	if( (result=malloc(mr_base64_decode_bound(base64_bytes)))==NULL ) {
+		exit(58);
+	}
+
+	if( (result_len=mr_base64_decode(base64, base64_bytes, 0, NULL, result)) == 0 ) {
+		free(result);
 		return 0; /* bad key */
 	}
 
 	mrkey_set_from_binary(ths, result, result_len, type);
-	mmap_string_unref(result);
+	free(result);
 
 	return 1;
 }
@@ -239,6 +246,10 @@ int mrkey_save_self_keypair__(const mrkey_t* public_key, const mrkey_t* private_
 		return 0;
 	}
 
+	if( sql->m_mailbox && sql->m_mailbox->m_sql == sql ) {
+		mrkeyring_clear_self_cache__(sql->m_mailbox);
+	}
+
 	stmt = mrsqlite3_predefine__(sql, INSERT_INTO_keypairs_aippc,
 		"INSERT INTO keypairs (addr, is_default, public_key, private_key, created) VALUES (?,?,?,?,?);");
 	sqlite3_bind_text (stmt, 1, addr, -1, SQLITE_STATIC);
@@ -326,9 +337,7 @@ char* mr_render_base64(const void* buf, size_t buf_bytes, int break_every, const
 		goto cleanup;
 	}
 
-	if( (ret = encode_base64((const char*)buf, buf_bytes))==NULL ) {
-		goto cleanup;
-	}
+	ret = mr_base64_encode(buf, buf_bytes, break_every, break_chars);
 
 	#if 0
 	if( add_checksum == 1/*appended checksum*/ ) {
@@ -337,7 +346,7 @@ char* mr_render_base64(const void* buf, size_t buf_bytes, int break_every, const
 		c[0] = (uint8_t)((checksum >> 16)&0xFF);
 		c[1] = (uint8_t)((checksum >> 8)&0xFF);
 		c[2] = (uint8_t)((checksum)&0xFF);
-		char* c64 = encode_base64((const char*)c, 3);
+		char* c64 = mr_base64_encode(c, 3, 0, NULL);
 			char* temp = ret;
 				ret = mr_mprintf("%s=%s", temp, c64);
 			free(temp);
@@ -345,19 +354,13 @@ char* mr_render_base64(const void* buf, size_t buf_bytes, int break_every, const
 	}
 	#endif
 
-	if( break_every>0 ) {
-		char* temp = ret;
-			ret = mr_insert_breaks(temp, break_every, break_chars);
-		free(temp);
-	}
-
 	if( add_checksum == 2/*checksum with break character*/ ) {
 		long checksum = crc_octets(buf, buf_bytes);
 		uint8_t c[3];
 		c[0] = (uint8_t)((checksum >> 16)&0xFF);
 		c[1] = (uint8_t)((checksum >> 8)&0xFF);
 		c[2] = (uint8_t)((checksum)&0xFF);
-		char* c64 = encode_base64((const char*)c, 3);
+		char* c64 = mr_base64_encode(c, 3, 0, NULL);
 			char* temp = ret;
 				ret = mr_mprintf("%s%s=%s", temp, break_chars, c64);
 			free(temp);
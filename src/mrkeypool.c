@@ -0,0 +1,195 @@
+/*******************************************************************************
+ *
+ *                              Delta Chat Core
+ *                      Copyright (C) 2017 Björn Petersen
+ *                   Contact: r10s@b44t.com, http://b44t.com
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see http://www.gnu.org/licenses/ .
+ *
+ ******************************************************************************/
+
+
+
+
+#include "mrmailbox_internal.h"
+#include "mrkey.h"
+#include "mrpgp.h"
+#include "mrkeypool.h"
+
+
+/* Generating a keypair takes some seconds.  If done on demand, this delays
+configuring an account or sending the first message, so keypairs can be
+generated in advance by some threads and are taken from the pool later.
+The pool is not persisted, keypairs not taken before the process ends are
+lost. */
+
+static pthread_mutex_t s_keypool_critical = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t  s_keypool_cond = PTHREAD_COND_INITIALIZER; /* signalled if a keypair gets ready or a thread ends */
+static carray*         s_keypool = NULL;  /* public and private keys, alternating */
+static int             s_wanted = 0;      /* keypairs requested by mrkeypool_fill() and not yet taken */
+static int             s_generating = 0;
+static int             s_threads = 0;
+static uint32_t        s_generated = 0;
+static uint32_t        s_taken = 0;
+
+
+static int ready_cnt__(void)
+{
+	return s_keypool? carray_count(s_keypool)/2 : 0;
+}
+
+
+static void* keypool_thread_entry_point(void* entry_arg)
+{
+	mrkey_t* public_key;
+	mrkey_t* private_key;
+	int      key_created;
+
+	while( 1 )
+	{
+		pthread_mutex_lock(&s_keypool_critical);
+			if( ready_cnt__() + s_generating >= s_wanted ) {
+				s_threads--;
+				pthread_cond_broadcast(&s_keypool_cond);
+				pthread_mutex_unlock(&s_keypool_critical);
+				break;
+			}
+			s_generating++;
+		pthread_mutex_unlock(&s_keypool_critical);
+
+		public_key = mrkey_new();
+		private_key = mrkey_new();
+		key_created = mrpgp_create_keypair(NULL, NULL, public_key, private_key);
+
+		pthread_mutex_lock(&s_keypool_critical);
+			s_generating--;
+			if( key_created ) {
+				if( carray_add(s_keypool, public_key, NULL)!=0
+				 || carray_add(s_keypool, private_key, NULL)!=0 ) {
+					exit(63);
+				}
+				s_generated++;
+			}
+			else {
+				/* do not retry endlessly, the keypair is created by the caller then */
+				mrkey_unref(public_key);
+				mrkey_unref(private_key);
+				s_threads--;
+			}
+			pthread_cond_broadcast(&s_keypool_cond);
+		pthread_mutex_unlock(&s_keypool_critical);
+
+		if( !key_created ) {
+			break;
+		}
+	}
+
+	return NULL;
+}
+
+
+/**
+ * Make sure, at least `cnt` keypairs are ready or in generation.  Missing
+ * keypairs are generated by up to `max_threads` detached threads, the function
+ * returns at once.
+ */
+void mrkeypool_fill(int cnt, int max_threads)
+{
+	pthread_t thread;
+	int       threads_wanted;
+
+	if( cnt <= 0 ) {
+		return;
+	}
+
+	max_threads = MR_MAX(MR_MIN(max_threads, MR_KEYPOOL_MAX_THREADS), 1);
+
+	pthread_mutex_lock(&s_keypool_critical);
+
+		if( s_keypool==NULL && (s_keypool=carray_new(16))==NULL ) {
+			exit(63);
+		}
+
+		s_wanted = MR_MAX(s_wanted, cnt);
+
+		threads_wanted = MR_MIN(s_wanted - ready_cnt__(), max_threads);
+		while( s_threads < threads_wanted ) {
+			if( pthread_create(&thread, NULL, keypool_thread_entry_point, NULL) != 0 ) {
+				break;
+			}
+			pthread_detach(thread);
+			s_threads++;
+		}
+
+	pthread_mutex_unlock(&s_keypool_critical);
+}
+
+
+/**
+ * Take a keypair from the pool.  If the pool is empty and `wait` is set, the
+ * function waits for keypairs in generation; this is never slower than
+ * generating a new keypair.
+ *
+ * @return 1=keypair taken, 0=no keypair available, the caller should generate one.
+ */
+int mrkeypool_take(mrkey_t* ret_public_key, mrkey_t* ret_private_key, int wait)
+{
+	int      success = 0, cnt;
+	mrkey_t* public_key = NULL;
+	mrkey_t* private_key = NULL;
+
+	if( ret_public_key==NULL || ret_private_key==NULL ) {
+		return 0;
+	}
+
+	pthread_mutex_lock(&s_keypool_critical);
+
+		if( wait ) {
+			while( ready_cnt__()==0 && (s_generating>0 || s_threads>0) ) {
+				pthread_cond_wait(&s_keypool_cond, &s_keypool_critical); /* unlock mutex -> wait -> lock mutex */
+			}
+		}
+
+		if( ready_cnt__() > 0 ) {
+			cnt = carray_count(s_keypool);
+			public_key  = (mrkey_t*)carray_get(s_keypool, cnt-2);
+			private_key = (mrkey_t*)carray_get(s_keypool, cnt-1);
+			carray_set_size(s_keypool, cnt-2);
+			s_wanted = MR_MAX(s_wanted-1, 0);
+			s_taken++;
+			success = 1;
+		}
+
+	pthread_mutex_unlock(&s_keypool_critical);
+
+	if( success ) {
+		mrkey_set_from_key(ret_public_key, public_key);
+		mrkey_set_from_key(ret_private_key, private_key);
+	}
+
+	mrkey_unref(public_key);
+	mrkey_unref(private_key);
+	return success;
+}
+
+
+void mrkeypool_get_stat(int* ret_ready, int* ret_generating, uint32_t* ret_generated, uint32_t* ret_taken)
+{
+	pthread_mutex_lock(&s_keypool_critical);
+		if( ret_ready )      { *ret_ready      = ready_cnt__(); }
+		if( ret_generating ) { *ret_generating = s_generating; }
+		if( ret_generated )  { *ret_generated  = s_generated; }
+		if( ret_taken )      { *ret_taken      = s_taken; }
+	pthread_mutex_unlock(&s_keypool_critical);
+}
@@ -0,0 +1,50 @@
+/*******************************************************************************
+ *
+ *                              Delta Chat Core
+ *                      Copyright (C) 2017 Björn Petersen
+ *                   Contact: r10s@b44t.com, http://b44t.com
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see http://www.gnu.org/licenses/ .
+ *
+ ******************************************************************************/
+
+
+
+
+#ifndef __MRKEYPOOL_H__
+#define __MRKEYPOOL_H__
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+typedef struct mrkey_t mrkey_t;
+
+
+/* Process-wide pool of keypairs generated in the background.  As the user id
+of our keys does not contain the address (see mrpgp_create_keypair()), a
+keypair is not bound to an account before it is saved to the database, so
+the pool can be shared by all mailboxes of the process. */
+
+#define MR_KEYPOOL_MAX_THREADS 16
+
+void mrkeypool_fill      (int cnt, int max_threads); /* make sure, at least `cnt` keypairs are ready or in generation, returns at once */
+int  mrkeypool_take      (mrkey_t* ret_public_key, mrkey_t* ret_private_key, int wait); /* returns 0 if the pool is empty; if `wait` is set, a keypair in generation is waited for */
+void mrkeypool_get_stat  (int* ret_ready, int* ret_generating, uint32_t* ret_generated, uint32_t* ret_taken);
+
+
+#ifdef __cplusplus
+} /* /extern "C" */
+#endif
+#endif /* __MRKEYPOOL_H__ */
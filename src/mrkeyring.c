@@ -78,15 +78,43 @@ void mrkeyring_add(mrkeyring_t* ths, mrkey_t* to_add)
 }
 
 
+static void add_copies(mrkeyring_t* ths, const mrkeyring_t* src)
+{
+	/* the keys are copied as the reference counters are not thread-safe and the keyrings may be used by parallel parsers */
+	int i;
+	for( i = 0; i < src->m_count; i++ ) {
+		mrkey_t* key = mrkey_new();
+			mrkey_set_from_key(key, src->m_keys[i]);
+			mrkeyring_add(ths, key);
+		mrkey_unref(key);
+	}
+}
+
+
 int mrkeyring_load_self_private_for_decrypting__(mrkeyring_t* ths, const char* self_addr, mrsqlite3_t* sql)
 {
 	sqlite3_stmt* stmt;
 	mrkey_t*      key;
+	mrmailbox_t*  mailbox = NULL;
 
 	if( ths==NULL || self_addr==NULL || sql==NULL ) {
 		return 0;
 	}
 
+	/* the private keys are needed for every encrypted message received, so they are loaded only once
+	after the database is opened, see mrkeyring_clear_self_cache__() */
+	if( sql->m_mailbox && sql->m_mailbox->m_sql == sql ) {
+		mailbox = sql->m_mailbox;
+		if( mailbox->m_self_private_keys && mailbox->m_self_private_keys_addr
+		 && strcmp(mailbox->m_self_private_keys_addr, self_addr)==0 ) {
+			add_copies(ths, mailbox->m_self_private_keys);
+			return 1;
+		}
+		mrkeyring_clear_self_cache__(mailbox);
+		mailbox->m_self_private_keys = mrkeyring_new();
+		mailbox->m_self_private_keys_addr = safe_strdup(self_addr);
+	}
+
 	stmt = mrsqlite3_predefine__(sql, SELECT_private_key_FROM_keypairs_ORDER_BY_default,
 		"SELECT private_key FROM keypairs ORDER BY addr=? DESC, is_default DESC;");
 	sqlite3_bind_text (stmt, 1, self_addr, -1, SQLITE_STATIC);
@@ -98,6 +126,24 @@ int mrkeyring_load_self_private_for_decrypting__(mrkeyring_t* ths, const char* s
 		mrkey_unref(key); /* unref in any case, mrkeyring_add() adds its own reference */
 	}
 
+	if( mailbox ) {
+		add_copies(mailbox->m_self_private_keys, ths);
+	}
+
 	return 1;
 }
 
+
+/* Must be called whenever the table keypairs is modified. */
+void mrkeyring_clear_self_cache__(mrmailbox_t* mailbox)
+{
+	if( mailbox == NULL ) {
+		return;
+	}
+
+	mrkeyring_unref(mailbox->m_self_private_keys);
+	mailbox->m_self_private_keys = NULL;
+
+	free(mailbox->m_self_private_keys_addr);
+	mailbox->m_self_private_keys_addr = NULL;
+}
@@ -27,6 +27,7 @@ extern "C" {
 #endif
 
 
+typedef struct _mrmailbox mrmailbox_t;
 typedef struct mrkey_t mrkey_t;
 
 
@@ -48,6 +49,7 @@ void         mrkeyring_unref();
 void         mrkeyring_add  (mrkeyring_t*, mrkey_t*); /* the reference counter of the key is increased by one */
 
 int          mrkeyring_load_self_private_for_decrypting__(mrkeyring_t*, const char* self_addr, mrsqlite3_t* sql);
+void         mrkeyring_clear_self_cache__(mrmailbox_t*);
 
 
 #ifdef __cplusplus
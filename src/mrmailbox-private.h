@@ -28,11 +28,17 @@ extern "C" {
 
 
 typedef struct mrimap_t       mrimap_t;
+typedef struct mrimapfetched_t mrimapfetched_t;
 typedef struct mrsmtp_t       mrsmtp_t;
 typedef struct mrsqlite3_t    mrsqlite3_t;
 typedef struct mrjob_t        mrjob_t;
+typedef struct mrjobqueue_t   mrjobqueue_t;
+typedef struct mrjobentry_t   mrjobentry_t;
 typedef struct mrmimeparser_t mrmimeparser_t;
 typedef struct mrhash_t       mrhash_t;
+typedef struct mrcontactcacheentry_t mrcontactcacheentry_t;
+typedef struct mrpeerstatecacheentry_t mrpeerstatecacheentry_t;
+typedef struct mrkeyring_t    mrkeyring_t;
 
 
 /** Structure behind mrmailbox_t */
@@ -46,11 +52,16 @@ struct _mrmailbox
 
 	char*            m_dbfile;                /**< The database file. This is the file given to mrmailbox_new(). */
 	char*            m_blobdir;               /**< Full path of the blob directory. This is the directory given to mrmailbox_new() or a directory in the same directory as mrmailbox_t::m_dbfile. */
+	pthread_mutex_t  m_blobdir_critical;      /**< Internal, used to find unique names for blob files if messages are parsed in parallel, see mrmailbox_receive_imf_batch() */
 
 	mrsqlite3_t*     m_sql;                   /**< Internal SQL object, never NULL */
 	mrimap_t*        m_imap;                  /**< Internal IMAP object, never NULL */
 	mrsmtp_t*        m_smtp;                  /**< Internal SMTP object, never NULL */
 
+	mrjobqueue_t*    m_imap_jobs;             /**< Internal, pending jobs of the IMAP-thread, never NULL */
+	mrjobqueue_t*    m_smtp_jobs;             /**< Internal, pending jobs of the SMTP-thread, never NULL */
+	mrjobentry_t*    m_jobs_pending;          /**< Internal, jobs added during the current transaction, queued on commit, see mrjob_add__() */
+
 	pthread_cond_t   m_smtpidle_cond;
 	pthread_mutex_t  m_smtpidle_condmutex;
 	int              m_smtpidle_condflag;
@@ -64,6 +75,37 @@ struct _mrmailbox
 	uint32_t         m_cmdline_sel_chat_id;   /**< Internal */
 
 	int              m_e2ee_enabled;          /**< Internal */
+	size_t           m_decode_buffer_bytes;   /**< Internal, config-option decode_buffer_bytes, attachments are decoded to the blobdir in slices of this size */
+
+	#define          MR_CONTACT_CACHE_SIZE 1000
+	mrhash_t*        m_contact_cache;         /**< Internal, address->mrcontactcacheentry_t, case-insensitive, used by mrmailbox_add_or_lookup_contact__(); only accessed with the database locked */
+	mrhash_t*        m_contact_cache_ids;     /**< Internal, contact_id->mrcontactcacheentry_t, same entries as m_contact_cache */
+	mrcontactcacheentry_t* m_contact_cache_first; /**< Internal, most recently used entry */
+	mrcontactcacheentry_t* m_contact_cache_last;  /**< Internal, least recently used entry, evicted first */
+	uint32_t         m_contact_cache_hits;    /**< Internal, statistics, shown by mrmailbox_get_info() */
+	uint32_t         m_contact_cache_misses;  /**< Internal, statistics, shown by mrmailbox_get_info() */
+
+	#define          MR_PEERSTATE_CACHE_SIZE 500
+	mrhash_t*        m_peerstate_cache;       /**< Internal, address->mrpeerstatecacheentry_t, case-insensitive, used by mrapeerstate_load_by_addr__(); only accessed with the database locked */
+	mrpeerstatecacheentry_t* m_peerstate_cache_first; /**< Internal, most recently used entry */
+	mrpeerstatecacheentry_t* m_peerstate_cache_last;  /**< Internal, least recently used entry, evicted first */
+	uint32_t         m_peerstate_cache_hits;  /**< Internal, statistics, shown by mrmailbox_get_info() */
+	uint32_t         m_peerstate_cache_misses;/**< Internal, statistics, shown by mrmailbox_get_info() */
+
+	uint32_t         m_receive_cnt;           /**< Internal, statistics, number of received messages, shown by mrmailbox_get_info(); only accessed with the database locked */
+	uint64_t         m_receive_parse_us;      /**< Internal, statistics, time taken by parsing the received messages without decrypting and simplifying */
+	uint64_t         m_receive_decrypt_us;    /**< Internal, statistics, time taken by mrmailbox_e2ee_decrypt() for the received messages */
+	uint64_t         m_receive_simplify_us;   /**< Internal, statistics, time taken by mrsimplify_simplify() for the received messages */
+	uint64_t         m_receive_apply_us;      /**< Internal, statistics, time taken by adding the received messages to the database */
+
+	char*            m_self_private_keys_addr;/**< Internal, the address m_self_private_keys were loaded for, NULL if they are not loaded */
+	mrkeyring_t*     m_self_private_keys;     /**< Internal, the keys returned by mrkeyring_load_self_private_for_decrypting__(); only accessed with the database locked */
+
+	#define          MR_MIMEPARSER_POOL_SIZE 16
+	pthread_mutex_t  m_mimeparser_pool_critical; /**< Internal */
+	mrmimeparser_t*  m_mimeparser_pool[MR_MIMEPARSER_POOL_SIZE];
+	                                          /**< Internal, emptied parsers kept for the next received messages, see mrmailbox_receive_imf_batch() */
+	int              m_mimeparser_pool_cnt;   /**< Internal */
 
 	#define          MR_LOG_RINGBUF_SIZE 200
 	pthread_mutex_t  m_log_ringbuf_critical;  /**< Internal */
@@ -85,9 +127,11 @@ void            mrmailbox_log_info          (mrmailbox_t*, int code, const char*
 
 /* misc.*/
 void            mrmailbox_receive_imf                             (mrmailbox_t*, const char* imf_raw_not_terminated, size_t imf_raw_bytes, const char* server_folder, uint32_t server_uid, uint32_t flags);
+void            mrmailbox_receive_imf_batch                       (mrmailbox_t*, const mrimapfetched_t* msgs, int msgs_cnt, const char* server_folder);
+void            mrmailbox_clear_mimeparser_pool                   (mrmailbox_t*);
 uint32_t        mrmailbox_send_msg_object                         (mrmailbox_t*, uint32_t chat_id, mrmsg_t*);
 int             mrmailbox_ll_connect_to_imap                      (mrmailbox_t*, mrjob_t*);
-int             mrmailbox_get_archived_count__                    (mrmailbox_t*);
+int             mrmailbox_get_archived_count__                    (mrsqlite3_t*);
 size_t          mrmailbox_get_real_contact_cnt__                  (mrmailbox_t*);
 uint32_t        mrmailbox_add_or_lookup_contact__                 (mrmailbox_t*, const char* display_name /*can be NULL*/, const char* addr_spec, int origin, int* sth_modified);
 int             mrmailbox_get_contact_origin__                    (mrmailbox_t*, uint32_t id, int* ret_blocked);
@@ -95,6 +139,7 @@ int             mrmailbox_is_contact_blocked__                    (mrmailbox_t*,
 int             mrmailbox_real_contact_exists__                   (mrmailbox_t*, uint32_t id);
 int             mrmailbox_contact_addr_equals__                   (mrmailbox_t*, uint32_t contact_id, const char* other_addr);
 void            mrmailbox_scaleup_contact_origin__                (mrmailbox_t*, uint32_t contact_id, int origin);
+void            mrmailbox_clear_contact_cache__                   (mrmailbox_t*);
 void            mrmailbox_unarchive_chat__                        (mrmailbox_t*, uint32_t chat_id);
 size_t          mrmailbox_get_chat_cnt__                          (mrmailbox_t*);
 void            mrmailbox_block_chat__                            (mrmailbox_t*, uint32_t chat_id, int new_blocking);
@@ -103,7 +148,8 @@ void            mrmailbox_create_or_lookup_nchat_by_contact_id__  (mrmailbox_t*,
 void            mrmailbox_lookup_real_nchat_by_contact_id__       (mrmailbox_t*, uint32_t contact_id, uint32_t* ret_chat_id, int* ret_chat_blocked);
 int             mrmailbox_get_total_msg_count__                   (mrmailbox_t*, uint32_t chat_id);
 int             mrmailbox_get_fresh_msg_count__                   (mrmailbox_t*, uint32_t chat_id);
-uint32_t        mrmailbox_get_last_deaddrop_fresh_msg__           (mrmailbox_t*);
+int             mrmailbox_get_fresh_msg_count_all__               (mrmailbox_t*);
+uint32_t        mrmailbox_get_last_deaddrop_fresh_msg__           (mrsqlite3_t*);
 void            mrmailbox_send_msg_to_smtp                        (mrmailbox_t*, mrjob_t*);
 void            mrmailbox_send_msg_to_imap                        (mrmailbox_t*, mrjob_t*);
 void            mrmailbox_configure_imap                          (mrmailbox_t*, mrjob_t*);
@@ -117,12 +163,14 @@ size_t          mrmailbox_get_deaddrop_msg_cnt__                  (mrmailbox_t*)
 int             mrmailbox_rfc724_mid_cnt__                        (mrmailbox_t*, const char* rfc724_mid);
 uint32_t        mrmailbox_rfc724_mid_exists__                     (mrmailbox_t*, const char* rfc724_mid, char** ret_server_folder, uint32_t* ret_server_uid);
 void            mrmailbox_update_server_uid__                     (mrmailbox_t*, const char* rfc724_mid, const char* server_folder, uint32_t server_uid);
+void            mrmailbox_sync_msgs_from_imap                     (mrmailbox_t*, const char* server_folder, const mrarray_t* server_uid_ranges, uint32_t flags);
 void            mrmailbox_update_msg_chat_id__                    (mrmailbox_t*, uint32_t msg_id, uint32_t chat_id);
+void            mrmailbox_update_chat_last_msg__                  (mrmailbox_t*, uint32_t chat_id);
 void            mrmailbox_update_msg_state__                      (mrmailbox_t*, uint32_t msg_id, int state);
 void            mrmailbox_delete_msg_on_imap                      (mrmailbox_t* mailbox, mrjob_t* job);
 int             mrmailbox_mdn_from_ext__                          (mrmailbox_t*, uint32_t from_id, const char* rfc724_mid, time_t, uint32_t* ret_chat_id, uint32_t* ret_msg_id); /* returns 1 if an event should be send */
 void            mrmailbox_send_mdn                                (mrmailbox_t*, mrjob_t* job);
-void            mrmailbox_markseen_msg_on_imap                    (mrmailbox_t* mailbox, mrjob_t* job);
+void            mrmailbox_markseen_msgs_on_imap                   (mrmailbox_t* mailbox, mrjob_t** jobs, int jobs_cnt);
 void            mrmailbox_markseen_mdn_on_imap                    (mrmailbox_t* mailbox, mrjob_t* job);
 uint32_t        mrmailbox_add_device_msg                          (mrmailbox_t*, uint32_t chat_id, const char* text);
 uint32_t        mrmailbox_add_device_msg__                        (mrmailbox_t*, uint32_t chat_id, const char* text, time_t timestamp);
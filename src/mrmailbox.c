@@ -20,6 +20,7 @@
  ******************************************************************************/
 
 
+#include <ctype.h>
 #include <sys/stat.h>
 #include <sys/types.h> /* for getpid() */
 #include <unistd.h>    /* for getpid() */
@@ -29,11 +30,15 @@
 #include "mrimap.h"
 #include "mrsmtp.h"
 #include "mrmimefactory.h"
+#include "mrmimeparser.h"
 #include "mrtools.h"
 #include "mrjob.h"
 #include "mrkey.h"
 #include "mrpgp.h"
 #include "mrapeerstate.h"
+#include "mrkeyring.h"
+#include "mrkeypool.h"
+#include "mrhash.h"
 
 
 /*******************************************************************************
@@ -60,10 +65,15 @@ static void cb_set_config(mrimap_t* imap, const char* key, const char* value)
 		mrsqlite3_set_config__(mailbox->m_sql, key, value);
 	mrsqlite3_unlock(mailbox->m_sql);
 }
-static void cb_receive_imf(mrimap_t* imap, const char* imf_raw_not_terminated, size_t imf_raw_bytes, const char* server_folder, uint32_t server_uid, uint32_t flags)
+static void cb_receive_imf(mrimap_t* imap, const mrimapfetched_t* msgs, int msgs_cnt, const char* server_folder)
 {
 	mrmailbox_t* mailbox = (mrmailbox_t*)imap->m_userData;
-	mrmailbox_receive_imf(mailbox, imf_raw_not_terminated, imf_raw_bytes, server_folder, server_uid, flags);
+	mrmailbox_receive_imf_batch(mailbox, msgs, msgs_cnt, server_folder);
+}
+static void cb_sync_msgs(mrimap_t* imap, const char* server_folder, const mrarray_t* server_uid_ranges, uint32_t flags)
+{
+	mrmailbox_t* mailbox = (mrmailbox_t*)imap->m_userData;
+	mrmailbox_sync_msgs_from_imap(mailbox, server_folder, server_uid_ranges, flags);
 }
 
 
@@ -105,16 +115,35 @@ mrmailbox_t* mrmailbox_new(mrmailboxcb_t cb, void* userdata, const char* os_name
 	}
 
 	pthread_mutex_init(&ths->m_log_ringbuf_critical, NULL);
+	pthread_mutex_init(&ths->m_blobdir_critical, NULL);
+	pthread_mutex_init(&ths->m_mimeparser_pool_critical, NULL);
 	pthread_mutex_init(&ths->m_smtpidle_condmutex, NULL);
 	pthread_cond_init(&ths->m_smtpidle_cond, NULL);
 
 	ths->m_magic    = MR_MAILBOX_MAGIC;
 	ths->m_sql      = mrsqlite3_new(ths);
+	mrsqlite3_set_readers(ths->m_sql, 2); /* read-only connections for the getters, see mrsqlite3_lock_reader() */
 	ths->m_cb       = cb? cb : cb_dummy;
 	ths->m_userdata = userdata;
-	ths->m_imap     = mrimap_new(cb_get_config, cb_set_config, cb_receive_imf, (void*)ths, ths);
+	ths->m_imap     = mrimap_new(cb_get_config, cb_set_config, cb_receive_imf, cb_sync_msgs, (void*)ths, ths);
 	ths->m_smtp     = mrsmtp_new(ths);
+	ths->m_imap_jobs = mrjobqueue_new();
+	ths->m_smtp_jobs = mrjobqueue_new();
 	ths->m_os_name  = strdup_keep_null(os_name);
+	ths->m_decode_buffer_bytes = MR_DECODE_BUFFER_BYTES;
+
+	ths->m_contact_cache = malloc(sizeof(mrhash_t));
+	ths->m_contact_cache_ids = malloc(sizeof(mrhash_t));
+	if( ths->m_contact_cache==NULL || ths->m_contact_cache_ids==NULL ) {
+		exit(24);
+	}
+	mrhash_init(ths->m_contact_cache, MRHASH_STRING, MRHASH_COPY);
+	mrhash_init(ths->m_contact_cache_ids, MRHASH_INT, MRHASH_NO_COPY);
+
+	if( (ths->m_peerstate_cache=malloc(sizeof(mrhash_t)))==NULL ) {
+		exit(62);
+	}
+	mrhash_init(ths->m_peerstate_cache, MRHASH_STRING, MRHASH_COPY);
 
 	mrpgp_init(ths);
 
@@ -164,9 +193,23 @@ void mrmailbox_unref(mrmailbox_t* mailbox)
 
 	mrimap_unref(mailbox->m_imap);
 	mrsmtp_unref(mailbox->m_smtp);
+	mrjobqueue_unref(mailbox->m_imap_jobs);
+	mrjobqueue_unref(mailbox->m_smtp_jobs);
 	mrsqlite3_unref(mailbox->m_sql);
 
+	mrmailbox_clear_contact_cache__(mailbox);
+	free(mailbox->m_contact_cache);
+	free(mailbox->m_contact_cache_ids);
+
+	mrapeerstate_clear_cache__(mailbox);
+	free(mailbox->m_peerstate_cache);
+	mrkeyring_clear_self_cache__(mailbox);
+
+	mrmailbox_clear_mimeparser_pool(mailbox);
+
 	pthread_mutex_destroy(&mailbox->m_log_ringbuf_critical);
+	pthread_mutex_destroy(&mailbox->m_blobdir_critical);
+	pthread_mutex_destroy(&mailbox->m_mimeparser_pool_critical);
 	pthread_cond_destroy(&mailbox->m_smtpidle_cond);
 	pthread_mutex_destroy(&mailbox->m_smtpidle_condmutex);
 
@@ -207,6 +250,11 @@ static void update_config_cache__(mrmailbox_t* ths, const char* key)
 	if( key==NULL || strcmp(key, "e2ee_enabled")==0 ) {
 		ths->m_e2ee_enabled = mrsqlite3_get_config_int__(ths->m_sql, "e2ee_enabled", MR_E2EE_DEFAULT_ENABLED);
 	}
+
+	if( key==NULL || strcmp(key, "decode_buffer_bytes")==0 ) {
+		int32_t val = mrsqlite3_get_config_int__(ths->m_sql, "decode_buffer_bytes", MR_DECODE_BUFFER_BYTES);
+		ths->m_decode_buffer_bytes = val>=MR_DECODE_BUFFER_MIN_BYTES? val : MR_DECODE_BUFFER_MIN_BYTES;
+	}
 }
 
 
@@ -264,6 +312,22 @@ int mrmailbox_open(mrmailbox_t* mailbox, const char* dbfile, const char* blobdir
 		}
 
 		update_config_cache__(mailbox, NULL);
+		mrmailbox_clear_contact_cache__(mailbox);
+		mrapeerstate_clear_cache__(mailbox);
+		mrkeyring_clear_self_cache__(mailbox);
+
+		mrjob_load_queues__(mailbox);
+
+		/* if there is no keypair yet, start generating one in the background;
+		it is used on configuring or when the first message is sent */
+		{
+			sqlite3_stmt* stmt = mrsqlite3_prepare_v2_(mailbox->m_sql, "SELECT id FROM keypairs LIMIT 1;");
+			int has_keypair = (stmt && sqlite3_step(stmt)==SQLITE_ROW);
+			sqlite3_finalize(stmt);
+			if( !has_keypair ) {
+				mrkeypool_fill(1, 1);
+			}
+		}
 
 		success = 1;
 
@@ -310,6 +374,12 @@ void mrmailbox_close(mrmailbox_t* mailbox)
 		free(mailbox->m_blobdir);
 		mailbox->m_blobdir = NULL;
 
+		mrjob_clear_queues(mailbox);
+
+		mrmailbox_clear_contact_cache__(mailbox);
+		mrapeerstate_clear_cache__(mailbox);
+		mrkeyring_clear_self_cache__(mailbox);
+
 	mrsqlite3_unlock(mailbox->m_sql);
 }
 
@@ -373,6 +443,9 @@ char* mrmailbox_get_blobdir(mrmailbox_t* mailbox)
  * - displayname  = Own name to use when sending messages.  MUAs are allowed to spread this way eg. using CC, defaults to empty
  * - selfstatus   = Own status to display eg. in email footers, defaults to a standard text
  * - e2ee_enabled = 0=no e2ee, 1=prefer encryption (default)
+ * - imap_fetch_batch_cnt   = max. number of messages downloaded with one IMAP command, defaults to 100
+ * - imap_fetch_batch_bytes = max. number of bytes downloaded with one IMAP command, defaults to 4 MB; a single larger message is always downloaded
+ * - decode_buffer_bytes    = attachments are decoded to the blob directory in slices of this number of bytes, defaults to 256 KB
  *
  * @memberof mrmailbox_t
  *
@@ -512,6 +585,11 @@ char* mrmailbox_get_info(mrmailbox_t* mailbox)
 	char *displayname = NULL, *temp = NULL, *l_readable_str = NULL, *l2_readable_str = NULL, *fingerprint_str = NULL;
 	mrloginparam_t *l = NULL, *l2 = NULL;
 	int contacts, chats, real_msgs, deaddrop_msgs, is_configured, dbversion, mdns_enabled, e2ee_enabled, prv_key_count, pub_key_count;
+	int contact_cache_cnt, contact_cache_hits, contact_cache_misses;
+	int peerstate_cache_cnt, peerstate_cache_hits, peerstate_cache_misses;
+	int key_cache_cnt; uint32_t key_cache_hits, key_cache_misses;
+	int keypool_ready, keypool_generating; uint32_t keypool_generated, keypool_taken;
+	uint32_t receive_cnt; double receive_ms[4];
 	mrkey_t* self_public = mrkey_new();
 
 	mrstrbuilder_t  ret;
@@ -555,6 +633,20 @@ char* mrmailbox_get_info(mrmailbox_t* mailbox)
 		pub_key_count = sqlite3_column_int(stmt, 0);
 		sqlite3_finalize(stmt);
 
+		contact_cache_cnt    = mrhash_count(mailbox->m_contact_cache);
+		contact_cache_hits   = mailbox->m_contact_cache_hits;
+		contact_cache_misses = mailbox->m_contact_cache_misses;
+
+		peerstate_cache_cnt    = mrhash_count(mailbox->m_peerstate_cache);
+		peerstate_cache_hits   = mailbox->m_peerstate_cache_hits;
+		peerstate_cache_misses = mailbox->m_peerstate_cache_misses;
+
+		receive_cnt   = mailbox->m_receive_cnt;
+		receive_ms[0] = mailbox->m_receive_parse_us    / 1000.0 / MR_MAX(receive_cnt, 1);
+		receive_ms[1] = mailbox->m_receive_decrypt_us  / 1000.0 / MR_MAX(receive_cnt, 1);
+		receive_ms[2] = mailbox->m_receive_simplify_us / 1000.0 / MR_MAX(receive_cnt, 1);
+		receive_ms[3] = mailbox->m_receive_apply_us    / 1000.0 / MR_MAX(receive_cnt, 1);
+
 		if( mrkey_load_self_public__(self_public, l2->m_addr, mailbox->m_sql) ) {
 			fingerprint_str = mrkey_get_formatted_fingerprint(self_public);
 		}
@@ -564,6 +656,9 @@ char* mrmailbox_get_info(mrmailbox_t* mailbox)
 
 	mrsqlite3_unlock(mailbox->m_sql);
 
+	mrpgp_get_key_cache_stat(&key_cache_cnt, &key_cache_hits, &key_cache_misses);
+	mrkeypool_get_stat(&keypool_ready, &keypool_generating, &keypool_generated, &keypool_taken);
+
 	l_readable_str = mrloginparam_get_readable(l);
 	l2_readable_str = mrloginparam_get_readable(l2);
 
@@ -587,6 +682,11 @@ char* mrmailbox_get_info(mrmailbox_t* mailbox)
 		"e2ee_enabled=%i\n"
 		"E2EE_DEFAULT_ENABLED=%i\n"
 		"Private keys=%i, public keys=%i, fingerprint=\n%s\n"
+		"Contact cache: %i entries, %i hits, %i misses\n"
+		"Peerstate cache: %i entries, %i hits, %i misses\n"
+		"Parsed key cache: %i keys, %i hits, %i misses\n"
+		"Keypair pool: %i ready, %i in generation, %i generated, %i taken\n"
+		"Received messages: %i, per message %.2f ms parsing, %.2f ms decrypting, %.2f ms simplifying, %.2f ms database\n"
 		"\n"
 		"Using Delta Chat Core v%i.%i.%i, SQLite %s-ts%i, libEtPan %i.%i, OpenSSL %i.%i.%i%c. Compiled " __DATE__ ", " __TIME__ " for %i bit usage.\n\n"
 		"Log excerpt:\n"
@@ -604,6 +704,11 @@ char* mrmailbox_get_info(mrmailbox_t* mailbox)
 		, e2ee_enabled
 		, MR_E2EE_DEFAULT_ENABLED
 		, prv_key_count, pub_key_count, fingerprint_str
+		, contact_cache_cnt, contact_cache_hits, contact_cache_misses
+		, peerstate_cache_cnt, peerstate_cache_hits, peerstate_cache_misses
+		, key_cache_cnt, (int)key_cache_hits, (int)key_cache_misses
+		, keypool_ready, keypool_generating, (int)keypool_generated, (int)keypool_taken
+		, (int)receive_cnt, receive_ms[0], receive_ms[1], receive_ms[2], receive_ms[3]
 
 		, MR_VERSION_MAJOR, MR_VERSION_MINOR, MR_VERSION_REVISION
 		, SQLITE_VERSION, sqlite3_threadsafe()   ,  libetpan_get_version_major(), libetpan_get_version_minor()
@@ -646,9 +751,9 @@ char* mrmailbox_get_info(mrmailbox_t* mailbox)
  ******************************************************************************/
 
 
-int mrmailbox_get_archived_count__(mrmailbox_t* mailbox)
+int mrmailbox_get_archived_count__(mrsqlite3_t* sql)
 {
-	sqlite3_stmt* stmt = mrsqlite3_predefine__(mailbox->m_sql, SELECT_COUNT_FROM_chats_WHERE_archived,
+	sqlite3_stmt* stmt = mrsqlite3_predefine__(sql, SELECT_COUNT_FROM_chats_WHERE_archived,
 		"SELECT COUNT(*) FROM chats WHERE blocked=0 AND archived=1;");
 	if( sqlite3_step(stmt) == SQLITE_ROW ) {
 		return sqlite3_column_int(stmt, 0);
@@ -686,24 +791,23 @@ int mrmailbox_get_archived_count__(mrmailbox_t* mailbox)
 mrchatlist_t* mrmailbox_get_chatlist(mrmailbox_t* mailbox, int listflags, const char* query_str, uint32_t query_id)
 {
 	int success = 0;
-	int db_locked = 0;
+	mrsqlite3_t* reader = NULL;
 	mrchatlist_t* obj = mrchatlist_new(mailbox);
 
 	if( mailbox == NULL || mailbox->m_magic != MR_MAILBOX_MAGIC ) {
 		goto cleanup;
 	}
 
-	mrsqlite3_lock(mailbox->m_sql);
-	db_locked = 1;
+	reader = mrsqlite3_lock_reader(mailbox->m_sql); /* do not wait for the transactions of the IMAP-thread */
 
-		if( !mrchatlist_load_from_db__(obj, listflags, query_str, query_id) ) {
+		if( !mrchatlist_load_from_db__(obj, reader, listflags, query_str, query_id) ) {
 			goto cleanup;
 		}
 
 		success = 1;
 
 cleanup:
-	if( db_locked ) { mrsqlite3_unlock(mailbox->m_sql); }
+	if( reader ) { mrsqlite3_unlock_reader(reader); }
 
 	if( success ) {
 		return obj;
@@ -1193,6 +1297,10 @@ mrarray_t* mrmailbox_get_fresh_msgs(mrmailbox_t* mailbox)
 
 		show_deaddrop = 0;//mrsqlite3_get_config_int__(mailbox->m_sql, "show_deaddrop", 0);
 
+		if( mrmailbox_get_fresh_msg_count_all__(mailbox) == 0 ) {
+			goto done; /* the usual case when polling, no need to join msgs, contacts and chats */
+		}
+
 		stmt = mrsqlite3_predefine__(mailbox->m_sql, SELECT_i_FROM_msgs_LEFT_JOIN_contacts_WHERE_fresh,
 			"SELECT m.id"
 				" FROM msgs m"
@@ -1206,6 +1314,7 @@ mrarray_t* mrmailbox_get_fresh_msgs(mrmailbox_t* mailbox)
 			mrarray_add_id(ret, sqlite3_column_int(stmt, 0));
 		}
 
+done:
 	mrsqlite3_unlock(mailbox->m_sql);
 	locked = 0;
 
@@ -1249,7 +1358,8 @@ mrarray_t* mrmailbox_get_chat_msgs(mrmailbox_t* mailbox, uint32_t chat_id, uint3
 {
 	clock_t       start = clock();
 
-	int           success = 0, locked = 0;
+	int           success = 0;
+	mrsqlite3_t*  reader = NULL;
 	mrarray_t*    ret = mrarray_new(mailbox, 512);
 	sqlite3_stmt* stmt = NULL;
 
@@ -1263,12 +1373,11 @@ mrarray_t* mrmailbox_get_chat_msgs(mrmailbox_t* mailbox, uint32_t chat_id, uint3
 		goto cleanup;
 	}
 
-	mrsqlite3_lock(mailbox->m_sql);
-	locked = 1;
+	reader = mrsqlite3_lock_reader(mailbox->m_sql); /* do not wait for the transactions of the IMAP-thread */
 
 		if( chat_id == MR_CHAT_ID_DEADDROP )
 		{
-			stmt = mrsqlite3_predefine__(mailbox->m_sql, SELECT_i_FROM_msgs_LEFT_JOIN_chats_contacts_WHERE_blocked,
+			stmt = mrsqlite3_predefine__(reader, SELECT_i_FROM_msgs_LEFT_JOIN_chats_contacts_WHERE_blocked,
 				"SELECT m.id, m.timestamp"
 					" FROM msgs m"
 					" LEFT JOIN chats ON m.chat_id=chats.id"
@@ -1281,7 +1390,7 @@ mrarray_t* mrmailbox_get_chat_msgs(mrmailbox_t* mailbox, uint32_t chat_id, uint3
 		}
 		else if( chat_id == MR_CHAT_ID_STARRED )
 		{
-			stmt = mrsqlite3_predefine__(mailbox->m_sql, SELECT_i_FROM_msgs_LEFT_JOIN_contacts_WHERE_starred,
+			stmt = mrsqlite3_predefine__(reader, SELECT_i_FROM_msgs_LEFT_JOIN_contacts_WHERE_starred,
 				"SELECT m.id, m.timestamp"
 					" FROM msgs m"
 					" LEFT JOIN contacts ct ON m.from_id=ct.id"
@@ -1292,7 +1401,7 @@ mrarray_t* mrmailbox_get_chat_msgs(mrmailbox_t* mailbox, uint32_t chat_id, uint3
 		}
 		else
 		{
-			stmt = mrsqlite3_predefine__(mailbox->m_sql, SELECT_i_FROM_msgs_LEFT_JOIN_contacts_WHERE_c,
+			stmt = mrsqlite3_predefine__(reader, SELECT_i_FROM_msgs_LEFT_JOIN_contacts_WHERE_c,
 				"SELECT m.id, m.timestamp"
 					" FROM msgs m"
 					//" LEFT JOIN contacts ct ON m.from_id=ct.id"
@@ -1325,13 +1434,13 @@ mrarray_t* mrmailbox_get_chat_msgs(mrmailbox_t* mailbox, uint32_t chat_id, uint3
 			mrarray_add_id(ret, curr_id);
 		}
 
-	mrsqlite3_unlock(mailbox->m_sql);
-	locked = 0;
+	mrsqlite3_unlock_reader(reader);
+	reader = NULL;
 
 	success = 1;
 
 cleanup:
-	if( locked ) { mrsqlite3_unlock(mailbox->m_sql); }
+	if( reader ) { mrsqlite3_unlock_reader(reader); }
 
 	mrmailbox_log_info(mailbox, 0, "Message list for chat #%i created in %.3f ms.", chat_id, (double)(clock()-start)*1000.0/CLOCKS_PER_SEC);
 
@@ -1347,14 +1456,221 @@ cleanup:
 }
 
 
+/**
+ * Get a part of the message IDs belonging to a chat.
+ * In contrast to mrmailbox_get_chat_msgs(), only `cnt` messages before or after
+ * a given message are returned, so UIs may load a chat step by step while scrolling.
+ * Loading a window costs the same for small and for huge chats.
+ *
+ * The messages are returned in the same order and with the same markers as
+ * from mrmailbox_get_chat_msgs(); a day marker is added before the first
+ * message of the window only if the message before it is from another day,
+ * so windows can be joined to a continuous list.
+ *
+ * @memberof mrmailbox_t
+ *
+ * @param mailbox The mailbox object as returned from mrmailbox_new().
+ *
+ * @param chat_id The chat ID of which the messages IDs should be queried.
+ *
+ * @param flags If set to MR_GCM_ADD_DAY_MARKER, the marker MR_MSG_ID_DAYMARKER will
+ *     be added before each day (regarding the local timezone).  Set this to 0 if you do not want this behaviour.
+ *
+ * @param marker1before An optional message ID.  If set and the message is in the window, the id MR_MSG_ID_MARKER1 will be added just
+ *   before the given ID in the returned array.  Set this to 0 if you do not want this behaviour.
+ *
+ * @param anchor_msg_id The message to start from, typically the first or the last message of a window
+ *   loaded before; the anchor itself is not returned.  Set this to 0 to start at the beginning
+ *   (cnt > 0) or at the end (cnt < 0) of the chat.
+ *
+ * @param cnt Number of messages to return.  If positive, messages newer than the anchor are returned,
+ *   if negative, messages older than the anchor are returned.
+ *   To open a chat with the newest 50 messages, use anchor_msg_id=0 and cnt=-50.
+ *
+ * @return Array of message IDs, must be mrarray_unref()'d when no longer used.
+ *     NULL on errors, eg. if the anchor message does not exist.
+ */
+mrarray_t* mrmailbox_get_chat_msgs_window(mrmailbox_t* mailbox, uint32_t chat_id, uint32_t flags, uint32_t marker1before, uint32_t anchor_msg_id, int cnt)
+{
+	clock_t       start = clock();
+
+	int           success = 0, i, row_cnt, limit = cnt<0? -cnt : cnt;
+	mrsqlite3_t*  reader = NULL;
+	mrarray_t*    ret = mrarray_new(mailbox, limit+16);
+	mrarray_t*    ids = mrarray_new(mailbox, limit+1);
+	mrarray_t*    timestamps = mrarray_new(mailbox, limit+1);
+	char*         q3 = NULL;
+	const char*   base = NULL;
+	sqlite3_stmt* stmt = NULL;
+	time_t        anchor_timestamp = 0, prev_timestamp = 0, curr_timestamp;
+	int           curr_day, last_day = 0;
+	long          cnv_to_local = mr_gm2local_offset();
+
+	if( mailbox==NULL || mailbox->m_magic != MR_MAILBOX_MAGIC || ret == NULL || ids == NULL || timestamps == NULL || cnt == 0 ) {
+		goto cleanup;
+	}
+
+	/* the same selections as in mrmailbox_get_chat_msgs(), the window is given by (timestamp, id),
+	for normal chats the selection and the order can be read directly from the index msgs_index8 */
+	if( chat_id == MR_CHAT_ID_DEADDROP ) {
+		base = "SELECT m.id, m.timestamp FROM msgs m"
+		       " LEFT JOIN chats ON m.chat_id=chats.id"
+		       " LEFT JOIN contacts ON m.from_id=contacts.id"
+		       " WHERE m.from_id!=" MR_STRINGIFY(MR_CONTACT_ID_SELF)
+		       "   AND m.hidden=0 "
+		       "   AND chats.blocked=" MR_STRINGIFY(MR_CHAT_DEADDROP_BLOCKED)
+		       "   AND contacts.blocked=0";
+	}
+	else if( chat_id == MR_CHAT_ID_STARRED ) {
+		base = "SELECT m.id, m.timestamp FROM msgs m"
+		       " LEFT JOIN contacts ct ON m.from_id=ct.id"
+		       " WHERE m.starred=1 "
+		       "   AND m.hidden=0 "
+		       "   AND ct.blocked=0";
+	}
+	else {
+		base = "SELECT m.id, m.timestamp FROM msgs m"
+		       " WHERE m.chat_id=?1 "
+		       "   AND m.hidden=0 ";
+	}
+
+	/* rows are read from the anchor outwards; for older messages we read one more row to get the timestamp of the message before the window */
+	q3 = sqlite3_mprintf("%s%s ORDER BY m.timestamp%s,m.id%s LIMIT ?5;", base,
+		anchor_msg_id==0? "" : (cnt>0? " AND m.timestamp>=?2 AND (m.timestamp>?3 OR m.id>?4)" : " AND m.timestamp<=?2 AND (m.timestamp<?3 OR m.id<?4)"),
+		cnt>0? "" : " DESC", cnt>0? "" : " DESC");
+
+	reader = mrsqlite3_lock_reader(mailbox->m_sql); /* do not wait for the transactions of the IMAP-thread */
+
+		if( anchor_msg_id ) {
+			stmt = mrsqlite3_prepare_v2_(reader, "SELECT timestamp FROM msgs WHERE id=?;");
+			sqlite3_bind_int(stmt, 1, anchor_msg_id);
+			if( sqlite3_step(stmt) != SQLITE_ROW ) {
+				goto cleanup;
+			}
+			anchor_timestamp = (time_t)sqlite3_column_int64(stmt, 0);
+			sqlite3_finalize(stmt);
+			stmt = NULL;
+		}
+
+		if( (stmt=mrsqlite3_prepare_v2_(reader, q3)) == NULL ) {
+			goto cleanup;
+		}
+		sqlite3_bind_int  (stmt, 1, chat_id);
+		sqlite3_bind_int64(stmt, 2, anchor_timestamp);
+		sqlite3_bind_int64(stmt, 3, anchor_timestamp);
+		sqlite3_bind_int  (stmt, 4, anchor_msg_id);
+		sqlite3_bind_int  (stmt, 5, cnt>0? limit : limit+1);
+		while( sqlite3_step(stmt) == SQLITE_ROW ) {
+			mrarray_add_id  (ids,        sqlite3_column_int  (stmt, 0));
+			mrarray_add_uint(timestamps, sqlite3_column_int64(stmt, 1));
+		}
+		sqlite3_finalize(stmt);
+		stmt = NULL;
+
+	mrsqlite3_unlock_reader(reader);
+	reader = NULL;
+
+	row_cnt = mrarray_get_cnt(ids);
+	if( cnt > 0 ) {
+		prev_timestamp = anchor_timestamp;
+	}
+	else if( row_cnt > limit ) {
+		row_cnt = limit;
+		prev_timestamp = (time_t)mrarray_get_uint(timestamps, limit);
+	}
+
+	if( prev_timestamp ) {
+		last_day = (prev_timestamp + cnv_to_local)/SECONDS_PER_DAY;
+	}
+
+	for( i = 0; i < row_cnt; i++ )
+	{
+		int row = cnt>0? i : row_cnt-1-i; /* older messages are read backwards */
+		uint32_t curr_id = mrarray_get_id(ids, row);
+
+		if( curr_id == marker1before ) {
+			mrarray_add_id(ret, MR_MSG_ID_MARKER1);
+		}
+
+		if( flags&MR_GCM_ADDDAYMARKER ) {
+			curr_timestamp = (time_t)mrarray_get_uint(timestamps, row);
+			curr_day = (curr_timestamp + cnv_to_local)/SECONDS_PER_DAY;
+			if( curr_day != last_day ) {
+				mrarray_add_id(ret, MR_MSG_ID_DAYMARKER);
+				last_day = curr_day;
+			}
+		}
+
+		mrarray_add_id(ret, curr_id);
+	}
+
+	success = 1;
+
+cleanup:
+	if( stmt ) { sqlite3_finalize(stmt); }
+	if( reader ) { mrsqlite3_unlock_reader(reader); }
+	if( q3 ) { sqlite3_free(q3); }
+	mrarray_unref(ids);
+	mrarray_unref(timestamps);
+
+	mrmailbox_log_info(mailbox, 0, "Message window for chat #%i created in %.3f ms.", chat_id, (double)(clock()-start)*1000.0/CLOCKS_PER_SEC);
+
+	if( success ) {
+		return ret;
+	}
+	else {
+		if( ret ) {
+			mrarray_unref(ret);
+		}
+		return NULL;
+	}
+}
+
+
+/* Convert a search string as entered by the user to an FTS5 query: every word is
+searched as a prefix, all words must match.  Words are quoted, so characters as `*`, `-` or `:`
+have no special meaning. */
+static char* get_fts_query(const char* query)
+{
+	mrstrbuilder_t ret;
+	const char*    p = query;
+	mrstrbuilder_init(&ret, 0);
+
+	while( *p )
+	{
+		while( *p==' ' || *p=='\t' || *p=='\n' || *p=='\r' ) {
+			p++;
+		}
+		if( *p == 0 ) {
+			break;
+		}
+
+		mrstrbuilder_cat(&ret, ret.m_buf[0]? " \"" : "\"");
+		while( *p && *p!=' ' && *p!='\t' && *p!='\n' && *p!='\r' ) {
+			char c[2] = { *p, 0 };
+			mrstrbuilder_cat(&ret, *p=='"'? "\"\"" : c);
+			p++;
+		}
+		mrstrbuilder_cat(&ret, "\"*");
+	}
+
+	return ret.m_buf;
+}
+
+
 /**
  * Search messages containing the given query string.
  * Searching can be done globally (chat_id=0) or in a specified chat only (chat_id
  * set).
  *
- * Global chat results are typically displayed using mrmsg_get_summary(), chat
- * search results may just hilite the corresponding messages and present a
- * prev/next button.
+ * Each word of the query matches words in the messages beginning with it,
+ * so the function can be used for incremental search as the user types.
+ * Messages are also found if the name of the sender begins with the query.
+ *
+ * Global chat results are typically displayed using mrmsg_get_summary()
+ * or mrmailbox_get_msg_search_snippet(); the best matching messages are returned first.
+ * Chat search results are returned in chronological order and may just hilite
+ * the corresponding messages and present a prev/next button.
  *
  * @memberof mrmailbox_t
  *
@@ -1374,7 +1690,7 @@ mrarray_t* mrmailbox_search_msgs(mrmailbox_t* mailbox, uint32_t chat_id, const c
 
 	int           success = 0, locked = 0;
 	mrarray_t*    ret = mrarray_new(mailbox, 100);
-	char*         strLikeInText = NULL, *strLikeBeg=NULL, *real_query = NULL;
+	char*         strLikeInText = NULL, *strLikeBeg=NULL, *real_query = NULL, *fts_query = NULL;
 	sqlite3_stmt* stmt = NULL;
 
 	if( mailbox==NULL || mailbox->m_magic != MR_MAILBOX_MAGIC || ret == NULL || query == NULL ) {
@@ -1390,17 +1706,45 @@ mrarray_t* mrmailbox_search_msgs(mrmailbox_t* mailbox, uint32_t chat_id, const c
 
 	strLikeInText = mr_mprintf("%%%s%%", real_query);
 	strLikeBeg = mr_mprintf("%s%%", real_query); /*for the name search, we use "Name%" which is fast as it can use the index ("%Name%" could not). */
+	fts_query = get_fts_query(real_query);
 
 	mrsqlite3_lock(mailbox->m_sql);
 	locked = 1;
 
-		/* Incremental search with "LIKE %query%" cannot take advantages from any index
-		("query%" could for COLLATE NOCASE indexes, see http://www.sqlite.org/optoverview.html#like_opt )
-		An alternative may be the FULLTEXT sqlite stuff, however, this does not really help with incremental search.
-		An extra table with all words and a COLLATE NOCASE indexes may help, however,
-		this must be updated all the time and probably consumes more time than we can save in tenthousands of searches.
-		For now, we just expect the following query to be fast enough :-) */
-		if( chat_id ) {
+		int show_deaddrop = 0;//mrsqlite3_get_config_int__(mailbox->m_sql, "show_deaddrop", 0);
+
+		if( mailbox->m_sql->m_has_fts )
+		{
+			/* the full-text index is used for the message texts, the sender names are searched using the indices over contacts.name and msgs.from_id;
+			rank is negative, the smaller the better, messages found by the sender name only come last */
+			#define FTS_QUR1 "SELECT m.id, m.timestamp FROM (" \
+			                 "   SELECT rowid AS id, rank FROM msgs_fts WHERE msgs_fts MATCH ? " \
+			                 "   UNION ALL SELECT id, 0 AS rank FROM msgs WHERE from_id IN (SELECT id FROM contacts WHERE name LIKE ?)) r" \
+			                 " INNER JOIN msgs m ON r.id=m.id" \
+			                 " LEFT JOIN contacts ct ON m.from_id=ct.id" \
+			                 " LEFT JOIN chats c ON m.chat_id=c.id" \
+			                 " WHERE m.hidden=0 AND ct.blocked=0"
+			if( chat_id ) {
+				stmt = mrsqlite3_predefine__(mailbox->m_sql, SELECT_i_FROM_msgs_fts_WHERE_chat_id_AND_query,
+					FTS_QUR1 " AND m.chat_id=? "
+					" GROUP BY m.id ORDER BY m.timestamp,m.id;"); /* chats starts with the oldest message*/
+				sqlite3_bind_text(stmt, 1, fts_query, -1, SQLITE_STATIC);
+				sqlite3_bind_text(stmt, 2, strLikeBeg, -1, SQLITE_STATIC);
+				sqlite3_bind_int (stmt, 3, chat_id);
+			}
+			else {
+				stmt = mrsqlite3_predefine__(mailbox->m_sql, SELECT_i_FROM_msgs_fts_WHERE_query,
+					FTS_QUR1 " AND m.chat_id>" MR_STRINGIFY(MR_CHAT_ID_LAST_SPECIAL) " AND (c.blocked=0 OR c.blocked=?)"
+					" GROUP BY m.id ORDER BY MIN(r.rank),m.timestamp DESC,m.id DESC;"); /* best matches first, then the newest message */
+				sqlite3_bind_text(stmt, 1, fts_query, -1, SQLITE_STATIC);
+				sqlite3_bind_text(stmt, 2, strLikeBeg, -1, SQLITE_STATIC);
+				sqlite3_bind_int (stmt, 3, show_deaddrop? MR_CHAT_DEADDROP_BLOCKED : 0);
+			}
+		}
+		else if( chat_id )
+		{
+			/* without the full-text index, "LIKE %query%" cannot take advantages from any index
+			("query%" could for COLLATE NOCASE indexes, see http://www.sqlite.org/optoverview.html#like_opt ) */
 			stmt = mrsqlite3_predefine__(mailbox->m_sql, SELECT_i_FROM_msgs_WHERE_chat_id_AND_query,
 				"SELECT m.id, m.timestamp FROM msgs m"
 				" LEFT JOIN contacts ct ON m.from_id=ct.id"
@@ -1412,8 +1756,8 @@ mrarray_t* mrmailbox_search_msgs(mrmailbox_t* mailbox, uint32_t chat_id, const c
 			sqlite3_bind_text(stmt, 2, strLikeInText, -1, SQLITE_STATIC);
 			sqlite3_bind_text(stmt, 3, strLikeBeg, -1, SQLITE_STATIC);
 		}
-		else {
-			int show_deaddrop = 0;//mrsqlite3_get_config_int__(mailbox->m_sql, "show_deaddrop", 0);
+		else
+		{
 			stmt = mrsqlite3_predefine__(mailbox->m_sql, SELECT_i_FROM_msgs_WHERE_query,
 				"SELECT m.id, m.timestamp FROM msgs m"
 				" LEFT JOIN contacts ct ON m.from_id=ct.id"
@@ -1442,6 +1786,7 @@ cleanup:
 	free(strLikeInText);
 	free(strLikeBeg);
 	free(real_query);
+	free(fts_query);
 
 	mrmailbox_log_info(mailbox, 0, "Message list for search \"%s\" in chat #%i created in %.3f ms.", query, chat_id, (double)(clock()-start)*1000.0/CLOCKS_PER_SEC);
 
@@ -1458,6 +1803,67 @@ cleanup:
 }
 
 
+/**
+ * Get the part of the message text matching a search query.
+ * The words found are enclosed by the given strings, eg. `<b>` and `</b>`,
+ * omitted text is marked by an ellipsis.
+ *
+ * The function can be used to display results of mrmailbox_search_msgs();
+ * for messages found by the sender name or if the full-text index is not
+ * available, NULL is returned and the UI may fall back to mrmsg_get_summary().
+ *
+ * @memberof mrmailbox_t
+ *
+ * @param mailbox The mailbox object as returned from mrmailbox_new().
+ *
+ * @param msg_id ID of the message as returned by mrmailbox_search_msgs().
+ *
+ * @param query The query as given to mrmailbox_search_msgs().
+ *
+ * @param hilite_begin String to insert before each found word, may be NULL.
+ *
+ * @param hilite_end String to insert after each found word, may be NULL.
+ *
+ * @return The snippet. Must be free()'d after usage. NULL if the message text does not match.
+ */
+char* mrmailbox_get_msg_search_snippet(mrmailbox_t* mailbox, uint32_t msg_id, const char* query, const char* hilite_begin, const char* hilite_end)
+{
+	char*         ret = NULL;
+	char*         fts_query = NULL;
+	sqlite3_stmt* stmt = NULL;
+
+	if( mailbox==NULL || mailbox->m_magic != MR_MAILBOX_MAGIC || query == NULL ) {
+		return NULL;
+	}
+
+	fts_query = get_fts_query(query);
+	if( fts_query[0]==0 ) {
+		goto cleanup;
+	}
+
+	mrsqlite3_lock(mailbox->m_sql);
+
+		if( mailbox->m_sql->m_has_fts )
+		{
+			stmt = mrsqlite3_predefine__(mailbox->m_sql, SELECT_snippet_FROM_msgs_fts_WHERE_id_AND_query,
+				"SELECT snippet(msgs_fts, 0, ?, ?, '...', 16) FROM msgs_fts WHERE msgs_fts MATCH ? AND rowid=?;");
+			sqlite3_bind_text(stmt, 1, hilite_begin? hilite_begin : "", -1, SQLITE_STATIC);
+			sqlite3_bind_text(stmt, 2, hilite_end? hilite_end : "", -1, SQLITE_STATIC);
+			sqlite3_bind_text(stmt, 3, fts_query, -1, SQLITE_STATIC);
+			sqlite3_bind_int (stmt, 4, msg_id);
+			if( sqlite3_step(stmt) == SQLITE_ROW ) {
+				ret = safe_strdup((const char*)sqlite3_column_text(stmt, 0));
+			}
+		}
+
+	mrsqlite3_unlock(mailbox->m_sql);
+
+cleanup:
+	free(fts_query);
+	return ret;
+}
+
+
 static void set_draft_int(mrmailbox_t* mailbox, mrchat_t* chat, uint32_t chat_id, const char* msg)
 {
 	sqlite3_stmt* stmt;
@@ -1544,11 +1950,8 @@ int mrmailbox_get_fresh_msg_count__(mrmailbox_t* mailbox, uint32_t chat_id)
 {
 	sqlite3_stmt* stmt = NULL;
 
-	stmt = mrsqlite3_predefine__(mailbox->m_sql, SELECT_COUNT_FROM_msgs_WHERE_state_AND_chat_id,
-		"SELECT COUNT(*) FROM msgs "
-		" WHERE state=" MR_STRINGIFY(MR_STATE_IN_FRESH)
-		"   AND hidden=0 "
-		"   AND chat_id=?;"); /* we have an index over the state-column, this should be sufficient as there are typically only few fresh messages */
+	stmt = mrsqlite3_predefine__(mailbox->m_sql, SELECT_fresh_cnt_FROM_chats_WHERE_id,
+		"SELECT fresh_cnt FROM chats WHERE id=?;"); /* maintained by the triggers on msgs, see mrsqlite3_open__() */
 	sqlite3_bind_int(stmt, 1, chat_id);
 
 	if( sqlite3_step(stmt) != SQLITE_ROW ) {
@@ -1559,11 +1962,27 @@ int mrmailbox_get_fresh_msg_count__(mrmailbox_t* mailbox, uint32_t chat_id)
 }
 
 
-uint32_t mrmailbox_get_last_deaddrop_fresh_msg__(mrmailbox_t* mailbox)
+/* Get the number of fresh messages in all chats that are not blocked; this is the sum of chats.fresh_cnt,
+so only the chats are read.  The result may be larger than the number of messages returned by mrmailbox_get_fresh_msgs()
+which also skips messages of blocked contacts, however, if it is 0, mrmailbox_get_fresh_msgs() returns nothing. */
+int mrmailbox_get_fresh_msg_count_all__(mrmailbox_t* mailbox)
+{
+	sqlite3_stmt* stmt = mrsqlite3_predefine__(mailbox->m_sql, SELECT_SUM_fresh_cnt_FROM_chats,
+		"SELECT SUM(fresh_cnt) FROM chats WHERE blocked=0;");
+
+	if( sqlite3_step(stmt) != SQLITE_ROW ) {
+		return 0;
+	}
+
+	return sqlite3_column_int(stmt, 0);
+}
+
+
+uint32_t mrmailbox_get_last_deaddrop_fresh_msg__(mrsqlite3_t* sql)
 {
 	sqlite3_stmt* stmt = NULL;
 
-	stmt = mrsqlite3_predefine__(mailbox->m_sql, SELECT_id_FROM_msgs_WHERE_fresh_AND_deaddrop,
+	stmt = mrsqlite3_predefine__(sql, SELECT_id_FROM_msgs_WHERE_fresh_AND_deaddrop,
 		"SELECT m.id "
 		" FROM msgs m "
 		" LEFT JOIN chats c ON c.id=m.chat_id "
@@ -1584,8 +2003,8 @@ int mrmailbox_get_total_msg_count__(mrmailbox_t* mailbox, uint32_t chat_id)
 {
 	sqlite3_stmt* stmt = NULL;
 
-	stmt = mrsqlite3_predefine__(mailbox->m_sql, SELECT_COUNT_FROM_msgs_WHERE_chat_id,
-		"SELECT COUNT(*) FROM msgs WHERE chat_id=?;");
+	stmt = mrsqlite3_predefine__(mailbox->m_sql, SELECT_total_cnt_FROM_chats_WHERE_id,
+		"SELECT total_cnt FROM chats WHERE id=?;");
 	sqlite3_bind_int(stmt, 1, chat_id);
 
 	if( sqlite3_step(stmt) != SQLITE_ROW ) {
@@ -1755,7 +2174,9 @@ int mrmailbox_get_total_msg_count(mrmailbox_t* mailbox, uint32_t chat_id)
 
 /**
  * Get the number of _fresh_ messages in a chat.  Typically used to implement
- * a badge with a number in the chatlist.
+ * a badge with a number in the chatlist.  The number is maintained together
+ * with the messages, so the function is cheap and may be called on every
+ * MR_EVENT_MSGS_CHANGED.
  *
  * @memberof mrmailbox_t
  *
@@ -1932,6 +2353,12 @@ cleanup:
 void mrmailbox_send_msg_to_imap(mrmailbox_t* mailbox, mrjob_t* job)
 {
 	mrmimefactory_t  mimefactory;
+	char*            spool_file = mrparam_get(job->m_param, MRP_FILE, NULL);
+	char*            spooled = NULL;
+	size_t           spooled_bytes = 0;
+	mrmsg_t*         msg = NULL;
+	const char*      data = NULL;
+	size_t           data_bytes = 0;
 	char*            server_folder = NULL;
 	uint32_t         server_uid = 0;
 
@@ -1946,28 +2373,57 @@ void mrmailbox_send_msg_to_imap(mrmailbox_t* mailbox, mrjob_t* job)
 		}
 	}
 
-	/* create message */
-	if( mrmimefactory_load_msg(&mimefactory, job->m_foreign_id)==0
-	 || mimefactory.m_from_addr == NULL ) {
-		goto cleanup; /* should not happen as we've sent the message to the SMTP server before */
+	/* use the bytes spooled by mrmailbox_send_msg_to_smtp(), if any; this way, the message is not rendered and encrypted
+	a second time and the copy in the "Sent" folder is exactly the message that went over SMTP */
+	if( spool_file && mr_read_file(spool_file, (void**)&spooled, &spooled_bytes, mailbox) )
+	{
+		msg = mrmsg_new();
+		mrsqlite3_lock(mailbox->m_sql);
+			int msg_ok = mrmsg_load_from_db__(msg, mailbox, job->m_foreign_id);
+		mrsqlite3_unlock(mailbox->m_sql);
+		if( !msg_ok ) {
+			goto cleanup; /* the message was deleted in between */
+		}
+		data       = spooled;
+		data_bytes = spooled_bytes;
 	}
+	else
+	{
+		/* create message */
+		if( mrmimefactory_load_msg(&mimefactory, job->m_foreign_id)==0
+		 || mimefactory.m_from_addr == NULL ) {
+			goto cleanup; /* should not happen as we've sent the message to the SMTP server before */
+		}
+
+		if( !mrmimefactory_render(&mimefactory) ) {
+			goto cleanup; /* should not happen as we've sent the message to the SMTP server before */
+		}
 
-	if( !mrmimefactory_render(&mimefactory) ) {
-		goto cleanup; /* should not happen as we've sent the message to the SMTP server before */
+		msg        = mimefactory.m_msg;
+		data       = mimefactory.m_out->str;
+		data_bytes = mimefactory.m_out->len;
 	}
 
-	if( !mrimap_append_msg(mailbox->m_imap, mimefactory.m_msg->m_timestamp, mimefactory.m_out->str, mimefactory.m_out->len, &server_folder, &server_uid) ) {
+	if( !mrimap_append_msg(mailbox->m_imap, msg->m_timestamp, data, data_bytes, &server_folder, &server_uid) ) {
 		mrjob_try_again_later(job, MR_STANDARD_DELAY);
 		goto cleanup;
 	}
 	else {
 		mrsqlite3_lock(mailbox->m_sql);
-			mrmailbox_update_server_uid__(mailbox, mimefactory.m_msg->m_rfc724_mid, server_folder, server_uid);
+			mrmailbox_update_server_uid__(mailbox, msg->m_rfc724_mid, server_folder, server_uid);
 		mrsqlite3_unlock(mailbox->m_sql);
 	}
 
 cleanup:
+	if( spool_file && job->m_start_again_at==0 && mr_file_exist(spool_file) ) {
+		mr_delete_file(spool_file, mailbox); /* the job is done or given up, the spooled message is no longer needed */
+	}
+	if( msg != mimefactory.m_msg ) {
+		mrmsg_unref(msg);
+	}
 	mrmimefactory_empty(&mimefactory);
+	free(spooled);
+	free(spool_file);
 	free(server_folder);
 }
 
@@ -2096,7 +2552,7 @@ static uint32_t mrmailbox_send_msg_i__(mrmailbox_t* mailbox, mrchat_t* chat, con
 	sqlite3_bind_int  (stmt,  6, msg->m_type);
 	sqlite3_bind_int  (stmt,  7, MR_STATE_OUT_PENDING);
 	sqlite3_bind_text (stmt,  8, msg->m_text? msg->m_text : "",  -1, SQLITE_STATIC);
-	sqlite3_bind_text (stmt,  9, msg->m_param->m_packed, -1, SQLITE_STATIC);
+	sqlite3_bind_text (stmt,  9, mrparam_get_packed(msg->m_param), -1, SQLITE_STATIC);
 	sqlite3_bind_int  (stmt, 10, msg->m_hidden);
 	if( sqlite3_step(stmt) != SQLITE_DONE ) {
 		mrmailbox_log_error(mailbox, 0, "Cannot send message, cannot insert to database.", chat->m_id);
@@ -2610,7 +3066,9 @@ uint32_t mrmailbox_add_device_msg__(mrmailbox_t* mailbox, uint32_t chat_id, cons
 		return 0;
 	}
 
-	return sqlite3_last_insert_rowid(mailbox->m_sql->m_cobj);
+	uint32_t msg_id = sqlite3_last_insert_rowid(mailbox->m_sql->m_cobj);
+	mrmailbox_update_chat_last_msg__(mailbox, chat_id);
+	return msg_id;
 }
 
 
@@ -3206,6 +3664,118 @@ cleanup:
  ******************************************************************************/
 
 
+/* Most incoming messages come from and go to addresses we have seen just before,
+so mrmailbox_add_or_lookup_contact__() keeps the last MR_CONTACT_CACHE_SIZE contacts in memory.
+The cache mirrors the columns of the contacts table that are needed to decide whether an update is needed;
+all functions modifying these columns must update the entry or drop it using contact_cache_invalidate__(). */
+struct mrcontactcacheentry_t
+{
+	uint32_t               m_id;
+	int                    m_origin;
+	int                    m_blocked;
+	char*                  m_addr;     /* as in the database, may differ in case from the address looked up */
+	char*                  m_name;     /* never NULL */
+	char*                  m_authname; /* never NULL */
+	mrcontactcacheentry_t* m_prev;
+	mrcontactcacheentry_t* m_next;
+};
+
+
+static void contact_cache_unlink__(mrmailbox_t* mailbox, mrcontactcacheentry_t* entry)
+{
+	if( entry->m_prev ) { entry->m_prev->m_next = entry->m_next; } else { mailbox->m_contact_cache_first = entry->m_next; }
+	if( entry->m_next ) { entry->m_next->m_prev = entry->m_prev; } else { mailbox->m_contact_cache_last = entry->m_prev; }
+	entry->m_prev = NULL;
+	entry->m_next = NULL;
+}
+
+
+static void contact_cache_link_first__(mrmailbox_t* mailbox, mrcontactcacheentry_t* entry)
+{
+	entry->m_prev = NULL;
+	entry->m_next = mailbox->m_contact_cache_first;
+	if( mailbox->m_contact_cache_first ) { mailbox->m_contact_cache_first->m_prev = entry; } else { mailbox->m_contact_cache_last = entry; }
+	mailbox->m_contact_cache_first = entry;
+}
+
+
+static void contact_cache_remove__(mrmailbox_t* mailbox, mrcontactcacheentry_t* entry)
+{
+	contact_cache_unlink__(mailbox, entry);
+	mrhash_insert(mailbox->m_contact_cache, entry->m_addr, strlen(entry->m_addr), NULL);
+	mrhash_insert(mailbox->m_contact_cache_ids, NULL, entry->m_id, NULL);
+	free(entry->m_addr);
+	free(entry->m_name);
+	free(entry->m_authname);
+	free(entry);
+}
+
+
+static mrcontactcacheentry_t* contact_cache_find__(mrmailbox_t* mailbox, const char* addr)
+{
+	mrcontactcacheentry_t* entry = (mrcontactcacheentry_t*)mrhash_find_str(mailbox->m_contact_cache, addr);
+	if( entry == NULL ) {
+		mailbox->m_contact_cache_misses++;
+		return NULL;
+	}
+
+	mailbox->m_contact_cache_hits++;
+	if( entry != mailbox->m_contact_cache_first ) {
+		contact_cache_unlink__(mailbox, entry);
+		contact_cache_link_first__(mailbox, entry);
+	}
+	return entry;
+}
+
+
+static mrcontactcacheentry_t* contact_cache_add__(mrmailbox_t* mailbox, uint32_t id, const char* addr, const char* name, const char* authname, int origin, int blocked)
+{
+	mrcontactcacheentry_t* entry;
+
+	if( mrhash_count(mailbox->m_contact_cache) >= MR_CONTACT_CACHE_SIZE && mailbox->m_contact_cache_last ) {
+		contact_cache_remove__(mailbox, mailbox->m_contact_cache_last);
+	}
+
+	if( (entry=calloc(1, sizeof(mrcontactcacheentry_t)))==NULL ) {
+		exit(25);
+	}
+	entry->m_id       = id;
+	entry->m_origin   = origin;
+	entry->m_blocked  = blocked;
+	entry->m_addr     = safe_strdup(addr);
+	entry->m_name     = safe_strdup(name);
+	entry->m_authname = safe_strdup(authname);
+
+	mrhash_insert(mailbox->m_contact_cache, entry->m_addr, strlen(entry->m_addr), entry);
+	mrhash_insert(mailbox->m_contact_cache_ids, NULL, id, entry);
+	contact_cache_link_first__(mailbox, entry);
+	return entry;
+}
+
+
+static void contact_cache_invalidate__(mrmailbox_t* mailbox, uint32_t contact_id)
+{
+	mrcontactcacheentry_t* entry = (mrcontactcacheentry_t*)mrhash_find(mailbox->m_contact_cache_ids, NULL, contact_id);
+	if( entry ) {
+		contact_cache_remove__(mailbox, entry);
+	}
+}
+
+
+/* Drop all cached contacts; must be called whenever the contacts table may have changed behind the cache,
+eg. on (re-)opening the database or on a rollback. */
+void mrmailbox_clear_contact_cache__(mrmailbox_t* mailbox)
+{
+	if( mailbox == NULL || mailbox->m_magic != MR_MAILBOX_MAGIC || mailbox->m_contact_cache == NULL ) {
+		return;
+	}
+
+	while( mailbox->m_contact_cache_first ) {
+		contact_cache_remove__(mailbox, mailbox->m_contact_cache_first);
+	}
+}
+
+
 int mrmailbox_real_contact_exists__(mrmailbox_t* mailbox, uint32_t contact_id)
 {
 	sqlite3_stmt* stmt;
@@ -3254,10 +3824,11 @@ uint32_t mrmailbox_add_or_lookup_contact__( mrmailbox_t* mailbox,
 {
 	#define       CONTACT_MODIFIED 1
 	#define       CONTACT_CREATED  2
-	sqlite3_stmt* stmt;
-	uint32_t      row_id = 0;
-	int           dummy;
-	char*         addr = NULL;
+	sqlite3_stmt*          stmt;
+	uint32_t               row_id = 0;
+	int                    dummy;
+	char*                  addr = NULL;
+	mrcontactcacheentry_t* entry = NULL;
 
 	if( sth_modified == NULL ) {
 		sth_modified = &dummy;
@@ -3281,23 +3852,35 @@ uint32_t mrmailbox_add_or_lookup_contact__( mrmailbox_t* mailbox,
 
 	/* insert email-address to database or modify the record with the given email-address.
 	we treat all email-addresses case-insensitive. */
-	stmt = mrsqlite3_predefine__(mailbox->m_sql, SELECT_inao_FROM_contacts_a,
-		"SELECT id, name, addr, origin, authname FROM contacts WHERE addr=? COLLATE NOCASE;");
-	sqlite3_bind_text(stmt, 1, (const char*)addr, -1, SQLITE_STATIC);
-	if( sqlite3_step(stmt) == SQLITE_ROW )
+	if( (entry=contact_cache_find__(mailbox, addr)) == NULL )
 	{
-		const char  *row_name, *row_addr, *row_authname;
-		int         row_origin, update_addr = 0, update_name = 0, update_authname = 0;
+		stmt = mrsqlite3_predefine__(mailbox->m_sql, SELECT_inaoab_FROM_contacts_a,
+			"SELECT id, name, addr, origin, authname, blocked FROM contacts WHERE addr=? COLLATE NOCASE;");
+		sqlite3_bind_text(stmt, 1, (const char*)addr, -1, SQLITE_STATIC);
+		if( sqlite3_step(stmt) == SQLITE_ROW )
+		{
+			const char* row_name     = (const char*)sqlite3_column_text(stmt, 1);
+			const char* row_addr     = (const char*)sqlite3_column_text(stmt, 2);
+			const char* row_authname = (const char*)sqlite3_column_text(stmt, 4);
+			entry = contact_cache_add__(mailbox,
+				sqlite3_column_int(stmt, 0),
+				row_addr? row_addr : addr,
+				row_name? row_name : "",
+				row_authname? row_authname : "",
+				sqlite3_column_int(stmt, 3),
+				sqlite3_column_int(stmt, 5));
+		}
+	}
 
-		row_id       = sqlite3_column_int(stmt, 0);
-		row_name     = (const char*)sqlite3_column_text(stmt, 1); if( row_name == NULL ) { row_name = ""; }
-		row_addr     = (const char*)sqlite3_column_text(stmt, 2); if( row_addr == NULL ) { row_addr = addr; }
-		row_origin   = sqlite3_column_int(stmt, 3);
-		row_authname = (const char*)sqlite3_column_text(stmt, 4); if( row_authname == NULL ) { row_authname = ""; }
+	if( entry )
+	{
+		int update_addr = 0, update_name = 0, update_authname = 0;
+
+		row_id = entry->m_id;
 
 		if( name && name[0] ) {
-			if( row_name && row_name[0] ) {
-				if( origin>=row_origin && strcmp(name, row_name)!=0 ) {
+			if( entry->m_name[0] ) {
+				if( origin>=entry->m_origin && strcmp(name, entry->m_name)!=0 ) {
 					update_name = 1;
 				}
 			}
@@ -3305,23 +3888,23 @@ uint32_t mrmailbox_add_or_lookup_contact__( mrmailbox_t* mailbox,
 				update_name = 1;
 			}
 
-			if( origin == MR_ORIGIN_INCOMING_UNKNOWN_FROM && strcmp(name, row_authname)!=0 ) {
+			if( origin == MR_ORIGIN_INCOMING_UNKNOWN_FROM && strcmp(name, entry->m_authname)!=0 ) {
 				update_authname = 1;
 			}
 		}
 
-		if( origin>=row_origin && strcmp(addr, row_addr)!=0 /*really compare case-sensitive here*/ ) {
+		if( origin>=entry->m_origin && strcmp(addr, entry->m_addr)!=0 /*really compare case-sensitive here*/ ) {
 			update_addr = 1;
 		}
 
-		if( update_name || update_authname || update_addr || origin>row_origin )
+		if( update_name || update_authname || update_addr || origin>entry->m_origin )
 		{
 			stmt = mrsqlite3_predefine__(mailbox->m_sql, UPDATE_contacts_nao_WHERE_i,
 				"UPDATE contacts SET name=?, addr=?, origin=?, authname=? WHERE id=?;");
-			sqlite3_bind_text(stmt, 1, update_name?       name   : row_name, -1, SQLITE_STATIC);
-			sqlite3_bind_text(stmt, 2, update_addr?       addr   : row_addr, -1, SQLITE_STATIC);
-			sqlite3_bind_int (stmt, 3, origin>row_origin? origin : row_origin);
-			sqlite3_bind_text(stmt, 4, update_authname?   name   : row_authname, -1, SQLITE_STATIC);
+			sqlite3_bind_text(stmt, 1, update_name?       name   : entry->m_name, -1, SQLITE_STATIC);
+			sqlite3_bind_text(stmt, 2, update_addr?       addr   : entry->m_addr, -1, SQLITE_STATIC);
+			sqlite3_bind_int (stmt, 3, origin>entry->m_origin? origin : entry->m_origin);
+			sqlite3_bind_text(stmt, 4, update_authname?   name   : entry->m_authname, -1, SQLITE_STATIC);
 			sqlite3_bind_int (stmt, 5, row_id);
 			sqlite3_step     (stmt);
 
@@ -3337,6 +3920,12 @@ uint32_t mrmailbox_add_or_lookup_contact__( mrmailbox_t* mailbox,
 				sqlite3_step     (stmt);
 			}
 
+			/* keep the cache in sync with the database */
+			if( update_name )     { free(entry->m_name);     entry->m_name     = safe_strdup(name); }
+			if( update_addr )     { free(entry->m_addr);     entry->m_addr     = safe_strdup(addr); }
+			if( update_authname ) { free(entry->m_authname); entry->m_authname = safe_strdup(name); }
+			if( origin>entry->m_origin ) { entry->m_origin = origin; }
+
 			*sth_modified = CONTACT_MODIFIED;
 		}
 	}
@@ -3350,6 +3939,7 @@ uint32_t mrmailbox_add_or_lookup_contact__( mrmailbox_t* mailbox,
 		if( sqlite3_step(stmt) == SQLITE_DONE )
 		{
 			row_id = sqlite3_last_insert_rowid(mailbox->m_sql->m_cobj);
+			contact_cache_add__(mailbox, row_id, addr, name? name : "", "", origin, 0);
 			*sth_modified = CONTACT_CREATED;
 		}
 		else
@@ -3376,14 +3966,25 @@ void mrmailbox_scaleup_contact_origin__(mrmailbox_t* mailbox, uint32_t contact_i
 	sqlite3_bind_int(stmt, 2, contact_id);
 	sqlite3_bind_int(stmt, 3, origin);
 	sqlite3_step(stmt);
+
+	mrcontactcacheentry_t* entry = (mrcontactcacheentry_t*)mrhash_find(mailbox->m_contact_cache_ids, NULL, contact_id);
+	if( entry && entry->m_origin < origin ) {
+		entry->m_origin = origin;
+	}
 }
 
 
 int mrmailbox_is_contact_blocked__(mrmailbox_t* mailbox, uint32_t contact_id)
 {
 	int          is_blocked = 0;
-	mrcontact_t* contact = mrcontact_new(mailbox);
+	mrcontact_t* contact = NULL;
 
+	mrcontactcacheentry_t* entry = (mrcontactcacheentry_t*)mrhash_find(mailbox->m_contact_cache_ids, NULL, contact_id);
+	if( entry ) {
+		return entry->m_blocked? 1 : 0;
+	}
+
+	contact = mrcontact_new(mailbox);
 	if( mrcontact_load_from_db__(contact, mailbox->m_sql, contact_id) ) { /* we could optimize this by loading only the needed fields */
 		if( contact->m_blocked ) {
 			is_blocked = 1;
@@ -3399,10 +4000,20 @@ int mrmailbox_get_contact_origin__(mrmailbox_t* mailbox, uint32_t contact_id, in
 {
 	int          ret = 0;
 	int          dummy; if( ret_blocked==NULL ) { ret_blocked = &dummy; }
-	mrcontact_t* contact = mrcontact_new(mailbox);
+	mrcontact_t* contact = NULL;
 
 	*ret_blocked = 0;
 
+	mrcontactcacheentry_t* entry = (mrcontactcacheentry_t*)mrhash_find(mailbox->m_contact_cache_ids, NULL, contact_id);
+	if( entry ) {
+		if( entry->m_blocked ) {
+			*ret_blocked = 1;
+			return 0;
+		}
+		return entry->m_origin;
+	}
+
+	contact = mrcontact_new(mailbox);
 	if( !mrcontact_load_from_db__(contact, mailbox->m_sql, contact_id) ) { /* we could optimize this by loading only the needed fields */
 		goto cleanup;
 	}
@@ -3549,7 +4160,8 @@ cleanup:
  *     - if the flag MR_GCL_VERIFIED_ONLY is set, only verified contacts are returned.
  *       if MR_GCL_VERIFIED_ONLY is not set, verified and unverified contacts are returned.
  * @param query A string to filter the list.  Typically used to implement an
- *     incremental search.  NULL for no filtering.
+ *     incremental search.  Each word of the query matches contacts with a word
+ *     of the name or a part of the address beginning with it.  NULL for no filtering.
  *
  * @return An array containing all contact IDs.  Must be mrarray_unref()'d
  *     after usage.
@@ -3563,6 +4175,7 @@ mrarray_t* mrmailbox_get_contacts(mrmailbox_t* mailbox, uint32_t listflags, cons
 	int           add_self = 0;
 	mrarray_t*    ret = mrarray_new(mailbox, 100);
 	char*         s3strLikeCmd = NULL;
+	char*         fts_query = NULL;
 	sqlite3_stmt* stmt;
 
 	if( mailbox == NULL || mailbox->m_magic != MR_MAILBOX_MAGIC ) {
@@ -3574,22 +4187,56 @@ mrarray_t* mrmailbox_get_contacts(mrmailbox_t* mailbox, uint32_t listflags, cons
 
 		self_addr = mrsqlite3_get_config__(mailbox->m_sql, "configured_addr", ""); /* we add MR_CONTACT_ID_SELF explicitly; so avoid doubles if the address is present as a normal entry for some case */
 
-		if( (listflags&MR_GCL_VERIFIED_ONLY) || query )
+		if( query && mailbox->m_sql->m_has_contacts_fts )
+		{
+			const char* p = query;
+			while( *p && !isalnum((unsigned char)*p) && !((unsigned char)*p&0x80) ) {
+				p++;
+			}
+			if( *p ) {
+				fts_query = get_fts_query(query); /* a query without any word character as "@" is not found by the index, use LIKE then */
+			}
+		}
+
+		if( fts_query )
+		{
+			/* every word of the query must match the beginning of a word of the name or of a part of the address */
+			stmt = mrsqlite3_predefine__(mailbox->m_sql, SELECT_id_FROM_contacts_fts_WHERE_query_ORDER_BY,
+				"SELECT id FROM contacts"
+					" WHERE id IN (SELECT rowid FROM contacts_fts WHERE contacts_fts MATCH ?)"
+					" AND addr!=? AND id>" MR_STRINGIFY(MR_CONTACT_ID_LAST_SPECIAL) " AND origin>=" MR_STRINGIFY(MR_ORIGIN_MIN_CONTACT_LIST) " AND blocked=0"
+					" AND verified>=?"
+					" ORDER BY sort_key,id;");
+			sqlite3_bind_text(stmt, 1, fts_query, -1, SQLITE_STATIC);
+			sqlite3_bind_text(stmt, 2, self_addr, -1, SQLITE_STATIC);
+			sqlite3_bind_int (stmt, 3, (listflags&MR_GCL_VERIFIED_ONLY)? 1 : 0);
+		}
+		else if( (listflags&MR_GCL_VERIFIED_ONLY) || query )
 		{
 			if( (s3strLikeCmd=sqlite3_mprintf("%%%s%%", query? query : ""))==NULL ) {
 				goto cleanup;
 			}
 			stmt = mrsqlite3_predefine__(mailbox->m_sql, SELECT_id_FROM_contacts_WHERE_query_ORDER_BY,
-				"SELECT c.id FROM contacts c"
-					" LEFT JOIN acpeerstates ps ON c.addr=ps.addr "
-					" WHERE c.addr!=? AND c.id>" MR_STRINGIFY(MR_CONTACT_ID_LAST_SPECIAL) " AND c.origin>=" MR_STRINGIFY(MR_ORIGIN_MIN_CONTACT_LIST) " AND c.blocked=0 AND (c.name LIKE ? OR c.addr LIKE ?)" /* see comments in mrmailbox_search_msgs() about the LIKE operator */
-					" AND (1=? OR LENGTH(ps.verified_key_fingerprint)!=0) "
-					" ORDER BY LOWER(c.name||c.addr),c.id;");
+				"SELECT id FROM contacts"
+					" WHERE addr!=? AND id>" MR_STRINGIFY(MR_CONTACT_ID_LAST_SPECIAL) " AND origin>=" MR_STRINGIFY(MR_ORIGIN_MIN_CONTACT_LIST) " AND blocked=0 AND (name LIKE ? OR addr LIKE ?)" /* see comments in mrmailbox_search_msgs() about the LIKE operator */
+					" AND verified>=?"
+					" ORDER BY sort_key,id;");
 			sqlite3_bind_text(stmt, 1, self_addr, -1, SQLITE_STATIC);
 			sqlite3_bind_text(stmt, 2, s3strLikeCmd, -1, SQLITE_STATIC);
 			sqlite3_bind_text(stmt, 3, s3strLikeCmd, -1, SQLITE_STATIC);
-			sqlite3_bind_int (stmt, 4, (listflags&MR_GCL_VERIFIED_ONLY)? 0/*force checking for verified_key*/ : 1/*force statement being always true*/);
+			sqlite3_bind_int (stmt, 4, (listflags&MR_GCL_VERIFIED_ONLY)? 1 : 0);
+		}
+		else
+		{
+			stmt = mrsqlite3_predefine__(mailbox->m_sql, SELECT_id_FROM_contacts_ORDER_BY,
+				"SELECT id FROM contacts"
+					" WHERE addr!=? AND id>" MR_STRINGIFY(MR_CONTACT_ID_LAST_SPECIAL) " AND origin>=" MR_STRINGIFY(MR_ORIGIN_MIN_CONTACT_LIST) " AND blocked=0"
+					" ORDER BY sort_key,id;"); /* read in the order of contacts_index3, no sorting needed */
+			sqlite3_bind_text(stmt, 1, self_addr, -1, SQLITE_STATIC);
+		}
 
+		if( (listflags&MR_GCL_VERIFIED_ONLY) || query )
+		{
 			self_name  = mrsqlite3_get_config__(mailbox->m_sql, "displayname", "");
 			self_name2 = mrstock_str(MR_STR_SELF);
 			if( query==NULL || mr_str_contains(self_addr, query) || mr_str_contains(self_name, query) || mr_str_contains(self_name2, query) ) {
@@ -3598,12 +4245,6 @@ mrarray_t* mrmailbox_get_contacts(mrmailbox_t* mailbox, uint32_t listflags, cons
 		}
 		else
 		{
-			stmt = mrsqlite3_predefine__(mailbox->m_sql, SELECT_id_FROM_contacts_ORDER_BY,
-				"SELECT id FROM contacts"
-					" WHERE addr!=? AND id>" MR_STRINGIFY(MR_CONTACT_ID_LAST_SPECIAL) " AND origin>=" MR_STRINGIFY(MR_ORIGIN_MIN_CONTACT_LIST) " AND blocked=0"
-					" ORDER BY LOWER(name||addr),id;");
-			sqlite3_bind_text(stmt, 1, self_addr, -1, SQLITE_STATIC);
-
 			add_self = 1;
 		}
 
@@ -3622,6 +4263,7 @@ mrarray_t* mrmailbox_get_contacts(mrmailbox_t* mailbox, uint32_t listflags, cons
 cleanup:
 	if( locked ) { mrsqlite3_unlock(mailbox->m_sql); }
 	if( s3strLikeCmd ) { sqlite3_free(s3strLikeCmd); }
+	free(fts_query);
 	free(self_addr);
 	free(self_name);
 	free(self_name2);
@@ -3835,6 +4477,8 @@ void mrmailbox_block_contact(mrmailbox_t* mailbox, uint32_t contact_id, int new_
 					goto cleanup;
 				}
 
+				contact_cache_invalidate__(mailbox, contact_id);
+
 				/* also (un)block all chats with _only_ this contact - we do not delete them to allow a non-destructive blocking->unblocking.
 				(Maybe, beside normal chats (type=100) we should also block group chats with only this user.
 				However, I'm not sure about this point; it may be confusing if the user wants to add other people;
@@ -4046,6 +4690,8 @@ int mrmailbox_delete_contact(mrmailbox_t* mailbox, uint32_t contact_id)
 			goto cleanup;
 		}
 
+		contact_cache_invalidate__(mailbox, contact_id);
+
 	mrsqlite3_unlock(mailbox->m_sql);
 	locked = 0;
 
@@ -4084,11 +4730,55 @@ int mrmailbox_contact_addr_equals__(mrmailbox_t* mailbox, uint32_t contact_id, c
 
 void mrmailbox_update_msg_chat_id__(mrmailbox_t* mailbox, uint32_t msg_id, uint32_t chat_id)
 {
-    sqlite3_stmt* stmt = mrsqlite3_predefine__(mailbox->m_sql, UPDATE_msgs_SET_chat_id_WHERE_id,
+	uint32_t old_chat_id = 0;
+
+	sqlite3_stmt* stmt = mrsqlite3_predefine__(mailbox->m_sql, SELECT_chat_id_FROM_msgs_WHERE_id,
+		"SELECT chat_id FROM msgs WHERE id=?;");
+	sqlite3_bind_int(stmt, 1, msg_id);
+	if( sqlite3_step(stmt) == SQLITE_ROW ) {
+		old_chat_id = sqlite3_column_int(stmt, 0);
+	}
+
+	stmt = mrsqlite3_predefine__(mailbox->m_sql, UPDATE_msgs_SET_chat_id_WHERE_id,
 		"UPDATE msgs SET chat_id=? WHERE id=?;");
 	sqlite3_bind_int(stmt, 1, chat_id);
 	sqlite3_bind_int(stmt, 2, msg_id);
 	sqlite3_step(stmt);
+
+	if( old_chat_id != chat_id ) {
+		mrmailbox_update_chat_last_msg__(mailbox, old_chat_id);
+		mrmailbox_update_chat_last_msg__(mailbox, chat_id);
+	}
+}
+
+
+/* Recalculate chats.last_msg_id and chats.last_timestamp, the newest non-hidden message of the chat.
+The columns are used by the chatlist instead of looking up the newest message of each chat on every load,
+so this function must be called whenever a message is added to a chat, moved away or deleted from it.
+For the special chats (trash etc.) nothing is done. */
+void mrmailbox_update_chat_last_msg__(mrmailbox_t* mailbox, uint32_t chat_id)
+{
+	uint32_t last_msg_id = 0;
+	time_t   last_timestamp = 0;
+
+	if( chat_id <= MR_CHAT_ID_LAST_SPECIAL ) {
+		return;
+	}
+
+	sqlite3_stmt* stmt = mrsqlite3_predefine__(mailbox->m_sql, SELECT_it_FROM_msgs_WHERE_chat_id_ORDER_BY_timestamp_LIMIT_1,
+		"SELECT id, timestamp FROM msgs WHERE chat_id=? AND hidden=0 ORDER BY timestamp DESC, id DESC LIMIT 1;");
+	sqlite3_bind_int(stmt, 1, chat_id);
+	if( sqlite3_step(stmt) == SQLITE_ROW ) {
+		last_msg_id    = sqlite3_column_int  (stmt, 0);
+		last_timestamp = sqlite3_column_int64(stmt, 1);
+	}
+
+	stmt = mrsqlite3_predefine__(mailbox->m_sql, UPDATE_chats_SET_last_msg_WHERE_id,
+		"UPDATE chats SET last_msg_id=?, last_timestamp=? WHERE id=?;");
+	sqlite3_bind_int  (stmt, 1, last_msg_id);
+	sqlite3_bind_int64(stmt, 2, last_timestamp);
+	sqlite3_bind_int  (stmt, 3, chat_id);
+	sqlite3_step(stmt);
 }
 
 
@@ -4188,6 +4878,55 @@ void mrmailbox_update_server_uid__(mrmailbox_t* mailbox, const char* rfc724_mid,
 }
 
 
+/* apply changes made on the server by another device, see sync_flags() in mrimap.c.
+`server_uid_ranges` contains pairs of the first and the last UID of a range, all ranges are applied in a single transaction.
+If the messages were expunged, we just forget the location as the message may be moved to another folder;
+if they were marked as seen, the messages are marked as seen locally, however, they are never marked as unseen again. */
+void mrmailbox_sync_msgs_from_imap(mrmailbox_t* mailbox, const char* server_folder, const mrarray_t* server_uid_ranges, uint32_t flags)
+{
+	sqlite3_stmt* stmt;
+	size_t        i, cnt;
+	int           changed = 0;
+
+	if( mailbox == NULL || mailbox->m_magic != MR_MAILBOX_MAGIC || server_folder == NULL || server_uid_ranges == NULL ) {
+		return;
+	}
+
+	cnt = mrarray_get_cnt(server_uid_ranges);
+
+	mrsqlite3_lock(mailbox->m_sql);
+	mrsqlite3_begin_transaction__(mailbox->m_sql);
+
+		for( i = 0; i+1 < cnt; i += 2 )
+		{
+			if( flags & MR_IMAP_EXPUNGED ) {
+				stmt = mrsqlite3_predefine__(mailbox->m_sql, UPDATE_msgs_SET_ss_WHERE_ss,
+					"UPDATE msgs SET server_folder='', server_uid=0 WHERE server_folder=? AND server_uid BETWEEN ? AND ?;");
+			}
+			else if( flags & MR_IMAP_SEEN ) {
+				stmt = mrsqlite3_predefine__(mailbox->m_sql, UPDATE_msgs_SET_state_WHERE_ss_AND_state,
+					"UPDATE msgs SET state=" MR_STRINGIFY(MR_STATE_IN_SEEN) " WHERE server_folder=? AND server_uid BETWEEN ? AND ? AND state IN(" MR_STRINGIFY(MR_STATE_IN_FRESH) "," MR_STRINGIFY(MR_STATE_IN_NOTICED) ");");
+			}
+			else {
+				break;
+			}
+			sqlite3_bind_text(stmt, 1, server_folder, -1, SQLITE_STATIC);
+			sqlite3_bind_int64(stmt, 2, mrarray_get_id(server_uid_ranges, i));
+			sqlite3_bind_int64(stmt, 3, mrarray_get_id(server_uid_ranges, i+1));
+			if( sqlite3_step(stmt) == SQLITE_DONE && (flags & MR_IMAP_SEEN) && sqlite3_changes(mailbox->m_sql->m_cobj) > 0 ) {
+				changed = 1;
+			}
+		}
+
+	mrsqlite3_commit__(mailbox->m_sql);
+	mrsqlite3_unlock(mailbox->m_sql);
+
+	if( changed ) {
+		mailbox->m_cb(mailbox, MR_EVENT_MSGS_CHANGED, 0, 0);
+	}
+}
+
+
 /**
  * Get a single message object of the type mrmsg_t.
  * For a list of messages in a chat, see mrmailbox_get_chat_msgs()
@@ -4621,6 +5360,8 @@ void mrmailbox_delete_msg_on_imap(mrmailbox_t* mailbox, mrjob_t* job)
 		sqlite3_bind_int(stmt, 1, msg->m_id);
 		sqlite3_step(stmt);
 
+		mrmailbox_update_chat_last_msg__(mailbox, msg->m_chat_id); /* normally, the message is in the trash and this does nothing */
+
 		stmt = mrsqlite3_predefine__(mailbox->m_sql, DELETE_FROM_msgs_mdns_WHERE_m,
 			"DELETE FROM msgs_mdns WHERE msg_id=?;");
 		sqlite3_bind_int(stmt, 1, msg->m_id);
@@ -4713,72 +5454,135 @@ void mrmailbox_delete_msgs(mrmailbox_t* mailbox, const uint32_t* msg_ids, int ms
  ******************************************************************************/
 
 
-void mrmailbox_markseen_msg_on_imap(mrmailbox_t* mailbox, mrjob_t* job)
+void mrmailbox_markseen_msgs_on_imap(mrmailbox_t* mailbox, mrjob_t** jobs, int jobs_cnt)
 {
-	int      locked = 0;
-	mrmsg_t* msg = mrmsg_new();
-	char*    new_server_folder = NULL;
-	uint32_t new_server_uid = 0;
-	int      in_ms_flags = 0, out_ms_flags = 0;
+	/* the jobs are grouped by the server folder of the messages and each group is handled by mrimap_markseen_msgs(),
+	so marking a whole chat as seen needs only a few commands independently of the number of messages */
+	int               locked = 0, i, j, group_cnt;
+	mrmsg_t**         msgs = NULL;
+	int*              in_ms_flags = NULL;
+	int*              group = NULL;
+	mrimapmarkseen_t* markseen = NULL;
+	char*             new_server_folder = NULL;
+
+	if( jobs_cnt <= 0 ) {
+		goto cleanup;
+	}
 
 	if( !mrimap_is_connected(mailbox->m_imap) ) {
 		mrmailbox_ll_connect_to_imap(mailbox, NULL);
 		if( !mrimap_is_connected(mailbox->m_imap) ) {
-			mrjob_try_again_later(job, MR_STANDARD_DELAY);
+			for( i = 0; i < jobs_cnt; i++ ) {
+				mrjob_try_again_later(jobs[i], MR_STANDARD_DELAY);
+			}
 			goto cleanup;
 		}
 	}
 
+	if( (msgs=calloc(jobs_cnt, sizeof(mrmsg_t*)))==NULL
+	 || (in_ms_flags=calloc(jobs_cnt, sizeof(int)))==NULL
+	 || (group=calloc(jobs_cnt, sizeof(int)))==NULL
+	 || (markseen=calloc(jobs_cnt, sizeof(mrimapmarkseen_t)))==NULL ) {
+		exit(46);
+	}
+
 	mrsqlite3_lock(mailbox->m_sql);
 	locked = 1;
 
-		if( !mrmsg_load_from_db__(msg, mailbox, job->m_foreign_id) ) {
-			goto cleanup;
-		}
+		int mdns_enabled = mrsqlite3_get_config_int__(mailbox->m_sql, "mdns_enabled", MR_MDNS_DEFAULT_ENABLED);
+
+		for( i = 0; i < jobs_cnt; i++ )
+		{
+			msgs[i] = mrmsg_new();
+			if( !mrmsg_load_from_db__(msgs[i], mailbox, jobs[i]->m_foreign_id)
+			 || msgs[i]->m_server_folder==NULL || msgs[i]->m_server_folder[0]==0 || msgs[i]->m_server_uid==0 ) {
+				mrmsg_unref(msgs[i]);
+				msgs[i] = NULL; /* job done */
+				continue;
+			}
+
+			/* add an additional job for sending the MDN (here in a thread for fast ui resonses) (an extra job as the MDN has a lower priority) */
+			if( mrparam_get_int(msgs[i]->m_param, MRP_WANTS_MDN, 0) /* MRP_WANTS_MDN is set only for one part of a multipart-message */
+			 && mdns_enabled ) {
+				in_ms_flags[i] |= MR_MS_SET_MDNSent_FLAG;
+			}
 
-		/* add an additional job for sending the MDN (here in a thread for fast ui resonses) (an extra job as the MDN has a lower priority) */
-		if( mrparam_get_int(msg->m_param, MRP_WANTS_MDN, 0) /* MRP_WANTS_MDN is set only for one part of a multipart-message */
-		 && mrsqlite3_get_config_int__(mailbox->m_sql, "mdns_enabled", MR_MDNS_DEFAULT_ENABLED) ) {
-			in_ms_flags |= MR_MS_SET_MDNSent_FLAG;
+			if( msgs[i]->m_is_msgrmsg ) {
+				in_ms_flags[i] |= MR_MS_ALSO_MOVE;
+			}
 		}
 
 	mrsqlite3_unlock(mailbox->m_sql);
 	locked = 0;
 
-	if( msg->m_is_msgrmsg ) {
-		in_ms_flags |= MR_MS_ALSO_MOVE;
-	}
-
-	if( mrimap_markseen_msg(mailbox->m_imap, msg->m_server_folder, msg->m_server_uid,
-		   in_ms_flags, &new_server_folder, &new_server_uid, &out_ms_flags) != 0 )
+	for( i = 0; i < jobs_cnt; i++ )
 	{
-		if( (new_server_folder && new_server_uid) || out_ms_flags&MR_MS_MDNSent_JUST_SET )
+		if( msgs[i] == NULL ) {
+			continue;
+		}
+
+		/* collect all messages in the folder of msgs[i]; handled messages are removed from `msgs` */
+		group_cnt = 0;
+		for( j = i; j < jobs_cnt; j++ ) {
+			if( msgs[j] && strcmp(msgs[j]->m_server_folder, msgs[i]->m_server_folder)==0 ) {
+				group[group_cnt] = j;
+				markseen[group_cnt].m_server_uid = msgs[j]->m_server_uid;
+				markseen[group_cnt].m_ms_flags   = in_ms_flags[j];
+				group_cnt++;
+			}
+		}
+
+		free(new_server_folder);
+		new_server_folder = NULL;
+		if( mrimap_markseen_msgs(mailbox->m_imap, msgs[i]->m_server_folder, markseen, group_cnt, &new_server_folder) != 0 )
 		{
 			mrsqlite3_lock(mailbox->m_sql);
 			locked = 1;
+			mrsqlite3_begin_transaction__(mailbox->m_sql);
 
-				if( new_server_folder && new_server_uid )
+				for( j = 0; j < group_cnt; j++ )
 				{
-					mrmailbox_update_server_uid__(mailbox, msg->m_rfc724_mid, new_server_folder, new_server_uid);
-				}
+					mrmsg_t* msg = msgs[group[j]];
 
-				if( out_ms_flags&MR_MS_MDNSent_JUST_SET )
-				{
-					mrjob_add__(mailbox, MRJ_SEND_MDN, msg->m_id, NULL, 0); /* results in a call to mrmailbox_send_mdn() */
+					if( new_server_folder && markseen[j].m_new_server_uid )
+					{
+						mrmailbox_update_server_uid__(mailbox, msg->m_rfc724_mid, new_server_folder, markseen[j].m_new_server_uid);
+					}
+
+					if( markseen[j].m_ret_ms_flags&MR_MS_MDNSent_JUST_SET )
+					{
+						mrjob_add__(mailbox, MRJ_SEND_MDN, msg->m_id, NULL, 0); /* results in a call to mrmailbox_send_mdn() */
+					}
 				}
 
+			mrsqlite3_commit__(mailbox->m_sql);
 			mrsqlite3_unlock(mailbox->m_sql);
 			locked = 0;
 		}
-	}
-	else
-	{
-		mrjob_try_again_later(job, MR_STANDARD_DELAY);
+		else
+		{
+			for( j = 0; j < group_cnt; j++ ) {
+				mrjob_try_again_later(jobs[group[j]], MR_STANDARD_DELAY);
+			}
+		}
+
+		for( j = 0; j < group_cnt; j++ ) {
+			mrmsg_unref(msgs[group[j]]);
+			msgs[group[j]] = NULL;
+		}
 	}
 
 cleanup:
 	if( locked ) { mrsqlite3_unlock(mailbox->m_sql); }
-	mrmsg_unref(msg);
+	if( msgs ) {
+		for( i = 0; i < jobs_cnt; i++ ) {
+			mrmsg_unref(msgs[i]);
+		}
+		free(msgs);
+	}
+	free(in_ms_flags);
+	free(group);
+	free(markseen);
 	free(new_server_folder);
 }
 
@@ -4858,7 +5662,7 @@ void mrmailbox_markseen_msgs(mrmailbox_t* mailbox, const uint32_t* msg_ids, int
 				if( curr_state == MR_STATE_IN_FRESH || curr_state == MR_STATE_IN_NOTICED ) {
 					mrmailbox_update_msg_state__(mailbox, msg_ids[i], MR_STATE_IN_SEEN);
 					mrmailbox_log_info(mailbox, 0, "Seen message #%i.", msg_ids[i]);
-					mrjob_add__(mailbox, MRJ_MARKSEEN_MSG_ON_IMAP, msg_ids[i], NULL, 0); /* results in a call to mrmailbox_markseen_msg_on_imap() */
+					mrjob_add__(mailbox, MRJ_MARKSEEN_MSG_ON_IMAP, msg_ids[i], NULL, 0); /* results in a call to mrmailbox_markseen_msgs_on_imap() */
 					send_event = 1;
 				}
 			}
@@ -247,6 +247,7 @@ void            mrmailbox_set_draft         (mrmailbox_t*, uint32_t chat_id, con
 
 #define         MR_GCM_ADDDAYMARKER         0x01
 mrarray_t*      mrmailbox_get_chat_msgs     (mrmailbox_t*, uint32_t chat_id, uint32_t flags, uint32_t marker1before);
+mrarray_t*      mrmailbox_get_chat_msgs_window (mrmailbox_t*, uint32_t chat_id, uint32_t flags, uint32_t marker1before, uint32_t anchor_msg_id, int cnt);
 int             mrmailbox_get_total_msg_count (mrmailbox_t*, uint32_t chat_id);
 int             mrmailbox_get_fresh_msg_count (mrmailbox_t*, uint32_t chat_id);
 mrarray_t*      mrmailbox_get_fresh_msgs    (mrmailbox_t*);
@@ -259,6 +260,7 @@ void            mrmailbox_delete_chat       (mrmailbox_t*, uint32_t chat_id);
 
 mrarray_t*      mrmailbox_get_chat_contacts (mrmailbox_t*, uint32_t chat_id);
 mrarray_t*      mrmailbox_search_msgs       (mrmailbox_t*, uint32_t chat_id, const char* query);
+char*           mrmailbox_get_msg_search_snippet (mrmailbox_t*, uint32_t msg_id, const char* query, const char* hilite_begin, const char* hilite_end);
 
 mrchat_t*       mrmailbox_get_chat          (mrmailbox_t*, uint32_t chat_id);
 
@@ -310,6 +312,8 @@ char*           mrmailbox_imex_has_backup   (mrmailbox_t*, const char* dir);
 int             mrmailbox_check_password    (mrmailbox_t*, const char* pw);
 char*           mrmailbox_initiate_key_transfer(mrmailbox_t*);
 int             mrmailbox_continue_key_transfer(mrmailbox_t*, uint32_t msg_id, const char* setup_code);
+void            mrmailbox_prepare_keypairs  (mrmailbox_t*, int cnt, int max_threads);
+int             mrmailbox_provision_keypairs(mrmailbox_t** mailboxes, int mailbox_cnt);
 
 
 /* out-of-band verification */
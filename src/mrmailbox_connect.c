@@ -193,6 +193,9 @@ static void mark_as_error(mrmailbox_t* mailbox, mrmsg_t* msg)
 void mrmailbox_send_msg_to_smtp(mrmailbox_t* mailbox, mrjob_t* job)
 {
 	mrmimefactory_t mimefactory;
+	int             upload_to_imap = 0;
+	mrparam_t*      imap_job_param = mrparam_new();
+	char*           spool_file = NULL;
 
 	mrmimefactory_init(&mimefactory, mailbox);
 
@@ -246,6 +249,22 @@ void mrmailbox_send_msg_to_smtp(mrmailbox_t* mailbox, mrjob_t* job)
 		}
 	}
 
+	/* spool the rendered message to the blobdir - the IMAP-job uploads exactly these bytes and
+	does not need to render and encrypt the message again.  If there is nothing rendered
+	(no recipients) or spooling fails, the IMAP-job renders the message itself. */
+	upload_to_imap = (mailbox->m_imap->m_server_flags&MR_NO_EXTRA_IMAP_UPLOAD)==0
+	 && !mrparam_exists(mimefactory.m_chat->m_param, MRP_SELFTALK)
+	 && mrparam_get_int(mimefactory.m_msg->m_param, MRP_CMD, 0)!=MR_CMD_SECUREJOIN_MESSAGE;
+
+	if( upload_to_imap && mimefactory.m_out ) {
+		char* desired_name = mr_mprintf("outbox-%i.eml", (int)mimefactory.m_msg->m_id);
+			spool_file = mr_get_fine_pathNfilename(mailbox->m_blobdir, desired_name);
+		free(desired_name);
+		if( spool_file && mr_write_file(spool_file, mimefactory.m_out->str, mimefactory.m_out->len, mailbox) ) {
+			mrparam_set(imap_job_param, MRP_FILE, spool_file);
+		}
+	}
+
 	/* done */
 	mrsqlite3_lock(mailbox->m_sql);
 	mrsqlite3_begin_transaction__(mailbox->m_sql);
@@ -269,10 +288,8 @@ void mrmailbox_send_msg_to_smtp(mrmailbox_t* mailbox, mrjob_t* job)
 			mrmsg_save_param_to_disk__(mimefactory.m_msg);
 		}
 
-		if( (mailbox->m_imap->m_server_flags&MR_NO_EXTRA_IMAP_UPLOAD)==0
-		 && mrparam_get(mimefactory.m_chat->m_param, MRP_SELFTALK, 0)==0
-		 && mrparam_get_int(mimefactory.m_msg->m_param, MRP_CMD, 0)!=MR_CMD_SECUREJOIN_MESSAGE ) {
-			mrjob_add__(mailbox, MRJ_SEND_MSG_TO_IMAP, mimefactory.m_msg->m_id, NULL, 0); /* send message to IMAP in another job */
+		if( upload_to_imap ) {
+			mrjob_add__(mailbox, MRJ_SEND_MSG_TO_IMAP, mimefactory.m_msg->m_id, mrparam_get_packed(imap_job_param), 0); /* send message to IMAP in another job */
 		}
 
 		// TODO: add to keyhistory
@@ -285,6 +302,8 @@ void mrmailbox_send_msg_to_smtp(mrmailbox_t* mailbox, mrjob_t* job)
 
 cleanup:
 	mrmimefactory_empty(&mimefactory);
+	mrparam_unref(imap_job_param);
+	free(spool_file);
 }
 
 
@@ -348,12 +367,19 @@ void mrmailbox_perform_smtp_idle(mrmailbox_t* mailbox)
 
 		mailbox->m_smtpidle_in_idleing = 1; // checked in suspend(), for idle-interruption the pthread-condition below is used
 
+		/* wait at most until the next job is due; new jobs interrupt the idle */
 		int r = 0;
+		time_t next_due = mrjob_get_next_due(mailbox, MR_SMTP_THREAD);
 		struct timespec timeToWait;
-		timeToWait.tv_sec  = time(NULL)+60;
+		timeToWait.tv_sec  = (next_due && next_due < time(NULL)+60)? next_due : time(NULL)+60;
 		timeToWait.tv_nsec = 0;
-		while( mailbox->m_smtpidle_condflag == 0 && mailbox->m_smtpidle_suspend == 0 && r == 0 ) {
-			r = pthread_cond_timedwait(&mailbox->m_smtpidle_cond, &mailbox->m_smtpidle_condmutex, &timeToWait); // unlock mutex -> wait -> lock mutex
+		while( (mailbox->m_smtpidle_condflag == 0 && r == 0) || mailbox->m_smtpidle_suspend ) {
+			if( mailbox->m_smtpidle_suspend ) {
+				pthread_cond_wait(&mailbox->m_smtpidle_cond, &mailbox->m_smtpidle_condmutex); // a suspended thread stays here until resumed, otherwise suspend() may never see m_smtpidle_in_idleing set
+			}
+			else {
+				r = pthread_cond_timedwait(&mailbox->m_smtpidle_cond, &mailbox->m_smtpidle_condmutex, &timeToWait); // unlock mutex -> wait -> lock mutex
+			}
 		}
 		mailbox->m_smtpidle_condflag = 0;
 
@@ -382,6 +408,9 @@ void mrmailbox_suspend_smtp_thread(mrmailbox_t* mailbox, int suspend)
 {
 	pthread_mutex_lock(&mailbox->m_smtpidle_condmutex);
 		mailbox->m_smtpidle_suspend = suspend;
+		if( !suspend ) {
+			pthread_cond_signal(&mailbox->m_smtpidle_cond);
+		}
 	pthread_mutex_unlock(&mailbox->m_smtpidle_condmutex);
 
 	// the smtp-thread may be in perform_jobs() when this function is called,
@@ -20,11 +20,13 @@
  ******************************************************************************/
 
 
+#include <unistd.h> /* for sysconf() */
 #include "mrmailbox_internal.h"
 #include "mrpgp.h"
 #include "mrapeerstate.h"
 #include "mraheader.h"
 #include "mrkeyring.h"
+#include "mrkeypool.h"
 #include "mrmimeparser.h"
 
 
@@ -209,7 +211,7 @@ static int load_or_generate_self_public_key__(mrmailbox_t* mailbox, mrkey_t* pub
 		key_creation_here = 1;
 		s_in_key_creation = 1;
 
-		/* seed the random generator */
+		/* seed the random generator (not needed if the keypair is taken from the pool, however, this is cheap) */
 		{
 			uintptr_t seed[4];
 			seed[0] = (uintptr_t)time(NULL);     /* time */
@@ -233,18 +235,26 @@ static int load_or_generate_self_public_key__(mrmailbox_t* mailbox, mrkey_t* pub
 		{
 			mrkey_t* private_key = mrkey_new();
 
-			mrmailbox_log_info(mailbox, 0, "Generating keypair ...");
-
 			mrsqlite3_unlock(mailbox->m_sql); /* SIC! unlock database during creation - otherwise the GUI may hang */
 
-				/* The public key must contain the following:
-				- a signing-capable primary key Kp
-				- a user id
-				- a self signature
-				- an encryption-capable subkey Ke
-				- a binding signature over Ke by Kp
-				(see https://autocrypt.readthedocs.io/en/latest/level0.html#type-p-openpgp-based-key-data )*/
-				key_created = mrpgp_create_keypair(mailbox, self_addr, public_key, private_key);
+				/* use a keypair generated in the background, if any; if a keypair is
+				just in generation, waiting for it is faster than starting a new one */
+				if( mrkeypool_take(public_key, private_key, 1/*wait*/) ) {
+					mrmailbox_log_info(mailbox, 0, "Using pre-generated keypair.");
+					key_created = 1;
+				}
+				else {
+					mrmailbox_log_info(mailbox, 0, "Generating keypair ...");
+
+					/* The public key must contain the following:
+					- a signing-capable primary key Kp
+					- a user id
+					- a self signature
+					- an encryption-capable subkey Ke
+					- a binding signature over Ke by Kp
+					(see https://autocrypt.readthedocs.io/en/latest/level0.html#type-p-openpgp-based-key-data )*/
+					key_created = mrpgp_create_keypair(mailbox, self_addr, public_key, private_key);
+				}
 
 			mrsqlite3_lock(mailbox->m_sql);
 
@@ -312,6 +322,133 @@ cleanup:
 }
 
 
+/**
+ * Start generating keypairs in the background.  Generating a keypair takes
+ * some seconds; keypairs generated in advance are used when a mailbox is
+ * configured or the first message is sent.  mrmailbox_open() already starts
+ * generating a keypair if the opened database has none, so this function is
+ * needed only if many accounts are set up.
+ *
+ * The keypairs are shared by all mailbox objects of the process and are not
+ * bound to an address before they are used.  The function returns at once.
+ *
+ * @memberof mrmailbox_t
+ *
+ * @param mailbox Mailbox object as created by mrmailbox_new(), used for logging only.
+ * @param cnt Number of keypairs that should be ready.
+ * @param max_threads Number of threads to use at most, 0 for one thread per CPU.
+ *
+ * @return None.
+ */
+void mrmailbox_prepare_keypairs(mrmailbox_t* mailbox, int cnt, int max_threads)
+{
+	if( mailbox==NULL || mailbox->m_magic != MR_MAILBOX_MAGIC || cnt <= 0 ) {
+		return;
+	}
+
+	if( max_threads <= 0 ) {
+		max_threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+	}
+
+	mrmailbox_log_info(mailbox, 0, "Preparing %i keypair(s) using up to %i thread(s) ...", cnt, max_threads);
+	mrkeypool_fill(cnt, max_threads);
+}
+
+
+/**
+ * Make sure, each of the given mailboxes has a keypair.  This is useful if
+ * many accounts are set up at once: the missing keypairs are generated in
+ * parallel, one thread per CPU, and are saved to the databases as they get
+ * ready.
+ *
+ * The keypair is bound to the configured address or, if the mailbox is not yet
+ * configured, to the address set by mrmailbox_set_config("addr").  Mailboxes
+ * that are not open or have no address are skipped.
+ *
+ * @memberof mrmailbox_t
+ *
+ * @param mailboxes Array of mailbox objects as created by mrmailbox_new() and opened by mrmailbox_open().
+ * @param mailbox_cnt Number of mailbox objects in the array.
+ *
+ * @return Number of mailboxes with a keypair when the function returns.
+ */
+int mrmailbox_provision_keypairs(mrmailbox_t** mailboxes, int mailbox_cnt)
+{
+	int          i, missing_cnt = 0, ready_cnt = 0;
+	char**       self_addrs = NULL;
+	mrkey_t*     public_key = mrkey_new();
+	mrmailbox_t* mailbox;
+
+	if( mailboxes == NULL || mailbox_cnt <= 0 ) {
+		goto cleanup;
+	}
+
+	if( (self_addrs=calloc(mailbox_cnt, sizeof(char*)))==NULL ) {
+		exit(64);
+	}
+
+	/* find out the mailboxes without keypair */
+	for( i = 0; i < mailbox_cnt; i++ )
+	{
+		mailbox = mailboxes[i];
+		if( mailbox==NULL || mailbox->m_magic != MR_MAILBOX_MAGIC ) {
+			continue;
+		}
+
+		mrsqlite3_lock(mailbox->m_sql);
+
+			if( mrsqlite3_is_open(mailbox->m_sql) ) {
+				if( (self_addrs[i]=mrsqlite3_get_config__(mailbox->m_sql, "configured_addr", NULL))==NULL
+				 && (self_addrs[i]=mrsqlite3_get_config__(mailbox->m_sql, "addr", NULL))!=NULL ) {
+					mr_trim(self_addrs[i]); /* as done by mrmailbox_configure() */
+				}
+			}
+
+			if( self_addrs[i] ) {
+				if( mrkey_load_self_public__(public_key, self_addrs[i], mailbox->m_sql) ) {
+					free(self_addrs[i]);
+					self_addrs[i] = NULL;
+					ready_cnt++;
+				}
+				else {
+					missing_cnt++;
+				}
+			}
+
+		mrsqlite3_unlock(mailbox->m_sql);
+	}
+
+	if( missing_cnt == 0 ) {
+		goto cleanup;
+	}
+
+	/* generate the missing keypairs in parallel and save them as they get ready */
+	mrkeypool_fill(missing_cnt, (int)sysconf(_SC_NPROCESSORS_ONLN));
+
+	for( i = 0; i < mailbox_cnt; i++ )
+	{
+		if( self_addrs[i] ) {
+			mailbox = mailboxes[i];
+			mrsqlite3_lock(mailbox->m_sql);
+				if( load_or_generate_self_public_key__(mailbox, public_key, self_addrs[i], NULL/*no random text data for seeding available*/) ) {
+					ready_cnt++;
+				}
+			mrsqlite3_unlock(mailbox->m_sql);
+		}
+	}
+
+cleanup:
+	if( self_addrs ) {
+		for( i = 0; i < mailbox_cnt; i++ ) {
+			free(self_addrs[i]);
+		}
+		free(self_addrs);
+	}
+	mrkey_unref(public_key);
+	return ready_cnt;
+}
+
+
 /*******************************************************************************
  * Encrypt
  ******************************************************************************/
@@ -574,7 +711,6 @@ static int decrypt_part(mrmailbox_t*       mailbox,
                         struct mailmime**  ret_decrypted_mime)
 {
 	struct mailmime_data*        mime_data;
-	int                          mime_transfer_encoding = MAILMIME_MECHANISM_BINARY;
 	char*                        transfer_decoding_buffer = NULL; /* mmap_string_unref()'d if set */
 	const char*                  decoded_data = NULL; /* must not be free()'d */
 	size_t                       decoded_data_bytes = 0;
@@ -592,41 +728,9 @@ static int decrypt_part(mrmailbox_t*       mailbox,
 		goto cleanup;
 	}
 
-	/* check headers in `mime` */
-	if( mime->mm_mime_fields != NULL ) {
-		clistiter* cur;
-		for( cur = clist_begin(mime->mm_mime_fields->fld_list); cur != NULL; cur = clist_next(cur) ) {
-			struct mailmime_field* field = (struct mailmime_field*)clist_content(cur);
-			if( field ) {
-				if( field->fld_type == MAILMIME_FIELD_TRANSFER_ENCODING && field->fld_data.fld_encoding ) {
-					mime_transfer_encoding = field->fld_data.fld_encoding->enc_type;
-				}
-			}
-		}
-	}
-
 	/* regard `Content-Transfer-Encoding:` */
-	if( mime_transfer_encoding == MAILMIME_MECHANISM_7BIT
-	 || mime_transfer_encoding == MAILMIME_MECHANISM_8BIT
-	 || mime_transfer_encoding == MAILMIME_MECHANISM_BINARY )
-	{
-		decoded_data       = mime_data->dt_data.dt_text.dt_data;
-		decoded_data_bytes = mime_data->dt_data.dt_text.dt_length;
-		if( decoded_data == NULL || decoded_data_bytes <= 0 ) {
-			goto cleanup; /* no error - but no data */
-		}
-	}
-	else
-	{
-		int r;
-		size_t current_index = 0;
-		r = mailmime_part_parse(mime_data->dt_data.dt_text.dt_data, mime_data->dt_data.dt_text.dt_length,
-			&current_index, mime_transfer_encoding,
-			&transfer_decoding_buffer, &decoded_data_bytes);
-		if( r != MAILIMF_NO_ERROR || transfer_decoding_buffer == NULL || decoded_data_bytes <= 0 ) {
-			goto cleanup;
-		}
-		decoded_data = transfer_decoding_buffer;
+	if( !mailmime_transfer_decode(mime, &decoded_data, &decoded_data_bytes, &transfer_decoding_buffer) ) {
+		goto cleanup; /* no error - but no data */
 	}
 
 	/* encrypted, decoded data in decoded_data now ... */
@@ -786,7 +890,7 @@ static mrhash_t* update_gossip_peerstates(mrmailbox_t* mailbox, time_t message_t
 						// verified when used in a verified group by a verified sender
 						if( gossipped_addr == NULL ) {
 							gossipped_addr = malloc(sizeof(mrhash_t));
-							mrhash_init(gossipped_addr, MRHASH_STRING, 1/*copy key*/);
+							mrhash_init(gossipped_addr, MRHASH_STRING, MRHASH_COPY_TO_ARENA);
 						}
 						mrhash_insert(gossipped_addr, gossip_header->m_addr, strlen(gossip_header->m_addr), (void*)1);
 					}
@@ -917,7 +1021,7 @@ void mrmailbox_e2ee_decrypt(mrmailbox_t* mailbox, struct mailmime* in_out_messag
 
 	/* finally, decrypt.  If sth. was decrypted, decrypt_recursive() returns "true" and we start over to decrypt maybe just added parts. */
 	helper->m_signatures = malloc(sizeof(mrhash_t));
-	mrhash_init(helper->m_signatures, MRHASH_STRING, 1/*copy key*/);
+	mrhash_init(helper->m_signatures, MRHASH_STRING, MRHASH_COPY_TO_ARENA);
 
 	int iterations = 0;
 	while( iterations < 10 ) {
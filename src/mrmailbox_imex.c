@@ -24,16 +24,18 @@
 #include <dirent.h>
 #include <unistd.h> /* for sleep() */
 #include <openssl/rand.h>
-#include <libetpan/mmapstring.h>
 #include <netpgp-extra.h>
 #include "mrmailbox_internal.h"
 #include "mrmimeparser.h"
+#include "mrcodec.h"
 #include "mrosnative.h"
 #include "mrloginparam.h"
 #include "mraheader.h"
 #include "mrapeerstate.h"
+#include "mrkeyring.h"
 #include "mrpgp.h"
 #include "mrmimefactory.h"
+#include "mrjob.h"
 
 
 /*******************************************************************************
@@ -314,7 +316,7 @@ char* mrmailbox_decrypt_setup_file(mrmailbox_t* mailbox, const char* passphrase,
 {
 	char*         fc_buf = NULL, *fc_headerline = NULL, *fc_base64 = NULL;
 	char*         binary = NULL;
-	size_t        binary_bytes = 0, indx = 0;
+	size_t        binary_bytes = 0;
 	pgp_io_t      io;
 	pgp_memory_t* outmem = NULL;
 	char*         payload = NULL;
@@ -327,8 +329,10 @@ char* mrmailbox_decrypt_setup_file(mrmailbox_t* mailbox, const char* passphrase,
 	}
 
 	/* convert base64 to binary */
-	if( mailmime_base64_body_parse(fc_base64, strlen(fc_base64), &indx, &binary/*must be freed using mmap_string_unref()*/, &binary_bytes)!=MAILIMF_NO_ERROR
-	 || binary == NULL || binary_bytes == 0 ) {
+	if( (binary=malloc(mr_base64_decode_bound(strlen(fc_base64))))==NULL ) {
+		exit(59);
+	}
+	if( (binary_bytes=mr_base64_decode(fc_base64, strlen(fc_base64), 0, NULL, binary)) == 0 ) {
 		goto cleanup;
 	}
 
@@ -344,7 +348,7 @@ char* mrmailbox_decrypt_setup_file(mrmailbox_t* mailbox, const char* passphrase,
 
 cleanup:
 	free(fc_buf);
-	if( binary ) { mmap_string_unref(binary); }
+	free(binary);
 	if( outmem ) { pgp_memory_free(outmem); }
 	return payload;
 }
@@ -588,6 +592,7 @@ static int set_self_key(mrmailbox_t* mailbox, const char* armored, int set_defau
 		sqlite3_step(stmt);
 		sqlite3_finalize(stmt);
 		stmt = NULL;
+		mrkeyring_clear_self_cache__(mailbox);
 
 		if( set_default ) {
 			mrsqlite3_execute__(mailbox->m_sql, "UPDATE keypairs SET is_default=0;"); /* if the new key should be the default key, all other should not */
@@ -1071,6 +1076,12 @@ static int import_backup(mrmailbox_t* mailbox, const char* backup_to_import)
 		goto cleanup;
 	}
 
+	mrmailbox_clear_contact_cache__(mailbox);
+	mrapeerstate_clear_cache__(mailbox);
+	mrkeyring_clear_self_cache__(mailbox);
+
+	mrjob_load_queues__(mailbox);
+
 	/* copy all blobs to files */
 	stmt = mrsqlite3_prepare_v2_(mailbox->m_sql, "SELECT COUNT(*) FROM backup_blobs;");
 	sqlite3_step(stmt);
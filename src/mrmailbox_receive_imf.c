@@ -21,6 +21,7 @@
 
 
 #include <assert.h>
+#include <unistd.h>
 #include "mrmailbox_internal.h"
 #include "mrmimeparser.h"
 #include "mrmimefactory.h"
@@ -935,10 +936,120 @@ cleanup:
  ******************************************************************************/
 
 
-void mrmailbox_receive_imf(mrmailbox_t* mailbox, const char* imf_raw_not_terminated, size_t imf_raw_bytes,
-                           const char* server_folder, uint32_t server_uid, uint32_t flags)
+static mrmimeparser_t* get_mimeparser(mrmailbox_t* mailbox)
+{
+	/* parsers are reused for the next messages, so the first block of their arena and other buffers need not to be allocated again */
+	mrmimeparser_t* mime_parser = NULL;
+
+	pthread_mutex_lock(&mailbox->m_mimeparser_pool_critical);
+		if( mailbox->m_mimeparser_pool_cnt > 0 ) {
+			mime_parser = mailbox->m_mimeparser_pool[--mailbox->m_mimeparser_pool_cnt];
+		}
+	pthread_mutex_unlock(&mailbox->m_mimeparser_pool_critical);
+
+	if( mime_parser ) {
+		mime_parser->m_blobdir = mailbox->m_blobdir; /* the mailbox may have been re-opened meanwhile */
+	}
+	else {
+		mime_parser = mrmimeparser_new(mailbox->m_blobdir, mailbox);
+	}
+
+	return mime_parser;
+}
+
+
+static void put_mimeparser(mrmailbox_t* mailbox, mrmimeparser_t* mime_parser)
+{
+	/* all temporary data of the message are released at once, the parser is kept for the next message if there is room in the pool */
+	if( mime_parser == NULL ) {
+		return;
+	}
+
+	mrmimeparser_empty(mime_parser);
+
+	pthread_mutex_lock(&mailbox->m_mimeparser_pool_critical);
+		if( mailbox->m_mimeparser_pool_cnt < MR_MIMEPARSER_POOL_SIZE ) {
+			mailbox->m_mimeparser_pool[mailbox->m_mimeparser_pool_cnt++] = mime_parser;
+			mime_parser = NULL;
+		}
+	pthread_mutex_unlock(&mailbox->m_mimeparser_pool_critical);
+
+	mrmimeparser_unref(mime_parser);
+}
+
+
+void mrmailbox_clear_mimeparser_pool(mrmailbox_t* mailbox)
+{
+	pthread_mutex_lock(&mailbox->m_mimeparser_pool_critical);
+		while( mailbox->m_mimeparser_pool_cnt > 0 ) {
+			mrmimeparser_unref(mailbox->m_mimeparser_pool[--mailbox->m_mimeparser_pool_cnt]);
+		}
+	pthread_mutex_unlock(&mailbox->m_mimeparser_pool_critical);
+}
+
+
+static mrmimeparser_t* parse_imf(mrmailbox_t* mailbox, const char* imf_raw_not_terminated, size_t imf_raw_bytes,
+                                 const char* server_folder, uint32_t server_uid)
 {
-	/* the function returns the number of created messages in the database */
+	/* first stage of receiving a message: parse and decrypt the message and write the attachments to the blob directory.
+	this does not need the database lock (only decrypting locks the database shortly for the peerstate)
+	and may be done on several threads in parallel, see mrmailbox_receive_imf_batch().
+	the returned parser should be given back using put_mimeparser() */
+	mrmimeparser_t* mime_parser = get_mimeparser(mailbox);
+
+	mrmailbox_log_info(mailbox, 0, "Receiving message %s/%lu...", server_folder? server_folder:"?", server_uid);
+
+	/* parse the imf to mailimf_message {
+	        mailimf_fields* msg_fields {
+	          clist* fld_list; // list of mailimf_field
+	        }
+	        mailimf_body* msg_body { // != NULL
+                const char * bd_text; // != NULL
+                size_t bd_size;
+	        }
+	   };
+	normally, this is done by mailimf_message_parse(), however, as we also need the MIME data,
+	we use mailmime_parse() through MrMimeParser (both call mailimf_struct_multiple_parse() somewhen, I did not found out anything
+	that speaks against this approach yet) */
+	if( mime_parser ) {
+		mrmimeparser_parse(mime_parser, imf_raw_not_terminated, imf_raw_bytes);
+	}
+
+	return mime_parser;
+}
+
+
+static void send_events(mrmailbox_t* mailbox, carray* events_to_send)
+{
+	/* events_to_send contains triples of event, data1 and data2 */
+	size_t i, icnt = carray_count(events_to_send);
+	for( i = 0; i+2 < icnt; i += 3 ) {
+		mailbox->m_cb(mailbox, (int)(uintptr_t)carray_get(events_to_send, i), (uintptr_t)carray_get(events_to_send, i+1), (uintptr_t)carray_get(events_to_send, i+2));
+	}
+	carray_set_size(events_to_send, 0);
+}
+
+
+static void add_receive_stat__(mrmailbox_t* mailbox, const mrmimeparser_t* mime_parser, uint64_t apply_us)
+{
+	/* sum up the time taken by the stages of receiving, shown by mrmailbox_get_info() */
+	if( mime_parser ) {
+		mailbox->m_receive_cnt++;
+		mailbox->m_receive_parse_us    += mime_parser->m_parse_us;
+		mailbox->m_receive_decrypt_us  += mime_parser->m_decrypt_us;
+		mailbox->m_receive_simplify_us += mime_parser->m_simplify_us;
+		mailbox->m_receive_apply_us    += apply_us;
+	}
+}
+
+
+static void apply_imf__(mrmailbox_t* mailbox, mrmimeparser_t* mime_parser, const char* imf_raw_not_terminated, size_t imf_raw_bytes,
+                        const char* server_folder, uint32_t server_uid, uint32_t flags, carray* events_to_send)
+{
+	/* second stage of receiving a message: add the parsed message to the database.
+	the caller holds the database lock; the function uses its own transaction, this may be nested in a transaction of the caller.
+	however, for Secure-Join messages, the lock is released meanwhile and the caller must not have a transaction pending then.
+	events are added to `events_to_send` and should be sent by the caller using send_events() after the database is unlocked. */
 	int              incoming = 1;
 	int              incoming_origin = 0;
 	#define          outgoing (!incoming)
@@ -957,12 +1068,10 @@ void mrmailbox_receive_imf(mrmailbox_t* mailbox, const char* imf_raw_not_termina
 	sqlite3_stmt*    stmt;
 	size_t           i, icnt;
 	uint32_t         first_dblocal_id = 0;
-	char*            rfc724_mid = NULL; /* Message-ID from the header */
+	char*            rfc724_mid = NULL; /* Message-ID from the header, allocated in the arena of the parser */
 	time_t           sort_timestamp = MR_INVALID_TIMESTAMP;
 	time_t           sent_timestamp = MR_INVALID_TIMESTAMP;
 	time_t           rcvd_timestamp = MR_INVALID_TIMESTAMP;
-	mrmimeparser_t*  mime_parser = mrmimeparser_new(mailbox->m_blobdir, mailbox);
-	int              db_locked = 0;
 	int              transaction_pending = 0;
 	const struct mailimf_field* field;
 
@@ -971,9 +1080,7 @@ void mrmailbox_receive_imf(mrmailbox_t* mailbox, const char* imf_raw_not_termina
 
 	carray*          rr_event_to_send = carray_new(16);
 
-	char*            txt_raw = NULL;
-
-	mrmailbox_log_info(mailbox, 0, "Receiving message %s/%lu...", server_folder? server_folder:"?", server_uid);
+	char*            txt_raw = NULL; /* allocated in the arena of the parser */
 
 	to_ids = mrarray_new(mailbox, 16);
 	if( to_ids==NULL || created_db_entries==NULL || rr_event_to_send==NULL || mime_parser == NULL ) {
@@ -981,19 +1088,6 @@ void mrmailbox_receive_imf(mrmailbox_t* mailbox, const char* imf_raw_not_termina
 		goto cleanup;
 	}
 
-	/* parse the imf to mailimf_message {
-	        mailimf_fields* msg_fields {
-	          clist* fld_list; // list of mailimf_field
-	        }
-	        mailimf_body* msg_body { // != NULL
-                const char * bd_text; // != NULL
-                size_t bd_size;
-	        }
-	   };
-	normally, this is done by mailimf_message_parse(), however, as we also need the MIME data,
-	we use mailmime_parse() through MrMimeParser (both call mailimf_struct_multiple_parse() somewhen, I did not found out anything
-	that speaks against this approach yet) */
-	mrmimeparser_parse(mime_parser, imf_raw_not_terminated, imf_raw_bytes);
 	if( mrhash_count(&mime_parser->m_header)==0 ) {
 		mrmailbox_log_info(mailbox, 0, "No header.");
 		goto cleanup; /* Error - even adding an empty record won't help as we do not know the message ID */
@@ -1016,8 +1110,6 @@ void mrmailbox_receive_imf(mrmailbox_t* mailbox, const char* imf_raw_not_termina
 		}
 	}
 
-	mrsqlite3_lock(mailbox->m_sql);
-	db_locked = 1;
 	mrsqlite3_begin_transaction__(mailbox->m_sql);
 	transaction_pending = 1;
 
@@ -1090,12 +1182,14 @@ void mrmailbox_receive_imf(mrmailbox_t* mailbox, const char* imf_raw_not_termina
 			if( (field=mrmimeparser_lookup_field(mime_parser, "Message-ID"))!=NULL && field->fld_type==MAILIMF_FIELD_MESSAGE_ID ) {
 				struct mailimf_message_id* fld_message_id = field->fld_data.fld_message_id;
 				if( fld_message_id ) {
-					rfc724_mid = safe_strdup(fld_message_id->mid_value);
+					rfc724_mid = mrarena_strdup(mime_parser->m_arena, fld_message_id->mid_value);
 				}
 			}
 
 			if( rfc724_mid == NULL ) {
-				rfc724_mid = mr_create_incoming_rfc724_mid(sort_timestamp, from_id, to_ids);
+				char* created_mid = mr_create_incoming_rfc724_mid(sort_timestamp, from_id, to_ids);
+				rfc724_mid = created_mid? mrarena_strdup(mime_parser->m_arena, created_mid) : NULL;
+				free(created_mid);
 				if( rfc724_mid == NULL ) {
 					mrmailbox_log_info(mailbox, 0, "Cannot create Message-ID.");
 					goto cleanup;
@@ -1288,7 +1382,7 @@ void mrmailbox_receive_imf(mrmailbox_t* mailbox, const char* imf_raw_not_termina
 				}
 
 				if( part->m_type == MR_MSG_TEXT ) {
-					txt_raw = mr_mprintf("%s\n\n%s", mime_parser->m_subject? mime_parser->m_subject : "", part->m_msg_raw);
+					txt_raw = mrarena_mprintf(mime_parser->m_arena, "%s\n\n%s", mime_parser->m_subject? mime_parser->m_subject : "", part->m_msg_raw);
 				}
 
 				if( mime_parser->m_is_system_message ) {
@@ -1312,7 +1406,7 @@ void mrmailbox_receive_imf(mrmailbox_t* mailbox, const char* imf_raw_not_termina
 				sqlite3_bind_int  (stmt, 12, msgrmsg);
 				sqlite3_bind_text (stmt, 13, part->m_msg? part->m_msg : "", -1, SQLITE_STATIC);
 				sqlite3_bind_text (stmt, 14, txt_raw? txt_raw : "", -1, SQLITE_STATIC);
-				sqlite3_bind_text (stmt, 15, part->m_param->m_packed, -1, SQLITE_STATIC);
+				sqlite3_bind_text (stmt, 15, mrparam_get_packed(part->m_param), -1, SQLITE_STATIC);
 				sqlite3_bind_int  (stmt, 16, part->m_bytes);
 				sqlite3_bind_int  (stmt, 17, hidden);
 				if( sqlite3_step(stmt) != SQLITE_DONE ) {
@@ -1320,7 +1414,6 @@ void mrmailbox_receive_imf(mrmailbox_t* mailbox, const char* imf_raw_not_termina
 					goto cleanup; /* i/o error - there is nothing more we can do - in other cases, we try to write at least an empty record */
 				}
 
-				free(txt_raw);
 				txt_raw = NULL;
 
 				if( first_dblocal_id == 0 ) {
@@ -1331,6 +1424,8 @@ void mrmailbox_receive_imf(mrmailbox_t* mailbox, const char* imf_raw_not_termina
 				carray_add(created_db_entries, (void*)(uintptr_t)first_dblocal_id, NULL);
 			}
 
+			mrmailbox_update_chat_last_msg__(mailbox, chat_id);
+
 			mrmailbox_log_info(mailbox, 0, "Message has %i parts and is assigned to chat #%i.", icnt, chat_id);
 
 			/* check event to send */
@@ -1470,17 +1565,16 @@ void mrmailbox_receive_imf(mrmailbox_t* mailbox, const char* imf_raw_not_termina
 
 cleanup:
 	if( transaction_pending ) { mrsqlite3_rollback__(mailbox->m_sql); }
-	if( db_locked ) { mrsqlite3_unlock(mailbox->m_sql); }
 
-	mrmimeparser_unref(mime_parser);
-	free(rfc724_mid);
 	mrarray_unref(to_ids);
 
 	if( created_db_entries ) {
 		if( create_event_to_send ) {
 			size_t i, icnt = carray_count(created_db_entries);
 			for( i = 0; i < icnt; i += 2 ) {
-				mailbox->m_cb(mailbox, create_event_to_send, (uintptr_t)carray_get(created_db_entries, i), (uintptr_t)carray_get(created_db_entries, i+1));
+				carray_add(events_to_send, (void*)(uintptr_t)create_event_to_send, NULL);
+				carray_add(events_to_send, carray_get(created_db_entries, i), NULL);
+				carray_add(events_to_send, carray_get(created_db_entries, i+1), NULL);
 			}
 		}
 		carray_free(created_db_entries);
@@ -1489,10 +1583,201 @@ cleanup:
 	if( rr_event_to_send ) {
 		size_t i, icnt = carray_count(rr_event_to_send);
 		for( i = 0; i < icnt; i += 2 ) {
-			mailbox->m_cb(mailbox, MR_EVENT_MSG_READ, (uintptr_t)carray_get(rr_event_to_send, i), (uintptr_t)carray_get(rr_event_to_send, i+1));
+			carray_add(events_to_send, (void*)(uintptr_t)MR_EVENT_MSG_READ, NULL);
+			carray_add(events_to_send, carray_get(rr_event_to_send, i), NULL);
+			carray_add(events_to_send, carray_get(rr_event_to_send, i+1), NULL);
 		}
 		carray_free(rr_event_to_send);
 	}
+}
+
+
+void mrmailbox_receive_imf(mrmailbox_t* mailbox, const char* imf_raw_not_terminated, size_t imf_raw_bytes,
+                           const char* server_folder, uint32_t server_uid, uint32_t flags)
+{
+	mrmimeparser_t* mime_parser = parse_imf(mailbox, imf_raw_not_terminated, imf_raw_bytes, server_folder, server_uid);
+	carray*         events_to_send = carray_new(16);
+	uint64_t        apply_start;
+
+	mrsqlite3_lock(mailbox->m_sql);
+		apply_start = mr_monotonic_us();
+		apply_imf__(mailbox, mime_parser, imf_raw_not_terminated, imf_raw_bytes, server_folder, server_uid, flags, events_to_send);
+		add_receive_stat__(mailbox, mime_parser, mr_monotonic_us()-apply_start);
+	mrsqlite3_unlock(mailbox->m_sql);
+
+	put_mimeparser(mailbox, mime_parser);
+
+	send_events(mailbox, events_to_send);
+	carray_free(events_to_send);
+}
+
+
+/*******************************************************************************
+ * Receive a batch of messages
+ ******************************************************************************/
+
+
+#define MR_RECEIVE_MAX_THREADS          4  /* max. number of threads parsing the messages of a batch */
+#define MR_RECEIVE_MSGS_PER_TRANSACTION 50 /* after this number of messages, the transaction is committed and the lock is released for a moment */
+
+
+typedef struct mrparsebatch_t
+{
+	mrmailbox_t*           m_mailbox;
+	const mrimapfetched_t* m_msgs;
+	int                    m_msgs_cnt;
+	const char*            m_server_folder;
+	mrmimeparser_t**       m_parsers;       /* one parser per message, same index as m_msgs */
+
+	pthread_mutex_t        m_critical;
+	int                    m_next;          /* the next message to parse */
+} mrparsebatch_t;
+
+
+static void* parse_thread_entry_point(void* entry_arg)
+{
+	mrparsebatch_t* batch = (mrparsebatch_t*)entry_arg;
+	int             i;
+
+	while( 1 )
+	{
+		pthread_mutex_lock(&batch->m_critical);
+			i = batch->m_next++;
+		pthread_mutex_unlock(&batch->m_critical);
+
+		if( i >= batch->m_msgs_cnt ) {
+			break;
+		}
+
+		batch->m_parsers[i] = parse_imf(batch->m_mailbox, batch->m_msgs[i].m_imf_raw_not_terminated, batch->m_msgs[i].m_imf_raw_bytes,
+			batch->m_server_folder, batch->m_msgs[i].m_server_uid);
+	}
+
+	return NULL;
+}
+
+
+typedef struct mrbatchorder_t
+{
+	uint32_t m_server_uid;
+	int      m_index;
+} mrbatchorder_t;
+
+static int cmp_batchorder(const void* p1, const void* p2)
+{
+	const mrbatchorder_t* o1 = (const mrbatchorder_t*)p1;
+	const mrbatchorder_t* o2 = (const mrbatchorder_t*)p2;
+	if( o1->m_server_uid != o2->m_server_uid ) {
+		return o1->m_server_uid<o2->m_server_uid? -1 : 1;
+	}
+	return o1->m_index<o2->m_index? -1 : (o1->m_index>o2->m_index? 1 : 0);
+}
+
+
+/**
+ * Receive several messages of a folder, typically the messages of one `UID FETCH` command.
+ *
+ * Other than calling mrmailbox_receive_imf() for each message, this is done in two stages:
+ * First, all messages are parsed and decrypted and the attachments are written to the blob directory;
+ * this does not lock the database and is done on several threads.
+ * Then, the messages are added to the database in the order of their UIDs, several messages per transaction.
+ *
+ * @private @memberof mrmailbox_t
+ */
+void mrmailbox_receive_imf_batch(mrmailbox_t* mailbox, const mrimapfetched_t* msgs, int msgs_cnt, const char* server_folder)
+{
+	mrparsebatch_t batch;
+	pthread_t      threads[MR_RECEIVE_MAX_THREADS];
+	int            i, k, threads_cnt = 0, transaction_pending = 0, in_transaction = 0, is_handshake;
+	mrbatchorder_t* order = NULL;
+	carray*        events_to_send = NULL;
+	uint64_t       apply_start;
+
+	if( mailbox == NULL || msgs == NULL || msgs_cnt <= 0 ) {
+		return;
+	}
+
+	memset(&batch, 0, sizeof(mrparsebatch_t));
+	batch.m_mailbox       = mailbox;
+	batch.m_msgs          = msgs;
+	batch.m_msgs_cnt      = msgs_cnt;
+	batch.m_server_folder = server_folder;
+	pthread_mutex_init(&batch.m_critical, NULL);
+
+	if( (batch.m_parsers=calloc(msgs_cnt, sizeof(mrmimeparser_t*)))==NULL
+	 || (order=malloc(sizeof(mrbatchorder_t)*msgs_cnt))==NULL
+	 || (events_to_send=carray_new(16))==NULL ) {
+		exit(47);
+	}
+
+	/* stage 1: parse, the calling thread is one of the parsing threads */
+	if( msgs_cnt > 1 ) {
+		long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+		int  threads_wanted = (int)MR_MIN(MR_MIN(cpus, MR_RECEIVE_MAX_THREADS), msgs_cnt);
+		for( i = 1; i < threads_wanted; i++ ) {
+			if( pthread_create(&threads[threads_cnt], NULL, parse_thread_entry_point, &batch) == 0 ) {
+				threads_cnt++;
+			}
+		}
+	}
+
+	parse_thread_entry_point(&batch);
+
+	for( i = 0; i < threads_cnt; i++ ) {
+		pthread_join(threads[i], NULL);
+	}
+
+	/* stage 2: add the messages to the database in the order of their UIDs */
+	for( i = 0; i < msgs_cnt; i++ ) {
+		order[i].m_server_uid = msgs[i].m_server_uid;
+		order[i].m_index      = i;
+	}
+	qsort(order, msgs_cnt, sizeof(mrbatchorder_t), cmp_batchorder);
+
+	mrsqlite3_lock(mailbox->m_sql);
+
+		for( k = 0; k < msgs_cnt; k++ )
+		{
+			i = order[k].m_index;
+			if( batch.m_parsers[i] == NULL ) {
+				continue;
+			}
+
+			/* Secure-Join messages release the lock while being processed, so they are handled outside of our transaction */
+			is_handshake = (mrmimeparser_lookup_field(batch.m_parsers[i], "Secure-Join")!=NULL);
+			if( transaction_pending && (is_handshake || in_transaction >= MR_RECEIVE_MSGS_PER_TRANSACTION) ) {
+				mrsqlite3_commit__(mailbox->m_sql);
+				transaction_pending = 0;
+				mrsqlite3_unlock(mailbox->m_sql); /* give other threads a chance */
+				mrsqlite3_lock(mailbox->m_sql);
+			}
+
+			if( !transaction_pending && !is_handshake ) {
+				mrsqlite3_begin_transaction__(mailbox->m_sql);
+				transaction_pending = 1;
+				in_transaction = 0;
+			}
+
+			apply_start = mr_monotonic_us();
+			apply_imf__(mailbox, batch.m_parsers[i], msgs[i].m_imf_raw_not_terminated, msgs[i].m_imf_raw_bytes,
+				server_folder, msgs[i].m_server_uid, msgs[i].m_flags, events_to_send);
+			add_receive_stat__(mailbox, batch.m_parsers[i], mr_monotonic_us()-apply_start);
+			in_transaction++;
+
+			put_mimeparser(mailbox, batch.m_parsers[i]); /* the temporary data of the message are not needed any longer */
+			batch.m_parsers[i] = NULL;
+		}
+
+		if( transaction_pending ) {
+			mrsqlite3_commit__(mailbox->m_sql);
+		}
+
+	mrsqlite3_unlock(mailbox->m_sql);
+
+	free(batch.m_parsers);
+	free(order);
+	pthread_mutex_destroy(&batch.m_critical);
 
-	free(txt_raw);
+	send_events(mailbox, events_to_send);
+	carray_free(events_to_send);
 }
@@ -26,6 +26,7 @@
 #include "mruudecode.h"
 #include "mrpgp.h"
 #include "mrsimplify.h"
+#include "mrcodec.h"
 
 
 /*******************************************************************************
@@ -426,7 +427,7 @@ mrhash_t* mailimf_get_recipients(struct mailimf_fields* imffields)
 {
 	/* the returned value must be mrhash_clear()'d and free()'d. returned addresses are normalized. */
 	mrhash_t* recipients = malloc(sizeof(mrhash_t));
-	mrhash_init(recipients, MRHASH_STRING, 1/*copy key*/);
+	mrhash_init(recipients, MRHASH_STRING, MRHASH_COPY_TO_ARENA);
 
 	clistiter* cur1;
 	for( cur1 = clist_begin(imffields->fld_list); cur1!=NULL ; cur1=clist_next(cur1) )
@@ -495,6 +496,60 @@ struct mailmime_parameter* mailmime_find_ct_parameter(struct mailmime* mime, con
 }
 
 
+int mailmime_transfer_encoding(struct mailmime* mime)
+{
+	/* returns the `Content-Transfer-Encoding:` as one of MAILMIME_MECHANISM_*, defaults to binary */
+	if( mime && mime->mm_mime_fields != NULL ) {
+		clistiter* cur;
+		for( cur = clist_begin(mime->mm_mime_fields->fld_list); cur != NULL; cur = clist_next(cur) ) {
+			struct mailmime_field* field = (struct mailmime_field*)clist_content(cur);
+			if( field && field->fld_type == MAILMIME_FIELD_TRANSFER_ENCODING && field->fld_data.fld_encoding ) {
+				return field->fld_data.fld_encoding->enc_type;
+			}
+		}
+	}
+	return MAILMIME_MECHANISM_BINARY;
+}
+
+
+int mailmime_part_decode(const char* encoded, size_t encoded_bytes, int encoding, char** ret_decoded, size_t* ret_decoded_bytes)
+{
+	/* the same as libetpan's mailmime_part_parse(), however, base64 and quoted-printable are decoded by mrcodec.
+	the result must be mmap_string_unref()'d */
+	MMAPString* str = NULL;
+	size_t      bytes = 0;
+
+	*ret_decoded = NULL;
+	*ret_decoded_bytes = 0;
+
+	if( encoding != MAILMIME_MECHANISM_BASE64 && encoding != MAILMIME_MECHANISM_QUOTED_PRINTABLE ) {
+		size_t index = 0;
+		return mailmime_part_parse(encoded, encoded_bytes, &index, encoding, ret_decoded, ret_decoded_bytes)==MAILIMF_NO_ERROR? 1 : 0;
+	}
+
+	if( (str=mmap_string_sized_new(encoding==MAILMIME_MECHANISM_BASE64? mr_base64_decode_bound(encoded_bytes) : mr_qp_decode_bound(encoded_bytes)))==NULL ) {
+		return 0;
+	}
+
+	if( encoding==MAILMIME_MECHANISM_BASE64 ) {
+		bytes = mr_base64_decode(encoded, encoded_bytes, 0, NULL, str->str);
+	}
+	else {
+		bytes = mr_qp_decode(encoded, encoded_bytes, 0, NULL, str->str);
+	}
+	mmap_string_set_size(str, bytes);
+
+	if( mmap_string_ref(str) < 0 ) {
+		mmap_string_free(str);
+		return 0;
+	}
+
+	*ret_decoded = str->str;
+	*ret_decoded_bytes = bytes;
+	return 1;
+}
+
+
 int mailmime_transfer_decode(struct mailmime* mime, const char** ret_decoded_data, size_t* ret_decoded_data_bytes, char** ret_to_mmap_string_unref)
 {
 	int                   mime_transfer_encoding = MAILMIME_MECHANISM_BINARY;
@@ -509,17 +564,7 @@ int mailmime_transfer_decode(struct mailmime* mime, const char** ret_decoded_dat
 	}
 
 	mime_data = mime->mm_data.mm_single;
-
-	if( mime->mm_mime_fields != NULL ) {
-		clistiter* cur;
-		for( cur = clist_begin(mime->mm_mime_fields->fld_list); cur != NULL; cur = clist_next(cur) ) {
-			struct mailmime_field* field = (struct mailmime_field*)clist_content(cur);
-			if( field && field->fld_type == MAILMIME_FIELD_TRANSFER_ENCODING && field->fld_data.fld_encoding ) {
-				mime_transfer_encoding = field->fld_data.fld_encoding->enc_type;
-				break;
-			}
-		}
-	}
+	mime_transfer_encoding = mailmime_transfer_encoding(mime);
 
 	/* regard `Content-Transfer-Encoding:` */
 	if( mime_transfer_encoding == MAILMIME_MECHANISM_7BIT
@@ -534,12 +579,10 @@ int mailmime_transfer_decode(struct mailmime* mime, const char** ret_decoded_dat
 	}
 	else
 	{
-		int r;
-		size_t current_index = 0;
-		r = mailmime_part_parse(mime_data->dt_data.dt_text.dt_data, mime_data->dt_data.dt_text.dt_length,
-			&current_index, mime_transfer_encoding,
-			&transfer_decoding_buffer, &decoded_data_bytes);
-		if( r != MAILIMF_NO_ERROR || transfer_decoding_buffer == NULL || decoded_data_bytes <= 0 ) {
+		if( !mailmime_part_decode(mime_data->dt_data.dt_text.dt_data, mime_data->dt_data.dt_text.dt_length, mime_transfer_encoding,
+				&transfer_decoding_buffer, &decoded_data_bytes)
+		 || transfer_decoding_buffer == NULL || decoded_data_bytes <= 0 ) {
+			if( transfer_decoding_buffer ) { mmap_string_unref(transfer_decoding_buffer); }
 			return 0;
 		}
 		decoded_data = transfer_decoding_buffer;
@@ -552,6 +595,127 @@ int mailmime_transfer_decode(struct mailmime* mime, const char** ret_decoded_dat
 }
 
 
+/**
+ * Decode data and write the result to a file.  In contrast to mailmime_transfer_decode(),
+ * large data are not decoded to memory at once: the encoded data are decoded
+ * in slices of about `buffer_bytes` and each slice is appended to the file
+ * before the next one is decoded, so the memory needed does not depend on the size of the data.
+ *
+ * @param encoded Pointer to the encoded data, typically a pointer to the raw message.
+ *
+ * @param encoded_bytes Number of bytes in `encoded`.
+ *
+ * @param encoding One of MAILMIME_MECHANISM_*, eg. as returned by mailmime_transfer_encoding().
+ *     Encodings other than base64 and quoted-printable are written as they are.
+ *
+ * @param buffer_bytes Number of encoded bytes to decode at once.
+ *
+ * @param pathNfilename The file to write, an existing file is overwritten.
+ *
+ * @param ret_decoded_bytes If not NULL, the number of bytes written is returned here.
+ *
+ * @return 1=success, 0=error; on errors, the file may be incomplete.
+ */
+int mailmime_transfer_decode_to_file(const char* encoded, size_t encoded_bytes, int encoding, size_t buffer_bytes,
+                                     const char* pathNfilename, size_t* ret_decoded_bytes)
+{
+	int    success = 0;
+	FILE*  f = NULL;
+	size_t index = 0, end = 0, decoded_bytes = 0;
+	char*  decoded = NULL;
+	size_t decoded_alloc = 0;
+
+	if( encoded == NULL || pathNfilename == NULL ) {
+		goto cleanup;
+	}
+
+	if( buffer_bytes < 1 ) {
+		buffer_bytes = 1;
+	}
+
+	if( (f=fopen(pathNfilename, "wb"))==NULL ) {
+		goto cleanup;
+	}
+
+	if( encoding != MAILMIME_MECHANISM_BASE64 && encoding != MAILMIME_MECHANISM_QUOTED_PRINTABLE )
+	{
+		if( fwrite(encoded, 1, encoded_bytes, f) != encoded_bytes ) {
+			goto cleanup;
+		}
+		decoded_bytes = encoded_bytes;
+	}
+	else while( index < encoded_bytes )
+	{
+		/* decode the next slice; a slice ends after a line break if possible, so that quoted-printable is never split
+		inside a line.  if the slice contains no complete unit, nothing is consumed and the next slice is larger. */
+		size_t start = index, min_end = MR_MAX(end, index), needed, decoded_len;
+		int    last_slice = 0;
+
+		end = min_end + buffer_bytes;
+		if( end >= encoded_bytes ) {
+			end = encoded_bytes;
+			last_slice = 1;
+		}
+		else {
+			size_t lf = end;
+			while( lf > min_end && encoded[lf-1] != '\n' ) {
+				lf--;
+			}
+			if( lf > min_end ) {
+				end = lf;
+			}
+		}
+
+		needed = encoding==MAILMIME_MECHANISM_BASE64? mr_base64_decode_bound(end-index) : mr_qp_decode_bound(end-index);
+		if( needed > decoded_alloc ) {
+			free(decoded);
+			if( (decoded=malloc(needed))==NULL ) {
+				exit(57);
+			}
+			decoded_alloc = needed;
+		}
+
+		if( encoding==MAILMIME_MECHANISM_BASE64 ) {
+			decoded_len = mr_base64_decode(encoded+index, end-index, !last_slice, &index, decoded);
+		}
+		else {
+			decoded_len = mr_qp_decode(encoded+index, end-index, !last_slice, &index, decoded);
+		}
+		index += start; /* the consumed bytes are returned relative to the slice */
+
+		if( fwrite(decoded, 1, decoded_len, f) != decoded_len ) {
+			goto cleanup;
+		}
+		decoded_bytes += decoded_len;
+
+		if( last_slice ) {
+			break;
+		}
+
+		if( index > start ) {
+			end = index;
+		}
+	}
+
+	if( fclose(f) != 0 ) {
+		f = NULL;
+		goto cleanup;
+	}
+	f = NULL;
+
+	if( ret_decoded_bytes ) {
+		*ret_decoded_bytes = decoded_bytes;
+	}
+
+	success = 1;
+
+cleanup:
+	free(decoded);
+	if( f ) { fclose(f); }
+	return success;
+}
+
+
 struct mailimf_fields* mailmime_find_mailimf_fields(struct mailmime* mime)
 {
 	if( mime == NULL ) {
@@ -784,14 +948,12 @@ static int mailmime_get_mime_type(struct mailmime* mime, int* msg_type)
  ******************************************************************************/
 
 
-static mrmimepart_t* mrmimepart_new(void)
+static mrmimepart_t* mrmimepart_new(mrmimeparser_t* parser)
 {
-	mrmimepart_t* ths = NULL;
-
-	if( (ths=calloc(1, sizeof(mrmimepart_t)))==NULL ) {
-		exit(33);
-	}
+	/* the part is allocated in the arena of the parser, only the parameters need to be freed by mrmimepart_unref() */
+	mrmimepart_t* ths = mrarena_alloc(parser->m_arena, sizeof(mrmimepart_t));
 
+	memset(ths, 0, sizeof(mrmimepart_t));
 	ths->m_type    = MR_MSG_UNDEFINED;
 	ths->m_param   = mrparam_new();
 
@@ -805,18 +967,9 @@ static void mrmimepart_unref(mrmimepart_t* ths)
 		return;
 	}
 
-	if( ths->m_msg ) {
-		free(ths->m_msg);
-		ths->m_msg = NULL;
-	}
-
-	if( ths->m_msg_raw ) {
-		free(ths->m_msg_raw);
-		ths->m_msg_raw = NULL;
-	}
-
+	/* m_msg and m_msg_raw are released together with the arena */
 	mrparam_unref(ths->m_param);
-	free(ths);
+	ths->m_param = NULL;
 }
 
 
@@ -825,6 +978,9 @@ static void mrmimepart_unref(mrmimepart_t* ths)
  ******************************************************************************/
 
 
+#define MR_MIMEPARSER_ARENA_BYTES (16*1024) /* the first block is kept when the parser is reused, enough for the parts of typical messages */
+
+
 /**
  * Create a new mime parser object.
  *
@@ -848,8 +1004,9 @@ mrmimeparser_t* mrmimeparser_new(const char* blobdir, mrmailbox_t* mailbox)
 	ths->m_blobdir = blobdir; /* no need to copy the string at the moment */
 	ths->m_reports = carray_new(16);
 	ths->m_e2ee_helper = calloc(1, sizeof(mrmailbox_e2ee_helper_t));
+	ths->m_arena   = mrarena_new(MR_MIMEPARSER_ARENA_BYTES);
 
-	mrhash_init(&ths->m_header, MRHASH_STRING, 0/* do not copy key */);
+	mrhash_init(&ths->m_header, MRHASH_STRING, MRHASH_NO_COPY);
 
 	return ths;
 }
@@ -875,6 +1032,7 @@ void mrmimeparser_unref(mrmimeparser_t* ths)
 	mrmimeparser_empty(ths);
 	if( ths->m_parts )   { carray_free(ths->m_parts); }
 	if( ths->m_reports ) { carray_free(ths->m_reports); }
+	mrarena_unref(ths->m_arena);
 	free(ths->m_e2ee_helper);
 	free(ths);
 }
@@ -884,7 +1042,9 @@ void mrmimeparser_unref(mrmimeparser_t* ths)
  * Empty all data in a MIME-parser object.
  *
  * This function is called implicitly by mrmimeparser_parse() to free
- * previously allocated data.
+ * previously allocated data, so a parser object can be reused for several
+ * messages; the temporary data of a message are allocated in
+ * mrmimeparser_t::m_arena and are released here at once.
  *
  * @private @memberof mrmimeparser_t
  *
@@ -921,8 +1081,7 @@ void mrmimeparser_empty(mrmimeparser_t* ths)
 	ths->m_is_send_by_messenger  = 0;
 	ths->m_is_system_message = 0;
 
-	free(ths->m_subject);
-	ths->m_subject = NULL;
+	ths->m_subject = NULL; /* released together with the arena */
 
 	if( ths->m_mimeroot )
 	{
@@ -938,7 +1097,13 @@ void mrmimeparser_empty(mrmimeparser_t* ths)
 
 	ths->m_decrypting_failed = 0;
 
+	ths->m_decrypt_us  = 0;
+	ths->m_simplify_us = 0;
+	ths->m_parse_us    = 0;
+
 	mrmailbox_e2ee_thanks(ths->m_e2ee_helper);
+
+	mrarena_reset(ths->m_arena); /* the parts are unref'd above, their memory is released here */
 }
 
 
@@ -955,38 +1120,85 @@ static void do_add_single_part(mrmimeparser_t* parser, mrmimepart_t* part)
 }
 
 
+static int get_image_size(const char* pathNfilename, size_t max_bytes, uint32_t* ret_width, uint32_t* ret_height)
+{
+	/* get the dimensions of an image file, we read only the first bytes; for JPEGs, the dimensions may be behind
+	some metadata chunks, so we read up to `max_bytes` */
+	int    success = 0;
+	FILE*  f = NULL;
+	char*  buf = NULL;
+	size_t buf_bytes = 0;
+
+	if( (f=fopen(pathNfilename, "rb"))==NULL ) {
+		goto cleanup;
+	}
+
+	if( (buf=malloc(max_bytes))==NULL ) {
+		exit(55);
+	}
+
+	buf_bytes = fread(buf, 1, max_bytes, f);
+	success = mr_get_filemeta(buf, buf_bytes, ret_width, ret_height);
+
+cleanup:
+	if( f ) { fclose(f); }
+	free(buf);
+	return success;
+}
+
+
 static void do_add_single_file_part(mrmimeparser_t* parser, int msg_type, int mime_type,
-                                    const char* decoded_data, size_t decoded_data_bytes,
+                                    const char* data, size_t data_bytes, int data_encoding,
                                     const char* desired_filename)
 {
+	/* `data` is decoded using `data_encoding` while it is written to the file, see mailmime_transfer_decode_to_file();
+	for data that are already decoded, `data_encoding` is MAILMIME_MECHANISM_BINARY */
 	mrmimepart_t* part = NULL;
 	char*         pathNfilename = NULL;
+	size_t        buffer_bytes = parser->m_mailbox? parser->m_mailbox->m_decode_buffer_bytes : MR_DECODE_BUFFER_BYTES;
+	size_t        decoded_data_bytes = 0;
+
+	/* create a free file name to use; as messages may be parsed in parallel, the name is reserved by creating an empty file */
+	pthread_mutex_lock(&parser->m_mailbox->m_blobdir_critical);
+		if( (pathNfilename=mr_get_fine_pathNfilename(parser->m_blobdir, desired_filename)) != NULL ) {
+			mr_write_file(pathNfilename, "", 0, parser->m_mailbox);
+		}
+	pthread_mutex_unlock(&parser->m_mailbox->m_blobdir_critical);
+	if( pathNfilename == NULL ) {
+		goto cleanup;
+	}
 
-	/* create a free file name to use */
-	if( (pathNfilename=mr_get_fine_pathNfilename(parser->m_blobdir, desired_filename)) == NULL ) {
+	/* decode data to file */
+	if( !mailmime_transfer_decode_to_file(data, data_bytes, data_encoding, buffer_bytes, pathNfilename, &decoded_data_bytes) ) {
+		mrmailbox_log_warning(parser->m_mailbox, 0, "Cannot write %lu bytes to \"%s\".", (unsigned long)data_bytes, pathNfilename);
+		mr_delete_file(pathNfilename, parser->m_mailbox);
 		goto cleanup;
 	}
 
-	/* copy data to file */
-	if( mr_write_file(pathNfilename, decoded_data, decoded_data_bytes, parser->m_mailbox)==0 ) {
+	if( decoded_data_bytes <= 0 ) {
+		mr_delete_file(pathNfilename, parser->m_mailbox); /* no error - but no data */
 		goto cleanup;
 	}
 
-	part = mrmimepart_new();
+	part = mrmimepart_new(parser);
 	part->m_type  = msg_type;
 	part->m_int_mimetype = mime_type;
 	part->m_bytes = decoded_data_bytes;
 	mrparam_set(part->m_param, MRP_FILE, pathNfilename);
 	if( MR_MSG_MAKE_FILENAME_SEARCHABLE(msg_type) ) {
-		part->m_msg = mr_get_filename(pathNfilename);
+		char* filename = mr_get_filename(pathNfilename);
+		part->m_msg = mrarena_strdup(parser->m_arena, filename);
+		free(filename);
 	}
 	else if( MR_MSG_MAKE_SUFFIX_SEARCHABLE(msg_type) ) {
-		part->m_msg = mr_get_filesuffix_lc(pathNfilename);
+		char* suffix = mr_get_filesuffix_lc(pathNfilename);
+		part->m_msg = suffix? mrarena_strdup(parser->m_arena, suffix) : NULL;
+		free(suffix);
 	}
 
 	if( mime_type == MR_MIMETYPE_IMAGE ) {
 		uint32_t w = 0, h = 0;
-		if( mr_get_filemeta(decoded_data, decoded_data_bytes, &w, &h) ) {
+		if( get_image_size(pathNfilename, MR_MIN(decoded_data_bytes, buffer_bytes), &w, &h) ) {
 			mrparam_set_int(part->m_param, MRP_WIDTH, w);
 			mrparam_set_int(part->m_param, MRP_HEIGHT, h);
 		}
@@ -1043,18 +1255,18 @@ static int mrmimeparser_add_single_part_if_known(mrmimeparser_t* ths, struct mai
 	}
 
 
-	/* regard `Content-Transfer-Encoding:` */
-	if( !mailmime_transfer_decode(mime, &decoded_data, &decoded_data_bytes, &transfer_decoding_buffer) ) {
-		goto cleanup; /* no always error - but no data */
-	}
-
 	switch( mime_type )
 	{
 		case MR_MIMETYPE_TEXT_PLAIN:
 		case MR_MIMETYPE_TEXT_HTML:
 			{
+				/* regard `Content-Transfer-Encoding:` */
+				if( !mailmime_transfer_decode(mime, &decoded_data, &decoded_data_bytes, &transfer_decoding_buffer) ) {
+					goto cleanup; /* no always error - but no data */
+				}
+
 				if( simplifier==NULL ) {
-					simplifier = mrsimplify_new();
+					simplifier = mrsimplify_new(ths->m_arena);
 					if( simplifier==NULL ) {
 						goto cleanup;
 					}
@@ -1078,7 +1290,7 @@ static int mrmimeparser_add_single_part_if_known(mrmimeparser_t* ths, struct mai
 				}
 
 				// add uuencoded stuff as MR_MSG_FILE/MR_MSG_IMAGE/etc. parts
-				char* txt = strndup(decoded_data, decoded_data_bytes);
+				char* txt = mrarena_strndup(ths->m_arena, decoded_data, decoded_data_bytes);
 				{
 					char*  uu_blob = NULL, *uu_filename = NULL, *new_txt = NULL;
 					size_t uu_blob_bytes = 0;
@@ -1090,9 +1302,10 @@ static int mrmimeparser_add_single_part_if_known(mrmimeparser_t* ths, struct mai
 							uu_msg_type = MR_MSG_FILE;
 						}
 
-						do_add_single_file_part(ths, uu_msg_type, 0, uu_blob, uu_blob_bytes, uu_filename);
+						do_add_single_file_part(ths, uu_msg_type, 0, uu_blob, uu_blob_bytes, MAILMIME_MECHANISM_BINARY, uu_filename);
 
-						free(txt);         txt = new_txt; new_txt = NULL;
+						txt = mrarena_strdup(ths->m_arena, new_txt);
+						free(new_txt);     new_txt = NULL;
 						free(uu_blob);     uu_blob = NULL; uu_blob_bytes = 0; uu_msg_type = 0;
 						free(uu_filename); uu_filename = NULL;
 
@@ -1104,23 +1317,20 @@ static int mrmimeparser_add_single_part_if_known(mrmimeparser_t* ths, struct mai
 				}
 
 				// add text as MR_MSG_TEXT part
-				char* simplified_txt = mrsimplify_simplify(simplifier, txt, strlen(txt), mime_type==MR_MIMETYPE_TEXT_HTML? 1 : 0);
-				free(txt);
+				uint64_t simplify_start = mr_monotonic_us();
+				char* simplified_txt = mrsimplify_simplify(simplifier, txt, strlen(txt), mime_type==MR_MIMETYPE_TEXT_HTML? 1 : 0); /* allocated in the arena */
+				ths->m_simplify_us += mr_monotonic_us() - simplify_start;
 				txt = NULL;
 				if( simplified_txt && simplified_txt[0] )
 				{
-					part = mrmimepart_new();
+					part = mrmimepart_new(ths);
 					part->m_type = MR_MSG_TEXT;
 					part->m_int_mimetype = mime_type;
 					part->m_msg = simplified_txt;
-					part->m_msg_raw = strndup(decoded_data, decoded_data_bytes);
+					part->m_msg_raw = mrarena_strndup(ths->m_arena, decoded_data, decoded_data_bytes);
 					do_add_single_part(ths, part);
 					part = NULL;
 				}
-				else
-				{
-					free(simplified_txt);
-				}
 
 				if( simplifier->m_is_forwarded ) {
 					ths->m_is_forwarded = 1;
@@ -1198,7 +1408,9 @@ static int mrmimeparser_add_single_part_if_known(mrmimeparser_t* ths, struct mai
 
 				mr_replace_bad_utf8_chars(desired_filename);
 
-				do_add_single_file_part(ths, msg_type, mime_type, decoded_data, decoded_data_bytes, desired_filename);
+				/* the data are decoded while they are written to the file, so large attachments are never decoded to memory at once */
+				do_add_single_file_part(ths, msg_type, mime_type, mime_data->dt_data.dt_text.dt_data, mime_data->dt_data.dt_text.dt_length,
+					mailmime_transfer_encoding(mime), desired_filename);
 			}
 			break;
 
@@ -1303,11 +1515,11 @@ static int mrmimeparser_parse_mime_recursive(mrmimeparser_t* ths, struct mailmim
 
 				case MR_MIMETYPE_MP_NOT_DECRYPTABLE:
 					{
-						mrmimepart_t* part = mrmimepart_new();
+						mrmimepart_t* part = mrmimepart_new(ths);
 						part->m_type = MR_MSG_TEXT;
 
 						char* msg_body = mrstock_str(MR_STR_CANTDECRYPT_MSG_BODY);
-						part->m_msg = mr_mprintf(MR_EDITORIAL_OPEN "%s" MR_EDITORIAL_CLOSE, msg_body);
+						part->m_msg = mrarena_mprintf(ths->m_arena, MR_EDITORIAL_OPEN "%s" MR_EDITORIAL_CLOSE, msg_body);
 						free(msg_body);
 
 						carray_add(ths->m_parts, (void*)part, NULL);
@@ -1482,8 +1694,10 @@ void mrmimeparser_parse(mrmimeparser_t* ths, const char* body_not_terminated, si
 {
 	int r;
 	size_t index = 0;
+	uint64_t start, decrypt_start;
 
 	mrmimeparser_empty(ths);
+	start = mr_monotonic_us();
 
 	/* parse body */
 	r = mailmime_parse(body_not_terminated, body_bytes, &index, &ths->m_mimeroot);
@@ -1495,7 +1709,9 @@ void mrmimeparser_parse(mrmimeparser_t* ths, const char* body_not_terminated, si
 
 	/* decrypt, if possible; handle Autocrypt:-header
 	(decryption may modifiy the given object) */
+	decrypt_start = mr_monotonic_us();
 	mrmailbox_e2ee_decrypt(ths->m_mailbox, ths->m_mimeroot, ths->m_e2ee_helper);
+	ths->m_decrypt_us = mr_monotonic_us() - decrypt_start;
 
 	//printf("after decryption:\n"); mailmime_print(ths->m_mimeroot);
 
@@ -1514,7 +1730,11 @@ void mrmimeparser_parse(mrmimeparser_t* ths, const char* body_not_terminated, si
 	{
 		struct mailimf_field* field = mrmimeparser_lookup_field(ths, "Subject");
 		if( field && field->fld_type == MAILIMF_FIELD_SUBJECT ) {
-			ths->m_subject = mr_decode_header_words(field->fld_data.fld_subject->sbj_value);
+			char* subject = mr_decode_header_words(field->fld_data.fld_subject->sbj_value);
+			if( subject ) {
+				ths->m_subject = mrarena_strdup(ths->m_arena, subject);
+				free(subject);
+			}
 		}
 	}
 
@@ -1563,7 +1783,7 @@ void mrmimeparser_parse(mrmimeparser_t* ths, const char* body_not_terminated, si
 
 		if( prepend_subject )
 		{
-			char* subj = safe_strdup(ths->m_subject);
+			char* subj = mrarena_strdup(ths->m_arena, ths->m_subject);
 			char* p = strchr(subj, '['); /* do not add any tags as "[checked by XYZ]" */
 			if( p ) {
 				*p = 0;
@@ -1575,14 +1795,11 @@ void mrmimeparser_parse(mrmimeparser_t* ths, const char* body_not_terminated, si
 					mrmimepart_t* part = (mrmimepart_t*)carray_get(ths->m_parts, i);
 					if( part->m_type == MR_MSG_TEXT ) {
 						#define MR_NDASH "\xE2\x80\x93"
-						char* new_txt = mr_mprintf("%s " MR_NDASH " %s", subj, part->m_msg);
-						free(part->m_msg);
-						part->m_msg = new_txt;
+						part->m_msg = mrarena_mprintf(ths->m_arena, "%s " MR_NDASH " %s", subj, part->m_msg);
 						break;
 					}
 				}
 			}
-			free(subj);
 		}
 	}
 
@@ -1602,8 +1819,7 @@ void mrmimeparser_parse(mrmimeparser_t* ths, const char* body_not_terminated, si
 		mrmimepart_t* part = (mrmimepart_t*)carray_get(ths->m_parts, 0);
 		if( part->m_type == MR_MSG_AUDIO ) {
 			if( mrmimeparser_lookup_optional_field2(ths, "Chat-Voice-Message", "X-MrVoiceMessage") ) {
-				free(part->m_msg);
-				part->m_msg = strdup("ogg"); /* MR_MSG_AUDIO adds sets the whole filename which is useless. however, the extension is useful. */
+				part->m_msg = mrarena_strdup(ths->m_arena, "ogg"); /* MR_MSG_AUDIO adds sets the whole filename which is useless. however, the extension is useful. */
 				part->m_type = MR_MSG_VOICE;
 				mrparam_set(part->m_param, MRP_AUTHORNAME, NULL); /* remove unneeded information */
 				mrparam_set(part->m_param, MRP_TRACKNAME, NULL);
@@ -1678,11 +1894,13 @@ void mrmimeparser_parse(mrmimeparser_t* ths, const char* body_not_terminated, si
 	/* Cleanup - and try to create at least an empty part if there are no parts yet */
 cleanup:
 	if( !mrmimeparser_has_nonmeta(ths) && carray_count(ths->m_reports)==0 ) {
-		mrmimepart_t* part = mrmimepart_new();
+		mrmimepart_t* part = mrmimepart_new(ths);
 		part->m_type = MR_MSG_TEXT;
-		part->m_msg = safe_strdup(ths->m_subject? ths->m_subject : "Empty message");
+		part->m_msg = mrarena_strdup(ths->m_arena, ths->m_subject? ths->m_subject : "Empty message");
 		carray_add(ths->m_parts, (void*)part, NULL);
 	}
+
+	ths->m_parse_us = mr_monotonic_us() - start - ths->m_decrypt_us - ths->m_simplify_us;
 }
 
 
@@ -34,6 +34,7 @@ extern "C" {
 
 #include "mrhash.h"
 #include "mrparam.h"
+#include "mrarena.h"
 
 
 typedef struct mrmailbox_e2ee_helper_t mrmailbox_e2ee_helper_t;
@@ -45,8 +46,8 @@ typedef struct mrmimepart_t
 	int                 m_type; /*one of MR_MSG_* */
 	int                 m_is_meta; /*meta parts contain eg. profile or group images and are only present if there is at least one "normal" part*/
 	int                 m_int_mimetype;
-	char*               m_msg;
-	char*               m_msg_raw;
+	char*               m_msg;              /* allocated in mrmimeparser_t::m_arena */
+	char*               m_msg_raw;          /* allocated in mrmimeparser_t::m_arena */
 	int                 m_bytes;
 	mrparam_t*          m_param;
 
@@ -65,7 +66,7 @@ typedef struct mrmimeparser_t
 	struct mailimf_fields* m_header_root;       /* must NOT be freed, do not use for query, merged into m_header, a pointer somewhere to the MIME data*/
 	struct mailimf_fields* m_header_protected;  /* MUST be freed, do not use for query, merged into m_header  */
 
-	char*                  m_subject;
+	char*                  m_subject;           /* allocated in mrmimeparser_t::m_arena */
 	int                    m_is_send_by_messenger;
 
 	int                    m_decrypting_failed; /* set, if there are multipart/encrypted parts left after decryption */
@@ -82,9 +83,19 @@ typedef struct mrmimeparser_t
 
 	int                    m_is_system_message;
 
+	mrarena_t*             m_arena;             /* temporary data of the parsed message, eg. the parts and their texts; released at once by mrmimeparser_empty() */
+
+	uint64_t               m_decrypt_us;        /* time taken by the last mrmimeparser_parse() for decrypting, for simplifying the texts and for the rest, for statistics */
+	uint64_t               m_simplify_us;
+	uint64_t               m_parse_us;
+
 } mrmimeparser_t;
 
 
+#define MR_DECODE_BUFFER_BYTES     (256*1024) /* default for the config-option decode_buffer_bytes */
+#define MR_DECODE_BUFFER_MIN_BYTES (4*1024)
+
+
 mrmimeparser_t*  mrmimeparser_new                    (const char* blobdir, mrmailbox_t*);
 void             mrmimeparser_unref                  (mrmimeparser_t*);
 void             mrmimeparser_empty                  (mrmimeparser_t*);
@@ -108,7 +119,10 @@ int                            mrmimeparser_sender_equals_recipient(mrmimeparser
 void                           mailmime_print                (struct mailmime*);
 #endif
 struct mailmime_parameter*     mailmime_find_ct_parameter    (struct mailmime*, const char* name);
+int                            mailmime_transfer_encoding    (struct mailmime*);
+int                            mailmime_part_decode          (const char* encoded, size_t encoded_bytes, int encoding, char** ret_to_mmap_string_unref, size_t* ret_decoded_bytes);
 int                            mailmime_transfer_decode      (struct mailmime*, const char** ret_decoded_data, size_t* ret_decoded_data_bytes, char** ret_to_mmap_string_unref);
+int                            mailmime_transfer_decode_to_file (const char* encoded, size_t encoded_bytes, int encoding, size_t buffer_bytes, const char* pathNfilename, size_t* ret_decoded_bytes);
 struct mailimf_fields*         mailmime_find_mailimf_fields  (struct mailmime*); /*the result is a pointer to mime, must not be freed*/
 char*                          mailimf_find_first_addr       (const struct mailimf_mailbox_list*); /*the result must be freed*/
 struct mailimf_field*          mailimf_find_field            (struct mailimf_fields*, int wanted_fld_type); /*the result is a pointer to mime, must not be freed*/
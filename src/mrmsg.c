@@ -1160,7 +1160,7 @@ void mrmsg_save_param_to_disk__(mrmsg_t* msg)
 
 	sqlite3_stmt* stmt = mrsqlite3_predefine__(msg->m_mailbox->m_sql, UPDATE_msgs_SET_param_WHERE_id,
 		"UPDATE msgs SET param=? WHERE id=?;");
-	sqlite3_bind_text(stmt, 1, msg->m_param->m_packed, -1, SQLITE_STATIC);
+	sqlite3_bind_text(stmt, 1, mrparam_get_packed(msg->m_param), -1, SQLITE_STATIC);
 	sqlite3_bind_int (stmt, 2, msg->m_id);
 	sqlite3_step(stmt);
 }
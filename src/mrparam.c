@@ -27,35 +27,90 @@
 #include "mrtools.h"
 
 
-static char* find_param(char* ths, int key, char** ret_p2)
+/* one key=value pair; m_value points either into mrparam_t::m_packed (then it
+is not null-terminated) or to memory owned by the slot */
+struct mrparamslot_t
 {
-	char *p1, *p2;
+	const char*     m_value;
+	size_t          m_bytes;
+	int32_t         m_int;       /* the decoded value, valid if m_int_valid is set */
+	uint8_t         m_key;
+	uint8_t         m_owned;
+	uint8_t         m_int_valid;
+};
 
-	/* let p1 point to the start of the */
-	p1 = ths;
-	while( 1 ) {
-		if( p1 == NULL || *p1 == 0 ) {
-			return NULL;
+
+static void free_slots(mrparam_t* param)
+{
+	int i;
+	for( i = 0; i < param->m_slots_cnt; i++ ) {
+		if( param->m_slots[i].m_owned ) {
+			free((char*)param->m_slots[i].m_value);
 		}
-		else if( *p1 == key && p1[1] == '=' ) {
-			break;
+	}
+	param->m_slots_cnt = 0;
+	memset(param->m_slot_of, 0, sizeof(param->m_slot_of));
+}
+
+
+static mrparamslot_t* add_slot(mrparam_t* param, int key, const char* value, size_t bytes, int owned)
+{
+	if( param->m_slots_cnt >= param->m_slots_alloc ) {
+		param->m_slots_alloc = param->m_slots_alloc? param->m_slots_alloc*2 : 8;
+		if( (param->m_slots=realloc(param->m_slots, param->m_slots_alloc*sizeof(mrparamslot_t)))==NULL ) {
+			exit(29); /* cannot allocate little memory, unrecoverable error */
+		}
+	}
+
+	mrparamslot_t* slot = &param->m_slots[param->m_slots_cnt++];
+	slot->m_value     = value;
+	slot->m_bytes     = bytes;
+	slot->m_int       = 0;
+	slot->m_key       = key;
+	slot->m_owned     = owned;
+	slot->m_int_valid = 0;
+	param->m_slot_of[key] = param->m_slots_cnt;
+	return slot;
+}
+
+
+static void build_index(mrparam_t* param)
+{
+	/* the packed string is scanned only once, this is also where the lenient parsing happens:
+	lines that are no `k=value` pairs are skipped, for duplicate keys the first one wins */
+	const char *p1 = param->m_packed, *p2;
+
+	free_slots(param);
+
+	while( *p1 ) {
+		p2 = strchr(p1, '\n'); /* if `\r\n` is used, the `\r` is part of the value and removed by mrparam_get() */
+		if( p2 == NULL ) {
+			p2 = &p1[strlen(p1)];
 		}
-		else {
-			p1 = strchr(p1, '\n'); /* if `\r\n` is used, this `\r` is also skipped by this*/
-			if( p1 ) {
-				p1++;
-			}
+
+		int key = (unsigned char)p1[0];
+		if( key < MRPARAM_KEYS && p1[1] == '=' && param->m_slot_of[key] == 0 ) {
+			add_slot(param, key, &p1[2], p2-&p1[2], 0);
 		}
+
+		p1 = *p2? p2+1 : p2;
 	}
 
-	/* let p2 point to the character _after_ the value - eiter `\n` or `\0` */
-	p2 = strchr(p1, '\n');
-	if( p2 == NULL ) {
-		p2 = &p1[strlen(p1)];
+	param->m_indexed = 1;
+}
+
+
+static mrparamslot_t* find_slot(mrparam_t* param, int key)
+{
+	if( key <= 0 || key >= MRPARAM_KEYS ) {
+		return NULL;
 	}
 
-	*ret_p2 = p2;
-	return p1;
+	if( !param->m_indexed ) {
+		build_index(param);
+	}
+
+	return param->m_slot_of[key]? &param->m_slots[param->m_slot_of[key]-1] : NULL;
 }
 
 
@@ -95,6 +150,7 @@ void mrparam_unref(mrparam_t* param)
 
 	mrparam_empty(param);
 	free(param->m_packed);
+	free(param->m_slots);
 	free(param);
 }
 
@@ -114,6 +170,10 @@ void mrparam_empty(mrparam_t* param)
 		return;
 	}
 
+	free_slots(param);
+	param->m_indexed = 1;
+	param->m_dirty = 0;
+
 	param->m_packed[0] = 0;
 }
 
@@ -143,10 +203,73 @@ void mrparam_set_packed(mrparam_t* param, const char* packed)
 	if( packed ) {
 		free(param->m_packed);
 		param->m_packed = safe_strdup(packed);
+		param->m_indexed = 0; /* the index is built on the first access, many objects are loaded only to read the packed string again */
 	}
 }
 
 
+/**
+ * Get the parameter set in packed form as `a=value1\nb=value2`, suitable to
+ * be stored in the `param` columns of the database and to be read by mrparam_set_packed().
+ *
+ * If the parameters were modified, the packed string is rebuilt here.
+ *
+ * @private @memberof mrparam_t
+ *
+ * @param param Parameter object to query.
+ *
+ * @return The packed parameters, never NULL.  The string must not be free()'d
+ *     and is valid until the object is modified or freed.
+ */
+const char* mrparam_get_packed(mrparam_t* param)
+{
+	char*  packed;
+	char*  p;
+	size_t bytes = 1;
+	int    i;
+
+	if( param == NULL ) {
+		return "";
+	}
+
+	if( !param->m_dirty ) {
+		return param->m_packed;
+	}
+
+	for( i = 0; i < param->m_slots_cnt; i++ ) {
+		bytes += param->m_slots[i].m_bytes + 3/*key, `=` and `\n`*/;
+	}
+
+	if( (packed=malloc(bytes))==NULL ) {
+		exit(30); /* cannot allocate little memory, unrecoverable error */
+	}
+
+	/* write the new string and let the slots point to it, so that owned values can be released */
+	p = packed;
+	for( i = 0; i < param->m_slots_cnt; i++ ) {
+		mrparamslot_t* slot = &param->m_slots[i];
+		if( i ) {
+			*p++ = '\n';
+		}
+		*p++ = slot->m_key;
+		*p++ = '=';
+		memcpy(p, slot->m_value, slot->m_bytes);
+		if( slot->m_owned ) {
+			free((char*)slot->m_value);
+			slot->m_owned = 0;
+		}
+		slot->m_value = p;
+		p += slot->m_bytes;
+	}
+	*p = 0;
+
+	free(param->m_packed);
+	param->m_packed = packed;
+	param->m_dirty = 0;
+	return param->m_packed;
+}
+
+
 /**
  * Same as mrparam_set_packed() but uses '&' as a separator (instead '\n').
  * Urldecoding itself is not done by this function, this is up to the caller.
@@ -163,6 +286,7 @@ void mrparam_set_urlencoded(mrparam_t* param, const char* urlencoded)
 		free(param->m_packed);
 		param->m_packed = safe_strdup(urlencoded);
 		mr_str_replace(&param->m_packed, "&", "\n");
+		param->m_indexed = 0;
 	}
 }
 
@@ -180,13 +304,11 @@ void mrparam_set_urlencoded(mrparam_t* param, const char* urlencoded)
  */
 int mrparam_exists(mrparam_t* param, int key)
 {
-	char *p2;
-
 	if( param == NULL || key == 0 ) {
 		return 0;
 	}
 
-	return find_param(param->m_packed, key, &p2)? 1 : 0;
+	return find_slot(param, key)? 1 : 0;
 }
 
 
@@ -205,24 +327,23 @@ int mrparam_exists(mrparam_t* param, int key)
  */
 char* mrparam_get(mrparam_t* param, int key, const char* def)
 {
-	char *p1, *p2, bak, *ret;
+	mrparamslot_t* slot;
+	char*          ret;
 
 	if( param == NULL || key == 0 ) {
 		return def? safe_strdup(def) : NULL;
 	}
 
-	p1 = find_param(param->m_packed, key, &p2);
-	if( p1 == NULL ) {
+	if( (slot=find_slot(param, key)) == NULL ) {
 		return def? safe_strdup(def) : NULL;
 	}
 
-	p1 += 2; /* skip key and "=" (safe as find_param checks for its existance) */
-
-	bak = *p2;
-	*p2 = 0;
-	ret = safe_strdup(p1);
+	if( (ret=malloc(slot->m_bytes+1))==NULL ) {
+		exit(31); /* cannot allocate little memory, unrecoverable error */
+	}
+	memcpy(ret, slot->m_value, slot->m_bytes);
+	ret[slot->m_bytes] = 0;
 	mr_rtrim(ret); /* to be safe with '\r' characters ... */
-	*p2 = bak;
 	return ret;
 }
 
@@ -242,17 +363,23 @@ char* mrparam_get(mrparam_t* param, int key, const char* def)
  */
 int32_t mrparam_get_int(mrparam_t* param, int key, int32_t def)
 {
+	mrparamslot_t* slot;
+
 	if( param == NULL || key == 0 ) {
 		return def;
 	}
 
-    char* str = mrparam_get(param, key, NULL);
-    if( str == NULL ) {
+	if( (slot=find_slot(param, key)) == NULL ) {
 		return def;
-    }
-    int32_t ret = atol(str);
-    free(str);
-    return ret;
+	}
+
+	if( !slot->m_int_valid ) {
+		/* the value is terminated by `\n` or `\0`, both stop atol() */
+		slot->m_int = atol(slot->m_value);
+		slot->m_int_valid = 1;
+	}
+
+	return slot->m_int;
 }
 
 
@@ -272,53 +399,46 @@ int32_t mrparam_get_int(mrparam_t* param, int key, int32_t def)
 
 void mrparam_set(mrparam_t* param, int key, const char* value)
 {
-	char *old1, *old2, *new1 = NULL;
+	mrparamslot_t* slot;
+	int            i;
 
-	if( param == NULL || key == 0 ) {
+	if( param == NULL || key <= 0 || key >= MRPARAM_KEYS ) {
 		return;
 	}
 
-	old1 = param->m_packed;
-	old2 = NULL;
-
-	/* remove existing parameter from packed string, if any */
-	if( old1 ) {
-		char *p1, *p2;
-		p1 = find_param(old1, key, &p2);
-		if( p1 != NULL ) {
-			*p1 = 0;
-			old2 = p2;
-		}
-		else if( value==NULL ) {
+	if( (slot=find_slot(param, key)) == NULL )
+	{
+		if( value == NULL ) {
 			return; /* parameter does not exist and should be cleared -> done. */
 		}
+		add_slot(param, key, safe_strdup(value), strlen(value), 1);
 	}
-
-	mr_rtrim(old1); /* trim functions are null-pointer-safe */
-	mr_ltrim(old2);
-
-	if( old1 && old1[0]==0 ) { old1 = NULL; }
-	if( old2 && old2[0]==0 ) { old2 = NULL; }
-
-	/* create new string */
-	if( value ) {
-		new1 = mr_mprintf("%s%s%c=%s%s%s",
-			old1?  old1 : "",
-			old1?  "\n" : "",
-			key,
-			value,
-			old2?  "\n" : "",
-			old2?  old2 : "");
+	else if( value == NULL )
+	{
+		/* remove the slot, keeping the order of the others */
+		int pos = param->m_slot_of[key]-1;
+		if( slot->m_owned ) {
+			free((char*)slot->m_value);
+		}
+		memmove(&param->m_slots[pos], &param->m_slots[pos+1], (param->m_slots_cnt-pos-1)*sizeof(mrparamslot_t));
+		param->m_slots_cnt--;
+		param->m_slot_of[key] = 0;
+		for( i = pos; i < param->m_slots_cnt; i++ ) {
+			param->m_slot_of[param->m_slots[i].m_key] = i+1;
+		}
 	}
-	else {
-		new1 = mr_mprintf("%s%s%s",
-			old1?         old1 : "",
-			(old1&&old2)? "\n" : "",
-			old2?         old2 : "");
+	else
+	{
+		if( slot->m_owned ) {
+			free((char*)slot->m_value);
+		}
+		slot->m_value     = safe_strdup(value);
+		slot->m_bytes     = strlen(value);
+		slot->m_owned     = 1;
+		slot->m_int_valid = 0;
 	}
 
-	free(param->m_packed);
-	param->m_packed = new1;
+	param->m_dirty = 1;
 }
 
 
@@ -347,4 +467,10 @@ void mrparam_set_int(mrparam_t* param, int key, int32_t value)
     }
     mrparam_set(param, key, value_str);
     free(value_str);
+
+    mrparamslot_t* slot = find_slot(param, key);
+    if( slot ) {
+		slot->m_int = value;
+		slot->m_int_valid = 1;
+    }
 }
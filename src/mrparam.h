@@ -27,19 +27,34 @@ extern "C" {
 #endif
 
 
+typedef struct mrparamslot_t mrparamslot_t;
+
+
 /**
  * An object for handling key=value parameter lists; for the key, curently only
- * a single character is allowed.
+ * a single ASCII character is allowed.
  *
  * The object is used eg. by mrchat_t or mrmsg_t, for readable paramter names,
  * these classes define some MRP_* constantats.
  *
+ * The parameters are indexed by key the first time they are accessed after
+ * mrparam_set_packed(); modifications go to the index and the packed string is
+ * only rebuilt when it is read using mrparam_get_packed().
+ *
  * Only for library-internal use.
  */
 typedef struct mrparam_t
 {
 	/** @privatesection */
-	char*           m_packed;    /**< Always set, never NULL. */
+	char*           m_packed;    /**< Always set, never NULL.  May be outdated, use mrparam_get_packed() to read it. */
+
+	#define         MRPARAM_KEYS 128
+	int             m_indexed;   /**< 1=m_slot_of and m_slots reflect the parameters, 0=index not yet built from m_packed */
+	int             m_dirty;     /**< 1=m_packed is outdated and must be rebuilt from m_slots */
+	uint8_t         m_slot_of[MRPARAM_KEYS]; /**< 1-based position in m_slots for each key, 0=key not set */
+	mrparamslot_t*  m_slots;     /**< The parameters in the order they appear in the packed string */
+	int             m_slots_cnt;
+	int             m_slots_alloc;
 } mrparam_t;
 
 
@@ -89,6 +104,7 @@ mrparam_t*      mrparam_new            ();
 void            mrparam_empty          (mrparam_t*);
 void            mrparam_unref          (mrparam_t*);
 void            mrparam_set_packed     (mrparam_t*, const char*);
+const char*     mrparam_get_packed     (mrparam_t*); /* the returned string is valid until the object is modified */
 void            mrparam_set_urlencoded (mrparam_t*, const char*);
 
 
@@ -309,7 +309,9 @@ int mrpgp_create_keypair(mrmailbox_t* mailbox, const char* addr, mrkey_t* ret_pu
 	memset(&pubkey, 0, sizeof(pgp_key_t));
 	memset(&subkey, 0, sizeof(pgp_key_t));
 
-	if( mailbox==NULL || addr==NULL || ret_public_key==NULL || ret_private_key==NULL
+	/* `mailbox` and `addr` may be NULL; the address is not used (see below), so
+	keypairs can be generated before the address is known (see mrkeypool.c) */
+	if( ret_public_key==NULL || ret_private_key==NULL
 	 || pubmem==NULL || secmem==NULL || pubout==NULL || secout==NULL ) {
 		goto cleanup;
 	}
@@ -396,6 +398,226 @@ cleanup:
 }
 
 
+/*******************************************************************************
+ * Parsed keys
+ ******************************************************************************/
+
+
+/* Parsing a key using pgp_filter_keys_from_mem() takes much longer than
+encrypting a session key to it, so the parsed keys are kept in a process-wide
+LRU cache.  The cache is keyed by the binary key; as the fingerprint is
+calculated from the key data, this is the same as a cache by fingerprint, but
+works without parsing.
+
+Entries are reference counted as they may be used by several threads (parsing
+messages in parallel); the cache holds one reference.  The parsed keys are not
+modified after they are added to the cache; keyrings for netpgp are built using
+pgp_keyring_add() which copies the pgp_key_t structure but not the key material,
+such keyrings must be freed using pgp_keyring_free(), not pgp_keyring_purge(). */
+typedef struct mrpgpkey_t
+{
+	int                m_refcnt;            /* protected by s_keycache_critical */
+	void*              m_binary;            /* the raw key, also used as the key in s_keycache */
+	int                m_bytes;
+	pgp_keyring_t      m_public_keys;
+	pgp_keyring_t      m_private_keys;
+	uint8_t*           m_fingerprint;       /* fingerprint of the first public key, NULL if there is no public key */
+	size_t             m_fingerprint_bytes;
+	int                m_can_sign;          /* set if the first private key passed pgp_rsa_private_check(); netpgp does not check the key on signing */
+	struct mrpgpkey_t* m_prev;              /* more recently used entry */
+	struct mrpgpkey_t* m_next;              /* less recently used entry */
+} mrpgpkey_t;
+
+
+#define MR_PGP_KEY_CACHE_SIZE 256
+static pthread_mutex_t s_keycache_critical = PTHREAD_MUTEX_INITIALIZER;
+static mrhash_t        s_keycache;          /* binary key -> mrpgpkey_t */
+static int             s_keycache_initialized = 0;
+static mrpgpkey_t*     s_keycache_first = NULL;
+static mrpgpkey_t*     s_keycache_last = NULL;
+static uint32_t        s_keycache_hits = 0;
+static uint32_t        s_keycache_misses = 0;
+
+
+static void pgpkey_unref__(mrpgpkey_t* pk)
+{
+	if( pk == NULL ) {
+		return;
+	}
+
+	pk->m_refcnt--;
+	if( pk->m_refcnt > 0 ) {
+		return;
+	}
+
+	pgp_keyring_purge(&pk->m_public_keys);
+	pgp_keyring_purge(&pk->m_private_keys);
+	free(pk->m_fingerprint);
+	free(pk->m_binary);
+	free(pk);
+}
+
+
+static void pgpkey_unref(mrpgpkey_t* pk)
+{
+	pthread_mutex_lock(&s_keycache_critical);
+		pgpkey_unref__(pk);
+	pthread_mutex_unlock(&s_keycache_critical);
+}
+
+
+static void keycache_unlink__(mrpgpkey_t* pk)
+{
+	if( pk->m_prev ) { pk->m_prev->m_next = pk->m_next; } else { s_keycache_first = pk->m_next; }
+	if( pk->m_next ) { pk->m_next->m_prev = pk->m_prev; } else { s_keycache_last = pk->m_prev; }
+	pk->m_prev = NULL;
+	pk->m_next = NULL;
+}
+
+
+static void keycache_link_first__(mrpgpkey_t* pk)
+{
+	pk->m_prev = NULL;
+	pk->m_next = s_keycache_first;
+	if( s_keycache_first ) { s_keycache_first->m_prev = pk; } else { s_keycache_last = pk; }
+	s_keycache_first = pk;
+}
+
+
+static void keycache_remove__(mrpgpkey_t* pk)
+{
+	keycache_unlink__(pk);
+	mrhash_insert(&s_keycache, pk->m_binary, pk->m_bytes, NULL);
+	pgpkey_unref__(pk); /* the reference of the cache */
+}
+
+
+static mrpgpkey_t* keycache_find__(const mrkey_t* raw_key)
+{
+	if( !s_keycache_initialized ) {
+		mrhash_init(&s_keycache, MRHASH_BINARY, MRHASH_NO_COPY);
+		s_keycache_initialized = 1;
+	}
+
+	mrpgpkey_t* pk = (mrpgpkey_t*)mrhash_find(&s_keycache, raw_key->m_binary, raw_key->m_bytes);
+	if( pk && pk != s_keycache_first ) {
+		keycache_unlink__(pk);
+		keycache_link_first__(pk);
+	}
+	return pk;
+}
+
+
+/* Returns the parsed key for the given raw key; the returned object must be
+released using pgpkey_unref().  Returns NULL only for missing data, a key that
+cannot be parsed results in empty keyrings. */
+static mrpgpkey_t* pgpkey_get(const mrkey_t* raw_key)
+{
+	mrpgpkey_t*   pk = NULL;
+	mrpgpkey_t*   other = NULL;
+	pgp_memory_t* keysmem = NULL;
+
+	if( raw_key==NULL || raw_key->m_binary==NULL || raw_key->m_bytes <= 0 ) {
+		return NULL;
+	}
+
+	pthread_mutex_lock(&s_keycache_critical);
+		if( (pk=keycache_find__(raw_key)) != NULL ) {
+			pk->m_refcnt++;
+			s_keycache_hits++;
+		}
+		else {
+			s_keycache_misses++;
+		}
+	pthread_mutex_unlock(&s_keycache_critical);
+
+	if( pk ) {
+		return pk;
+	}
+
+	/* parse the key without holding the lock, parallel parsers should not wait for each other */
+	if( (pk=calloc(1, sizeof(mrpgpkey_t)))==NULL
+	 || (pk->m_binary=malloc(raw_key->m_bytes))==NULL
+	 || (keysmem=pgp_memory_new())==NULL ) {
+		exit(60);
+	}
+	pk->m_refcnt = 1;
+	memcpy(pk->m_binary, raw_key->m_binary, raw_key->m_bytes);
+	pk->m_bytes = raw_key->m_bytes;
+
+	pgp_memory_add(keysmem, raw_key->m_binary, raw_key->m_bytes);
+	pgp_filter_keys_from_mem(&s_io, &pk->m_public_keys, &pk->m_private_keys, NULL, 0, keysmem); /* function returns 0 on any error in any packet - this does not mean, we cannot use the key. The callers check the details. */
+	pgp_memory_free(keysmem);
+
+	if( pk->m_public_keys.keyc > 0 ) {
+		pgp_key_t* key0 = &pk->m_public_keys.keys[0];
+		if( pgp_fingerprint(&key0->pubkeyfpr, &key0->key.pubkey, 0) && key0->pubkeyfpr.length > 0 ) {
+			pk->m_fingerprint_bytes = key0->pubkeyfpr.length;
+			if( (pk->m_fingerprint=malloc(pk->m_fingerprint_bytes))==NULL ) {
+				exit(60);
+			}
+			memcpy(pk->m_fingerprint, key0->pubkeyfpr.fingerprint, pk->m_fingerprint_bytes);
+		}
+	}
+
+	if( pk->m_private_keys.keyc > 0 ) {
+		const pgp_seckey_t* seckey0 = &pk->m_private_keys.keys[0].key.seckey;
+		switch( seckey0->pubkey.alg ) {
+			case PGP_PKA_RSA:
+			case PGP_PKA_RSA_SIGN_ONLY:
+				pk->m_can_sign = pgp_rsa_private_check(seckey0);
+				break;
+			default:
+				pk->m_can_sign = 1;
+				break;
+		}
+	}
+
+	if( pk->m_public_keys.keyc <= 0 && pk->m_private_keys.keyc <= 0 ) {
+		return pk; /* do not let garbage replace usable keys in the cache */
+	}
+
+	pthread_mutex_lock(&s_keycache_critical);
+		if( (other=keycache_find__(raw_key)) != NULL ) {
+			/* another thread was faster; use its key */
+			other->m_refcnt++;
+			pgpkey_unref__(pk);
+			pk = other;
+		}
+		else {
+			if( mrhash_count(&s_keycache) >= MR_PGP_KEY_CACHE_SIZE && s_keycache_last ) {
+				keycache_remove__(s_keycache_last);
+			}
+			pk->m_refcnt++; /* the reference of the cache */
+			mrhash_insert(&s_keycache, pk->m_binary, pk->m_bytes, pk);
+			keycache_link_first__(pk);
+		}
+	pthread_mutex_unlock(&s_keycache_critical);
+
+	return pk;
+}
+
+
+void mrpgp_clear_key_cache(void)
+{
+	pthread_mutex_lock(&s_keycache_critical);
+		while( s_keycache_first ) {
+			keycache_remove__(s_keycache_first);
+		}
+	pthread_mutex_unlock(&s_keycache_critical);
+}
+
+
+void mrpgp_get_key_cache_stat(int* ret_cnt, uint32_t* ret_hits, uint32_t* ret_misses)
+{
+	pthread_mutex_lock(&s_keycache_critical);
+		if( ret_cnt )    { *ret_cnt    = s_keycache_initialized? mrhash_count(&s_keycache) : 0; }
+		if( ret_hits )   { *ret_hits   = s_keycache_hits; }
+		if( ret_misses ) { *ret_misses = s_keycache_misses; }
+	pthread_mutex_unlock(&s_keycache_critical);
+}
+
+
 /*******************************************************************************
  * Check keys
  ******************************************************************************/
@@ -403,71 +625,49 @@ cleanup:
 
 int mrpgp_is_valid_key(mrmailbox_t* mailbox, const mrkey_t* raw_key)
 {
-	int             key_is_valid = 0;
-	pgp_keyring_t*  public_keys = calloc(1, sizeof(pgp_keyring_t));
-	pgp_keyring_t*  private_keys = calloc(1, sizeof(pgp_keyring_t));
-	pgp_memory_t*   keysmem = pgp_memory_new();
+	int         key_is_valid = 0;
+	mrpgpkey_t* pk = NULL;
 
 	if( mailbox==NULL || raw_key==NULL
-	 || raw_key->m_binary == NULL || raw_key->m_bytes <= 0
-	 || public_keys==NULL || private_keys==NULL || keysmem==NULL ) {
+	 || (pk=pgpkey_get(raw_key))==NULL ) {
 		goto cleanup;
 	}
 
-	pgp_memory_add(keysmem, raw_key->m_binary, raw_key->m_bytes);
-	pgp_filter_keys_from_mem(&s_io, public_keys, private_keys, NULL, 0, keysmem); /* function returns 0 on any error in any packet - this does not mean, we cannot use the key. We check the details below therefore. */
-
-	if( raw_key->m_type == MR_PUBLIC && public_keys->keyc >= 1 ) {
+	if( raw_key->m_type == MR_PUBLIC && pk->m_public_keys.keyc >= 1 ) {
 		key_is_valid = 1;
 	}
-	else if( raw_key->m_type == MR_PRIVATE && private_keys->keyc >= 1 ) {
+	else if( raw_key->m_type == MR_PRIVATE && pk->m_private_keys.keyc >= 1 ) {
 		key_is_valid = 1;
 	}
 
 cleanup:
-	if( keysmem )      { pgp_memory_free(keysmem); }
-	if( public_keys )  { pgp_keyring_purge(public_keys); free(public_keys); } /*pgp_keyring_free() frees the content, not the pointer itself*/
-	if( private_keys ) { pgp_keyring_purge(private_keys); free(private_keys); }
+	pgpkey_unref(pk);
 	return key_is_valid;
 }
 
 
 int mrpgp_calc_fingerprint(const mrkey_t* raw_key, uint8_t** ret_fingerprint, size_t* ret_fingerprint_bytes)
 {
-	int             success = 0;
-	pgp_keyring_t*  public_keys = calloc(1, sizeof(pgp_keyring_t));
-	pgp_keyring_t*  private_keys = calloc(1, sizeof(pgp_keyring_t));
-	pgp_memory_t*   keysmem = pgp_memory_new();
+	int         success = 0;
+	mrpgpkey_t* pk = NULL;
 
 	if( raw_key==NULL || ret_fingerprint==NULL || *ret_fingerprint!=NULL || ret_fingerprint_bytes==NULL || *ret_fingerprint_bytes!=0
-	 || raw_key->m_binary == NULL || raw_key->m_bytes <= 0
-	 || public_keys==NULL || private_keys==NULL || keysmem==NULL ) {
-		goto cleanup;
-	}
-
-	pgp_memory_add(keysmem, raw_key->m_binary, raw_key->m_bytes);
-	pgp_filter_keys_from_mem(&s_io, public_keys, private_keys, NULL, 0, keysmem);
-
-	if( raw_key->m_type != MR_PUBLIC || public_keys->keyc <= 0 ) {
+	 || (pk=pgpkey_get(raw_key))==NULL ) {
 		goto cleanup;
 	}
 
-	pgp_key_t* key0 = &public_keys->keys[0];
-	pgp_pubkey_t* pubkey0 = &key0->key.pubkey;
-	if( !pgp_fingerprint(&key0->pubkeyfpr, pubkey0, 0) ) {
+	if( raw_key->m_type != MR_PUBLIC || pk->m_fingerprint == NULL ) {
 		goto cleanup;
 	}
 
-	*ret_fingerprint_bytes = key0->pubkeyfpr.length;
-    *ret_fingerprint = malloc(*ret_fingerprint_bytes);
-	memcpy(*ret_fingerprint, key0->pubkeyfpr.fingerprint, *ret_fingerprint_bytes);
+	*ret_fingerprint_bytes = pk->m_fingerprint_bytes;
+	*ret_fingerprint = malloc(*ret_fingerprint_bytes);
+	memcpy(*ret_fingerprint, pk->m_fingerprint, *ret_fingerprint_bytes);
 
 	success = 1;
 
 cleanup:
-	if( keysmem )      { pgp_memory_free(keysmem); }
-	if( public_keys )  { pgp_keyring_purge(public_keys); free(public_keys); } /*pgp_keyring_free() frees the content, not the pointer itself*/
-	if( private_keys ) { pgp_keyring_purge(private_keys); free(private_keys); }
+	pgpkey_unref(pk);
 	return success;
 }
 
@@ -534,30 +734,39 @@ int mrpgp_pk_encrypt(  mrmailbox_t*       mailbox,
                        size_t*            ret_ctext_bytes)
 {
 	pgp_keyring_t*  public_keys = calloc(1, sizeof(pgp_keyring_t));
-	pgp_keyring_t*  private_keys = calloc(1, sizeof(pgp_keyring_t));
-	pgp_keyring_t*  dummy_keys = calloc(1, sizeof(pgp_keyring_t));
-	pgp_memory_t*   keysmem = pgp_memory_new();
+	mrpgpkey_t**    parsed_keys = NULL;
+	int             parsed_cnt = 0;
+	mrpgpkey_t*     sign_key = NULL;
 	pgp_memory_t*   signedmem = NULL;
-	int             i, success = 0;
+	int             i, j, unexpected_private_keys = 0, success = 0;
 
 	if( mailbox==NULL || plain_text==NULL || plain_bytes==0 || ret_ctext==NULL || ret_ctext_bytes==NULL
 	 || raw_public_keys_for_encryption==NULL || raw_public_keys_for_encryption->m_count<=0
-	 || keysmem==NULL || public_keys==NULL || private_keys==NULL || dummy_keys==NULL ) {
+	 || public_keys==NULL ) {
 		goto cleanup;
 	}
 
 	*ret_ctext       = NULL;
 	*ret_ctext_bytes = 0;
 
-	/* setup keys (the keys may come from pgp_filter_keys_fileread(), see also pgp_keyring_add(rcpts, key)) */
+	/* setup keys; the keyring only references the keys parsed before, see pgpkey_get() */
+	if( (parsed_keys=calloc(raw_public_keys_for_encryption->m_count, sizeof(mrpgpkey_t*)))==NULL ) {
+		goto cleanup;
+	}
+
 	for( i = 0; i < raw_public_keys_for_encryption->m_count; i++ ) {
-		pgp_memory_clear(keysmem);
-		pgp_memory_add(keysmem, raw_public_keys_for_encryption->m_keys[i]->m_binary, raw_public_keys_for_encryption->m_keys[i]->m_bytes);
-		pgp_filter_keys_from_mem(&s_io, public_keys, private_keys/*should stay empty*/, NULL, 0, keysmem);
+		mrpgpkey_t* pk = pgpkey_get(raw_public_keys_for_encryption->m_keys[i]);
+		if( pk ) {
+			parsed_keys[parsed_cnt++] = pk;
+			for( j = 0; j < (int)pk->m_public_keys.keyc; j++ ) {
+				pgp_keyring_add(public_keys, &pk->m_public_keys.keys[j]);
+			}
+			unexpected_private_keys += pk->m_private_keys.keyc;
+		}
 	}
 
-	if( public_keys->keyc <=0 || private_keys->keyc!=0 ) {
-		mrmailbox_log_warning(mailbox, 0, "Encryption-keyring contains unexpected data (%i/%i)", public_keys->keyc, private_keys->keyc);
+	if( public_keys->keyc <=0 || unexpected_private_keys!=0 ) {
+		mrmailbox_log_warning(mailbox, 0, "Encryption-keyring contains unexpected data (%i/%i)", public_keys->keyc, unexpected_private_keys);
 		goto cleanup;
 	}
 
@@ -568,15 +777,18 @@ int mrpgp_pk_encrypt(  mrmailbox_t*       mailbox,
 		int         encrypt_raw_packet = 0;
 
 		if( raw_private_key_for_signing ) {
-			pgp_memory_clear(keysmem);
-			pgp_memory_add(keysmem, raw_private_key_for_signing->m_binary, raw_private_key_for_signing->m_bytes);
-			pgp_filter_keys_from_mem(&s_io, dummy_keys, private_keys, NULL, 0, keysmem);
-			if( private_keys->keyc <= 0 ) {
+			sign_key = pgpkey_get(raw_private_key_for_signing);
+			if( sign_key == NULL || sign_key->m_private_keys.keyc <= 0 ) {
 				mrmailbox_log_warning(mailbox, 0, "No key for signing found.");
 				goto cleanup;
 			}
 
-			pgp_key_t* sk0 = &private_keys->keys[0];
+			if( !sign_key->m_can_sign ) {
+				mrmailbox_log_warning(mailbox, 0, "Signing key is not valid.");
+				goto cleanup;
+			}
+
+			pgp_key_t* sk0 = &sign_key->m_private_keys.keys[0];
 			signedmem = pgp_sign_buf(&s_io, plain_text, plain_bytes, &sk0->key.seckey, time(NULL)/*birthtime*/, 0/*duration*/,
 				NULL/*hash, defaults to sha256*/, 0/*armored*/, 0/*cleartext*/);
 			if( signedmem == NULL ) {
@@ -606,11 +818,11 @@ int mrpgp_pk_encrypt(  mrmailbox_t*       mailbox,
 	success = 1;
 
 cleanup:
-	if( keysmem )      { pgp_memory_free(keysmem); }
 	if( signedmem )    { pgp_memory_free(signedmem); }
-	if( public_keys )  { pgp_keyring_purge(public_keys); free(public_keys); } /*pgp_keyring_free() frees the content, not the pointer itself*/
-	if( private_keys ) { pgp_keyring_purge(private_keys); free(private_keys); }
-	if( dummy_keys )   { pgp_keyring_purge(dummy_keys); free(dummy_keys); }
+	if( public_keys )  { pgp_keyring_free(public_keys); free(public_keys); } /*pgp_keyring_free() frees the array, not the keys nor the pointer itself*/
+	for( i = 0; i < parsed_cnt; i++ ) { pgpkey_unref(parsed_keys[i]); }
+	free(parsed_keys);
+	pgpkey_unref(sign_key);
 	return success;
 }
 
@@ -627,27 +839,35 @@ int mrpgp_pk_decrypt(  mrmailbox_t*       mailbox,
 {
 	pgp_keyring_t*    public_keys = calloc(1, sizeof(pgp_keyring_t)); /*should be 0 after parsing*/
 	pgp_keyring_t*    private_keys = calloc(1, sizeof(pgp_keyring_t));
-	pgp_keyring_t*    dummy_keys = calloc(1, sizeof(pgp_keyring_t));
+	mrpgpkey_t**      parsed_keys = NULL;
+	int               parsed_cnt = 0;
 	pgp_validation_t* vresult = calloc(1, sizeof(pgp_validation_t));
 	key_id_t*         recipients_key_ids = NULL;
 	unsigned          recipients_count = 0;
-	pgp_memory_t*     keysmem = pgp_memory_new();
-	int               i, success = 0;
+	int               i, j, success = 0;
 
 	if( mailbox==NULL || ctext==NULL || ctext_bytes==0 || ret_plain==NULL || ret_plain_bytes==NULL
 	 || raw_private_keys_for_decryption==NULL || raw_private_keys_for_decryption->m_count<=0
-	 || vresult==NULL || keysmem==NULL || public_keys==NULL || private_keys==NULL ) {
+	 || vresult==NULL || public_keys==NULL || private_keys==NULL ) {
 		goto cleanup;
 	}
 
 	*ret_plain             = NULL;
 	*ret_plain_bytes       = 0;
 
-	/* setup keys (the keys may come from pgp_filter_keys_fileread(), see also pgp_keyring_add(rcpts, key)) */
+	/* setup keys; the keyrings only reference the keys parsed before, see pgpkey_get() */
+	if( (parsed_keys=calloc(raw_private_keys_for_decryption->m_count + (raw_public_keys_for_validation? raw_public_keys_for_validation->m_count : 0), sizeof(mrpgpkey_t*)))==NULL ) {
+		goto cleanup;
+	}
+
 	for( i = 0; i < raw_private_keys_for_decryption->m_count; i++ ) {
-		pgp_memory_clear(keysmem); /* a simple concatenate of private binary keys fails (works for public keys, however, we don't do it there either) */
-		pgp_memory_add(keysmem, raw_private_keys_for_decryption->m_keys[i]->m_binary, raw_private_keys_for_decryption->m_keys[i]->m_bytes);
-		pgp_filter_keys_from_mem(&s_io, dummy_keys/*should stay empty*/, private_keys, NULL, 0, keysmem);
+		mrpgpkey_t* pk = pgpkey_get(raw_private_keys_for_decryption->m_keys[i]);
+		if( pk ) {
+			parsed_keys[parsed_cnt++] = pk;
+			for( j = 0; j < (int)pk->m_private_keys.keyc; j++ ) {
+				pgp_keyring_add(private_keys, &pk->m_private_keys.keys[j]);
+			}
+		}
 	}
 
 	if( private_keys->keyc<=0 ) {
@@ -657,9 +877,13 @@ int mrpgp_pk_decrypt(  mrmailbox_t*       mailbox,
 
 	if( raw_public_keys_for_validation ) {
 		for( i = 0; i < raw_public_keys_for_validation->m_count; i++ ) {
-			pgp_memory_clear(keysmem);
-			pgp_memory_add(keysmem, raw_public_keys_for_validation->m_keys[i]->m_binary, raw_public_keys_for_validation->m_keys[i]->m_bytes);
-			pgp_filter_keys_from_mem(&s_io, public_keys, dummy_keys/*should stay empty*/, NULL, 0, keysmem);
+			mrpgpkey_t* pk = pgpkey_get(raw_public_keys_for_validation->m_keys[i]);
+			if( pk ) {
+				parsed_keys[parsed_cnt++] = pk;
+				for( j = 0; j < (int)pk->m_public_keys.keyc; j++ ) {
+					pgp_keyring_add(public_keys, &pk->m_public_keys.keys[j]);
+				}
+			}
 		}
 	}
 
@@ -701,10 +925,10 @@ int mrpgp_pk_decrypt(  mrmailbox_t*       mailbox,
 	success = 1;
 
 cleanup:
-	if( keysmem )            { pgp_memory_free(keysmem); }
-	if( public_keys )        { pgp_keyring_purge(public_keys); free(public_keys); } /*pgp_keyring_free() frees the content, not the pointer itself*/
-	if( private_keys )       { pgp_keyring_purge(private_keys); free(private_keys); }
-	if( dummy_keys )         { pgp_keyring_purge(dummy_keys); free(dummy_keys); }
+	if( public_keys )        { pgp_keyring_free(public_keys); free(public_keys); } /*pgp_keyring_free() frees the array, not the keys nor the pointer itself*/
+	if( private_keys )       { pgp_keyring_free(private_keys); free(private_keys); }
+	for( i = 0; i < parsed_cnt; i++ ) { pgpkey_unref(parsed_keys[i]); }
+	free(parsed_keys);
 	if( vresult )            { pgp_validate_result_free(vresult); }
 	if( recipients_key_ids ) { free(recipients_key_ids); }
 	return success;
@@ -51,6 +51,10 @@ int  mrpgp_split_key        (mrmailbox_t*, const mrkey_t* private_in, mrkey_t* p
 int  mrpgp_pk_encrypt       (mrmailbox_t*, const void* plain, size_t plain_bytes, const mrkeyring_t*, const mrkey_t* sign_key, int use_armor, void** ret_ctext, size_t* ret_ctext_bytes);
 int  mrpgp_pk_decrypt       (mrmailbox_t*, const void* ctext, size_t ctext_bytes, const mrkeyring_t*, const mrkeyring_t* validate_keys, int use_armor, void** plain, size_t* plain_bytes, mrhash_t* ret_signature_fingerprints);
 
+/* process-wide cache of parsed keys, used by the functions above */
+void mrpgp_clear_key_cache  (void);
+void mrpgp_get_key_cache_stat(int* ret_cnt, uint32_t* ret_hits, uint32_t* ret_misses);
+
 
 #ifdef __cplusplus
 } /* /extern "C" */
@@ -30,7 +30,9 @@ and spits out all text and tags found.
 - The parser does not care about hierarchy, if needed this can be
   done by the user.
 - Input and output strings must be UTF-8 encoded.
-- Tag and attribute names are converted to lower case.
+- Tag and attribute names are converted to lower case for the
+  null-terminated callbacks; the span callbacks get the original data.
+- The document is not copied and may be given in chunks.
 - Parsing does not stop on errors; instead errors are recovered. */
 
 
@@ -127,99 +129,112 @@ static const char* s_ent[] = {
 };
 
 
-/* Recursively decodes entity and character references and normalizes new lines.
-set "type" to ...
-'&' for general entity decoding,
-'%' for parameter entity decoding (currently not needed),
-'c' for cdata sections,
-' ' for attribute normalization, or
-'*' for non-cdata attribute normalization (currently not needed).
-Returns s, or if the decoded string is longer than s, returns a malloced string
-that must be freed.
-Function based upon ezxml_decode() from the "ezxml" parser which is
-Copyright 2004-2006 Aaron Voisine <aaron@voisine.org> */
-static char* xml_decode(char* s, char type)
+/* Decodes entity and character references and normalizes line ends;
+based upon ezxml_decode() from the "ezxml" parser which is
+Copyright 2004-2006 Aaron Voisine <aaron@voisine.org>.
+Other than ezxml_decode(), the input is not modified and replaced text is not
+decoded again, so `&amp;lt;` results in `&lt;`. */
+static int decode_reference(const char* in, const char* end, char* out, int* ret_out_bytes)
 {
-	char *e, *r = s;
-	const char* original_buf = s;
-	long b, c, d, l;
+	/* `in` points to `&`; returns the number of bytes of the reference or 0 if there is no valid reference */
+	const char* p = in + 1;
+	int         b;
 
-	for (; *s; s++) { /* normalize line endings */
-		while (*s == '\r') {
-			*(s++) = '\n';
-			if (*s == '\n') memmove(s, (s + 1), strlen(s));
+	if( p < end && *p == '#' )
+	{
+		/* character reference */
+		long c = 0;
+		int  base = 10, digits = 0;
+		p++;
+		if( p < end && (*p == 'x' || *p == 'X') ) { base = 16; p++; }
+		for( ; p < end && digits < 8; p++, digits++ ) {
+			int v;
+			     if( *p >= '0' && *p <= '9' )               { v = *p - '0'; }
+			else if( base == 16 && *p >= 'a' && *p <= 'f' ) { v = *p - 'a' + 10; }
+			else if( base == 16 && *p >= 'A' && *p <= 'F' ) { v = *p - 'A' + 10; }
+			else                                             { break; }
+			c = c*base + v;
 		}
-	}
-
-	for (s = r; ; ) {
-		while( *s && *s != '&' /*&& (*s != '%' || type != '%')*/ && !isspace(*s)) s++;
-
-		if( ! *s )
-		{
-			break;
+		if( digits == 0 || c == 0 || c > 0x10FFFF || p >= end || *p != ';' ) {
+			return 0; /* not a character reference */
 		}
-		else if( type != 'c' && ! strncmp(s, "&#", 2) )
-		{
-			/* character reference */
-			if (s[2] == 'x') c = strtol(s + 3, &e, 16); /* base 16 */
-			else c = strtol(s + 2, &e, 10); /* base 10 */
-			if (! c || *e != ';') { s++; continue; } /* not a character ref */
-
-			if (c < 0x80) *(s++) = c; /* US-ASCII subset */
-			else { /* multi-byte UTF-8 sequence */
-				for (b = 0, d = c; d; d /= 2) b++; /* number of bits in c */
-				b = (b - 2) / 5; /* number of bytes in payload */
-				*(s++) = (0xFF << (7 - b)) | (c >> (6 * b)); /* head */
-				while (b) *(s++) = 0x80 | ((c >> (6 * --b)) & 0x3F); /* payload */
-			}
 
-			memmove(s, strchr(s, ';') + 1, strlen(strchr(s, ';')));
+		if( c < 0x80 ) { /* US-ASCII subset */
+			out[0] = c;
+			*ret_out_bytes = 1;
 		}
-		else if( (*s == '&' && (type == '&' || type == ' ' /*|| type == '*'*/))
-		    /*|| (*s == '%' && type == '%')*/ )
-		{
-			/* entity reference */
-			for (b = 0; s_ent[b] && strncmp(s + 1, s_ent[b], strlen(s_ent[b])); b += 2)
-				; /* find entity in entity list */
-
-			if (s_ent[b++]) { /* found a match */
-				if ((c = strlen(s_ent[b])) - 1 > (e = strchr(s, ';')) - s) {
-					/* the replacement is larger than the entity: enlarge buffer */
-					l = (d = (s - r)) + c + strlen(e); /* new length */
-					if( r == original_buf ) {
-						char* new_ret = malloc(l); if( new_ret == NULL ) { return r; }
-						strcpy(new_ret, r);
-						r = new_ret;
-					}
-					else {
-						char* new_ret = realloc(r, l); if( new_ret == NULL ) { return r; }
-						r = new_ret;
-					}
-					e = strchr((s = r + d), ';'); /* fix up pointers */
-				}
+		else { /* multi-byte UTF-8 sequence */
+			int  n = c < 0x800? 1 : (c < 0x10000? 2 : 3); /* number of bytes in payload */
+			char* o = out;
+			*o++ = (0xFF << (7 - n)) | (c >> (6 * n)); /* head */
+			while( n ) { *o++ = 0x80 | ((c >> (6 * --n)) & 0x3F); } /* payload */
+			*ret_out_bytes = o - out;
+		}
+		return (p + 1) - in;
+	}
 
-				memmove(s + c, e + 1, strlen(e)); /* shift rest of string */
-				strncpy(s, s_ent[b], c); /* copy in replacement text */
-			}
-			else s++; /* not a known entity */
+	/* entity reference, the names in the table end with `;` */
+	for( b = 0; s_ent[b] && p < end; b += 2 ) {
+		int name_bytes;
+		if( s_ent[b][0] == *p && (name_bytes=strlen(s_ent[b])) <= end-p && strncmp(p, s_ent[b], name_bytes) == 0 ) {
+			*ret_out_bytes = strlen(s_ent[b+1]);
+			memcpy(out, s_ent[b+1], *ret_out_bytes); /* the replacement is never longer than the reference */
+			return 1 + name_bytes;
 		}
-		else if ((type == ' ' /*|| type == '*'*/) && isspace(*s))
-		{
-			*(s++) = ' ';
+	}
+
+	return 0;
+}
+
+
+const char* mrsaxparser_decode(const char* in, int in_bytes, int is_attr, int is_cdata, char* scratch, int* ret_bytes)
+{
+	const char* p = in, *end = in + in_bytes;
+	char*       o = scratch;
+
+	/* check if there is anything to decode at all */
+	if( is_attr ) {
+		while( p < end && *p != '&' && (*p == ' ' || !isspace((unsigned char)*p)) ) { p++; }
+	}
+	else {
+		p = memchr(in, '\r', in_bytes);
+		if( !is_cdata ) {
+			const char* amp = memchr(in, '&', p? p-in : in_bytes);
+			if( amp ) { p = amp; }
 		}
-		else s++; /* no decoding needed */
+		if( p == NULL ) { p = end; }
+	}
+
+	if( p == end ) {
+		*ret_bytes = in_bytes;
+		return in;
 	}
 
-	/* normalize spaces for non-cdata attributes
-	if (type == '*') {
-		for (s = r; *s; s++) {
-			if ((l = strspn(s, " "))) memmove(s, s + l, strlen(s + l) + 1);
-			while (*s && *s != ' ') s++;
+	memcpy(o, in, p-in);
+	o += p-in;
+	while( p < end )
+	{
+		int ref_bytes, out_bytes;
+		if( *p == '\r' ) { /* normalize `\r\n` and `\r` to `\n` */
+			*o++ = is_attr? ' ' : '\n';
+			p++;
+			if( p < end && *p == '\n' ) { p++; }
 		}
-		if (--s >= r && *s == ' ') *s = '\0';
-	}*/
+		else if( *p == '&' && !is_cdata && (ref_bytes=decode_reference(p, end, o, &out_bytes)) > 0 ) {
+			o += out_bytes;
+			p += ref_bytes;
+		}
+		else if( is_attr && isspace((unsigned char)*p) ) {
+			*o++ = ' ';
+			p++;
+		}
+		else {
+			*o++ = *p++;
+		}
+	}
 
-	return r;
+	*ret_bytes = o - scratch;
+	return scratch;
 }
 
 
@@ -236,35 +251,133 @@ static void def_endtag_cb   (void* userdata, const char* tag) { }
 static void def_text_cb     (void* userdata, const char* text, int len) { }
 
 
-static void call_text_cb(mrsaxparser_t* ths, char* text, size_t len, char type)
+static const char* find_str(const char* p, const char* end, const char* str)
 {
-	if( text && len )
-	{
-		char bak = text[len], *text_new;
+	/* as strstr(), however, the data are not null-terminated */
+	int str_bytes = strlen(str);
+	while( (p=memchr(p, str[0], end-p)) != NULL ) {
+		if( end-p >= str_bytes && memcmp(p, str, str_bytes)==0 ) {
+			return p;
+		}
+		p++;
+	}
+	return NULL;
+}
+
+
+static const char* skip_chars(const char* p, const char* end, const char* chars)
+{
+	/* as p+strspn() */
+	while( p < end && strchr(chars, *p) && *p ) { p++; }
+	return p;
+}
+
+
+static const char* find_chars(const char* p, const char* end, const char* chars)
+{
+	/* as p+strcspn() */
+	while( p < end && !strchr(chars, *p) ) { p++; }
+	return p;
+}
 
-		text[len] = '\0';
-		text_new = xml_decode(text, type);
-		ths->m_text_cb(ths->m_userdata, text_new, len);
-		if( text != text_new ) { free(text_new); }
 
-		text[len] = bak;
+static const char* skip_space(const char* p, const char* end)
+{
+	while( p < end && isspace((unsigned char)*p) ) { p++; }
+	return p;
+}
+
+
+static char* scratch_alloc(mrsaxparser_t* ths, size_t bytes)
+{
+	if( bytes > ths->m_scratch_alloc ) {
+		ths->m_scratch_alloc = MR_MAX(bytes, ths->m_scratch_alloc*2);
+		free(ths->m_scratch);
+		if( (ths->m_scratch=malloc(ths->m_scratch_alloc)) == NULL ) {
+			exit(64);
+		}
 	}
+	return ths->m_scratch;
 }
 
 
-static void do_free_attr(char** attr, int* free_attr)
+static char* scratch_cat(char* dst, const char* in, int in_bytes, int decode, int is_attr, int lower)
 {
-	/* "attr" are key/value pairs; the function frees the data if the corresponding bit in "free_attr" is set.
-	(we need this as we try to use the strings from the "main" document instead of allocating small strings) */
-	#define FREE_KEY    0x01
-	#define FREE_VALUE  0x02
-	int i = 0;
-	while( attr[i] ) {
-		if( free_attr[i>>1]&FREE_KEY   && attr[i]   ) { free(attr[i]);   }
-		if( free_attr[i>>1]&FREE_VALUE && attr[i+1] ) { free(attr[i+1]); }
-		i += 2;
-	}
-	attr[0] = NULL; /* set list to zero-length */
+	/* copy a span null-terminated to `dst` and return the position after the null-byte */
+	int         bytes = in_bytes, i;
+	const char* decoded = decode? mrsaxparser_decode(in, in_bytes, is_attr, 0, dst, &bytes) : in;
+	if( decoded != dst ) {
+		memcpy(dst, decoded, bytes);
+	}
+	if( lower ) {
+		for( i = 0; i < bytes; i++ ) { dst[i] = tolower((unsigned char)dst[i]); }
+	}
+	dst[bytes] = 0;
+	return dst + bytes + 1;
+}
+
+
+static void call_starttag_cb(mrsaxparser_t* ths, const char* tag, int tag_bytes, int attr_cnt)
+{
+	if( ths->m_starttag_span_cb ) {
+		ths->m_starttag_span_cb(ths->m_userdata, tag, tag_bytes, ths->m_attr, attr_cnt);
+	}
+	else {
+		/* null-terminated, lower-cased names and decoded values for the old-style callback */
+		char*  attr[(MRSAX_MAX_ATTR+1)*2];
+		size_t bytes = tag_bytes + 1;
+		int    i;
+		for( i = 0; i < attr_cnt; i++ ) {
+			bytes += ths->m_attr[i].m_name_bytes + 1 + ths->m_attr[i].m_value_bytes + 1;
+		}
+
+		char* p = scratch_alloc(ths, bytes), *tag_lower = p;
+		p = scratch_cat(p, tag, tag_bytes, 0, 0, 1);
+		for( i = 0; i < attr_cnt; i++ ) {
+			attr[i*2] = p;
+			p = scratch_cat(p, ths->m_attr[i].m_name, ths->m_attr[i].m_name_bytes, 0, 0, 1);
+			attr[i*2+1] = p;
+			p = scratch_cat(p, ths->m_attr[i].m_value, ths->m_attr[i].m_value_bytes, 1, 1, 0);
+		}
+		attr[attr_cnt*2] = NULL;
+
+		ths->m_starttag_cb(ths->m_userdata, tag_lower, attr);
+	}
+}
+
+
+static void call_endtag_cb(mrsaxparser_t* ths, const char* tag, int tag_bytes)
+{
+	if( ths->m_endtag_span_cb ) {
+		ths->m_endtag_span_cb(ths->m_userdata, tag, tag_bytes);
+	}
+	else {
+		char* tag_lower = scratch_alloc(ths, tag_bytes+1);
+		scratch_cat(tag_lower, tag, tag_bytes, 0, 0, 1);
+		ths->m_endtag_cb(ths->m_userdata, tag_lower);
+	}
+}
+
+
+static void call_text_cb(mrsaxparser_t* ths, const char* text, int text_bytes, int is_cdata)
+{
+	if( text_bytes <= 0 ) {
+		return;
+	}
+
+	if( ths->m_text_span_cb ) {
+		ths->m_text_span_cb(ths->m_userdata, text, text_bytes, is_cdata);
+	}
+	else {
+		int   bytes;
+		char* scratch = scratch_alloc(ths, text_bytes+1);
+		const char* decoded = mrsaxparser_decode(text, text_bytes, 0, is_cdata, scratch, &bytes);
+		if( decoded != scratch ) {
+			memcpy(scratch, decoded, bytes);
+		}
+		scratch[bytes] = 0;
+		ths->m_text_cb(ths->m_userdata, scratch, text_bytes);
+	}
 }
 
 
@@ -289,8 +402,33 @@ const char* mrattr_find(char** attr, const char* key)
 }
 
 
+int mrsaxparser_tag_is(const char* tag, int tag_bytes, const char* lower_name)
+{
+	int i;
+	for( i = 0; i < tag_bytes; i++ ) {
+		if( tolower((unsigned char)tag[i]) != lower_name[i] ) { /* also stops at the end of lower_name */
+			return 0;
+		}
+	}
+	return lower_name[i] == 0;
+}
+
+
+const mrsaxattr_t* mrsaxattr_find_span(const mrsaxattr_t* attr, int attr_cnt, const char* lower_name)
+{
+	int i;
+	for( i = 0; i < attr_cnt; i++ ) {
+		if( mrsaxparser_tag_is(attr[i].m_name, attr[i].m_name_bytes, lower_name) ) {
+			return &attr[i];
+		}
+	}
+	return NULL;
+}
+
+
 void mrsaxparser_init(mrsaxparser_t* ths, void* userdata)
 {
+	memset(ths, 0, sizeof(mrsaxparser_t));
 	ths->m_userdata    = userdata;
 	ths->m_starttag_cb = def_starttag_cb;
 	ths->m_endtag_cb   = def_endtag_cb;
@@ -319,232 +457,289 @@ void mrsaxparser_set_text_handler (mrsaxparser_t* ths, mrsaxparser_text_cb_t tex
 }
 
 
-void mrsaxparser_parse(mrsaxparser_t* ths, const char* buf_start__)
+void mrsaxparser_set_span_handler(mrsaxparser_t* ths, mrsaxparser_starttag_span_cb_t starttag_cb, mrsaxparser_endtag_span_cb_t endtag_cb, mrsaxparser_text_span_cb_t text_cb)
 {
-	char bak, *buf_start, *last_text_start, *p;
+	if( ths == NULL || starttag_cb == NULL || endtag_cb == NULL || text_cb == NULL ) {
+		return;
+	}
 
-	#define MAX_ATTR 100 /* attributes per tag - a fixed border here is a security feature, not a limit */
-	char*   attr[(MAX_ATTR+1)*2]; /* attributes as key/value pairs, +1 for terminating the list */
-	int     free_attr[MAX_ATTR]; /* free the value at attr[i*2+1]? */
+	ths->m_starttag_span_cb = starttag_cb;
+	ths->m_endtag_span_cb   = endtag_cb;
+	ths->m_text_span_cb     = text_cb;
+}
 
-	attr[0] = NULL; /* null-terminate list, this also terminates "free_values" */
 
-	if( ths == NULL ) {
-		return;
-	}
+#define INCOMPLETE NULL
 
-	buf_start = safe_strdup(buf_start__); /* we make a copy as we can easily null-terminate tag names and attributes "in place" */
-	last_text_start = buf_start;
-	p               = buf_start;
-	while( *p )
-	{
-		if( *p == '<' )
-		{
-			call_text_cb(ths, last_text_start, p - last_text_start, '&'); /* flush pending text */
 
-			p++;
-			if( strncmp(p, "!--", 3) == 0 )
-			{
-				/* skip <!-- ... --> comment
-				 **************************************************************/
+static const char* parse_tag(mrsaxparser_t* ths, const char* p, const char* end, int is_last)
+{
+	/* `p` points behind `<` of a start- or end-tag; returns the position behind the tag,
+	INCOMPLETE if more data are needed or `end` if there is no closing `>` in the last chunk */
+	const char* tag = NULL, *after_tag = NULL;
+	int         is_endtag = 0, is_selfclosing = 0, attr_cnt = 0;
 
-				p = strstr(p, "-->");
-				if( p == NULL ) { goto cleanup; }
-				p += 3;
-			}
-			else if( strncmp(p, "![CDATA[", 8) == 0 )
+	p = skip_chars(p, end, XML_WS); /* skip whitespace between `<` and tagname */
+	if( p < end && *p == '/' )
+	{
+		/* process </tag> end tag */
+		is_endtag = 1;
+		p = skip_chars(p+1, end, XML_WS); /* skip whitespace between `/` and tagname */
+		tag = p;
+		after_tag = p = find_chars(p, end, XML_WS "/>"); /* find character after tagname */
+	}
+	else
+	{
+		/* process <tag attr1="val" attr2='val' attr3=val ..> */
+		tag = p;
+		after_tag = p = find_chars(p, end, XML_WS "/>"); /* find character after tagname */
+		if( after_tag != tag )
+		{
+			/* scan for attributes */
+			p = skip_space(p, end); /* forward to first attribute name beginning */
+			while( p < end && *p != '/' && *p != '>' )
 			{
-				/* process <![CDATA[ ... ]]> text
-				 **************************************************************/
+				const char* name = p, *after_name, *value = p;
+				int         value_bytes = 0;
 
-				char* text_beg = p + 8;
-				if( (p = strstr(p, "]]>"))!=NULL ) /* `]]>` itself is not allowed in CDATA and must be escaped by dividing into two CDATA parts  */ {
-					call_text_cb(ths, text_beg, p-text_beg, 'c');
-					p += 3;
-				}
-				else {
-					call_text_cb(ths, text_beg, strlen(text_beg), 'c'); /* CDATA not closed, add all remaining text */
-					goto cleanup;
+				p = find_chars(p, end, XML_WS "=/>"); /* get end of attribute name */
+				if( p == name ) {
+					p++; /* `=` without name, skip it */
+					continue;
 				}
-			}
-			else if( strncmp(p, "!DOCTYPE", 8) == 0 )
-			{
-				/* skip <!DOCTYPE ...> or <!DOCTYPE name [ ... ]>
-				 **************************************************************/
 
-				while( *p && *p != '[' && *p != '>'  ) p++; /* search for [ or >, whatever comes first */
-				if( *p == 0 ) {
-					goto cleanup; /* unclosed doctype */
-				}
-				else if( *p == '[' ) {
-					p = strstr(p, "]>"); /* search end of inline doctype */
-					if( p == NULL ) {
-						goto cleanup; /* unclosed inline doctype */
+				after_name = p;
+				p = skip_chars(p, end, XML_WS); /* skip whitespace between attribute name and possible `=` */
+				if( p < end && *p == '=' )
+				{
+					p = skip_chars(p, end, XML_WS "="); /* skip spaces and equal signs */
+					if( p < end && (*p == '"' || *p == '\'') )
+					{
+						/* quoted attribute value */
+						const char* quote_end = memchr(p+1, *p, end-(p+1));
+						value = p+1;
+						if( quote_end == NULL ) {
+							if( !is_last ) { return INCOMPLETE; }
+							quote_end = end; /* unclosed quote, the value is the rest of the document */
+						}
+						value_bytes = quote_end - value;
+						p = quote_end < end? quote_end+1 : end;
 					}
-					else {
-						p += 2;
+					else
+					{
+						/* unquoted attribute value */
+						value = p;
+						p = find_chars(p, end, XML_WS "/>"); /* get end of attribute value */
+						value_bytes = p - value;
 					}
 				}
-				else {
-					p++;
+
+				if( attr_cnt < MRSAX_MAX_ATTR ) {
+					ths->m_attr[attr_cnt].m_name        = name;
+					ths->m_attr[attr_cnt].m_name_bytes  = after_name - name;
+					ths->m_attr[attr_cnt].m_value       = value;
+					ths->m_attr[attr_cnt].m_value_bytes = value_bytes;
+					attr_cnt++;
 				}
+
+				p = skip_space(p, end); /* forward to attribute name beginning */
 			}
-			else if( *p == '?' )
-			{
-				/* skip <? ... ?> processing instruction
-				 **************************************************************/
 
-				p = strstr(p, "?>");
-				if( p == NULL ) { goto cleanup; } /* unclosed processing instruction */
-				p += 2;
+			/* self-closing tag */
+			p = skip_chars(p, end, XML_WS); /* skip whitespace before possible `/` */
+			if( p < end && *p == '/' ) {
+				is_selfclosing = 1;
+				p++;
 			}
-			else
-			{
-				p += strspn(p, XML_WS); /* skip whitespace between `<` and tagname */
-				if( *p == '/' )
-				{
-					/* process </tag> end tag
-					 **************************************************************/
-
-					p++;
-					p += strspn(p, XML_WS); /* skip whitespace between `/` and tagname */
-					char* beg_tag_name = p;
-					p += strcspn(p, XML_WS "/>"); /* find character after tagname */
-					if( p != beg_tag_name )
-					{
-						bak = *p;
-						*p = '\0'; /* null-terminate tag name temporary, eg. a covered `>` may get important downwards */
-						mr_strlower_in_place(beg_tag_name);
-						ths->m_endtag_cb(ths->m_userdata, beg_tag_name);
-						*p = bak;
-					}
-				}
-				else
-				{
-					/* process <tag attr1="val" attr2='val' attr3=val ..>
-					 **************************************************************/
+		}
+	}
 
-					do_free_attr(attr, free_attr);
+	/* a tag is only reported when it is complete, as the tag name or attributes may continue in the next chunk */
+	const char* gt = memchr(p, '>', end-p);
+	if( gt == NULL && !is_last ) {
+		return INCOMPLETE;
+	}
 
-					char* beg_tag_name = p;
-					p += strcspn(p, XML_WS "/>"); /* find character after tagname */
-					if( p != beg_tag_name )
-					{
-						char* after_tag_name = p;
-
-						/* scan for attributes */
-						int attr_index = 0;
-						while( isspace(*p) ) { p++; } /* forward to first attribute name beginning */
-						for( ; *p && *p != '/' && *p != '>'; attr_index += 2 )
-						{
-							char *beg_attr_name = p, *beg_attr_value = NULL, *beg_attr_value_new = NULL;
-
-							p += strcspn(p, XML_WS "=/>"); /* get end of attribute name */
-							if( p != beg_attr_name )
-							{
-								/* attribute found */
-								char* after_attr_name = p;
-								p += strspn(p, XML_WS); /* skip whitespace between attribute name and possible `=` */
-								if( *p == '=' )
-								{
-									p += strspn(p, XML_WS "="); /* skip spaces and equal signs */
-									char quote = *p;
-									if( quote == '"' || quote == '\'' )
-									{
-										/* quoted attribute value */
-										p++;
-										beg_attr_value = p;
-
-										while( *p && *p != quote ) { p++; }
-										if( *p ) {
-											*p = '\0'; /* null terminate attribute val */
-											p++;
-										}
-
-										beg_attr_value_new = xml_decode(beg_attr_value, ' ');
-									}
-									else
-									{
-										/* unquoted attribute value, as the needed null-terminated may overwrite important characters, we'll create a copy */
-										beg_attr_value = p;
-										p += strcspn(p, XML_WS "/>"); /* get end of attribute value */
-										bak = *p;
-										*p = '\0';
-											char* temp = safe_strdup(beg_attr_value);
-											beg_attr_value_new = xml_decode(temp, ' ');
-											if( beg_attr_value_new!=temp ) { free(temp); }
-										*p = bak;
-									}
-								}
-								else
-								{
-									beg_attr_value_new = safe_strdup(NULL);
-								}
-
-								/* add attribute */
-								if( attr_index < MAX_ATTR )
-								{
-									char* beg_attr_name_new = beg_attr_name;
-									int   free_bits = (beg_attr_value_new != beg_attr_value)? FREE_VALUE : 0;
-									if( after_attr_name == p ) {
-										/* take care not to overwrite the current pointer (happens eg. for `<tag attrWithoutValue>` */
-										bak = *after_attr_name;
-										*after_attr_name = '\0';
-										beg_attr_name_new = safe_strdup(beg_attr_name);
-										*after_attr_name = bak;
-										free_bits |= FREE_KEY;
-									}
-									else {
-										*after_attr_name = '\0';
-									}
-
-									mr_strlower_in_place(beg_attr_name_new);
-									attr[attr_index]         = beg_attr_name_new;
-									attr[attr_index+1]       = beg_attr_value_new;
-									attr[attr_index+2]       = NULL; /* null-terminate list */
-									free_attr[attr_index>>1] = free_bits;
-								}
-							}
-
-							while( isspace(*p) ) { p++; } /* forward to attribute name beginning */
-						}
+	if( after_tag != tag ) {
+		if( is_endtag ) {
+			call_endtag_cb(ths, tag, after_tag-tag);
+		}
+		else {
+			call_starttag_cb(ths, tag, after_tag-tag, attr_cnt);
+			if( is_selfclosing ) {
+				call_endtag_cb(ths, tag, after_tag-tag);
+			}
+		}
+	}
 
-						char bak = *after_tag_name; /* backup the character as it may be `/` or `>` which gets important downwards */
-						*after_tag_name = 0;
-						mr_strlower_in_place(beg_tag_name);
-						ths->m_starttag_cb(ths->m_userdata, beg_tag_name, attr);
-						*after_tag_name = bak;
-
-						/* self-closing tag */
-						p += strspn(p, XML_WS); /* skip whitespace before possible `/` */
-						if( *p == '/' )
-						{
-							p++;
-							*after_tag_name = 0;
-							ths->m_endtag_cb(ths->m_userdata, beg_tag_name); /* already lowercase from starttag_cb()-call */
-						}
-					}
+	return gt? gt+1 : end; /* for a missing `>`, the rest of the document is ignored */
+}
 
-				} /* end of processing start-tag */
 
-				p = strchr(p, '>');
-				if( p == NULL ) { goto cleanup; } /* unclosed start-tag or end-tag */
-				p++;
+static const char* parse_construct(mrsaxparser_t* ths, const char* p, const char* end, int is_last)
+{
+	/* `p` points behind `<`; returns the position behind the construct,
+	INCOMPLETE if more data are needed or `end` if the construct is not closed in the last chunk */
+	const char* e;
 
-			} /* end of processing start-tag or end-tag */
+	if( !is_last && (p == end || (*p == '!' && end-p < 8)) ) {
+		return INCOMPLETE; /* we need some characters to find out the type of the construct */
+	}
 
-			last_text_start = p;
+	if( end-p >= 3 && strncmp(p, "!--", 3) == 0 )
+	{
+		/* skip <!-- ... --> comment */
+		if( (e=find_str(p, end, "-->")) != NULL ) {
+			return e+3;
 		}
-		else
-		{
-			p++;
+	}
+	else if( end-p >= 8 && strncmp(p, "![CDATA[", 8) == 0 )
+	{
+		/* process <![CDATA[ ... ]]> text, `]]>` itself is not allowed in CDATA and must be escaped by dividing into two CDATA parts */
+		if( (e=find_str(p, end, "]]>")) != NULL ) {
+			call_text_cb(ths, p+8, e-(p+8), 1);
+			return e+3;
+		}
+		else if( is_last ) {
+			call_text_cb(ths, p+8, end-(p+8), 1); /* CDATA not closed, add all remaining text */
+		}
+	}
+	else if( end-p >= 8 && strncmp(p, "!DOCTYPE", 8) == 0 )
+	{
+		/* skip <!DOCTYPE ...> or <!DOCTYPE name [ ... ]> */
+		if( (e=find_chars(p, end, "[>")) < end ) {
+			if( *e == '>' ) {
+				return e+1;
+			}
+			else if( (e=find_str(e, end, "]>")) != NULL ) { /* search end of inline doctype */
+				return e+2;
+			}
+		}
+	}
+	else if( p < end && *p == '?' )
+	{
+		/* skip <? ... ?> processing instruction */
+		if( (e=find_str(p, end, "?>")) != NULL ) {
+			return e+2;
+		}
+	}
+	else
+	{
+		return parse_tag(ths, p, end, is_last);
+	}
+
+	return is_last? end : INCOMPLETE; /* unclosed construct */
+}
+
+
+static size_t parse(mrsaxparser_t* ths, const char* buf, size_t bytes, int is_last)
+{
+	/* returns the number of bytes processed; the caller has to keep the others until more data arrive */
+	const char* p = buf, *end = buf + bytes, *lt, *after;
+
+	while( (lt=memchr(p, '<', end-p)) != NULL )
+	{
+		call_text_cb(ths, p, lt-p, 0); /* flush pending text */
+
+		if( (after=parse_construct(ths, lt+1, end, is_last)) == INCOMPLETE ) {
+			return lt - buf;
+		}
+		else if( after == end && is_last ) {
+			ths->m_done = 1; /* everything processed or the rest of the document is ignored */
+			return bytes;
 		}
+		p = after;
 	}
 
-	call_text_cb(ths, last_text_start, p - last_text_start, '&'); /* flush pending text */
+	if( !is_last )
+	{
+		/* keep a reference that may continue in the next chunk and a `\r` that may be followed by `\n` */
+		const char* keep = end;
+		if( keep > p && keep[-1] == '\r' ) {
+			keep--;
+		}
+		const char* amp = keep;
+		while( amp > p && amp > keep-32 && amp[-1] != '&' && amp[-1] != ';' && amp[-1] != '<' ) { amp--; }
+		if( amp > p && amp[-1] == '&' ) {
+			keep = amp-1;
+		}
+		call_text_cb(ths, p, keep-p, 0);
+		return keep - buf;
+	}
 
-cleanup:
-	do_free_attr(attr, free_attr);
-	free(buf_start);
+	call_text_cb(ths, p, end-p, 0); /* flush pending text */
+	return bytes;
 }
 
+
+static void pending_cat(mrsaxparser_t* ths, const char* buf, size_t bytes)
+{
+	if( ths->m_pending_bytes+bytes > ths->m_pending_alloc ) {
+		ths->m_pending_alloc = MR_MAX(ths->m_pending_bytes+bytes, ths->m_pending_alloc*2);
+		if( (ths->m_pending=realloc(ths->m_pending, ths->m_pending_alloc)) == NULL ) {
+			exit(65);
+		}
+	}
+	memcpy(ths->m_pending+ths->m_pending_bytes, buf, bytes);
+	ths->m_pending_bytes += bytes;
+}
+
+
+void mrsaxparser_feed(mrsaxparser_t* ths, const char* buf, size_t bytes, int is_last)
+{
+	size_t done;
+
+	if( ths == NULL ) {
+		return;
+	}
+
+	if( buf == NULL ) {
+		bytes = 0;
+	}
+
+	/* complete a construct pending from the last chunk: add data up to the next `>` (or `;` for a pending reference) and try again */
+	while( ths->m_pending_bytes && !ths->m_done )
+	{
+		const char* stop = buf? memchr(buf, ths->m_pending[0]=='<'? '>' : ';', bytes) : NULL;
+		size_t      add = stop? (stop+1)-buf : bytes;
+		if( ths->m_pending[0]!='<' && add > 32 ) {
+			add = MR_MIN(bytes, 32); /* references are short, pending text never needs more */
+		}
+
+		pending_cat(ths, buf, add);
+		buf += add;
+		bytes -= add;
+
+		done = parse(ths, ths->m_pending, ths->m_pending_bytes, is_last && bytes==0);
+		memmove(ths->m_pending, ths->m_pending+done, ths->m_pending_bytes-done);
+		ths->m_pending_bytes -= done;
+
+		if( bytes == 0 ) {
+			break;
+		}
+	}
+
+	/* parse the chunk in place and keep only an incomplete construct at its end */
+	if( bytes && !ths->m_done ) {
+		done = parse(ths, buf, bytes, is_last);
+		pending_cat(ths, buf+done, bytes-done);
+	}
+
+	if( is_last ) {
+		free(ths->m_pending);
+		free(ths->m_scratch);
+		ths->m_pending = NULL;
+		ths->m_pending_bytes = 0;
+		ths->m_pending_alloc = 0;
+		ths->m_scratch = NULL;
+		ths->m_scratch_alloc = 0;
+		ths->m_done = 0;
+	}
+}
+
+
+void mrsaxparser_parse(mrsaxparser_t* ths, const char* text)
+{
+	/* parse a null-terminated document at once */
+	mrsaxparser_feed(ths, text, text? strlen(text) : 0, 1);
+}
@@ -32,21 +32,72 @@ typedef void (*mrsaxparser_endtag_cb_t)   (void* userdata, const char* tag);
 typedef void (*mrsaxparser_text_cb_t)     (void* userdata, const char* text, int len); /* len is only informational, text is already null-terminated */
 
 
+/* Span callbacks: tag names, attributes and text point directly into the
+data given to mrsaxparser_feed() and are neither null-terminated, nor
+lower-cased, nor decoded; use mrsaxparser_tag_is() and mrsaxparser_decode()
+for this.  A text may be reported in several pieces if the document is fed
+in chunks. */
+typedef struct mrsaxattr_t
+{
+	const char* m_name;
+	int         m_name_bytes;
+	const char* m_value;       /* if the attribute has no value, this is an empty span */
+	int         m_value_bytes;
+} mrsaxattr_t;
+
+typedef void (*mrsaxparser_starttag_span_cb_t) (void* userdata, const char* tag, int tag_bytes, const mrsaxattr_t* attr, int attr_cnt);
+typedef void (*mrsaxparser_endtag_span_cb_t)   (void* userdata, const char* tag, int tag_bytes);
+typedef void (*mrsaxparser_text_span_cb_t)     (void* userdata, const char* text, int text_bytes, int is_cdata);
+
+
+#define MRSAX_MAX_ATTR 50 /* attributes per tag - a fixed border here is a security feature, not a limit */
+
+
 typedef struct mrsaxparser_t
 {
 	mrsaxparser_starttag_cb_t m_starttag_cb;
 	mrsaxparser_endtag_cb_t   m_endtag_cb;
 	mrsaxparser_text_cb_t     m_text_cb;
 	void*                     m_userdata;
+
+	mrsaxparser_starttag_span_cb_t m_starttag_span_cb;
+	mrsaxparser_endtag_span_cb_t   m_endtag_span_cb;
+	mrsaxparser_text_span_cb_t     m_text_span_cb;
+
+	/* the start of a construct that was not complete at the end of the last chunk; this is the only data copied */
+	char*                     m_pending;
+	size_t                    m_pending_bytes;
+	size_t                    m_pending_alloc;
+	int                       m_done;           /* an unclosed construct was found at the end of the document, the rest is ignored */
+
+	mrsaxattr_t               m_attr[MRSAX_MAX_ATTR];
+
+	char*                     m_scratch;        /* used only for the null-terminated callbacks */
+	size_t                    m_scratch_alloc;
 } mrsaxparser_t;
 
 
 void           mrsaxparser_init             (mrsaxparser_t*, void* userData);
 void           mrsaxparser_set_tag_handler  (mrsaxparser_t*, mrsaxparser_starttag_cb_t, mrsaxparser_endtag_cb_t);
 void           mrsaxparser_set_text_handler (mrsaxparser_t*, mrsaxparser_text_cb_t);
+void           mrsaxparser_set_span_handler (mrsaxparser_t*, mrsaxparser_starttag_span_cb_t, mrsaxparser_endtag_span_cb_t, mrsaxparser_text_span_cb_t); /* replaces the handlers set by the functions above */
 
 void           mrsaxparser_parse            (mrsaxparser_t*, const char* text);
 
+/* parse a document given in one or more chunks; the last chunk must be flagged by `is_last`,
+this also frees all data hold by the parser.  The chunks are not copied, only an incomplete
+tag, entity etc. at the end of a chunk is kept until the next chunk arrives. */
+void           mrsaxparser_feed             (mrsaxparser_t*, const char* buf, size_t bytes, int is_last);
+
+/* decode entities and character references and normalize line ends of a text or attribute span;
+if there is nothing to decode, `in` is returned, otherwise the decoded span is written to
+`scratch` which must have space for `in_bytes` bytes, the decoded span is never longer.
+The result is not null-terminated. */
+const char*    mrsaxparser_decode           (const char* in, int in_bytes, int is_attr, int is_cdata, char* scratch, int* ret_bytes);
+
+int            mrsaxparser_tag_is           (const char* tag, int tag_bytes, const char* lower_name); /* case-insensitive compare of a span */
+const mrsaxattr_t* mrsaxattr_find_span      (const mrsaxattr_t* attr, int attr_cnt, const char* lower_name);
+
 const char*    mrattr_find                  (char** attr, const char* key);
 
 
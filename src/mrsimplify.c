@@ -27,7 +27,6 @@
 #include "mrtools.h"
 #include "mrdehtml.h"
 #include "mrmimeparser.h"
-#include "mrstrbuilder.h"
 
 
 /*******************************************************************************
@@ -35,10 +34,64 @@
  ******************************************************************************/
 
 
-static int mr_is_empty_line(const char* buf)
+/* a line is a span in the text buffer, the buffer is not modified and the
+terminating `\n` is not part of the line */
+typedef struct mrline_t
 {
-	const unsigned char* p1 = (const unsigned char*)buf; /* force unsigned - otherwise the `> ' '` comparison will fail */
-	while( *p1 ) {
+	const char* m_start;
+	int         m_bytes;
+} mrline_t;
+
+
+static mrline_t* mr_scan_lines(const char* buf, int buf_bytes, int* ret_cnt, mrarena_t* arena)
+{
+	/* other than mr_split_into_lines(), nothing is copied or terminated, we only
+	collect the spans of the lines.  The scan is done by memchr() which is
+	vectorized by the usual C libraries; the array grows in place as it is the
+	last allocation in the arena. */
+	int         alloc_cnt = 64, cnt = 0;
+	mrline_t*   lines = mrarena_alloc(arena, sizeof(mrline_t)*alloc_cnt);
+	const char* p1 = buf, *end = buf + buf_bytes, *lf;
+
+	while( 1 ) {
+		if( cnt == alloc_cnt ) {
+			lines = mrarena_realloc(arena, lines, sizeof(mrline_t)*alloc_cnt, sizeof(mrline_t)*alloc_cnt*2);
+			alloc_cnt *= 2;
+		}
+
+		lines[cnt].m_start = p1;
+		if( (lf=memchr(p1, '\n', end-p1)) == NULL ) {
+			lines[cnt++].m_bytes = end-p1;
+			break;
+		}
+		lines[cnt++].m_bytes = lf-p1;
+		p1 = lf+1;
+	}
+
+	*ret_cnt = cnt;
+	return lines;
+}
+
+
+static int mr_line_is(const mrline_t* line, const char* str)
+{
+	int str_bytes = strlen(str);
+	return (line->m_bytes==str_bytes && memcmp(line->m_start, str, str_bytes)==0);
+}
+
+
+static int mr_line_starts_with(const mrline_t* line, const char* str)
+{
+	int str_bytes = strlen(str);
+	return (line->m_bytes>=str_bytes && memcmp(line->m_start, str, str_bytes)==0);
+}
+
+
+static int mr_is_empty_line(const mrline_t* line)
+{
+	const unsigned char* p1 = (const unsigned char*)line->m_start; /* force unsigned - otherwise the `> ' '` comparison will fail */
+	const unsigned char* end = p1 + line->m_bytes;
+	while( p1 < end ) {
 		if( *p1 > ' ' ) {
 			return 0; /* at least one character found - buffer is not empty */
 		}
@@ -48,30 +101,28 @@ static int mr_is_empty_line(const char* buf)
 }
 
 
-static int mr_is_plain_quote(const char* buf)
+static int mr_is_plain_quote(const mrline_t* line)
 {
-	if( buf[0] == '>' ) {
+	if( line->m_bytes > 0 && line->m_start[0] == '>' ) {
 		return 1;
 	}
 	return 0;
 }
 
 
-static int mr_is_quoted_headline(const char* buf)
+static int mr_is_quoted_headline(const mrline_t* line)
 {
 	/* This function may be called for the line _directly_ before a quote.
 	The function checks if the line contains sth. like "On 01.02.2016, xy@z wrote:" in various languages.
 	- Currently, we simply check if the last character is a ':'.
 	- Checking for the existance of an email address may fail (headlines may show the user's name instead of the address) */
 
-	int buf_len = strlen(buf);
-
-	if( buf_len > 80 ) {
+	if( line->m_bytes > 80 ) {
 		return 0; /* the buffer is too long to be a quoted headline (some mailprograms (eg. "Mail" from Stock Android)
 		          forget to insert a line break between the answer and the quoted headline ...)) */
 	}
 
-	if( buf_len > 0 && buf[buf_len-1] == ':' ) {
+	if( line->m_bytes > 0 && line->m_start[line->m_bytes-1] == ':' ) {
 		return 1; /* the buffer is a quoting headline in the meaning described above) */
 	}
 
@@ -79,28 +130,53 @@ static int mr_is_quoted_headline(const char* buf)
 }
 
 
+static char* mr_strndup_without_cr(const char* in, int in_bytes, int* ret_bytes, mrarena_t* arena)
+{
+	char*       out = mrarena_alloc(arena, in_bytes+1), *p2 = out;
+	const char* p1 = in, *end = in + in_bytes, *cr;
+
+	while( (cr=memchr(p1, '\r', end-p1)) != NULL ) {
+		memcpy(p2, p1, cr-p1);
+		p2 += cr-p1;
+		p1 = cr+1;
+	}
+	memcpy(p2, p1, end-p1);
+	p2 += end-p1;
+	*p2 = 0;
+
+	*ret_bytes = p2-out;
+	return out;
+}
+
+
 
 /*******************************************************************************
  * Main interface
  ******************************************************************************/
 
 
-mrsimplify_t* mrsimplify_new()
+mrsimplify_t* mrsimplify_new(mrarena_t* arena)
 {
 	mrsimplify_t* ths = NULL;
 
-	if( (ths=calloc(1, sizeof(mrsimplify_t)))==NULL ) {
+	if( arena ) {
+		ths = mrarena_alloc(arena, sizeof(mrsimplify_t));
+		memset(ths, 0, sizeof(mrsimplify_t));
+	}
+	else if( (ths=calloc(1, sizeof(mrsimplify_t)))==NULL ) {
 		exit(31);
 	}
 
+	ths->m_arena = arena;
+
 	return ths;
 }
 
 
 void mrsimplify_unref(mrsimplify_t* ths)
 {
-	if( ths == NULL ) {
-		return;
+	if( ths == NULL || ths->m_arena ) {
+		return; /* objects in an arena are released together with the arena */
 	}
 
 	free(ths);
@@ -112,7 +188,7 @@ void mrsimplify_unref(mrsimplify_t* ths)
  ******************************************************************************/
 
 
-static char* mrsimplify_simplify_plain_text(mrsimplify_t* ths, const char* buf_terminated)
+static char* mrsimplify_simplify_plain_text(mrsimplify_t* ths, const char* buf, int buf_bytes, mrarena_t* arena)
 {
 	/* This function ...
 	... removes all text after the line `-- ` (footer mark)
@@ -123,10 +199,11 @@ static char* mrsimplify_simplify_plain_text(mrsimplify_t* ths, const char* buf_t
 	/* we could skip some of this stuff if we know that the mail is from another messenger,
 	however, this adds some additional complexity and seems not to be needed currently */
 
-	/* split the given buffer into lines */
-	carray* lines = mr_split_into_lines(buf_terminated);
-	int l, l_first = 0, l_last = carray_count(lines)-1; /* if l_last is -1, there are no lines */
-	char* line;
+	/* find the lines of the given buffer; `buf` must not contain `\r` and is not modified */
+	int       lines_cnt;
+	mrline_t* lines = mr_scan_lines(buf, buf_bytes, &lines_cnt, arena);
+	int l, l_first = 0, l_last = lines_cnt-1; /* if l_last is -1, there are no lines */
+	mrline_t* line;
 
 	/* search for the line `-- ` and ignore this and all following lines
 	If the line contains more characters, it is _not_ treated as the footer start mark (hi, Thorsten) */
@@ -135,16 +212,16 @@ static char* mrsimplify_simplify_plain_text(mrsimplify_t* ths, const char* buf_t
 		for( l = l_first; l <= l_last; l++ )
 		{
 			/* hide standard footer, "-- " - we do not set m_is_cut_at_end if we find this mark */
-			line = (char*)carray_get(lines, l);
-			if( strcmp(line, "-- ")==0
-			 || strcmp(line, "--  ")==0 ) { /* quoted-printable may encode `-- ` to `-- =20` which is converted back to `--  ` ... */
+			line = &lines[l];
+			if( mr_line_is(line, "-- ")
+			 || mr_line_is(line, "--  ") ) { /* quoted-printable may encode `-- ` to `-- =20` which is converted back to `--  ` ... */
 				footer_mark = 1;
 			}
 
 			/* also hide some non-standard footers - they got m_is_cut_at_end set, however  */
-			if( strcmp(line, "--")==0
-			 || strcmp(line, "---")==0
-			 || strcmp(line, "----")==0 ) {
+			if( mr_line_is(line, "--")
+			 || mr_line_is(line, "---")
+			 || mr_line_is(line, "----") ) {
 				footer_mark = 1;
 				ths->m_is_cut_at_end = 1;
 			}
@@ -158,12 +235,9 @@ static char* mrsimplify_simplify_plain_text(mrsimplify_t* ths, const char* buf_t
 
 	/* check for "forwarding header" */
 	if( (l_last-l_first+1) >= 3 ) {
-		char* line0 = (char*)carray_get(lines, l_first);
-		char* line1 = (char*)carray_get(lines, l_first+1);
-		char* line2 = (char*)carray_get(lines, l_first+2);
-		if( strcmp(line0, "---------- Forwarded message ----------")==0 /* do not chage this! sent exactly in this form in mrchat.c! */
-		 && strncmp(line1, "From: ", 6)==0
-		 && line2[0] == 0 )
+		if( mr_line_is(&lines[l_first], "---------- Forwarded message ----------") /* do not chage this! sent exactly in this form in mrchat.c! */
+		 && mr_line_starts_with(&lines[l_first+1], "From: ")
+		 && lines[l_first+2].m_bytes == 0 )
 		{
             ths->m_is_forwarded = 1; /* nothing is cutted, the forward state should displayed explicitly in the ui */
             l_first += 3;
@@ -174,12 +248,12 @@ static char* mrsimplify_simplify_plain_text(mrsimplify_t* ths, const char* buf_t
 	also loose forwarded messages, however, the user has always the option to show the full mail text. */
 	for( l = l_first; l <= l_last; l++ )
 	{
-		line = (char*)carray_get(lines, l);
-		if( strncmp(line, "-----", 5)==0
-		 || strncmp(line, "_____", 5)==0
-		 || strncmp(line, "=====", 5)==0
-		 || strncmp(line, "*****", 5)==0
-		 || strncmp(line, "~~~~~", 5)==0 )
+		line = &lines[l];
+		if( mr_line_starts_with(line, "-----")
+		 || mr_line_starts_with(line, "_____")
+		 || mr_line_starts_with(line, "=====")
+		 || mr_line_starts_with(line, "*****")
+		 || mr_line_starts_with(line, "~~~~~") )
 		{
 			l_last = l - 1; /* if l_last is -1, there are no lines */
 			ths->m_is_cut_at_end = 1;
@@ -192,7 +266,7 @@ static char* mrsimplify_simplify_plain_text(mrsimplify_t* ths, const char* buf_t
 		int l_lastQuotedLine = -1;
 
 		for( l = l_last; l >= l_first; l-- ) {
-			line = (char*)carray_get(lines, l);
+			line = &lines[l];
 			if( mr_is_plain_quote(line) ) {
 				l_lastQuotedLine = l;
 			}
@@ -207,14 +281,13 @@ static char* mrsimplify_simplify_plain_text(mrsimplify_t* ths, const char* buf_t
 			ths->m_is_cut_at_end = 1;
 
 			if( l_last > 0 ) {
-				if( mr_is_empty_line((char*)carray_get(lines, l_last)) ) { /* allow one empty line between quote and quote headline (eg. mails from Jürgen) */
+				if( mr_is_empty_line(&lines[l_last]) ) { /* allow one empty line between quote and quote headline (eg. mails from Jürgen) */
 					l_last--;
 				}
 			}
 
 			if( l_last > 0 ) {
-				line = (char*)carray_get(lines, l_last);
-				if( mr_is_quoted_headline(line) ) {
+				if( mr_is_quoted_headline(&lines[l_last]) ) {
 					l_last--;
 				}
 			}
@@ -227,7 +300,7 @@ static char* mrsimplify_simplify_plain_text(mrsimplify_t* ths, const char* buf_t
 		int hasQuotedHeadline = 0;
 
 		for( l = l_first; l <= l_last; l++ ) {
-			line = (char*)carray_get(lines, l);
+			line = &lines[l];
 			if( mr_is_plain_quote(line) ) {
 				l_lastQuotedLine = l;
 			}
@@ -248,12 +321,23 @@ static char* mrsimplify_simplify_plain_text(mrsimplify_t* ths, const char* buf_t
 		}
 	}
 
-	/* re-create buffer from the remaining lines */
-	mrstrbuilder_t ret;
-	mrstrbuilder_init(&ret, strlen(buf_terminated));
+	/* copy the remaining lines to the result which is the only string allocated
+	for the text; it is returned to the caller, so it is allocated in the arena
+	of the simplifier or on the heap */
+	int   ret_bytes = buf_bytes + 2*(1+strlen(MR_EDITORIAL_ELLIPSE)) + 1;
+	char* ret = NULL, *p2;
+
+	if( ths->m_arena ) {
+		ret = mrarena_alloc(ths->m_arena, ret_bytes);
+	}
+	else if( (ret=malloc(ret_bytes))==NULL ) {
+		exit(32);
+	}
+	p2 = ret;
 
 	if( ths->m_is_cut_at_begin ) {
-		mrstrbuilder_cat(&ret, MR_EDITORIAL_ELLIPSE " ");
+		memcpy(p2, MR_EDITORIAL_ELLIPSE " ", strlen(MR_EDITORIAL_ELLIPSE " "));
+		p2 += strlen(MR_EDITORIAL_ELLIPSE " ");
 	}
 
 	int pending_linebreaks = 0; /* we write empty lines only in case and non-empty line follows */
@@ -261,7 +345,7 @@ static char* mrsimplify_simplify_plain_text(mrsimplify_t* ths, const char* buf_t
 
 	for( l = l_first; l <= l_last; l++ )
 	{
-		line = (char*)carray_get(lines, l);
+		line = &lines[l];
 
 		if( mr_is_empty_line(line) )
 		{
@@ -273,12 +357,13 @@ static char* mrsimplify_simplify_plain_text(mrsimplify_t* ths, const char* buf_t
 			{
 				if( pending_linebreaks > 2 ) { pending_linebreaks = 2; } /* ignore more than one empty line (however, regard normal line ends) */
 				while( pending_linebreaks ) {
-					mrstrbuilder_cat(&ret, "\n");
+					*p2++ = '\n';
 					pending_linebreaks--;
 				}
 			}
 
-			mrstrbuilder_cat(&ret, line);
+			memcpy(p2, line->m_start, line->m_bytes);
+			p2 += line->m_bytes;
 			content_lines_added++;
 			pending_linebreaks = 1;
 		}
@@ -286,12 +371,12 @@ static char* mrsimplify_simplify_plain_text(mrsimplify_t* ths, const char* buf_t
 
 	if( ths->m_is_cut_at_end
 	 && (!ths->m_is_cut_at_begin || content_lines_added) /* avoid two `[...]` without content */ ) {
-		mrstrbuilder_cat(&ret, " " MR_EDITORIAL_ELLIPSE);
+		memcpy(p2, " " MR_EDITORIAL_ELLIPSE, strlen(" " MR_EDITORIAL_ELLIPSE));
+		p2 += strlen(" " MR_EDITORIAL_ELLIPSE);
 	}
 
-	mr_free_splitted_lines(lines);
-
-	return ret.m_buf;
+	*p2 = 0;
+	return ret;
 }
 
 
@@ -302,39 +387,49 @@ static char* mrsimplify_simplify_plain_text(mrsimplify_t* ths, const char* buf_t
 
 char* mrsimplify_simplify(mrsimplify_t* ths, const char* in_unterminated, int in_bytes, int is_html)
 {
-	/* create a copy of the given buffer */
-	char* out = NULL, *temp = NULL;
+	/* the text is scanned line by line in a single buffer which is the given one
+	for plain text without `\r`; otherwise, a copy without `\r` or the text
+	converted from HTML is used.
+	Temporary data are allocated in the arena of the simplifier or, if there is
+	none, in a temporary arena; the result is the only other allocation. */
+	const char* buf = NULL;
+	int         buf_bytes = 0;
+	char*       temp = NULL, *out = NULL;
+	mrarena_t*  arena = NULL;
 
 	if( ths == NULL || in_unterminated == NULL || in_bytes <= 0 ) {
-		return safe_strdup("");
+		return (ths && ths->m_arena)? mrarena_strdup(ths->m_arena, "") : safe_strdup("");
 	}
 
 	ths->m_is_forwarded    = 0;
 	ths->m_is_cut_at_begin = 0;
 	ths->m_is_cut_at_end   = 0;
 
-	out = strndup((char*)in_unterminated, in_bytes); /* strndup() makes sure, the string is null-terminated */
-	if( out == NULL ) {
-		return safe_strdup("");
-	}
+	arena = ths->m_arena? ths->m_arena : mrarena_new(4096);
+
+	in_bytes = strnlen(in_unterminated, in_bytes); /* as before, the text ends at a null-byte */
 
-	/* convert HTML to text, if needed */
 	if( is_html ) {
-		if( (temp = mr_dehtml(out)) != NULL ) { /* mr_dehtml() returns way too much lineends, however they're removed in the simplification below */
-			free(out);
-			out = temp;
-		}
+		/* convert HTML to text; mr_dehtml() works on the given buffer and returns way too much lineends,
+		however they're removed in the simplification below.  Characters to remove may be marked by `\r`. */
+		temp = mr_dehtml(in_unterminated, in_bytes, arena);
+		mr_remove_cr_chars(temp); /* make comparisons easier, eg. for line `-- ` */
+		buf = temp;
+		buf_bytes = strlen(temp);
 	}
-
-	/* simplify the text in the buffer (characters to remove may be marked by `\r`) */
-	mr_remove_cr_chars(out); /* make comparisons easier, eg. for line `-- ` */
-	if( (temp = mrsimplify_simplify_plain_text(ths, out)) != NULL ) {
-		free(out);
-		out = temp;
+	else if( memchr(in_unterminated, '\r', in_bytes) ) {
+		buf = mr_strndup_without_cr(in_unterminated, in_bytes, &buf_bytes, arena);
+	}
+	else {
+		buf = in_unterminated;
+		buf_bytes = in_bytes;
 	}
 
-	/* remove all `\r` from string */
-	mr_remove_cr_chars(out);
+	out = mrsimplify_simplify_plain_text(ths, buf, buf_bytes, arena);
+
+	if( arena != ths->m_arena ) {
+		mrarena_unref(arena);
+	}
 
 	return out;
 }
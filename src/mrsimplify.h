@@ -29,20 +29,25 @@ extern "C" {
 
 /*** library-private **********************************************************/
 
+#include "mrarena.h"
+
 typedef struct mrsimplify_t
 {
 	int m_is_forwarded;
 	int m_is_cut_at_begin;
 	int m_is_cut_at_end;
+	mrarena_t* m_arena;
 } mrsimplify_t;
 
 
-mrsimplify_t* mrsimplify_new           ();
+mrsimplify_t* mrsimplify_new           (mrarena_t*);
 void          mrsimplify_unref         (mrsimplify_t*);
 
 /* Simplify and normalise text: Remove quotes, signatures, unnecessary
 lineends etc.
-The data returned from Simplify() must be free()'d when no longer used, private */
+If the simplifier was created with an arena, the object, the data returned
+from Simplify() and all temporary data are allocated in the arena;
+otherwise the returned data must be free()'d when no longer used, private */
 char*         mrsimplify_simplify      (mrsimplify_t*, const char* txt_unterminated, int txt_bytes, int is_html);
 
 
@@ -22,6 +22,8 @@
 
 #include "mrmailbox_internal.h"
 #include "mrapeerstate.h"
+#include "mrkeyring.h"
+#include "mrjob.h"
 
 
 /* This class wraps around SQLite.  Some hints to the underlying database:
@@ -37,7 +39,13 @@
 
 - Some words to the "param" fields:  These fields contains a string with
   additonal, named parameters which must not be accessed by a search and/or
-  are very seldomly used. Moreover, this allows smart minor database updates. */
+  are very seldomly used. Moreover, this allows smart minor database updates.
+
+- If mrsqlite3_set_readers() is used, the database is switched to
+  `PRAGMA journal_mode=WAL` and some read-only connections are opened in
+  addition to the normal one.  In WAL mode, readers do not block writers and
+  writers do not block readers, so getters using mrsqlite3_lock_reader() see
+  the last committed state without waiting for a running transaction. */
 
 
 /*******************************************************************************
@@ -129,6 +137,8 @@ mrsqlite3_t* mrsqlite3_new(mrmailbox_t* mailbox)
 	}
 
 	pthread_mutex_init(&ths->m_critical_, NULL);
+	pthread_rwlock_init(&ths->m_readers_rwlock, NULL);
+	ths->m_pool = ths;
 
 	return ths;
 }
@@ -147,10 +157,174 @@ void mrsqlite3_unref(mrsqlite3_t* ths)
 	}
 
 	pthread_mutex_destroy(&ths->m_critical_);
+	pthread_rwlock_destroy(&ths->m_readers_rwlock);
 	free(ths);
 }
 
 
+void mrsqlite3_set_readers(mrsqlite3_t* ths, int readers_cnt)
+{
+	if( ths == NULL ) {
+		return;
+	}
+
+	ths->m_readers_cnt = MR_MIN(MR_MAX(readers_cnt, 0), MR_MAX_READERS);
+}
+
+
+static void open_readers__(mrsqlite3_t* ths, const char* dbfile)
+{
+	int i;
+
+	/* the pool is used only in WAL mode, otherwise a reader would block the writer.
+	the journal mode cannot be changed while statements are pending, so reset them before */
+	mrsqlite3_reset_all_predefinitions(ths);
+	sqlite3_stmt* stmt = mrsqlite3_prepare_v2_(ths, "PRAGMA journal_mode=WAL;");
+	int wal_ok = (stmt && sqlite3_step(stmt)==SQLITE_ROW && strcmp((const char*)sqlite3_column_text(stmt, 0), "wal")==0);
+	sqlite3_finalize(stmt);
+	if( !wal_ok ) {
+		mrmailbox_log_warning(ths->m_mailbox, 0, "Cannot switch to WAL mode, reading is done on the main connection.");
+		return;
+	}
+
+	for( i = 0; i < ths->m_readers_cnt; i++ ) {
+		mrsqlite3_t* reader = mrsqlite3_new(ths->m_mailbox);
+		if( !mrsqlite3_open__(reader, dbfile, MR_OPEN_READONLY|MR_OPEN_NOMUTEX) ) {
+			mrsqlite3_unref(reader);
+			break;
+		}
+		reader->m_pool = ths;
+		ths->m_readers[i] = reader; /* set only after the reader is completely usable */
+	}
+}
+
+
+static void close_readers__(mrsqlite3_t* ths)
+{
+	int i;
+
+	if( ths->m_readers[0] == NULL ) {
+		return; /* no pool; getters may wait for the writer in this case, so we must not wait for them */
+	}
+
+	pthread_rwlock_wrlock(&ths->m_readers_rwlock); /* wait until no reader is in use */
+		for( i = 0; i < MR_MAX_READERS; i++ ) {
+			if( ths->m_readers[i] ) {
+				mrsqlite3_unref(ths->m_readers[i]);
+				ths->m_readers[i] = NULL;
+			}
+		}
+	pthread_rwlock_unlock(&ths->m_readers_rwlock);
+}
+
+
+static int schema_object_exists__(mrsqlite3_t* ths, const char* type, const char* name)
+{
+	/* other than mrsqlite3_table_exists__(), this also works for virtual tables whose module is not available */
+	int           ret = 0;
+	sqlite3_stmt* stmt = mrsqlite3_prepare_v2_(ths, "SELECT COUNT(*) FROM sqlite_master WHERE type=? AND name=?;");
+	if( stmt ) {
+		sqlite3_bind_text(stmt, 1, type, -1, SQLITE_STATIC);
+		sqlite3_bind_text(stmt, 2, name, -1, SQLITE_STATIC);
+		ret = (sqlite3_step(stmt)==SQLITE_ROW && sqlite3_column_int(stmt, 0)>0);
+		sqlite3_finalize(stmt);
+	}
+	return ret;
+}
+
+
+static int fts5_available__(mrsqlite3_t* ths)
+{
+	/* the system SQLite may come without FTS5; creating a temporary table is the only reliable check */
+	if( sqlite3_exec(ths->m_cobj, "CREATE VIRTUAL TABLE temp.fts5_probe USING fts5(x);", NULL, NULL, NULL) != SQLITE_OK ) {
+		return 0;
+	}
+	sqlite3_exec(ths->m_cobj, "DROP TABLE temp.fts5_probe;", NULL, NULL, NULL);
+	return 1;
+}
+
+
+/* the triggers keeping the full-text indices in sync with their content tables, pairs of names and CREATE statements */
+static const char* s_msgs_fts_triggers[] = {
+	"msgs_fts_ai", "CREATE TRIGGER msgs_fts_ai AFTER INSERT ON msgs BEGIN"
+	               " INSERT INTO msgs_fts (rowid, txt) VALUES (new.id, new.txt);"
+	               " END;",
+	"msgs_fts_ad", "CREATE TRIGGER msgs_fts_ad AFTER DELETE ON msgs BEGIN"
+	               " INSERT INTO msgs_fts (msgs_fts, rowid, txt) VALUES ('delete', old.id, old.txt);"
+	               " END;",
+	"msgs_fts_au", "CREATE TRIGGER msgs_fts_au AFTER UPDATE OF txt ON msgs BEGIN"
+	               " INSERT INTO msgs_fts (msgs_fts, rowid, txt) VALUES ('delete', old.id, old.txt);"
+	               " INSERT INTO msgs_fts (rowid, txt) VALUES (new.id, new.txt);"
+	               " END;",
+	NULL
+};
+
+
+static const char* s_contacts_fts_triggers[] = {
+	"contacts_fts_ai", "CREATE TRIGGER contacts_fts_ai AFTER INSERT ON contacts BEGIN"
+	                   " INSERT INTO contacts_fts (rowid, name, addr) VALUES (new.id, new.name, new.addr);"
+	                   " END;",
+	"contacts_fts_ad", "CREATE TRIGGER contacts_fts_ad AFTER DELETE ON contacts BEGIN"
+	                   " INSERT INTO contacts_fts (contacts_fts, rowid, name, addr) VALUES ('delete', old.id, old.name, old.addr);"
+	                   " END;",
+	"contacts_fts_au", "CREATE TRIGGER contacts_fts_au AFTER UPDATE OF name, addr ON contacts BEGIN"
+	                   " INSERT INTO contacts_fts (contacts_fts, rowid, name, addr) VALUES ('delete', old.id, old.name, old.addr);"
+	                   " INSERT INTO contacts_fts (rowid, name, addr) VALUES (new.id, new.name, new.addr);"
+	                   " END;",
+	NULL
+};
+
+
+/* The full-text indices are FTS5 tables kept in sync with their content tables by triggers.  Without FTS5, the triggers would make
+every change of the content table fail with "no such module", so they are dropped; this may happen if a database or an imported
+backup is opened by another SQLite.  With FTS5, missing parts are created and the index is rebuilt.  This is checked on each open;
+returns 1 if the index is usable. */
+static int update_fts_index__(mrsqlite3_t* ths, int fts5_available, const char* table, const char* create_table, const char** triggers)
+{
+	int   complete, i;
+	char* q;
+
+	if( !fts5_available ) {
+		for( i = 0; triggers[i]; i += 2 ) {
+			if( schema_object_exists__(ths, "trigger", triggers[i]) ) {
+				mrmailbox_log_warning(ths->m_mailbox, 0, "SQLite comes without FTS5, dropping %s.", triggers[i]);
+				q = sqlite3_mprintf("DROP TRIGGER %s;", triggers[i]);
+					mrsqlite3_execute__(ths, q);
+				sqlite3_free(q);
+			}
+		}
+		return 0;
+	}
+
+	complete = schema_object_exists__(ths, "table", table);
+	for( i = 0; triggers[i]; i += 2 ) {
+		complete = complete && schema_object_exists__(ths, "trigger", triggers[i]);
+	}
+	if( complete ) {
+		return 1;
+	}
+
+	mrmailbox_log_info(ths->m_mailbox, 0, "Creating full-text index %s.", table);
+
+	if( !schema_object_exists__(ths, "table", table)
+	 && !mrsqlite3_execute__(ths, create_table) ) {
+		return 0;
+	}
+
+	for( i = 0; triggers[i]; i += 2 ) {
+		q = sqlite3_mprintf("DROP TRIGGER IF EXISTS %s;", triggers[i]);
+			mrsqlite3_execute__(ths, q);
+		sqlite3_free(q);
+		mrsqlite3_execute__(ths, triggers[i+1]);
+	}
+
+	q = sqlite3_mprintf("INSERT INTO %s (%s) VALUES ('rebuild');", table, table); /* index the existing rows */
+		mrsqlite3_execute__(ths, q);
+	sqlite3_free(q);
+	return 1;
+}
+
+
 int mrsqlite3_open__(mrsqlite3_t* ths, const char* dbfile, int flags)
 {
 	if( ths == NULL || dbfile == NULL ) {
@@ -172,7 +346,7 @@ int mrsqlite3_open__(mrsqlite3_t* ths, const char* dbfile, int flags)
 	// However, locking is _also_ used for mrmailbox_t which _is_ still needed, so, we
 	// should remove locks only if we're really sure. If in doubt, leave the locking.
 	if( sqlite3_open_v2(dbfile, &ths->m_cobj,
-			SQLITE_OPEN_FULLMUTEX | ((flags&MR_OPEN_READONLY)? SQLITE_OPEN_READONLY : (SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE)),
+			((flags&MR_OPEN_NOMUTEX)? SQLITE_OPEN_NOMUTEX : SQLITE_OPEN_FULLMUTEX) | ((flags&MR_OPEN_READONLY)? SQLITE_OPEN_READONLY : (SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE)),
 			NULL) != SQLITE_OK ) {
 		mrsqlite3_log_error(ths, "Cannot open database \"%s\".", dbfile); /* ususally, even for errors, the pointer is set up (if not, this is also checked by mrsqlite3_log_error()) */
 		goto cleanup;
@@ -431,6 +605,132 @@ int mrsqlite3_open__(mrsqlite3_t* ths, const char* dbfile, int flags)
 			}
 		#undef NEW_DB_VERSION
 
+		#define NEW_DB_VERSION 41
+			if( dbversion < NEW_DB_VERSION )
+			{
+				/* the newest message of each chat, maintained by mrmailbox_update_chat_last_msg__(); this avoids a subquery per chat when loading the chatlist */
+				mrsqlite3_execute__(ths, "ALTER TABLE chats ADD COLUMN last_msg_id INTEGER DEFAULT 0;");
+				mrsqlite3_execute__(ths, "ALTER TABLE chats ADD COLUMN last_timestamp INTEGER DEFAULT 0;");
+				mrsqlite3_execute__(ths, "CREATE INDEX msgs_index6 ON msgs (chat_id, timestamp);");
+				mrsqlite3_execute__(ths, "UPDATE chats SET last_msg_id=IFNULL((SELECT id FROM msgs WHERE chat_id=chats.id AND hidden=0 ORDER BY timestamp DESC, id DESC LIMIT 1),0) WHERE id>" MR_STRINGIFY(MR_CHAT_ID_LAST_SPECIAL) ";");
+				mrsqlite3_execute__(ths, "UPDATE chats SET last_timestamp=IFNULL((SELECT timestamp FROM msgs WHERE id=chats.last_msg_id),0) WHERE id>" MR_STRINGIFY(MR_CHAT_ID_LAST_SPECIAL) ";");
+
+				dbversion = NEW_DB_VERSION;
+				mrsqlite3_set_config_int__(ths, "dbversion", NEW_DB_VERSION);
+			}
+		#undef NEW_DB_VERSION
+
+		#define NEW_DB_VERSION 42
+			if( dbversion < NEW_DB_VERSION )
+			{
+				/* for searching sender names; the full-text index msgs_fts over msgs.txt for mrmailbox_search_msgs() is created by
+				update_fts_index__() on opening as it depends on the SQLite used */
+				mrsqlite3_execute__(ths, "CREATE INDEX msgs_index7 ON msgs (from_id);");
+
+				dbversion = NEW_DB_VERSION;
+				mrsqlite3_set_config_int__(ths, "dbversion", NEW_DB_VERSION);
+			}
+		#undef NEW_DB_VERSION
+
+		#define NEW_DB_VERSION 43
+			if( dbversion < NEW_DB_VERSION )
+			{
+				/* covering index for the message lists of normal chats, see mrmailbox_get_chat_msgs() and mrmailbox_get_chat_msgs_window();
+				it also serves mrmailbox_update_chat_last_msg__(), so msgs_index6 is no longer needed */
+				mrsqlite3_execute__(ths, "CREATE INDEX msgs_index8 ON msgs (chat_id, hidden, timestamp, id);");
+				mrsqlite3_reset_all_predefinitions(ths); /* DROP fails with "database table is locked" if there are pending statements */
+				mrsqlite3_execute__(ths, "DROP INDEX IF EXISTS msgs_index6;");
+
+				dbversion = NEW_DB_VERSION;
+				mrsqlite3_set_config_int__(ths, "dbversion", NEW_DB_VERSION);
+			}
+		#undef NEW_DB_VERSION
+
+		#define NEW_DB_VERSION 44
+			if( dbversion < NEW_DB_VERSION )
+			{
+				/* find messages by their location on the server, needed to apply flag changes and expunges reported by CONDSTORE/QRESYNC */
+				mrsqlite3_execute__(ths, "CREATE INDEX msgs_index9 ON msgs (server_folder, server_uid);");
+
+				dbversion = NEW_DB_VERSION;
+				mrsqlite3_set_config_int__(ths, "dbversion", NEW_DB_VERSION);
+			}
+		#undef NEW_DB_VERSION
+
+		#define NEW_DB_VERSION 45
+			if( dbversion < NEW_DB_VERSION )
+			{
+				/* message counters per chat, used for badges instead of counting the messages on every refresh.
+				fresh_cnt and noticed_cnt count the non-hidden messages in the given state, total_cnt counts all messages of the chat.
+				The triggers keep the counters in sync with msgs on any insert, delete or change of chat_id, state or hidden,
+				so they are updated in the same transaction as the message itself, no matter which function changes the message. */
+				mrsqlite3_execute__(ths, "ALTER TABLE chats ADD COLUMN fresh_cnt INTEGER DEFAULT 0;");
+				mrsqlite3_execute__(ths, "ALTER TABLE chats ADD COLUMN noticed_cnt INTEGER DEFAULT 0;");
+				mrsqlite3_execute__(ths, "ALTER TABLE chats ADD COLUMN total_cnt INTEGER DEFAULT 0;");
+				mrsqlite3_execute__(ths, "CREATE TRIGGER msgs_cnt_ai AFTER INSERT ON msgs BEGIN"
+				                         " UPDATE chats SET fresh_cnt=fresh_cnt+(new.state=" MR_STRINGIFY(MR_STATE_IN_FRESH) " AND new.hidden=0),"
+				                                          " noticed_cnt=noticed_cnt+(new.state=" MR_STRINGIFY(MR_STATE_IN_NOTICED) " AND new.hidden=0),"
+				                                          " total_cnt=total_cnt+1"
+				                                          " WHERE id=new.chat_id;"
+				                         " END;");
+				mrsqlite3_execute__(ths, "CREATE TRIGGER msgs_cnt_ad AFTER DELETE ON msgs BEGIN"
+				                         " UPDATE chats SET fresh_cnt=fresh_cnt-(old.state=" MR_STRINGIFY(MR_STATE_IN_FRESH) " AND old.hidden=0),"
+				                                          " noticed_cnt=noticed_cnt-(old.state=" MR_STRINGIFY(MR_STATE_IN_NOTICED) " AND old.hidden=0),"
+				                                          " total_cnt=total_cnt-1"
+				                                          " WHERE id=old.chat_id;"
+				                         " END;");
+				mrsqlite3_execute__(ths, "CREATE TRIGGER msgs_cnt_au AFTER UPDATE OF chat_id, state, hidden ON msgs"
+				                         " WHEN old.chat_id!=new.chat_id OR old.state!=new.state OR old.hidden!=new.hidden BEGIN"
+				                         " UPDATE chats SET fresh_cnt=fresh_cnt-(old.state=" MR_STRINGIFY(MR_STATE_IN_FRESH) " AND old.hidden=0),"
+				                                          " noticed_cnt=noticed_cnt-(old.state=" MR_STRINGIFY(MR_STATE_IN_NOTICED) " AND old.hidden=0),"
+				                                          " total_cnt=total_cnt-1"
+				                                          " WHERE id=old.chat_id;"
+				                         " UPDATE chats SET fresh_cnt=fresh_cnt+(new.state=" MR_STRINGIFY(MR_STATE_IN_FRESH) " AND new.hidden=0),"
+				                                          " noticed_cnt=noticed_cnt+(new.state=" MR_STRINGIFY(MR_STATE_IN_NOTICED) " AND new.hidden=0),"
+				                                          " total_cnt=total_cnt+1"
+				                                          " WHERE id=new.chat_id;"
+				                         " END;");
+				mrsqlite3_execute__(ths, "UPDATE chats SET"
+				                         " fresh_cnt=(SELECT COUNT(*) FROM msgs WHERE chat_id=chats.id AND state=" MR_STRINGIFY(MR_STATE_IN_FRESH) " AND hidden=0),"
+				                         " noticed_cnt=(SELECT COUNT(*) FROM msgs WHERE chat_id=chats.id AND state=" MR_STRINGIFY(MR_STATE_IN_NOTICED) " AND hidden=0),"
+				                         " total_cnt=(SELECT COUNT(*) FROM msgs WHERE chat_id=chats.id);");
+
+				dbversion = NEW_DB_VERSION;
+				mrsqlite3_set_config_int__(ths, "dbversion", NEW_DB_VERSION);
+			}
+		#undef NEW_DB_VERSION
+
+		#define NEW_DB_VERSION 46
+			if( dbversion < NEW_DB_VERSION )
+			{
+				/* for mrmailbox_get_contacts(): contacts.sort_key is the key the contact list is ordered by, contacts.verified is set if there is
+				a peerstate with a verified key for the address.  Both are maintained by triggers, so listing the contacts needs neither sorting
+				nor joining acpeerstates. */
+				mrsqlite3_execute__(ths, "ALTER TABLE contacts ADD COLUMN sort_key TEXT DEFAULT '';");
+				mrsqlite3_execute__(ths, "ALTER TABLE contacts ADD COLUMN verified INTEGER DEFAULT 0;");
+				mrsqlite3_execute__(ths, "CREATE INDEX contacts_index3 ON contacts (blocked, sort_key, id, origin, addr);"); /* covers the unfiltered contact list, which is read in index order then */
+				#define CONTACTS_SET_KEYS "UPDATE contacts SET sort_key=LOWER(new.name||new.addr)," \
+				                          " verified=EXISTS(SELECT 1 FROM acpeerstates WHERE addr=new.addr AND LENGTH(verified_key_fingerprint)!=0)" \
+				                          " WHERE id=new.id;"
+				mrsqlite3_execute__(ths, "CREATE TRIGGER contacts_key_ai AFTER INSERT ON contacts BEGIN " CONTACTS_SET_KEYS " END;");
+				mrsqlite3_execute__(ths, "CREATE TRIGGER contacts_key_au AFTER UPDATE OF name, addr ON contacts BEGIN " CONTACTS_SET_KEYS " END;");
+				#define CONTACTS_SET_VERIFIED(a) "UPDATE contacts SET verified=EXISTS(SELECT 1 FROM acpeerstates WHERE addr=contacts.addr AND LENGTH(verified_key_fingerprint)!=0)" \
+				                                 " WHERE addr=" a " COLLATE NOCASE;" /* explicit collation, so contacts_index2 is used */
+				mrsqlite3_execute__(ths, "CREATE TRIGGER acpeerstates_verified_ai AFTER INSERT ON acpeerstates BEGIN " CONTACTS_SET_VERIFIED("new.addr") " END;");
+				mrsqlite3_execute__(ths, "CREATE TRIGGER acpeerstates_verified_ad AFTER DELETE ON acpeerstates BEGIN " CONTACTS_SET_VERIFIED("old.addr") " END;");
+				mrsqlite3_execute__(ths, "CREATE TRIGGER acpeerstates_verified_au AFTER UPDATE OF addr, verified_key_fingerprint ON acpeerstates"
+				                         " WHEN old.addr IS NOT new.addr OR old.verified_key_fingerprint IS NOT new.verified_key_fingerprint BEGIN "
+				                         CONTACTS_SET_VERIFIED("old.addr") " " CONTACTS_SET_VERIFIED("new.addr") " END;");
+				mrsqlite3_execute__(ths, "UPDATE contacts SET sort_key=LOWER(name||addr),"
+				                         " verified=EXISTS(SELECT 1 FROM acpeerstates WHERE addr=contacts.addr AND LENGTH(verified_key_fingerprint)!=0);");
+				#undef CONTACTS_SET_VERIFIED
+				#undef CONTACTS_SET_KEYS
+
+				dbversion = NEW_DB_VERSION;
+				mrsqlite3_set_config_int__(ths, "dbversion", NEW_DB_VERSION);
+			}
+		#undef NEW_DB_VERSION
+
 		// (2) updates that require high-level objects (the structure is complete now and all objects are usable)
 		if( recalc_fingerprints )
 		{
@@ -445,6 +745,25 @@ int mrsqlite3_open__(mrsqlite3_t* ths, const char* dbfile, int flags)
 				}
 			sqlite3_finalize(stmt);
 		}
+
+		// (3) full-text indices, msgs_fts does not store the text itself but refers to msgs.id; in contacts_fts, each word or part of
+		// an address can be searched by its beginning, see mrmailbox_get_contacts().  Without FTS5, searching falls back to LIKE.
+		{
+			int fts5_ok = fts5_available__(ths);
+			mrsqlite3_reset_all_predefinitions(ths); /* DROP fails with "database table is locked" if there are pending statements */
+			ths->m_has_fts = update_fts_index__(ths, fts5_ok, "msgs_fts",
+				"CREATE VIRTUAL TABLE msgs_fts USING fts5(txt, content='msgs', content_rowid='id');", s_msgs_fts_triggers);
+			ths->m_has_contacts_fts = update_fts_index__(ths, fts5_ok, "contacts_fts",
+				"CREATE VIRTUAL TABLE contacts_fts USING fts5(name, addr, content='contacts', content_rowid='id', prefix='1 2');", s_contacts_fts_triggers);
+			if( !ths->m_has_fts || !ths->m_has_contacts_fts ) {
+				mrmailbox_log_warning(ths->m_mailbox, 0, "Cannot use full-text indices, searching will be slow.");
+			}
+		}
+
+		// (4) open the read-only connections, the database structure is final now
+		if( ths->m_readers_cnt > 0 ) {
+			open_readers__(ths, dbfile);
+		}
 	}
 
 	mrmailbox_log_info(ths->m_mailbox, 0, "Opened \"%s\" successfully.", dbfile);
@@ -464,6 +783,8 @@ void mrsqlite3_close__(mrsqlite3_t* ths)
 		return;
 	}
 
+	close_readers__(ths); /* before the writer is closed, so the WAL is checkpointed and removed on closing the last connection */
+
 	if( ths->m_cobj )
 	{
 		for( i = 0; i < PREDEFINED_CNT; i++ ) {
@@ -722,6 +1043,50 @@ void mrsqlite3_unlock(mrsqlite3_t* ths)
 }
 
 
+mrsqlite3_t* mrsqlite3_lock_reader(mrsqlite3_t* ths)
+{
+	int          i, cnt = 0;
+	mrsqlite3_t* reader;
+
+	pthread_rwlock_rdlock(&ths->m_readers_rwlock); /* released in mrsqlite3_unlock_reader() */
+
+	for( i = 0; i < MR_MAX_READERS; i++ ) {
+		if( (reader=ths->m_readers[i]) != NULL ) {
+			if( pthread_mutex_trylock(&reader->m_critical_) == 0 ) {
+				return reader; /* an idle reader, fine */
+			}
+			cnt++;
+		}
+	}
+
+	if( cnt == 0 ) {
+		mrsqlite3_lock(ths); /* no pool, use the writer */
+		return ths;
+	}
+
+	/* all readers are busy, wait for the next one in turn */
+	reader = ths->m_readers[(__sync_fetch_and_add(&ths->m_next_reader, 1)&0x7FFFFFFF) % cnt];
+	mrsqlite3_lock(reader);
+	return reader;
+}
+
+
+void mrsqlite3_unlock_reader(mrsqlite3_t* reader)
+{
+	if( reader == NULL ) {
+		return;
+	}
+
+	mrsqlite3_t* pool = reader->m_pool;
+
+	/* predefined statements that are not stepped to the end keep the read transaction - and the WAL snapshot - open, finish them */
+	mrsqlite3_reset_all_predefinitions(reader);
+
+	mrsqlite3_unlock(reader);
+	pthread_rwlock_unlock(&pool->m_readers_rwlock);
+}
+
+
 /*******************************************************************************
  * Transactions
  ******************************************************************************/
@@ -740,6 +1105,15 @@ void mrsqlite3_begin_transaction__(mrsqlite3_t* ths)
 			mrsqlite3_log_error(ths, "Cannot begin transaction.");
 		}
 	}
+	else
+	{
+		/* nested transactions are savepoints, so they can be rolled back without affecting the outer transaction,
+		eg. when receiving several messages in one transaction, see mrmailbox_receive_imf_batch() */
+		stmt = mrsqlite3_predefine__(ths, SAVEPOINT_nested, "SAVEPOINT nested;");
+		if( sqlite3_step(stmt) != SQLITE_DONE ) {
+			mrsqlite3_log_error(ths, "Cannot set savepoint.");
+		}
+	}
 }
 
 
@@ -756,8 +1130,28 @@ void mrsqlite3_rollback__(mrsqlite3_t* ths)
 				mrsqlite3_log_error(ths, "Cannot rollback transaction.");
 			}
 		}
+		else
+		{
+			stmt = mrsqlite3_predefine__(ths, ROLLBACK_TO_nested, "ROLLBACK TO nested;");
+			if( sqlite3_step(stmt) != SQLITE_DONE ) {
+				mrsqlite3_log_error(ths, "Cannot rollback to savepoint.");
+			}
+			stmt = mrsqlite3_predefine__(ths, RELEASE_nested, "RELEASE nested;");
+			sqlite3_step(stmt);
+		}
+
+		/* cached rows may be gone or changed back, added jobs are gone */
+		if( ths->m_mailbox && ths->m_mailbox->m_sql == ths ) {
+			mrjob_rollback_pending__(ths->m_mailbox, ths->m_transactionCount);
+		}
 
 		ths->m_transactionCount--;
+
+		if( ths->m_mailbox && ths->m_mailbox->m_sql == ths ) {
+			mrmailbox_clear_contact_cache__(ths->m_mailbox);
+			mrapeerstate_clear_cache__(ths->m_mailbox);
+			mrkeyring_clear_self_cache__(ths->m_mailbox);
+		}
 	}
 }
 
@@ -775,6 +1169,17 @@ void mrsqlite3_commit__(mrsqlite3_t* ths)
 				mrsqlite3_log_error(ths, "Cannot commit transaction.");
 			}
 		}
+		else
+		{
+			stmt = mrsqlite3_predefine__(ths, RELEASE_nested, "RELEASE nested;");
+			if( sqlite3_step(stmt) != SQLITE_DONE ) {
+				mrsqlite3_log_error(ths, "Cannot release savepoint.");
+			}
+		}
+
+		if( ths->m_mailbox && ths->m_mailbox->m_sql == ths ) {
+			mrjob_commit_pending__(ths->m_mailbox, ths->m_transactionCount);
+		}
 
 		ths->m_transactionCount--;
 	}
@@ -41,6 +41,9 @@ enum
 	 BEGIN_transaction = 0 /* must be first */
 	,ROLLBACK_transaction
 	,COMMIT_transaction
+	,SAVEPOINT_nested
+	,ROLLBACK_TO_nested
+	,RELEASE_nested
 
 	,SELECT_v_FROM_config_k
 	,INSERT_INTO_config_kv
@@ -49,12 +52,13 @@ enum
 
 	,SELECT_COUNT_FROM_contacts
 	,SELECT_naob_FROM_contacts_i
-	,SELECT_inao_FROM_contacts_a
+	,SELECT_inaoab_FROM_contacts_a
 	,SELECT_id_FROM_contacts_WHERE_id
 	,SELECT_na_FROM_chats_contacs_JOIN_contacts_WHERE_cc
 	,SELECT_p_FROM_chats_contacs_JOIN_contacts_peerstates_WHERE_cc
 	,SELECT_id_FROM_contacts_ORDER_BY
 	,SELECT_id_FROM_contacts_WHERE_query_ORDER_BY
+	,SELECT_id_FROM_contacts_fts_WHERE_query_ORDER_BY
 	,SELECT_COUNT_FROM_contacts_WHERE_blocked
 	,SELECT_id_FROM_contacts_WHERE_blocked
 	,INSERT_INTO_contacts_neo
@@ -65,10 +69,13 @@ enum
 
 	,SELECT_COUNT_FROM_chats
 	,SELECT_COUNT_FROM_chats_WHERE_archived
-	,SELECT_ii_FROM_chats_LEFT_JOIN_msgs_WHERE_archived
-	,SELECT_ii_FROM_chats_LEFT_JOIN_msgs_WHERE_unarchived
-	,SELECT_ii_FROM_chats_LEFT_JOIN_msgs_WHERE_query
-	,SELECT_ii_FROM_chats_LEFT_JOIN_msgs_WHERE_contact_id
+	,SELECT_fresh_cnt_FROM_chats_WHERE_id
+	,SELECT_total_cnt_FROM_chats_WHERE_id
+	,SELECT_SUM_fresh_cnt_FROM_chats
+	,SELECT_ii_FROM_chats_WHERE_archived
+	,SELECT_ii_FROM_chats_WHERE_unarchived
+	,SELECT_ii_FROM_chats_WHERE_query
+	,SELECT_ii_FROM_chats_WHERE_contact_id
 	,SELECT_itndd_FROM_chats_WHERE_i
 	,SELECT_id_FROM_chats_WHERE_id
 	,SELECT_id_FROM_chats_WHERE_contact_id
@@ -78,11 +85,14 @@ enum
 	,SELECT_it_FROM_msgs_JOIN_chats_WHERE_rfc724
 	,SELECT_MAX_timestamp_FROM_msgs
 	,SELECT_rfc724_FROM_msgs_ORDER_BY_timestamp_LIMIT_1
+	,SELECT_it_FROM_msgs_WHERE_chat_id_ORDER_BY_timestamp_LIMIT_1
+	,SELECT_chat_id_FROM_msgs_WHERE_id
 	,UPDATE_chats_SET_draft_WHERE_id
 	,UPDATE_chats_SET_n_WHERE_c
 	,UPDATE_chats_SET_blocked_WHERE_chat_id
 	,UPDATE_chats_SET_blocked_WHERE_contact_id
 	,UPDATE_chats_SET_unarchived
+	,UPDATE_chats_SET_last_msg_WHERE_id
 
 	,SELECT_a_FROM_chats_contacts_WHERE_i
 	,SELECT_COUNT_FROM_chats_contacts_WHERE_chat_id
@@ -95,8 +105,6 @@ enum
 
 	,SELECT_COUNT_FROM_msgs_WHERE_assigned
 	,SELECT_COUNT_FROM_msgs_WHERE_unassigned
-	,SELECT_COUNT_FROM_msgs_WHERE_state_AND_chat_id
-	,SELECT_COUNT_FROM_msgs_WHERE_chat_id
 	,SELECT_COUNT_FROM_msgs_WHERE_rfc724_mid
 	,SELECT_COUNT_FROM_msgs_WHERE_ft
 	,SELECT_i_FROM_msgs_WHERE_ctt
@@ -112,6 +120,9 @@ enum
 	,SELECT_i_FROM_msgs_LEFT_JOIN_chats_contacts_WHERE_blocked
 	,SELECT_i_FROM_msgs_WHERE_query
 	,SELECT_i_FROM_msgs_WHERE_chat_id_AND_query
+	,SELECT_i_FROM_msgs_fts_WHERE_query
+	,SELECT_i_FROM_msgs_fts_WHERE_chat_id_AND_query
+	,SELECT_snippet_FROM_msgs_fts_WHERE_id_AND_query
 	,INSERT_INTO_msgs_msscftttsmttpb
 	,INSERT_INTO_msgs_cftttst
 	,INSERT_INTO_msgs_mcftttstpb
@@ -121,6 +132,8 @@ enum
 	,UPDATE_msgs_SET_state_WHERE_chat_id_AND_state
 	,UPDATE_msgs_SET_state_WHERE_from_id_AND_state
 	,UPDATE_msgs_SET_ss_WHERE_rfc724_mid
+	,UPDATE_msgs_SET_ss_WHERE_ss
+	,UPDATE_msgs_SET_state_WHERE_ss_AND_state
 	,UPDATE_msgs_SET_param_WHERE_id
 	,UPDATE_msgs_SET_starred_WHERE_id
 	,DELETE_FROM_msgs_WHERE_id
@@ -144,6 +157,11 @@ enum
 	,SELECT_private_key_FROM_keypairs_ORDER_BY_default
 	,SELECT_public_key_FROM_keypairs_WHERE_default
 
+	,INSERT_INTO_jobs_atafpd
+	,UPDATE_jobs_SET_dp_WHERE_id
+	,DELETE_FROM_jobs_WHERE_id
+	,DELETE_FROM_jobs_WHERE_action
+
 	,PREDEFINED_CNT /* must be last */
 };
 
@@ -156,6 +174,7 @@ enum
  * database is locked as needed.  Of course, the same is true if you call any
  * sqlite3-function directly.
  */
+#define MR_MAX_READERS 4
 typedef struct mrsqlite3_t
 {
 	/** @privatesection */
@@ -165,6 +184,15 @@ typedef struct mrsqlite3_t
 	mrmailbox_t*  m_mailbox;            /**< used for logging and to acquire wakelocks, there may be N mrsqlite3_t objects per mrmailbox! In practise, we use 2 on backup, 1 otherwise. */
 	pthread_mutex_t m_critical_;        /**< the user must make sure, only one thread uses sqlite at the same time! for this purpose, all calls must be enclosed by a locked m_critical; use mrsqlite3_lock() for this purpose */
 
+	int           m_readers_cnt;        /**< number of read-only connections opened by mrsqlite3_open__() in WAL mode, 0=no pool, all reading is done on this object */
+	struct mrsqlite3_t* m_readers[MR_MAX_READERS]; /**< the read-only connections, each with its own predefined statements and its own m_critical_ */
+	int           m_next_reader;        /**< round-robin index used if all readers are busy */
+	pthread_rwlock_t m_readers_rwlock;  /**< read-locked while a reader is in use, write-locked while the readers are closed */
+	struct mrsqlite3_t* m_pool;         /**< the object owning m_readers_rwlock; the writer for readers, the object itself otherwise */
+
+	int           m_has_fts;            /**< 1=the full-text index msgs_fts is available, see mrmailbox_search_msgs() */
+	int           m_has_contacts_fts;   /**< 1=the full-text index contacts_fts is available, see mrmailbox_get_contacts() */
+
 } mrsqlite3_t;
 
 
@@ -172,7 +200,9 @@ mrsqlite3_t*  mrsqlite3_new              (mrmailbox_t*);
 void          mrsqlite3_unref            (mrsqlite3_t*);
 
 #define       MR_OPEN_READONLY           0x01
+#define       MR_OPEN_NOMUTEX            0x02 /* the connection is guarded by m_critical_ only, used for the readers */
 int           mrsqlite3_open__           (mrsqlite3_t*, const char* dbfile, int flags);
+void          mrsqlite3_set_readers      (mrsqlite3_t*, int readers_cnt); /* must be called before mrsqlite3_open__() */
 
 void          mrsqlite3_close__          (mrsqlite3_t*);
 int           mrsqlite3_is_open          (const mrsqlite3_t*);
@@ -207,6 +237,13 @@ void          mrsqlite3_lock             (mrsqlite3_t*); /* lock or wait; these
 void          mrsqlite3_unlock           (mrsqlite3_t*);
 #endif
 
+/* read-only getters may use one of the reader connections instead of locking this object; this way, they do not
+wait for long transactions on the writer.  The function returns a locked reader (or the locked object itself if there
+is no pool) that must be given to mrsqlite3_unlock_reader(); the reader MUST NOT be used for writing and the caller
+MUST NOT lock the writer while holding a reader. */
+mrsqlite3_t*  mrsqlite3_lock_reader      (mrsqlite3_t*);
+void          mrsqlite3_unlock_reader    (mrsqlite3_t* reader);
+
 /* nestable transactions, only the outest is really used */
 void          mrsqlite3_begin_transaction__(mrsqlite3_t*);
 void          mrsqlite3_commit__           (mrsqlite3_t*);
@@ -52,6 +52,7 @@ void mrstrbuilder_init(mrstrbuilder_t* strbuilder, int init_bytes)
 
 	strbuilder->m_allocated    = MR_MAX(init_bytes, 128); /* use a small default minimum, we may use _many_ of these objects at the same time */
 	strbuilder->m_buf          = malloc(strbuilder->m_allocated); 
+	strbuilder->m_arena        = NULL;
     
     if( strbuilder->m_buf==NULL ) {
 		exit(38);
@@ -63,6 +64,36 @@ void mrstrbuilder_init(mrstrbuilder_t* strbuilder, int init_bytes)
 }
 
 
+/**
+ * Init a string-builder-object that allocates its buffer in an arena.
+ * Other than with mrstrbuilder_init(), the resulting mrstrbuilder_t::m_buf
+ * must not be free()'d, it is released together with the arena.
+ *
+ * @param strbuilder The object to initialze.
+ *
+ * @param init_bytes The number of bytes to reserve for the string, see mrstrbuilder_init().
+ *
+ * @param arena The arena to allocate the buffer from; the string is typically
+ *     the last allocation of the arena, so growing the buffer does not need any copying.
+ *
+ * @return None.
+ */
+void mrstrbuilder_init_arena(mrstrbuilder_t* strbuilder, int init_bytes, mrarena_t* arena)
+{
+	if( strbuilder==NULL || arena==NULL ) {
+		return;
+	}
+
+	strbuilder->m_allocated    = MR_MAX(init_bytes, 128);
+	strbuilder->m_buf          = mrarena_alloc(arena, strbuilder->m_allocated);
+	strbuilder->m_arena        = arena;
+
+	strbuilder->m_buf[0]       = 0;
+	strbuilder->m_free         = strbuilder->m_allocated - 1 /*the nullbyte! */;
+	strbuilder->m_eos          = strbuilder->m_buf;
+}
+
+
 /**
  * Add a string to the end of the current string in a string-builder-object.
  * The internal buffer is reallocated as needed.
@@ -86,28 +117,74 @@ char* mrstrbuilder_cat(mrstrbuilder_t* strbuilder, const char* text)
 		return NULL;
 	}
 
-	int len = strlen(text);
+	int   len = strlen(text);
+	char* ret = mrstrbuilder_reserve(strbuilder, len);
+
+	memcpy(ret, text, len);
+	return mrstrbuilder_commit(strbuilder, len);
+}
+
 
-	if( len > strbuilder->m_free ) {
-		int add_bytes  = MR_MAX(len, strbuilder->m_allocated);
+/**
+ * Make sure, the string-builder-object has space for some more bytes.
+ * This allows to write data directly to the end of the string, eg. while
+ * decoding, without an additional copy; the written data are added to the
+ * string by mrstrbuilder_commit() then.
+ *
+ * @param strbuilder The object to use. Must be initialized with
+ *      mrstrbuilder_init().
+ *
+ * @param bytes The number of bytes that will be written, not counting the
+ *      terminating null-byte which is always reserved.
+ *
+ * @return Pointer to the end of the string where `bytes` bytes may be written.
+ *     The pointer is valid until the next call to a function of the
+ *     string-builder-object.
+ */
+char* mrstrbuilder_reserve(mrstrbuilder_t* strbuilder, int bytes)
+{
+	if( bytes > strbuilder->m_free ) {
+		int add_bytes  = MR_MAX(bytes, strbuilder->m_allocated);
 		int old_offset = (int)(strbuilder->m_eos - strbuilder->m_buf);
 
 		strbuilder->m_allocated = strbuilder->m_allocated + add_bytes;
-		strbuilder->m_buf       = realloc(strbuilder->m_buf, strbuilder->m_allocated+add_bytes);
-        
-        if( strbuilder->m_buf==NULL ) {
+		if( strbuilder->m_arena ) {
+			strbuilder->m_buf   = mrarena_realloc(strbuilder->m_arena, strbuilder->m_buf, strbuilder->m_allocated-add_bytes, strbuilder->m_allocated);
+		}
+		else {
+			strbuilder->m_buf   = realloc(strbuilder->m_buf, strbuilder->m_allocated+add_bytes);
+		}
+
+		if( strbuilder->m_buf==NULL ) {
 			exit(39);
 		}
-		
+
 		strbuilder->m_free      = strbuilder->m_free + add_bytes;
 		strbuilder->m_eos       = strbuilder->m_buf + old_offset;
 	}
 
+	return strbuilder->m_eos;
+}
+
+
+/**
+ * Add bytes written to the space returned by mrstrbuilder_reserve() to the string.
+ *
+ * @param strbuilder The object to use. Must be initialized with
+ *      mrstrbuilder_init().
+ *
+ * @param bytes The number of bytes written, must not be larger than the
+ *      number given to mrstrbuilder_reserve().
+ *
+ * @return Returns a pointer to the added bytes, see mrstrbuilder_cat().
+ */
+char* mrstrbuilder_commit(mrstrbuilder_t* strbuilder, int bytes)
+{
 	char* ret = strbuilder->m_eos;
 
-	strcpy(strbuilder->m_eos, text);
-	strbuilder->m_eos += len;
-	strbuilder->m_free -= len;
+	strbuilder->m_eos += bytes;
+	strbuilder->m_free -= bytes;
+	*strbuilder->m_eos = 0;
 
 	return ret;
 }
@@ -27,17 +27,24 @@ extern "C" {
 #endif
 
 
+#include "mrarena.h"
+
+
 typedef struct mrstrbuilder_t
 {
 	char* m_buf;
 	int   m_allocated;
 	int   m_free;
 	char* m_eos;
+	mrarena_t* m_arena; /* if set, the buffer is allocated in the arena and must not be free()'d */
 } mrstrbuilder_t;
 
 
 void  mrstrbuilder_init    (mrstrbuilder_t* ths, int init_bytes);
+void  mrstrbuilder_init_arena (mrstrbuilder_t* ths, int init_bytes, mrarena_t*);
 char* mrstrbuilder_cat     (mrstrbuilder_t* ths, const char* text);
+char* mrstrbuilder_reserve (mrstrbuilder_t* ths, int bytes);
+char* mrstrbuilder_commit  (mrstrbuilder_t* ths, int bytes);
 void  mrstrbuilder_catf    (mrstrbuilder_t* ths, const char* format, ...);
 void  mrstrbuilder_empty   (mrstrbuilder_t* ths);
 
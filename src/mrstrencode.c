@@ -468,6 +468,8 @@ char* mr_decode_header_words(const char* in)
 		out = safe_strdup(in); /* error, make a copy of the original string (as we free it later) */
 	}
 
+	mr_replace_bad_utf8_chars(out); /* unencoded 8-bit headers or wrong charsets must not end up in the database as invalid UTF-8 */
+
 	return out; /* must be free()'d by the caller */
 }
 
@@ -876,5 +878,9 @@ char* mr_decode_ext_header(const char* to_decode)
 
 cleanup:
 	free(charset);
-	return decoded? decoded : safe_strdup(to_decode);
+	if( decoded == NULL ) {
+		decoded = safe_strdup(to_decode);
+	}
+	mr_replace_bad_utf8_chars(decoded);
+	return decoded;
 }
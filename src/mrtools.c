@@ -31,6 +31,7 @@
 #include <libetpan/libetpan.h>
 #include <libetpan/mailimap_types.h>
 #include "mrmailbox_internal.h"
+#include "mrcodec.h"
 
 
 /*******************************************************************************
@@ -368,44 +369,9 @@ void mr_unify_lineends(char* buf)
 
 void mr_replace_bad_utf8_chars(char* buf)
 {
-	if( buf==NULL ) {
-		return;
-	}
-
-	unsigned char* p1 = (unsigned char*)buf; /* force unsigned - otherwise the `> ' '` comparison will fail */
-	int            p1len = strlen(buf);
-	int            c, i, ix, n, j;
-	for( i=0, ix=p1len; i < ix; i++ )
-	{
-		c = p1[i];
-		     if( c > 0 && c <= 0x7f )                           { n=0; }        /* 0bbbbbbb */
-		else if( (c & 0xE0) == 0xC0 )                           { n=1; }        /* 110bbbbb */
-		else if( c==0xed && i<(ix-1) && (p1[i+1] & 0xa0)==0xa0) { goto error; } /* U+d800 to U+dfff */
-		else if( (c & 0xF0) == 0xE0 )                           { n=2; }        /* 1110bbbb */
-		else if( (c & 0xF8) == 0xF0)                            { n=3; }        /* 11110bbb */
-		//else if( (c & 0xFC) == 0xF8)                          { n=4; }        /* 111110bb - not valid in https://tools.ietf.org/html/rfc3629 */
-		//else if( (c & 0xFE) == 0xFC)                          { n=5; }        /* 1111110b - not valid in https://tools.ietf.org/html/rfc3629 */
-		else                                                    { goto error; }
-
-		for( j = 0; j < n && i < ix; j++ ) { /* n bytes matching 10bbbbbb follow ? */
-			if( (++i == ix) || (( p1[i] & 0xC0) != 0x80) ) {
-				goto error;
-			}
-		}
-	}
-
-    /* everything is fine */
-    return;
-
-error:
-	/* there are errors in the string -> replace potential errors by the character `_`
-	(to avoid problems in filenames, we do not use eg. `?`) */
-	while( *p1 ) {
-		if( *p1 > 0x7f ) {
-			*p1 = '_';
-		}
-		p1++;
-	}
+	/* only the invalid sequences are replaced by `_` (to avoid problems in filenames, we do not use eg. `?`),
+	valid characters in the same string are kept */
+	mr_utf8_repair(buf);
 }
 
 
@@ -758,6 +724,15 @@ struct mailimap_date_time* mr_timestamp_to_mailimap_date_time(time_t timeval)
 }
 
 
+uint64_t mr_monotonic_us(void)
+{
+	/* microseconds since an arbitrary point, not affected by changes of the clock; used to measure durations */
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec*1000000 + ts.tv_nsec/1000;
+}
+
+
 /*******************************************************************************
  * Time smearing
  ******************************************************************************/
@@ -1150,26 +1125,35 @@ char* mr_get_fine_pathNfilename(const char* folder, const char* desired_filename
 	time_t      now = time(NULL);
 	struct stat st;
 	int         i;
+	size_t      ret_bytes;
 
 	filenameNsuffix = safe_strdup(desired_filenameNsuffix__);
 	mr_validate_filename(filenameNsuffix);
 	mr_split_filename(filenameNsuffix, &basename, &dotNSuffix);
 
+	/* all names tried are formatted to the same buffer, the index has at most 20 digits */
+	ret_bytes = strlen(folder) + strlen(basename) + strlen(dotNSuffix) + 24;
+	if( (ret=malloc(ret_bytes))==NULL ) {
+		exit(54);
+	}
+
 	for( i = 0; i < 1000 /*no deadlocks, please*/; i++ ) {
 		if( i ) {
 			time_t idx = i<100? i : now+i;
-			ret = mr_mprintf("%s/%s-%lu%s", folder, basename, (unsigned long)idx, dotNSuffix);
+			snprintf(ret, ret_bytes, "%s/%s-%lu%s", folder, basename, (unsigned long)idx, dotNSuffix);
 		}
 		else {
-			ret = mr_mprintf("%s/%s%s", folder, basename, dotNSuffix);
+			snprintf(ret, ret_bytes, "%s/%s%s", folder, basename, dotNSuffix);
 		}
 		if (stat(ret, &st) == -1) {
 			goto cleanup; /* fine filename found */
 		}
-		free(ret); /* try over with the next index */
-		ret = NULL;
+		/* try over with the next index */
 	}
 
+	free(ret);
+	ret = NULL;
+
 cleanup:
 	free(filenameNsuffix);
 	free(basename);
@@ -55,7 +55,7 @@ char*   mr_mprintf                 (const char* format, ...); /* The result must
 char*   mr_binary_to_uc_hex        (const uint8_t* buf, size_t bytes);
 void    mr_remove_cr_chars         (char*); /* remove all \r characters from string */
 void    mr_unify_lineends          (char*);
-void    mr_replace_bad_utf8_chars  (char*); /* replace bad UTF-8 characters by sequences of `_` (to avoid problems in filenames, we do not use eg. `?`) the function is useful if strings are unexpectingly encoded eg. as ISO-8859-1 */
+void    mr_replace_bad_utf8_chars  (char*); /* replace the bytes of bad UTF-8 sequences by `_` (to avoid problems in filenames, we do not use eg. `?`), valid characters are kept; the function is useful if strings are unexpectingly encoded eg. as ISO-8859-1 */
 void    mr_truncate_str            (char*, int approx_characters);
 void    mr_truncate_n_unwrap_str   (char*, int approx_characters, int do_unwrap);
 carray* mr_split_into_lines        (const char* buf_terminated); /* split string into lines*/
@@ -74,6 +74,7 @@ time_t                     mr_timestamp_from_date             (struct mailimf_da
 char*                      mr_timestamp_to_str                (time_t); /* the return value must be free()'d */
 struct mailimap_date_time* mr_timestamp_to_mailimap_date_time (time_t);
 long                       mr_gm2local_offset                 (void);
+uint64_t                   mr_monotonic_us                    (void); /* for measuring durations */
 
 /* timesmearing */
 time_t mr_smeared_time__             (void);